@@ -9,8 +9,9 @@ import warnings
 
 import numpy as np
 
-from ._odeint import adaptive, predefined, requires_jac, steppers
-from ._util import _check_callable, _check_indexing, _ensure_5args
+from ._odeint import (adaptive, predefined, adaptive_multi, predefined_multi, adaptive_ensemble,
+                      predefined_ensemble, requires_jac, steppers, DenseSolution, Integrator, Stepper)
+from ._util import _check_callable, _check_indexing, _ensure_5args, _ensure_idx_arg, _native_address
 
 from ._release import __version__
 
@@ -35,10 +36,11 @@ def integrate_adaptive(rhs, jac, y0, x0, xend, atol, rtol, dx0=.0, dx_max=.0,
     Parameters
     ----------
     rhs: callable
-        Function with signature f(t, y, fout) which modifies fout *inplace*.
+        Function with signature f(t, y, fout) which modifies fout *inplace*,
+        or a C function (see 'user_data' below).
     jac: callable
         Function with signature j(t, y, jmat_out, dfdx_out) which modifies
-        jmat_out and dfdx_out *inplace*.
+        jmat_out and dfdx_out *inplace*, or a C function (see 'user_data' below).
     y0: array_like
         Initial values of the dependent variables.
     x0: float
@@ -50,7 +52,7 @@ def integrate_adaptive(rhs, jac, y0, x0, xend, atol, rtol, dx0=.0, dx_max=.0,
     rtol: float
         Relative tolerance.
     dx0: float
-        Initial step-size.
+        Initial step-size (0: ``dx0cb``, otherwise estimated from two calls of ``rhs``).
     dx_max: float
         Maximum step-size.
     check_callable: bool (default: False)
@@ -59,15 +61,94 @@ def integrate_adaptive(rhs, jac, y0, x0, xend, atol, rtol, dx0=.0, dx_max=.0,
         Perform item setting sanity checks on ``rhs`` and ``jac``.
     \\*\\*kwargs:
         'method': str
-            'rosenbrock4', 'dopri5' or 'bs'
+            'rosenbrock4', 'dopri5', 'bs', 'rosenbrock4_banded', 'rosenbrock4_sparse', 'ros34pw2',
+            'fehlberg78', 'cash_karp54' or 'verner65' (explicit Runge-Kutta pairs without
+            dense output: not with ``dense_output``; 'fehlberg78' needs fewer calls of ``rhs``
+            than 'dopri5' for non-stiff problems at tight tolerances, the other two about as many)
         'return_on_error': bool
-            Returns on error without raising an excpetion (with ``'success'==False``).
+            Returns on error without raising an excpetion (with ``'success'==False``), the
+            reason is given by info['status']: 'success', 'mxsteps_reached' (more than
+            ``nsteps`` steps, without any exception raised internally) or 'step_failed'.
         'autorestart': int
-            Useful for autonomous systems where conditions change during integration.
-            Will restart the integration with ``x==0``.
+            Number of times to resume after an error, from the last accepted step (``x``
+            in ``info['x_restarts']``) with its step size and a new budget of ``nsteps``.
         'dx0cb': callable
             Callback for calculating dx0 (make sure to pass ``dx0==0.0``) to enable.
             Signature: ``f(x, y[:]) -> float``.
+        'mlower': int
+            Number of sub-diagonals of the Jacobian ('rosenbrock4_banded').
+        'mupper': int
+            Number of super-diagonals of the Jacobian ('rosenbrock4_banded'),
+            ``jmat_out`` then has shape ``(mlower + mupper + 1, ny)`` where element
+            ``(i, j)`` of the Jacobian is stored at ``jmat_out[mupper + i - j, j]``
+            (``dfdx_out`` is ``None``).
+        'nnz': int
+            Number of (structurally) non-zero elements of the Jacobian ('rosenbrock4_sparse'),
+            ``jac`` then has the signature ``j(t, y, data_out, colptrs_out, rowvals_out)``
+            (compressed sparse column format, the pattern is checked and must not change during the integration).
+            The pattern, nnz and the number of elements stored for the LU factors (their pattern
+            is symmetric) are reported in info ('jac_colptrs', 'jac_rowvals', 'nnz' & 'nnz_lu').
+        'autonomous_exprs': bool (default: False)
+            ``rhs`` does not depend on ``x``. The banded & sparse ``jac`` give no ``dfdx``: it
+            is then zero, otherwise it is approximated by a forward difference which costs two
+            additional calls of ``rhs`` per Jacobian evaluation (counted in ``nfev``).
+        'max_jac_age': int (default: 10)
+            'ros34pw2' (a Rosenbrock-W method) reuses the Jacobian for at most this many
+            steps (1: a new Jacobian for every step). The number of factorizations of the
+            iteration matrix and of rejected steps are reported in info
+            ('n_factorizations' & 'n_rejected').
+        'sink': str, path or callable
+            Hand the accepted steps over in chunks instead of keeping them in memory: a path
+            (an ``.npy`` file with rows ``x, y[0], ..., y[ny-1]`` is written, ``xout`` and
+            ``yout`` are then views of it mapped read-only into memory) or a callable
+            ``sink(x[n], y[n, ny])`` (arrays only valid during the call, ``xout`` and ``yout``
+            are then ``None``).
+        'chunk_size': int
+            Number of steps per chunk handed over to ``sink`` (default: about 1 MiB).
+        'output_stride': int (default: 1)
+            Store only every ``output_stride``-th step (step control is unaffected,
+            the first and the last step are always stored).
+        'output_dx': float
+            Of those, store only steps at least ``output_dx`` after the last stored step
+            (or which pass ``output_dy_rel``).
+        'output_dy_rel': float
+            Of those, store only steps where a component changed by more than ``output_dy_rel``
+            relative to the last stored step (or which pass ``output_dx``).
+        'output_final_only': bool (default: False)
+            Store only the final state.
+        'dense_output': bool (default: False)
+            Keep the dense output of every step and return it as a :class:`DenseSolution`
+            (see below), the last step ends on ``xend``. Not together with ``sink``,
+            ``autorestart`` or ``trace`` (nor with 'fehlberg78', 'cash_karp54' & 'verner65').
+        'trace': bool (default: False)
+            Instrument the integration and report in info: 'n_accepted' & 'n_rejected'
+            (accepted/rejected steps, the latter only for the implicit steppers as the dense
+            output of 'dopri5' & 'bulirsch_stoer' hides rejected steps), 'n_lu_factorizations'
+            & 'n_lu_solves' and the time (s) spent in ``rhs``, ``jac`` and the linear algebra
+            ('time_rhs', 'time_jac' & 'time_linalg').
+        'trace_history': bool (default: False)
+            As ``trace`` and additionally every attempted step: its start, size, error norm
+            (scaled by the tolerances, ``nan`` if unknown) and whether it was accepted
+            ('steps_x', 'steps_dt', 'steps_err' & 'steps_accepted').
+        'diagnostics': bool (default: False)
+            Collect the messages otherwise printed to ``stderr`` (failed steps, restarts)
+            in info['diagnostics'] (str, one message per line).
+        'user_data': int, ndarray or ctypes object
+            Passed as the last argument (``void *``) to native callbacks: ``rhs``, ``jac``,
+            ``dx0cb`` and ``dx_max_cb`` may be C functions given as an address (int), a ctypes
+            function pointer or an object with an ``address`` attribute (e.g. ``numba.cfunc``),
+            the integration then runs without the GIL. Signatures (return 0 on success, any other
+            value, e.g. 1 for a recoverable error, fails the step: see ``return_on_error``)::
+
+                int rhs(double t, const double *y, double *f, void *user_data);
+                int jac(double t, const double *y, const double *fy, double *jmat, long ldim,
+                        double *dfdt, void *user_data);  /* jmat[i*ldim + j] */
+                double dx0cb(double t, const double *y, void *user_data);  /* also dx_max_cb */
+
+            ('rosenbrock4_banded': jmat column major with element (i, j) at
+            ``jmat[mupper + i - j + j*ldim]`` and dfdt == NULL, 'rosenbrock4_sparse':
+            ``int jac(double t, const double *y, const double *fy, double *data, int *colptrs,
+            int *rowvals, void *user_data)``).
 
     Returns
     -------
@@ -76,13 +157,20 @@ def integrate_adaptive(rhs, jac, y0, x0, xend, atol, rtol, dx0=.0, dx_max=.0,
         yout: 2-dimensional array of the dependent variables (axis 1) for
             values corresponding to xout (axis 0)
         info: dictionary with information about the integration
+            (the rosenbrock4 steppers report Jacobian evaluations saved on
+            rejected steps as 'njev_cached')
+
+    (xout, yout, info, solution) when ``dense_output=True``:
+        solution: :class:`DenseSolution`, ``solution(x)`` gives ``y`` at any ``x``
+            (float or array) in ``[x0, xend]`` without calling ``rhs``
     """
     # Sanity checks to reduce risk of having a segfault:
     jac = _ensure_5args(jac)
-    if check_callable:
+    native = _native_address(rhs) is not None
+    if check_callable and not native:
         _check_callable(rhs, jac, x0, y0)
 
-    if check_indexing:
+    if check_indexing and not native:
         _check_indexing(rhs, jac, x0, y0)
 
     return adaptive(rhs, jac, np.asarray(y0, dtype=np.float64), x0, xend, atol, rtol, dx0, dx_max, **_bs(kwargs))
@@ -96,10 +184,11 @@ def integrate_predefined(rhs, jac, y0, xout, atol, rtol, dx0=0.0, dx_max=0.0,
     Parameters
     ----------
     rhs: callable
-        Function with signature f(t, y, fout) which modifies fout *inplace*.
+        Function with signature f(t, y, fout) which modifies fout *inplace*,
+        or a C function (see 'user_data' below).
     jac: callable
         Function with signature j(t, y, jmat_out, dfdx_out) which modifies
-        jmat_out and dfdx_out *inplace*.
+        jmat_out and dfdx_out *inplace*, or a C function (see 'user_data' below).
     y0: array_like
         Initial values of the dependent variables.
     xout: array_like
@@ -109,7 +198,7 @@ def integrate_predefined(rhs, jac, y0, xout, atol, rtol, dx0=0.0, dx_max=0.0,
     rtol: float
         Relative tolerance.
     dx0: float
-        Initial step-size.
+        Initial step-size (0: ``dx0cb``, otherwise estimated from two calls of ``rhs``).
     dx_max: float
         Maximum step-size.
     check_callable: bool (default: False)
@@ -118,15 +207,74 @@ def integrate_predefined(rhs, jac, y0, xout, atol, rtol, dx0=0.0, dx_max=0.0,
         Perform item setting sanity checks on ``rhs`` and ``jac``.
     \\*\\*kwargs:
         'method': str
-            One in ``('rosenbrock4', 'dopri5', 'bs')``.
+            One in ``('rosenbrock4', 'dopri5', 'bs', 'rosenbrock4_banded', 'rosenbrock4_sparse',
+            'ros34pw2', 'fehlberg78', 'cash_karp54', 'verner65')``.
         'return_on_error': bool
-            Returns on error without raising an excpetion (with ``'success'==False``).
+            Returns on error without raising an excpetion (with ``'success'==False``), the
+            reason is given by info['status']: 'success', 'mxsteps_reached' (more than
+            ``nsteps`` steps, without any exception raised internally) or 'step_failed'.
         'autorestart': int
-            Useful for autonomous systems where conditions change during integration.
-            Will restart the integration with ``x==0``.
+            Number of times to resume after an error, from the last accepted step (``x``
+            in ``info['x_restarts']``) with its step size and a new budget of ``nsteps``.
         'dx0cb': callable
             Callback for calculating dx0 (make sure to pass ``dx0==0.0``) to enable.
             Signature: ``f(x, y[:]) -> float``.
+        'single_pass': bool (default: False)
+            Integrate once over ``xout`` and use dense output (interpolation) for
+            the values at ``xout`` instead of restarting the stepper in every interval.
+            ``nsteps`` then limits the number of steps between two consecutive points.
+            Not for 'fehlberg78', 'cash_karp54' & 'verner65' (no dense output).
+        'mlower': int
+            Number of sub-diagonals of the Jacobian ('rosenbrock4_banded').
+        'mupper': int
+            Number of super-diagonals of the Jacobian ('rosenbrock4_banded'),
+            ``jmat_out`` then has shape ``(mlower + mupper + 1, ny)`` where element
+            ``(i, j)`` of the Jacobian is stored at ``jmat_out[mupper + i - j, j]``
+            (``dfdx_out`` is ``None``).
+        'nnz': int
+            Number of (structurally) non-zero elements of the Jacobian ('rosenbrock4_sparse'),
+            ``jac`` then has the signature ``j(t, y, data_out, colptrs_out, rowvals_out)``
+            (compressed sparse column format, the pattern is checked and must not change during the integration).
+            The pattern, nnz and the number of elements stored for the LU factors (their pattern
+            is symmetric) are reported in info ('jac_colptrs', 'jac_rowvals', 'nnz' & 'nnz_lu').
+        'autonomous_exprs': bool (default: False)
+            ``rhs`` does not depend on ``x``. The banded & sparse ``jac`` give no ``dfdx``: it
+            is then zero, otherwise it is approximated by a forward difference which costs two
+            additional calls of ``rhs`` per Jacobian evaluation (counted in ``nfev``).
+        'max_jac_age': int (default: 10)
+            'ros34pw2' (a Rosenbrock-W method) reuses the Jacobian for at most this many
+            steps (1: a new Jacobian for every step). The number of factorizations of the
+            iteration matrix and of rejected steps are reported in info
+            ('n_factorizations' & 'n_rejected').
+        'trace': bool (default: False)
+            Instrument the integration and report in info: 'n_accepted' & 'n_rejected'
+            (accepted/rejected steps, the latter only for the implicit steppers as the dense
+            output of 'dopri5' & 'bulirsch_stoer' hides rejected steps), 'n_lu_factorizations'
+            & 'n_lu_solves' and the time (s) spent in ``rhs``, ``jac`` and the linear algebra
+            ('time_rhs', 'time_jac' & 'time_linalg').
+        'trace_history': bool (default: False)
+            As ``trace`` and additionally every attempted step: its start, size, error norm
+            (scaled by the tolerances, ``nan`` if unknown) and whether it was accepted
+            ('steps_x', 'steps_dt', 'steps_err' & 'steps_accepted').
+        'diagnostics': bool (default: False)
+            Collect the messages otherwise printed to ``stderr`` (failed steps, restarts)
+            in info['diagnostics'] (str, one message per line).
+        'user_data': int, ndarray or ctypes object
+            Passed as the last argument (``void *``) to native callbacks: ``rhs``, ``jac``,
+            ``dx0cb`` and ``dx_max_cb`` may be C functions given as an address (int), a ctypes
+            function pointer or an object with an ``address`` attribute (e.g. ``numba.cfunc``),
+            the integration then runs without the GIL. Signatures (return 0 on success, any other
+            value, e.g. 1 for a recoverable error, fails the step: see ``return_on_error``)::
+
+                int rhs(double t, const double *y, double *f, void *user_data);
+                int jac(double t, const double *y, const double *fy, double *jmat, long ldim,
+                        double *dfdt, void *user_data);  /* jmat[i*ldim + j] */
+                double dx0cb(double t, const double *y, void *user_data);  /* also dx_max_cb */
+
+            ('rosenbrock4_banded': jmat column major with element (i, j) at
+            ``jmat[mupper + i - j + j*ldim]`` and dfdt == NULL, 'rosenbrock4_sparse':
+            ``int jac(double t, const double *y, const double *fy, double *data, int *colptrs,
+            int *rowvals, void *user_data)``).
 
     Returns
     -------
@@ -134,14 +282,272 @@ def integrate_predefined(rhs, jac, y0, xout, atol, rtol, dx0=0.0, dx_max=0.0,
         result: 2-dimensional array of the dependent variables (axis 1) for
             values corresponding to xout (axis 0)
         info: dictionary with information about the integration
+            (the rosenbrock4 steppers report Jacobian evaluations saved on
+            rejected steps as 'njev_cached')
     """
     # Sanity checks to reduce risk of having a segfault:
     jac = _ensure_5args(jac)
-    if check_callable:
+    native = _native_address(rhs) is not None
+    if check_callable and not native:
         _check_callable(rhs, jac, xout[0], y0)
 
-    if check_indexing:
+    if check_indexing and not native:
         _check_indexing(rhs, jac, xout[0], y0)
 
     return predefined(rhs, jac, np.asarray(y0, dtype=np.float64), np.asarray(xout, dtype=np.float64),
                       atol, rtol, dx0, dx_max, **_bs(kwargs))
+
+
+def _is_shared(cb):
+    return cb is None or callable(cb) or _native_address(cb) is not None
+
+
+def _multi_check(rhs, jac, x0, y0, check_callable, check_indexing):
+    for idx, y0_i in enumerate(y0):
+        f = rhs if _is_shared(rhs) else rhs[idx]
+        j = jac if _is_shared(jac) else jac[idx]
+        x0_i = np.broadcast_to(x0, (len(y0),))[idx]
+        if _native_address(f) is not None:
+            continue
+        if check_callable:
+            _check_callable(f, j, x0_i, y0_i)
+        if check_indexing:
+            _check_indexing(f, j, x0_i, y0_i)
+
+
+def _ensure_5args_multi(jac):
+    if _is_shared(jac):
+        return _ensure_5args(jac)
+    return [_ensure_5args(j) for j in jac]
+
+
+def integrate_adaptive_multi(rhs, jac, y0, x0, xend, atol, rtol, dx0=.0, dx_max=.0,
+                             check_callable=False, check_indexing=False, **kwargs):
+    """
+    Integrates several systems of ordinary differential equations (in parallel).
+
+    The systems are integrated without holding the GIL by ``ANYODE_NUM_THREADS``
+    threads (environment variable, default: 1), the GIL is only taken for calls
+    to Python callbacks (native callbacks run fully in parallel).
+
+    Parameters
+    ----------
+    rhs: callable or sequence of callables
+        As in :func:`integrate_adaptive`, either shared by all systems or one per system.
+    jac: callable or sequence of callables (or None)
+        As in :func:`integrate_adaptive`, either shared by all systems or one per system.
+    y0: array_like
+        Initial values of the dependent variables, shape ``(nsys, ny)``.
+    x0: float or array_like
+        Initial value of the independent variable (per system).
+    xend: float or array_like
+        Stopping value for the independent variable (per system).
+    atol: float
+        Absolute tolerance.
+    rtol: float
+        Relative tolerance.
+    dx0: float or array_like
+        Initial step-size (per system).
+    dx_max: float or array_like
+        Maximum step-size (per system).
+    check_callable: bool (default: False)
+        Perform signature sanity checks on ``rhs`` and ``jac``.
+    check_indexing: bool (default: False)
+        Perform item setting sanity checks on ``rhs`` and ``jac``.
+    \\*\\*kwargs:
+        See :func:`integrate_adaptive` (``dx0cb``, ``dx_max_cb`` & ``user_data`` may also be given
+        one per system, ``user_data`` then as a list), and:
+
+        'cost': array_like
+            Estimated relative cost per system (e.g. 'n_steps' of a previous run), the most
+            expensive systems are then integrated first.
+        'sink': sequence
+            One path or callable per system (see :func:`integrate_adaptive`).
+        'ragged': bool (default: False)
+            Return the steps of all systems in flat arrays (see below).
+
+    Returns
+    -------
+    (xout, yout, info):
+        xout: list of 1-dimensional arrays (one per system)
+        yout: list of 2-dimensional arrays (one per system)
+        info: list of dictionaries (one per system)
+
+    (xout, yout, offsets, info) when ``ragged=True``:
+        xout: 1-dimensional array, the steps of all systems
+        yout: 2-dimensional array, shape ``(xout.size, ny)``
+        offsets: 1-dimensional array of ints, shape ``(nsys + 1,)``, the steps of system ``idx``
+            are ``xout[offsets[idx]:offsets[idx+1]]``
+        info: list of dictionaries (one per system)
+
+    Without ``ragged`` the arrays of the systems are views of such flat arrays.
+    """
+    y0 = np.atleast_2d(np.asarray(y0, dtype=np.float64))
+    jac = _ensure_5args_multi(jac)
+    if check_callable or check_indexing:
+        _multi_check(rhs, jac, x0, y0, check_callable, check_indexing)
+    return adaptive_multi(rhs, jac, y0, x0, xend, atol, rtol, dx0, dx_max, **_bs(kwargs))
+
+
+def integrate_predefined_multi(rhs, jac, y0, xout, atol, rtol, dx0=.0, dx_max=.0,
+                               check_callable=False, check_indexing=False, **kwargs):
+    """
+    Integrates several systems of ordinary differential equations (in parallel).
+
+    The systems are integrated without holding the GIL by ``ANYODE_NUM_THREADS``
+    threads (environment variable, default: 1), the GIL is only taken for calls
+    to Python callbacks (native callbacks run fully in parallel).
+
+    Parameters
+    ----------
+    rhs: callable or sequence of callables
+        As in :func:`integrate_predefined`, either shared by all systems or one per system.
+    jac: callable or sequence of callables (or None)
+        As in :func:`integrate_predefined`, either shared by all systems or one per system.
+    y0: array_like
+        Initial values of the dependent variables, shape ``(nsys, ny)``.
+    xout: array_like
+        Values of the independent variable, shape ``(nout,)`` (shared) or ``(nsys, nout)``.
+    atol: float
+        Absolute tolerance.
+    rtol: float
+        Relative tolerance.
+    dx0: float or array_like
+        Initial step-size (per system).
+    dx_max: float or array_like
+        Maximum step-size (per system).
+    check_callable: bool (default: False)
+        Perform signature sanity checks on ``rhs`` and ``jac``.
+    check_indexing: bool (default: False)
+        Perform item setting sanity checks on ``rhs`` and ``jac``.
+    \\*\\*kwargs:
+        See :func:`integrate_predefined` (``dx0cb``, ``dx_max_cb`` & ``user_data`` may also be given
+        one per system, ``user_data`` then as a list), and:
+
+        'cost': array_like
+            Estimated relative cost per system (e.g. 'n_steps' of a previous run), the most
+            expensive systems are then integrated first.
+
+    Returns
+    -------
+    (result, info):
+        result: 3-dimensional array of the dependent variables, shape ``(nsys, nout, ny)``
+        info: list of dictionaries (one per system)
+    """
+    y0 = np.atleast_2d(np.asarray(y0, dtype=np.float64))
+    xout = np.asarray(xout, dtype=np.float64)
+    jac = _ensure_5args_multi(jac)
+    if check_callable or check_indexing:
+        _multi_check(rhs, jac, xout[..., 0], y0, check_callable, check_indexing)
+    return predefined_multi(rhs, jac, y0, xout, atol, rtol, dx0, dx_max, **_bs(kwargs))
+
+
+
+def integrate_adaptive_ensemble(rhs, jac, y0, x0, xend, atol, rtol, dx0=.0, dx_max=.0, **kwargs):
+    """
+    Integrates several instances of one system with vectorized callbacks.
+
+    The systems are stepped in lockstep (each with its own step-size control, systems
+    which reject a step or have finished are masked) so that ``rhs`` and ``jac`` are
+    called once per stage for all active systems instead of once per system, which
+    amortizes the Python call overhead when the callbacks use NumPy array operations.
+
+    Parameters
+    ----------
+    rhs: callable
+        Vectorized right-hand side, signature ``rhs(x, y, fout, idx)`` (or ``rhs(x, y, fout)``)
+        with ``x`` of shape ``(n,)``, ``y`` & ``fout`` of shape ``(n, ny)`` and ``idx`` the
+        indices of the ``n`` systems (rows of ``y0``) in the call, e.g. to look up per-system
+        parameters. ``fout`` is to be filled in place.
+    jac: callable (or None)
+        Vectorized Jacobian (required by 'rosenbrock4'), signature
+        ``jac(x, y, jmat_out, dfdx_out, idx)`` (or without ``idx``) with ``jmat_out`` of shape
+        ``(n, ny, ny)`` and ``dfdx_out`` of shape ``(n, ny)`` (both zeroed before the call).
+    y0: array_like
+        Initial values of the dependent variables, shape ``(nsys, ny)``.
+    x0: float or array_like
+        Initial value of the independent variable (per system).
+    xend: float or array_like
+        Stopping value for the independent variable (per system).
+    atol: float
+        Absolute tolerance.
+    rtol: float
+        Relative tolerance.
+    dx0: float or array_like
+        Initial step-size (per system).
+    dx_max: float or array_like
+        Maximum step-size (per system).
+    \\*\\*kwargs:
+        'method': str
+            'dopri5' (default) or 'rosenbrock4'.
+        'nsteps': int
+            Maximum number of steps (default: 500).
+        'return_on_error': bool
+            Return the results so far instead of raising an exception when a system fails.
+        'batch_size': int
+            Maximum number of systems per call of ``rhs``/``jac`` (default: all systems of a
+            thread, see ``ANYODE_NUM_THREADS``).
+
+    Returns
+    -------
+    (xout, yout, info):
+        xout: list of 1-dimensional arrays (one per system)
+        yout: list of 2-dimensional arrays (one per system)
+        info: list of dictionaries (one per system)
+    """
+    y0 = np.atleast_2d(np.asarray(y0, dtype=np.float64))
+    return adaptive_ensemble(_ensure_idx_arg(rhs, 4), _ensure_idx_arg(jac, 5), y0, x0, xend, atol, rtol,
+                             dx0, dx_max, **kwargs)
+
+
+def integrate_predefined_ensemble(rhs, jac, y0, xout, atol, rtol, dx0=.0, dx_max=.0, **kwargs):
+    """
+    Integrates several instances of one system with vectorized callbacks.
+
+    As :func:`integrate_adaptive_ensemble` but evaluated at the values of ``xout`` by
+    interpolating the dense output (as ``single_pass`` of :func:`integrate_predefined`), only
+    the last step is shortened to end on ``xout[-1]``.
+
+    Parameters
+    ----------
+    rhs: callable
+        Vectorized right-hand side, signature ``rhs(x, y, fout, idx)`` (or ``rhs(x, y, fout)``)
+        with ``x`` of shape ``(n,)``, ``y`` & ``fout`` of shape ``(n, ny)`` and ``idx`` the
+        indices of the ``n`` systems (rows of ``y0``) in the call, e.g. to look up per-system
+        parameters. ``fout`` is to be filled in place.
+    jac: callable (or None)
+        Vectorized Jacobian (required by 'rosenbrock4'), signature
+        ``jac(x, y, jmat_out, dfdx_out, idx)`` (or without ``idx``) with ``jmat_out`` of shape
+        ``(n, ny, ny)`` and ``dfdx_out`` of shape ``(n, ny)`` (both zeroed before the call).
+    y0: array_like
+        Initial values of the dependent variables, shape ``(nsys, ny)``.
+    xout: array_like
+        Values of the independent variable, shape ``(nout,)`` (shared) or ``(nsys, nout)``.
+    atol: float
+        Absolute tolerance.
+    rtol: float
+        Relative tolerance.
+    dx0: float or array_like
+        Initial step-size (per system).
+    dx_max: float or array_like
+        Maximum step-size (per system).
+    \\*\\*kwargs:
+        'method': str
+            'dopri5' (default) or 'rosenbrock4'.
+        'nsteps': int
+            Maximum number of steps (default: 500).
+        'return_on_error': bool
+            Return the results so far instead of raising an exception when a system fails.
+        'batch_size': int
+            Maximum number of systems per call of ``rhs``/``jac`` (default: all systems of a
+            thread, see ``ANYODE_NUM_THREADS``).
+
+    Returns
+    -------
+    (result, info):
+        result: 3-dimensional array of the dependent variables, shape ``(nsys, nout, ny)``
+        info: list of dictionaries (one per system)
+    """
+    y0 = np.atleast_2d(np.asarray(y0, dtype=np.float64))
+    return predefined_ensemble(_ensure_idx_arg(rhs, 4), _ensure_idx_arg(jac, 5), y0,
+                               np.asarray(xout, dtype=np.float64), atol, rtol, dx0, dx_max, **kwargs)
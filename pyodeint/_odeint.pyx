@@ -5,52 +5,219 @@
 
 from cpython.ref cimport PyObject
 from libcpp cimport bool
+from libcpp.string cimport string
+from libcpp.utility cimport pair
+from libcpp.vector cimport vector
 cimport numpy as cnp
 cnp.import_array()  # Numpy C-API initialization
 
+import os
+
 import numpy as np
 
+from ._util import _ensure_5args, _native_address, _native_callbacks
+
+from anyode cimport OdeSysBase
 from anyode_numpy cimport PyOdeSys
-from odeint_anyode cimport simple_adaptive, simple_predefined, styp_from_name
+from odeint_anyode cimport (simple_adaptive, simple_predefined, simple_dense, styp_from_name, StepType, Session,
+                            Stepping, dense_solution, output_policy, trajectory_sink, npy_sink, step_trace)
+from odeint_anyode_ensemble cimport ensemble_adaptive, ensemble_predefined, ensemble_batch, ensemble_member
+from odeint_anyode_native cimport NativeOdeSys
+from odeint_anyode_numpy cimport (PyEnsembleBatch, PyOdeSysGIL, PyTrajectorySink, restore_first_error,
+                                  restore_sink_error)
+from odeint_anyode_parallel cimport multi_adaptive, multi_adaptive_ragged, multi_predefined, ragged_trajectories
 
-steppers = ('rosenbrock4', 'dopri5', 'bulirsch_stoer')
-requires_jac = ('rosenbrock4',)
+steppers = ('rosenbrock4', 'dopri5', 'bulirsch_stoer', 'rosenbrock4_banded', 'rosenbrock4_sparse', 'ros34pw2',
+            'fehlberg78', 'cash_karp54', 'verner65')
+requires_jac = ('rosenbrock4', 'rosenbrock4_banded', 'rosenbrock4_sparse', 'ros34pw2')
+statuses = ('success', 'mxsteps_reached', 'step_failed')  # IntegrStatus
 
+ctypedef OdeSysBase[double, int] OdeSysBase_t
 ctypedef PyOdeSys[double, int] PyOdeSys_t
+ctypedef PyOdeSysGIL[double, int] PyOdeSysGIL_t
+
+
+cdef class _VectorOwner:
+    # Keeps the memory of a std::vector alive for as long as NumPy arrays refer to it.
+    cdef vector[double] data
+
+
+cdef cnp.ndarray _as_array(vector[double]& v):
+    # Takes over the buffer of v (which is left empty) without copying.
+    cdef:
+        _VectorOwner owner = _VectorOwner()
+        cnp.npy_intp size = v.size()
+        cnp.ndarray arr
+    owner.data.swap(v)
+    arr = cnp.PyArray_SimpleNewFromData(1, &size, cnp.NPY_DOUBLE, owner.data.data())
+    cnp.set_array_base(arr, owner)
+    return arr
 
 
-cdef dict get_last_info(PyOdeSys_t * odesys, success=True):
+cdef OdeSysBase_t * _new_system(int ny, rhs, jac, dx0cb, dx_max_cb, user_data, int mlower, int mupper, int nnz,
+                                bint autonomous_exprs=False, bint take_gil=False) except NULL:
+    # C function pointers (see _util._native_address) give a NativeOdeSys which never needs the GIL.
+    cdef:
+        int nquads=0, nroots=0
+        size_t rhs_addr, jac_addr, dx0_addr, dx_max_addr, user_data_addr
+        OdeSysBase_t * odesys
+    native = _native_callbacks(rhs, jac, dx0cb, dx_max_cb, user_data)
+    if native is not None:
+        rhs_addr, jac_addr, dx0_addr, dx_max_addr, user_data_addr = native
+        odesys = <OdeSysBase_t *>new NativeOdeSys(ny, <void *>rhs_addr, <void *>jac_addr, <void *>dx0_addr,
+                                                  <void *>dx_max_addr, <void *>user_data_addr, mlower, mupper, nnz)
+    elif take_gil:
+        odesys = <OdeSysBase_t *>new PyOdeSysGIL_t(ny, <PyObject *>rhs, <PyObject *>jac, NULL, NULL, NULL, NULL,
+                                                   mlower, mupper, nquads, nroots, <PyObject *>dx0cb,
+                                                   <PyObject *>dx_max_cb, nnz)
+    else:
+        odesys = <OdeSysBase_t *>new PyOdeSys_t(ny, <PyObject *>rhs, <PyObject *>jac, NULL, NULL, NULL, NULL,
+                                                mlower, mupper, nquads, nroots, <PyObject *>dx0cb,
+                                                <PyObject *>dx_max_cb, nnz)
+    odesys.autonomous_exprs = autonomous_exprs  # dfdt = 0 instead of a finite difference (banded & sparse Jacobians)
+    return odesys
+
+
+cdef dict get_last_info(OdeSysBase_t * odesys, success=True):
     info = {str(k.decode('utf-8')): v for k, v in dict(odesys.current_info.nfo_int).items()}
     info.update({str(k.decode('utf-8')): v for k, v in dict(odesys.current_info.nfo_dbl).items()})
+    info.update({str(k.decode('utf-8')): np.array(v, dtype=np.int32)
+                 for k, v in dict(odesys.current_info.nfo_vecint).items()})
+    info.update({str(k.decode('utf-8')): np.array(v, dtype=np.float64)
+                 for k, v in dict(odesys.current_info.nfo_vecdbl).items()})
     info['nfev'] = odesys.nfev
     info['njev'] = odesys.njev
     info['success'] = success
+    if 'status' in info:
+        info['status'] = statuses[info['status']]
     return info
 
 
+cdef step_trace * _new_trace(bint trace, bint history):
+    cdef step_trace * tr = NULL
+    if trace or history:
+        tr = new step_trace()
+        tr.history = history
+    return tr
+
+
+cdef dict _trace_info(dict info):
+    if 'steps_accepted' in info:
+        info['steps_accepted'] = info['steps_accepted'].astype(np.bool_)
+    return info
+
+
+cdef output_policy _output_policy(long stride, double dx, double dy_rel, bint final_only) except *:
+    cdef output_policy pol
+    if stride < 1:
+        raise ValueError("output_stride needs to be >= 1")
+    pol.stride, pol.dx, pol.dy_rel, pol.final_only = stride, dx, dy_rel, final_only
+    return pol
+
+
+cdef trajectory_sink * _new_sink(sink, int ny) except NULL:
+    # A path: .npy file (rows: x, y), a callable: called with the steps in chunks.
+    if isinstance(sink, (str, bytes, os.PathLike)):
+        return new npy_sink(os.fsencode(sink), ny)
+    elif callable(sink):
+        return new PyTrajectorySink(ny, <PyObject *>sink)
+    raise TypeError("sink: expected a path or a callable, got %r" % (sink,))
+
+
+cdef int _raise_sink_error(trajectory_sink ** sinks, size_t n) except -1:
+    # A failed integration raises the exception of a Python sink (kept by PyTrajectorySink) if any.
+    if restore_sink_error(sinks, n):
+        return -1
+    return 0
+
+
+cdef tuple _sink_result(sink):
+    # xout & yout: views of the memory mapped file (None for a callable).
+    if callable(sink):
+        return None, None
+    data = np.load(sink, mmap_mode='r')
+    return data[:, 0], data[:, 1:]
+
+
 def adaptive(rhs, jac, cnp.ndarray[cnp.float64_t] y0, double x0, double xend,
              double atol, double rtol, double dx0=.0, double dx_max=.0, str method='rosenbrock4', int nsteps=500,
-             int autorestart=0, bool return_on_error=False, dx0cb=None, dx_max_cb=None):
+             int autorestart=0, bool return_on_error=False, dx0cb=None, dx_max_cb=None,
+             int mlower=-1, int mupper=-1, int nnz=-1, bint autonomous_exprs=False, int max_jac_age=10, user_data=None,
+             sink=None, long chunk_size=0, long output_stride=1, double output_dx=0, double output_dy_rel=0,
+             bint output_final_only=False, bint dense_output=False, bint trace=False, bint trace_history=False,
+             bint diagnostics=False):
     cdef:
+        output_policy pol = _output_policy(output_stride, output_dx, output_dy_rel, output_final_only)
         int ny = y0.shape[y0.ndim - 1]
-        PyOdeSys_t * odesys
-        int mlower=-1, mupper=-1, nquads=0, nroots=0, nnz=-1
+        OdeSysBase_t * odesys
+        trajectory_sink * c_sink = NULL
+        step_trace * c_trace = NULL
+        string diag
+        string * diag_ptr = &diag if diagnostics else NULL
+        bint native = _native_address(rhs) is not None
+        StepType styp = styp_from_name(method.lower().encode('UTF-8'))
+        double * y0_ptr = &y0[0]
+        pair[vector[double], vector[double]] result
+        DenseSolution sol
 
     if method in requires_jac and jac is None:
         raise ValueError("Method requires explicit jacobian callback")
     if np.isnan(y0).any():
         raise ValueError("NaN found in y0")
+    if dense_output and (sink is not None or autorestart or trace or trace_history):
+        raise ValueError("dense_output: not supported together with sink, autorestart or trace")
 
-    odesys = new PyOdeSys_t(ny, <PyObject *>rhs, <PyObject *>jac, NULL, NULL, NULL, NULL,
-                          mlower, mupper, nquads, nroots, <PyObject *> dx0cb, <PyObject *>dx_max_cb, nnz)
+    odesys = _new_system(ny, rhs, jac, dx0cb, dx_max_cb, user_data, mlower, mupper, nnz, autonomous_exprs)
     try:
-        xout, yout = map(np.asarray, simple_adaptive[PyOdeSys_t](
-            odesys, atol, rtol, styp_from_name(method.lower().encode('UTF-8')),
-            &y0[0], x0, xend, nsteps, dx0, dx_max, autorestart, return_on_error))
-        nfo = get_last_info(odesys, False if return_on_error and xout[-1] != xend else True)
+        if dense_output:
+            sol = DenseSolution.__new__(DenseSolution)
+            if native:
+                with nogil:
+                    sol.sol = simple_dense[OdeSysBase_t](odesys, atol, rtol, styp, y0_ptr, x0, xend, nsteps, dx0,
+                                                         dx_max, max_jac_age, return_on_error, diag_ptr)
+            else:
+                sol.sol = simple_dense[OdeSysBase_t](odesys, atol, rtol, styp, y0_ptr, x0, xend, nsteps, dx0,
+                                                     dx_max, max_jac_age, return_on_error, diag_ptr)
+            xout = sol.breakpoints
+            nfo = get_last_info(odesys, sol.sol.x_end() == xend)
+            if nfo['success']:
+                xout[-1] = xend  # the shortened last step ends on xend up to rounding
+            nfo['atol'], nfo['rtol'] = atol, rtol
+            if diagnostics:
+                nfo['diagnostics'] = diag.decode('utf-8', 'replace')
+            return xout, sol(xout), nfo, sol
+        if sink is not None:
+            c_sink = _new_sink(sink, ny)
+        c_trace = _new_trace(trace, trace_history)
+        try:
+            if native:
+                with nogil:
+                    result = simple_adaptive[OdeSysBase_t](
+                        odesys, atol, rtol, styp, y0_ptr, x0, xend, nsteps, dx0, dx_max, autorestart,
+                        return_on_error, max_jac_age, c_sink, chunk_size, pol, c_trace, diag_ptr)
+            else:
+                result = simple_adaptive[OdeSysBase_t](
+                    odesys, atol, rtol, styp, y0_ptr, x0, xend, nsteps, dx0, dx_max, autorestart, return_on_error,
+                    max_jac_age, c_sink, chunk_size, pol, c_trace, diag_ptr)
+        except RuntimeError:
+            _raise_sink_error(&c_sink, 1)
+            raise
+        if c_sink != NULL:
+            nfo = _trace_info(get_last_info(odesys, False if return_on_error and c_sink.x_last != xend else True))
+            nfo['atol'], nfo['rtol'] = atol, rtol
+            if diagnostics:
+                nfo['diagnostics'] = diag.decode('utf-8', 'replace')
+            return _sink_result(sink) + (nfo,)
+        xout, yout = _as_array(result.first), _as_array(result.second)
+        nfo = _trace_info(get_last_info(odesys, False if return_on_error and (xout.size == 0 or xout[-1] != xend)
+                                        else True))
         nfo['atol'], nfo['rtol'] = atol, rtol
+        if diagnostics:
+            nfo['diagnostics'] = diag.decode('utf-8', 'replace')
         return xout, yout.reshape(xout.size, ny), nfo
     finally:
+        del c_trace
+        del c_sink
         del odesys
 
 
@@ -58,28 +225,555 @@ def predefined(rhs, jac,
                cnp.ndarray[cnp.float64_t] y0,
                cnp.ndarray[cnp.float64_t, ndim=1] xout,
                double atol, double rtol, double dx0=.0, double dx_max=.0, method='rosenbrock4',
-               int nsteps=500, int autorestart=0, bool return_on_error=False, dx0cb=None, dx_max_cb=None):
+               int nsteps=500, int autorestart=0, bool return_on_error=False, dx0cb=None, dx_max_cb=None,
+               bool single_pass=False, int mlower=-1, int mupper=-1, int nnz=-1, bint autonomous_exprs=False,
+               int max_jac_age=10, user_data=None, bint trace=False, bint trace_history=False, bint diagnostics=False):
     cdef:
         int ny = y0.shape[y0.ndim - 1]
-        int nreached
-        cnp.ndarray[cnp.float64_t, ndim=2] yout
-        PyOdeSys_t * odesys
-        int mlower=-1, mupper=-1, nquads=0, nroots=0, nnz=-1
+        int nreached, nout = xout.size
+        cnp.ndarray[cnp.float64_t, ndim=2] yout = np.empty((xout.size, ny))
+        OdeSysBase_t * odesys
+        step_trace * c_trace = NULL
+        string diag
+        string * diag_ptr = &diag if diagnostics else NULL
+        bint native = _native_address(rhs) is not None
+        StepType styp = styp_from_name(method.lower().encode('UTF-8'))
+        double * y0_ptr = &y0[0]
+        double * xout_ptr = &xout[0]
+        double * yout_ptr = &yout[0, 0]
 
     if method in requires_jac and jac is None:
         raise ValueError("Method requires explicit jacobian callback")
     if np.isnan(y0).any():
         raise ValueError("NaN found in y0")
-    odesys = new PyOdeSys_t(ny, <PyObject *>rhs, <PyObject *>jac, NULL, NULL, NULL, NULL, mlower, mupper,
-                          nquads, nroots, <PyObject *> dx0cb, <PyObject *>dx_max_cb, nnz)
+    odesys = _new_system(ny, rhs, jac, dx0cb, dx_max_cb, user_data, mlower, mupper, nnz, autonomous_exprs)
     try:
-        yout = np.empty((xout.size, ny))
-        nreached = simple_predefined[PyOdeSys_t](odesys, atol, rtol, styp_from_name(method.lower().encode('UTF-8')),
-                                                 &y0[0], xout.size, &xout[0], &yout[0, 0], nsteps, dx0, dx_max,
-                                                 autorestart, return_on_error)
-        info = get_last_info(odesys, success=False if return_on_error and nreached < xout.size else True)
+        c_trace = _new_trace(trace, trace_history)
+        if native:
+            with nogil:
+                nreached = simple_predefined[OdeSysBase_t](
+                    odesys, atol, rtol, styp, y0_ptr, nout, xout_ptr, yout_ptr, nsteps, dx0, dx_max,
+                    autorestart, return_on_error, single_pass, max_jac_age, c_trace, diag_ptr)
+        else:
+            nreached = simple_predefined[OdeSysBase_t](
+                odesys, atol, rtol, styp, y0_ptr, nout, xout_ptr, yout_ptr, nsteps, dx0, dx_max,
+                autorestart, return_on_error, single_pass, max_jac_age, c_trace, diag_ptr)
+        info = _trace_info(get_last_info(odesys, success=False if return_on_error and nreached < nout else True))
         info['nreached'] = nreached
         info['atol'], info['rtol'] = atol, rtol
+        if diagnostics:
+            info['diagnostics'] = diag.decode('utf-8', 'replace')
         return yout, info
     finally:
+        del c_trace
         del odesys
+
+
+cdef class DenseSolution:
+    """ Continuous solution of :func:`pyodeint.integrate_adaptive` (``dense_output=True``)
+
+    Keeps the dense output of every accepted step, calling it evaluates the
+    solution anywhere in ``[x_begin, x_end]`` without calling ``rhs``.
+    """
+    cdef:
+        dense_solution sol
+
+    @property
+    def ny(self):
+        return self.sol.ny()
+
+    @property
+    def n_steps(self):
+        return self.sol.n_steps()
+
+    @property
+    def x_begin(self):
+        return self.sol.x_begin()
+
+    @property
+    def x_end(self):
+        return self.sol.x_end()
+
+    @property
+    def breakpoints(self):
+        """ Values of the independent variable of the accepted steps (copy). """
+        return np.array(self.sol.breakpoints(), dtype=np.float64)
+
+    def __call__(self, x):
+        """ Returns ``y`` at ``x`` (float or array_like), shape ``np.shape(x) + (ny,)``. """
+        cdef:
+            const double[::1] _x = np.ascontiguousarray(np.ravel(x), dtype=np.float64)
+            cnp.ndarray[cnp.float64_t, ndim=2] yout = np.empty((_x.shape[0], self.sol.ny()))
+        if _x.shape[0] > 0:
+            with nogil:
+                self.sol(_x.shape[0], &_x[0], &yout[0, 0])
+        return yout.reshape(np.shape(x) + (self.sol.ny(),))
+
+
+cdef class Integrator:
+    """ Integrator for repeated integrations of one system with the same settings
+
+    Owns the system and the settings (parsed once), :meth:`solve` only checks its
+    arguments and integrates, the info dict is built on request (:meth:`info`).
+    Arguments as in :func:`pyodeint.integrate_predefined` (``ny``: number of
+    dependent variables).
+    """
+    cdef:
+        OdeSysBase_t * odesys
+        Session[OdeSysBase_t] * session
+        readonly int ny, nreached
+        readonly bint native
+        readonly double atol, rtol
+        int nout
+        tuple refs  # the system only holds borrowed references
+
+    def __cinit__(self, rhs, jac, int ny, double atol, double rtol, str method='rosenbrock4', double dx0=.0,
+                  double dx_max=.0, int nsteps=500, int autorestart=0, bool return_on_error=False, dx0cb=None,
+                  dx_max_cb=None, bool single_pass=False, int mlower=-1, int mupper=-1, int nnz=-1,
+                  bint autonomous_exprs=False, int max_jac_age=10, user_data=None):
+        cdef StepType styp = styp_from_name(method.lower().encode('UTF-8'))
+        if method in requires_jac and jac is None:
+            raise ValueError("Method requires explicit jacobian callback")
+        jac = _ensure_5args(jac)
+        self.ny, self.atol, self.rtol = ny, atol, rtol
+        self.native = _native_address(rhs) is not None
+        self.refs = (rhs, jac, dx0cb, dx_max_cb, user_data)
+        self.odesys = _new_system(ny, rhs, jac, dx0cb, dx_max_cb, user_data, mlower, mupper, nnz, autonomous_exprs)
+        self.session = new Session[OdeSysBase_t](self.odesys, atol, rtol, styp, nsteps, dx0, dx_max, autorestart,
+                                                 return_on_error, single_pass, max_jac_age)
+
+    def __dealloc__(self):
+        del self.session
+        del self.odesys
+
+    def solve(self, const double[::1] y0, const double[::1] xout, out=None):
+        """ Integrates from ``y0`` at ``xout[0]``, the result (shape ``(len(xout), ny)``)
+        is written to ``out`` (allocated if not given) which is returned. """
+        cdef:
+            int nout = xout.shape[0]
+            double[:, ::1] yout
+        if y0.shape[0] != self.ny:
+            raise ValueError("Expected y0 of length %d, got %d" % (self.ny, y0.shape[0]))
+        if nout < 2:
+            raise ValueError("xout needs to contain at least two values")
+        for i in range(self.ny):
+            if y0[i] != y0[i]:
+                raise ValueError("NaN found in y0")
+        if out is None:
+            out = np.empty((nout, self.ny))
+        yout = out
+        if yout.shape[0] != nout or yout.shape[1] != self.ny:
+            raise ValueError("Expected out of shape (%d, %d)" % (nout, self.ny))
+        if self.native:
+            with nogil:
+                self.nreached = self.session.predefined(&y0[0], nout, &xout[0], &yout[0, 0])
+        else:
+            self.nreached = self.session.predefined(&y0[0], nout, &xout[0], &yout[0, 0])
+        self.nout = nout
+        return out
+
+    def info(self):
+        """ Info dict of the last call of :meth:`solve`. """
+        self.session.set_info()
+        info = get_last_info(self.odesys, success=self.nreached == self.nout)
+        info['nreached'] = self.nreached
+        info['atol'], info['rtol'] = self.atol, self.rtol
+        return info
+
+
+cdef class Stepper:
+    """ Integration in increments chosen by the caller
+
+    Keeps the stepper between calls: :meth:`advance_to` and :meth:`step` continue
+    from the last accepted step with its step size (no restarts), e.g. for
+    co-simulation or when the caller handles events. Arguments as in
+    :func:`pyodeint.integrate_adaptive` (a negative ``dx0`` integrates towards
+    smaller ``x``), ``nsteps`` limits the number of steps per call of
+    :meth:`advance_to`. Not for the steppers without dense output ('fehlberg78',
+    'cash_karp54' & 'verner65').
+    """
+    cdef:
+        OdeSysBase_t * odesys
+        Stepping[OdeSysBase_t] * stepping
+        readonly int ny
+        readonly bint native
+        readonly double atol, rtol
+        tuple refs  # the system only holds borrowed references
+
+    def __cinit__(self, rhs, jac, y0, double x0, double atol, double rtol, str method='rosenbrock4', double dx0=.0,
+                  double dx_max=.0, int nsteps=500, dx0cb=None, dx_max_cb=None, int mlower=-1, int mupper=-1,
+                  int nnz=-1, bint autonomous_exprs=False, int max_jac_age=10, user_data=None):
+        cdef:
+            StepType styp = styp_from_name(method.lower().encode('UTF-8'))
+            const double[::1] _y0 = np.ascontiguousarray(y0, dtype=np.float64)
+        if method in requires_jac and jac is None:
+            raise ValueError("Method requires explicit jacobian callback")
+        if np.isnan(_y0).any():
+            raise ValueError("NaN found in y0")
+        jac = _ensure_5args(jac)
+        self.ny, self.atol, self.rtol = _y0.shape[0], atol, rtol
+        self.native = _native_address(rhs) is not None
+        self.refs = (rhs, jac, dx0cb, dx_max_cb, user_data)
+        self.odesys = _new_system(self.ny, rhs, jac, dx0cb, dx_max_cb, user_data, mlower, mupper, nnz,
+                                  autonomous_exprs)
+        self.stepping = new Stepping[OdeSysBase_t](self.odesys, atol, rtol, styp, &_y0[0], x0, nsteps, dx0,
+                                                   dx_max, max_jac_age)
+
+    def __dealloc__(self):
+        del self.stepping
+        del self.odesys
+
+    @property
+    def x(self):
+        """ Current value of the independent variable. """
+        return self.stepping.x()
+
+    @property
+    def dx(self):
+        """ Size of the next step. """
+        return self.stepping.dx()
+
+    @property
+    def n_steps(self):
+        """ Number of steps taken so far. """
+        return self.stepping.n_steps()
+
+    def _state(self, out):
+        cdef double[::1] yout
+        if out is None:
+            out = np.empty(self.ny)
+        yout = out
+        if yout.shape[0] != self.ny:
+            raise ValueError("Expected out of length %d" % self.ny)
+        for i in range(self.ny):
+            yout[i] = self.stepping.y()[i]
+        return out
+
+    def state(self, out=None):
+        """ Returns ``(x, y)`` at the current ``x``. """
+        return self.stepping.x(), self._state(out)
+
+    def step(self, out=None):
+        """ Takes one step, returns ``(x, y)`` after it. """
+        if self.native:
+            with nogil:
+                self.stepping.step()
+        else:
+            self.stepping.step()
+        return self.state(out)
+
+    def advance_to(self, double x, out=None):
+        """ Integrates up to ``x`` (interpolating within the last step), returns ``y`` at ``x``
+        (written to ``out`` if given). """
+        if self.native:
+            with nogil:
+                self.stepping.advance_to(x)
+        else:
+            self.stepping.advance_to(x)
+        return self._state(out)
+
+    def info(self):
+        """ Info dict covering all steps so far. """
+        self.stepping.set_info()
+        info = get_last_info(self.odesys, success=True)
+        info['atol'], info['rtol'] = self.atol, self.rtol
+        return info
+
+
+cdef vector[OdeSysBase_t *] _new_systems(int nsys, int ny, rhs, jac, dx0cb, dx_max_cb, user_data,
+                                         int mlower, int mupper, int nnz, bint autonomous_exprs) except *:
+    # Python callbacks are called with the GIL taken (the integration runs without it).
+    cdef:
+        vector[OdeSysBase_t *] systems
+        size_t i
+    try:
+        for idx in range(nsys):
+            systems.push_back(_new_system(ny, rhs[idx], jac[idx], dx0cb[idx], dx_max_cb[idx], user_data[idx],
+                                          mlower, mupper, nnz, autonomous_exprs, True))
+    except:
+        for i in range(systems.size()):
+            del systems[i]
+        raise
+    return systems
+
+
+cdef int _raise_kept_error(vector[OdeSysBase_t *]& systems) except -1:
+    # A failed batch raises the first exception of a Python callback (kept by PyOdeSysGIL) if any.
+    if restore_first_error[OdeSysBase_t](systems):
+        return -1
+    return 0
+
+
+def _per_system(cb, int nsys):
+    if cb is None or callable(cb) or _native_address(cb) is not None:
+        return [cb]*nsys
+    cb = list(cb)
+    if len(cb) != nsys:
+        raise ValueError("Expected one callback per system (%d), got %d" % (nsys, len(cb)))
+    return cb
+
+
+def _per_system_user_data(user_data, int nsys):
+    if isinstance(user_data, (list, tuple)):
+        if len(user_data) != nsys:
+            raise ValueError("Expected user_data for each system (%d), got %d" % (nsys, len(user_data)))
+        return user_data
+    return [user_data]*nsys
+
+
+def _multi_args(rhs, jac, cnp.ndarray[cnp.float64_t, ndim=2] y0, method, dx0, dx_max, dx0cb, dx_max_cb, user_data,
+                cost):
+    nsys = y0.shape[0]
+    if nsys == 0:
+        raise ValueError("y0 needs to contain at least one system")
+    if method in requires_jac and (jac is None or any(j is None for j in _per_system(jac, nsys))):
+        raise ValueError("Method requires explicit jacobian callback")
+    if np.isnan(y0).any():
+        raise ValueError("NaN found in y0")
+    return (_per_system(rhs, nsys), _per_system(jac, nsys), _per_system(dx0cb, nsys), _per_system(dx_max_cb, nsys),
+            _per_system_user_data(user_data, nsys),
+            np.ascontiguousarray(np.broadcast_to(dx0, (nsys,)), dtype=np.float64),
+            np.ascontiguousarray(np.broadcast_to(dx_max, (nsys,)), dtype=np.float64),
+            None if cost is None else np.ascontiguousarray(np.broadcast_to(cost, (nsys,)), dtype=np.float64))
+
+
+def adaptive_multi(rhs, jac, cnp.ndarray[cnp.float64_t, ndim=2] y0, x0, xend,
+                   double atol, double rtol, dx0=.0, dx_max=.0, str method='rosenbrock4', int nsteps=500,
+                   int autorestart=0, bool return_on_error=False, dx0cb=None, dx_max_cb=None,
+                   int mlower=-1, int mupper=-1, int nnz=-1, bint autonomous_exprs=False, int max_jac_age=10,
+                   user_data=None, cost=None, sink=None, long chunk_size=0, long output_stride=1, double output_dx=0,
+                   double output_dy_rel=0, bint output_final_only=False, bint ragged=False, bint diagnostics=False):
+    cdef:
+        output_policy pol = _output_policy(output_stride, output_dx, output_dy_rel, output_final_only)
+        int nsys = y0.shape[0], ny = y0.shape[1]
+        ragged_trajectories flat
+        cnp.ndarray[cnp.int64_t, ndim=1] offsets
+        vector[trajectory_sink *] sinks
+        trajectory_sink ** sinks_ptr = NULL
+        cnp.ndarray[cnp.float64_t, ndim=1] _x0 = np.ascontiguousarray(np.broadcast_to(x0, (nsys,)), dtype=np.float64)
+        cnp.ndarray[cnp.float64_t, ndim=1] _xend = np.ascontiguousarray(
+            np.broadcast_to(xend, (nsys,)), dtype=np.float64)
+        cnp.ndarray[cnp.float64_t, ndim=1] _dx0, _dx_max, _cost
+        const double * cost_ptr = NULL
+        StepType styp = styp_from_name(method.lower().encode('UTF-8'))
+        vector[OdeSysBase_t *] systems
+        vector[string] diag
+        vector[string] * diag_ptr = &diag if diagnostics else NULL
+        size_t i
+    rhs, jac, dx0cb, dx_max_cb, user_data, _dx0, _dx_max, _cost = _multi_args(
+        rhs, jac, y0, method, dx0, dx_max, dx0cb, dx_max_cb, user_data, cost)
+    if _cost is not None:
+        cost_ptr = &_cost[0]
+    y0 = np.ascontiguousarray(y0)
+    if sink is not None:
+        if isinstance(sink, (str, bytes, os.PathLike)) or callable(sink) or len(sink) != nsys:
+            raise ValueError("sink: expected one path or callable per system (%d)" % nsys)
+        if ragged:
+            raise ValueError("ragged: not supported together with sink")
+    systems = _new_systems(nsys, ny, rhs, jac, dx0cb, dx_max_cb, user_data, mlower, mupper, nnz, autonomous_exprs)
+    try:
+        if sink is None:
+            # All steps in three flat arrays, the systems' arrays are views of them.
+            try:
+                with nogil:
+                    flat = multi_adaptive_ragged[OdeSysBase_t](
+                        systems, atol, rtol, styp, &y0[0, 0], &_x0[0], &_xend[0], nsteps, &_dx0[0], &_dx_max[0],
+                        autorestart, return_on_error, cost_ptr, NULL, max_jac_age, chunk_size, pol, diag_ptr)
+            except RuntimeError:
+                _raise_kept_error(systems)
+                raise
+            offsets = np.empty(nsys + 1, dtype=np.int64)
+            for idx in range(nsys + 1):
+                offsets[idx] = flat.offsets[idx]
+            xflat = _as_array(flat.xout)
+            yflat = _as_array(flat.yout).reshape(xflat.size, ny)
+            info = []
+            for idx in range(nsys):
+                nfo = get_last_info(systems[idx], False if return_on_error and (
+                    offsets[idx + 1] == offsets[idx] or xflat[offsets[idx + 1] - 1] != _xend[idx]) else True)
+                nfo['atol'], nfo['rtol'] = atol, rtol
+                if diagnostics:
+                    nfo['diagnostics'] = diag[idx].decode('utf-8', 'replace')
+                info.append(nfo)
+            if ragged:
+                return xflat, yflat, offsets, info
+            return ([xflat[offsets[idx]:offsets[idx + 1]] for idx in range(nsys)],
+                    [yflat[offsets[idx]:offsets[idx + 1]] for idx in range(nsys)], info)
+        for idx in range(nsys):
+            sinks.push_back(_new_sink(sink[idx], ny))
+        sinks_ptr = &sinks[0]
+        try:
+            with nogil:
+                multi_adaptive[OdeSysBase_t](
+                    systems, atol, rtol, styp, &y0[0, 0], &_x0[0], &_xend[0], nsteps, &_dx0[0], &_dx_max[0],
+                    autorestart, return_on_error, cost_ptr, NULL, max_jac_age, sinks_ptr, chunk_size,
+                    pol, diag_ptr)
+        except RuntimeError:
+            _raise_kept_error(systems)
+            _raise_sink_error(sinks_ptr, sinks.size())
+            raise
+        xout, yout, info = [], [], []
+        for idx in range(nsys):
+            x, y = _sink_result(sink[idx])
+            xout.append(x)
+            yout.append(y)
+            nfo = get_last_info(systems[idx], False if return_on_error and sinks[idx].x_last != _xend[idx]
+                                else True)
+            nfo['atol'], nfo['rtol'] = atol, rtol
+            if diagnostics:
+                nfo['diagnostics'] = diag[idx].decode('utf-8', 'replace')
+            info.append(nfo)
+        return xout, yout, info
+    finally:
+        for i in range(sinks.size()):
+            del sinks[i]
+        for i in range(systems.size()):
+            del systems[i]
+
+
+def predefined_multi(rhs, jac, cnp.ndarray[cnp.float64_t, ndim=2] y0, xout,
+                     double atol, double rtol, dx0=.0, dx_max=.0, str method='rosenbrock4', int nsteps=500,
+                     int autorestart=0, bool return_on_error=False, dx0cb=None, dx_max_cb=None,
+                     bool single_pass=False, int mlower=-1, int mupper=-1, int nnz=-1, bint autonomous_exprs=False,
+                     int max_jac_age=10, user_data=None, cost=None, bint diagnostics=False):
+    cdef:
+        int nsys = y0.shape[0], ny = y0.shape[1]
+        cnp.ndarray[cnp.float64_t, ndim=2] _xout = np.ascontiguousarray(np.broadcast_to(
+            xout, (nsys, np.shape(xout)[-1])), dtype=np.float64)
+        int nout = _xout.shape[1]
+        cnp.ndarray[cnp.float64_t, ndim=3] yout = np.empty((nsys, nout, ny))
+        cnp.ndarray[cnp.float64_t, ndim=1] _dx0, _dx_max, _cost
+        const double * cost_ptr = NULL
+        StepType styp = styp_from_name(method.lower().encode('UTF-8'))
+        vector[OdeSysBase_t *] systems
+        vector[int] nreached
+        vector[string] diag
+        vector[string] * diag_ptr = &diag if diagnostics else NULL
+        size_t i
+    rhs, jac, dx0cb, dx_max_cb, user_data, _dx0, _dx_max, _cost = _multi_args(
+        rhs, jac, y0, method, dx0, dx_max, dx0cb, dx_max_cb, user_data, cost)
+    if _cost is not None:
+        cost_ptr = &_cost[0]
+    y0 = np.ascontiguousarray(y0)
+    systems = _new_systems(nsys, ny, rhs, jac, dx0cb, dx_max_cb, user_data, mlower, mupper, nnz, autonomous_exprs)
+    try:
+        try:
+            with nogil:
+                nreached = multi_predefined[OdeSysBase_t](
+                    systems, atol, rtol, styp, &y0[0, 0], nout, &_xout[0, 0], &yout[0, 0, 0], nsteps,
+                    &_dx0[0], &_dx_max[0], autorestart, return_on_error, single_pass, cost_ptr, NULL, max_jac_age,
+                    diag_ptr)
+        except RuntimeError:
+            _raise_kept_error(systems)
+            raise
+        info = []
+        for idx in range(nsys):
+            nfo = get_last_info(systems[idx], success=False if return_on_error and nreached[idx] < nout else True)
+            nfo['nreached'] = nreached[idx]
+            nfo['atol'], nfo['rtol'] = atol, rtol
+            if diagnostics:
+                nfo['diagnostics'] = diag[idx].decode('utf-8', 'replace')
+            info.append(nfo)
+        return yout, info
+    finally:
+        for i in range(systems.size()):
+            del systems[i]
+
+
+def _ensemble_args(cnp.ndarray[cnp.float64_t, ndim=2] y0, jac, method, dx0, dx_max):
+    nsys = y0.shape[0]
+    if nsys == 0:
+        raise ValueError("y0 needs to contain at least one system")
+    if method not in ('dopri5', 'rosenbrock4'):
+        raise ValueError("Ensembles support 'dopri5' and 'rosenbrock4', got: %s" % method)
+    if method in requires_jac and jac is None:
+        raise ValueError("Method requires explicit jacobian callback")
+    if np.isnan(y0).any():
+        raise ValueError("NaN found in y0")
+    return (np.ascontiguousarray(np.broadcast_to(dx0, (nsys,)), dtype=np.float64),
+            np.ascontiguousarray(np.broadcast_to(dx_max, (nsys,)), dtype=np.float64))
+
+
+cdef vector[ensemble_member *] _new_members(int nsys, int ny):
+    cdef vector[ensemble_member *] systems
+    for idx in range(nsys):
+        systems.push_back(new ensemble_member(ny))
+    return systems
+
+
+def adaptive_ensemble(rhs, jac, cnp.ndarray[cnp.float64_t, ndim=2] y0, x0, xend, double atol, double rtol,
+                      dx0=.0, dx_max=.0, str method='dopri5', int nsteps=500, bool return_on_error=False,
+                      int batch_size=0):
+    cdef:
+        int nsys = y0.shape[0], ny = y0.shape[1]
+        cnp.ndarray[cnp.float64_t, ndim=1] _x0 = np.ascontiguousarray(np.broadcast_to(x0, (nsys,)), dtype=np.float64)
+        cnp.ndarray[cnp.float64_t, ndim=1] _xend = np.ascontiguousarray(
+            np.broadcast_to(xend, (nsys,)), dtype=np.float64)
+        cnp.ndarray[cnp.float64_t, ndim=1] _dx0, _dx_max
+        StepType styp
+        PyEnsembleBatch * batch
+        vector[ensemble_member *] systems
+        vector[pair[vector[double], vector[double]]] result
+        size_t i
+    _dx0, _dx_max = _ensemble_args(y0, jac, method, dx0, dx_max)
+    styp = styp_from_name(method.encode('UTF-8'))
+    y0 = np.ascontiguousarray(y0)
+    batch = new PyEnsembleBatch(ny, <PyObject *>rhs, <PyObject *>jac)
+    systems = _new_members(nsys, ny)
+    try:
+        with nogil:
+            result = ensemble_adaptive[ensemble_member](
+                systems, atol, rtol, &y0[0, 0], &_x0[0], &_xend[0], nsteps, &_dx0[0], &_dx_max[0],
+                return_on_error, styp, <ensemble_batch *>batch, batch_size)
+        xout, yout, info = [], [], []
+        for idx in range(nsys):
+            xout.append(_as_array(result[idx].first))
+            yout.append(_as_array(result[idx].second).reshape(xout[idx].size, ny))
+            nfo = get_last_info(<OdeSysBase_t *>systems[idx],
+                                False if return_on_error and xout[idx][-1] != _xend[idx] else True)
+            nfo['atol'], nfo['rtol'] = atol, rtol
+            info.append(nfo)
+        return xout, yout, info
+    finally:
+        for i in range(systems.size()):
+            del systems[i]
+        del batch
+
+
+def predefined_ensemble(rhs, jac, cnp.ndarray[cnp.float64_t, ndim=2] y0, xout, double atol, double rtol,
+                        dx0=.0, dx_max=.0, str method='dopri5', int nsteps=500, bool return_on_error=False,
+                        int batch_size=0):
+    cdef:
+        int nsys = y0.shape[0], ny = y0.shape[1]
+        cnp.ndarray[cnp.float64_t, ndim=2] _xout = np.ascontiguousarray(np.broadcast_to(
+            xout, (nsys, np.shape(xout)[-1])), dtype=np.float64)
+        int nout = _xout.shape[1]
+        cnp.ndarray[cnp.float64_t, ndim=3] yout = np.empty((nsys, nout, ny))
+        cnp.ndarray[cnp.float64_t, ndim=1] _dx0, _dx_max
+        StepType styp
+        PyEnsembleBatch * batch
+        vector[ensemble_member *] systems
+        vector[int] nreached
+        size_t i
+    _dx0, _dx_max = _ensemble_args(y0, jac, method, dx0, dx_max)
+    styp = styp_from_name(method.encode('UTF-8'))
+    y0 = np.ascontiguousarray(y0)
+    batch = new PyEnsembleBatch(ny, <PyObject *>rhs, <PyObject *>jac)
+    systems = _new_members(nsys, ny)
+    try:
+        with nogil:
+            nreached = ensemble_predefined[ensemble_member](
+                systems, atol, rtol, &y0[0, 0], nout, &_xout[0, 0], &yout[0, 0, 0], nsteps, &_dx0[0],
+                &_dx_max[0], return_on_error, styp, <ensemble_batch *>batch, batch_size)
+        info = []
+        for idx in range(nsys):
+            nfo = get_last_info(<OdeSysBase_t *>systems[idx],
+                                success=False if return_on_error and nreached[idx] < nout else True)
+            nfo['nreached'] = nreached[idx]
+            nfo['atol'], nfo['rtol'] = atol, rtol
+            info.append(nfo)
+        return yout, info
+    finally:
+        for i in range(systems.size()):
+            del systems[i]
+        del batch
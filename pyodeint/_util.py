@@ -2,6 +2,7 @@
 
 from __future__ import division
 
+import ctypes
 import inspect
 
 import numpy as np
@@ -69,8 +70,8 @@ def _ensure_5args(func):
     callable which possibly ignores 0 or 1 positional arguments
 
     """
-    if func is None:
-        return None
+    if func is None or _native_address(func) is not None:
+        return func
 
     self_arg = 1 if inspect.ismethod(func) else 0
     if hasattr(inspect, 'getfullargspec'):
@@ -83,3 +84,79 @@ def _ensure_5args(func):
         return lambda t, y, J, dfdt, fy=None: func(t, y, J, dfdt)
     else:
         raise ValueError("Incorrect numer of arguments")
+
+
+def _ensure_idx_arg(func, nargs):
+    """ Conditionally wrap a vectorized (ensemble) callback to accept the indices
+
+    Parameters
+    ----------
+    func: callable
+        with ``nargs`` positional arguments (the last being the indices of the systems)
+        or ``nargs - 1`` (no indices)
+    nargs: int
+
+    Returns
+    -------
+    callable which possibly ignores its last positional argument
+
+    """
+    if func is None:
+        return func
+    self_arg = 1 if inspect.ismethod(func) else 0
+    args = inspect.getfullargspec(func)[0]
+    if len(args) == nargs + self_arg:
+        return func
+    elif len(args) == nargs - 1 + self_arg:
+        return lambda *args: func(*args[:-1])
+    else:
+        raise ValueError("Incorrect numer of arguments")
+
+
+def _native_address(cb):
+    """ Address of a C function (or None for Python callables)
+
+    Accepts an int, a ctypes function pointer (e.g. from ``ctypes.CFUNCTYPE`` or a
+    loaded library) or an object with an integer ``address`` attribute (e.g. ``numba.cfunc``).
+    For cffi pass ``int(ffi.cast('uintptr_t', fptr))``.
+    """
+    if isinstance(cb, bool):
+        return None
+    if isinstance(cb, int):
+        return cb
+    if isinstance(cb, ctypes._CFuncPtr):
+        return ctypes.cast(cb, ctypes.c_void_p).value
+    address = getattr(cb, 'address', None)
+    if isinstance(address, int):
+        return address
+    return None
+
+
+def _user_data_address(user_data):
+    if user_data is None:
+        return 0
+    if isinstance(user_data, int):
+        return user_data
+    if isinstance(user_data, np.ndarray):
+        return user_data.ctypes.data
+    if isinstance(user_data, (ctypes._Pointer, ctypes.c_void_p)):
+        return ctypes.cast(user_data, ctypes.c_void_p).value or 0
+    if isinstance(user_data, ctypes._SimpleCData) or isinstance(user_data, (ctypes.Array, ctypes.Structure)):
+        return ctypes.addressof(user_data)
+    raise TypeError("Unsupported type of user_data: %s" % type(user_data))
+
+
+def _native_callbacks(rhs, jac, dx0cb, dx_max_cb, user_data):
+    """ Addresses of (rhs, jac, dx0cb, dx_max_cb, user_data), or None if rhs is a Python callable """
+    rhs_addr = _native_address(rhs)
+    if rhs_addr is None:
+        if user_data is not None:
+            raise ValueError("user_data is only passed to native callbacks")
+        return None
+    addresses = [rhs_addr]
+    for cb in (jac, dx0cb, dx_max_cb):
+        addr = 0 if cb is None else _native_address(cb)
+        if addr is None:
+            raise ValueError("Cannot mix native (C) and Python callbacks")
+        addresses.append(addr)
+    return tuple(addresses) + (_user_data_address(user_data),)
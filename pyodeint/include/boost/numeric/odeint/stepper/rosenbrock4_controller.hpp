@@ -19,8 +19,11 @@
 #ifndef BOOST_NUMERIC_ODEINT_STEPPER_ROSENBROCK4_CONTROLLER_HPP_INCLUDED
 #define BOOST_NUMERIC_ODEINT_STEPPER_ROSENBROCK4_CONTROLLER_HPP_INCLUDED
 
+#include <utility>
+
 #include <boost/config.hpp>
 #include <boost/numeric/odeint/util/bind.hpp>
+#include <boost/numeric/odeint/util/unwrap_reference.hpp>
 
 #include <boost/numeric/odeint/stepper/controlled_step_result.hpp>
 #include <boost/numeric/odeint/stepper/stepper_categories.hpp>
@@ -31,6 +34,8 @@
 
 #include <boost/numeric/odeint/stepper/rosenbrock4.hpp>
 
+#include <odeint_anyode_trace.hpp>
+
 namespace boost {
 namespace numeric {
 namespace odeint {
@@ -51,6 +56,7 @@ public:
     typedef typename stepper_type::deriv_type deriv_type;
     typedef typename stepper_type::wrapped_deriv_type wrapped_deriv_type;
     typedef typename stepper_type::resizer_type resizer_type;
+    typedef typename stepper_type::matrix_type matrix_type;
     typedef controlled_stepper_tag stepper_category;
 
     typedef rosenbrock4_controller< Stepper > controller_type;
@@ -61,16 +67,38 @@ public:
         : m_stepper( stepper ) , m_atol( atol ) , m_rtol( rtol ) ,
           m_max_dt( static_cast<time_type>(0) ) ,
           m_first_step( true ) , m_err_old( 0.0 ) , m_dt_old( 0.0 ) ,
-          m_last_rejected( false )
+          m_last_rejected( false ) , m_jac_cached( false ) , m_jac_t() , m_jac_cache_hits( 0 ) , m_trace( 0 )
     { }
 
     rosenbrock4_controller( value_type atol, value_type rtol, time_type max_dt,
                             const stepper_type &stepper = stepper_type() )
             : m_stepper( stepper ) , m_atol( atol ) , m_rtol( rtol ) , m_max_dt( max_dt ) ,
               m_first_step( true ) , m_err_old( 0.0 ) , m_dt_old( 0.0 ) ,
-              m_last_rejected( false )
+              m_last_rejected( false ) , m_jac_cached( false ) , m_jac_t() , m_jac_cache_hits( 0 ) , m_trace( 0 )
     { }
 
+    /*
+     * A rejected step is retried from the same (x, t): the Jacobian and dfdt of the previous
+     * evaluation are then reused and only the iteration matrix is assembled and factorized anew.
+     * If a counter is given, it is incremented for every Jacobian evaluation saved this way.
+     */
+    void count_jacobian_cache_hits( long int *counter )
+    {
+        m_jac_cache_hits = counter;
+    }
+
+    /*
+     * Records every attempted step (accepted or rejected) in the given trace. Both rosenbrock4
+     * steppers factorize once and solve six times per step, the time of a step not spent in
+     * the callbacks (rhs & Jacobian, timed by the caller) is attributed to the linear algebra.
+     */
+    void trace( odeint_anyode::step_trace *tr )
+    {
+        m_trace = tr;
+        if( m_trace )
+            m_trace->rejections_known = true;
+    }
+
     value_type error( const state_type &x , const state_type &xold , const state_type &xerr )
     {
         BOOST_USING_STD_MAX();
@@ -129,8 +157,30 @@ public:
 
         m_xerr_resizer.adjust_size( x , detail::bind( &controller_type::template resize_m_xerr< state_type > , detail::ref( *this ) , detail::_1 ) );
 
-        m_stepper.do_step( sys , x , t , xout , dt , m_xerr.m_v );
+        typedef typename odeint::unwrap_reference< System >::type system_type;
+        typedef typename odeint::unwrap_reference< typename system_type::first_type >::type deriv_func_type;
+        typedef typename odeint::unwrap_reference< typename system_type::second_type >::type jacobi_func_type;
+        system_type &system = sys;
+        deriv_func_type &deriv_func = system.first;
+        jacobi_func_type &jacobi_func = system.second;
+        cached_jacobi< jacobi_func_type > jacobi = { *this , jacobi_func };
+        odeint_anyode::step_trace::clock::time_point t_step;
+        double t_callbacks = 0.0;
+        if( m_trace )
+        {
+            t_step = odeint_anyode::step_trace::clock::now();
+            t_callbacks = m_trace->time_rhs + m_trace->time_jac;
+        }
+        m_stepper.do_step( std::make_pair( detail::ref( deriv_func ) , jacobi ) , x , t , xout , dt , m_xerr.m_v );
         value_type err = error( xout , x , m_xerr.m_v );
+        if( m_trace )
+        {
+            m_trace->n_factorizations += 1;
+            m_trace->n_solves += 6;
+            m_trace->time_linalg += odeint_anyode::step_trace::seconds_since( t_step ) -
+                ( m_trace->time_rhs + m_trace->time_jac - t_callbacks );
+            m_trace->step( t , dt , err , err <= 1.0 );
+        }
 
         value_type fac = max BOOST_PREVENT_MACRO_SUBSTITUTION (
             fac2 , min BOOST_PREVENT_MACRO_SUBSTITUTION (
@@ -202,6 +252,47 @@ public:
 
 private:
 
+    template< class JacobiFunc >
+    struct cached_jacobi
+    {
+        controller_type &m_controller;
+        JacobiFunc &m_jacobi;
+
+        void operator()( const state_type &x , matrix_type &jac , const time_type &t , deriv_type &dfdt )
+        {
+            m_controller.jacobian( m_jacobi , x , jac , t , dfdt );
+        }
+    };
+
+    template< class JacobiFunc >
+    void jacobian( JacobiFunc &jacobi , const state_type &x , matrix_type &jac , time_type t , deriv_type &dfdt )
+    {
+        if( m_jac_cached && t == m_jac_t && same_state( x , m_jac_x.m_v ) )
+        {
+            jac = m_jac.m_v;
+            dfdt = m_dfdt.m_v;
+            if( m_jac_cache_hits )
+                ++( *m_jac_cache_hits );
+            return;
+        }
+        jacobi( x , jac , t , dfdt );
+        m_jac.m_v = jac;
+        m_jac_x.m_v = x;
+        m_dfdt.m_v = dfdt;
+        m_jac_t = t;
+        m_jac_cached = true;
+    }
+
+    static bool same_state( const state_type &a , const state_type &b )
+    {
+        if( a.size() != b.size() )
+            return false;
+        for( size_t i=0 ; i<a.size() ; ++i )
+            if( !( a[i] == b[i] ) )
+                return false;
+        return true;
+    }
+
     template< class StateIn >
     bool resize_m_xerr( const StateIn &x )
     {
@@ -225,6 +316,13 @@ private:
     bool m_first_step;
     value_type m_err_old , m_dt_old;
     bool m_last_rejected;
+    bool m_jac_cached;
+    time_type m_jac_t;
+    wrapped_state_type m_jac_x;
+    wrapped_deriv_type m_dfdt;
+    state_wrapper< matrix_type > m_jac;
+    long int *m_jac_cache_hits;
+    odeint_anyode::step_trace *m_trace;
 };
 
 
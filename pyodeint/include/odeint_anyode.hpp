@@ -1,12 +1,18 @@
 #ifndef ODEINT_ANYODE_H_6D2AAAD4880011E6AC5C734FA77443A3
 #define ODEINT_ANYODE_H_6D2AAAD4880011E6AC5C734FA77443A3
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <limits>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <chrono>
 #include <iostream>
 #include <sstream>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <boost/numeric/ublas/matrix.hpp>
@@ -14,6 +20,14 @@
 
 #include <anyode/anyode.hpp>
 
+#include "odeint_anyode_buffer_vector.hpp"
+#include "odeint_anyode_dense.hpp"
+#include "odeint_anyode_explicit.hpp"
+#include "odeint_anyode_rosenbrock4.hpp"
+#include "odeint_anyode_rosenbrock_w.hpp"
+#include "odeint_anyode_sink.hpp"
+#include "odeint_anyode_trace.hpp"
+
 
 #if !defined(PYODEINT_NO_BOOST_CHECK)
   #if BOOST_VERSION / 100000 == 1
@@ -57,20 +71,28 @@ namespace {
 namespace odeint_anyode{
     using namespace std::placeholders;
 
-    using boost::numeric::odeint::integrate_adaptive;
     using boost::numeric::odeint::make_dense_output;
     using boost::numeric::odeint::rosenbrock4;
     using boost::numeric::odeint::runge_kutta_dopri5;
+    using boost::numeric::odeint::runge_kutta_cash_karp54;
+    using boost::numeric::odeint::runge_kutta_fehlberg78;
     using boost::numeric::odeint::bulirsch_stoer_dense_out;
 
     // value_type is hardcoded to double at the moment
     using value_type = double;
     using vector_type = boost::numeric::ublas::vector<value_type>;
     using matrix_type = boost::numeric::ublas::matrix<value_type>;
+    using buffer_type = buffer_vector<value_type>;
 
     // using OdeSys_t = AnyODE::OdeSysBase;
 
-    enum class StepType : int { bulirsch_stoer, rosenbrock4, dopri5 };
+    enum class StepType : int { bulirsch_stoer, rosenbrock4, dopri5, rosenbrock4_banded, rosenbrock4_sparse, ros34pw2,
+                                fehlberg78, cash_karp54, verner65 };
+
+    // Outcome of an integration (info["status"]). With return_on_error an integration which stops early
+    // reports it here: reaching mxsteps involves no exception at all, failures of a step (exceptions thrown
+    // by the stepper or the callbacks) are caught.
+    enum class IntegrStatus : int { success = 0, mxsteps_reached = 1, step_failed = 2 };
 
     StepType styp_from_name(std::string name){
         if (name == "bulirsch_stoer")
@@ -79,17 +101,100 @@ namespace odeint_anyode{
             return StepType::rosenbrock4;
         else if (name == "dopri5")
             return StepType::dopri5;
+        else if (name == "rosenbrock4_banded")
+            return StepType::rosenbrock4_banded;
+        else if (name == "rosenbrock4_sparse")
+            return StepType::rosenbrock4_sparse;
+        else if (name == "ros34pw2")
+            return StepType::ros34pw2;
+        else if (name == "fehlberg78")
+            return StepType::fehlberg78;
+        else if (name == "cash_karp54")
+            return StepType::cash_karp54;
+        else if (name == "verner65")
+            return StepType::verner65;
         else
             throw std::runtime_error(StreamFmt() << "Unknown stepper type name: " << name);
     }
 
     bool requires_jacobian(StepType styp){
-        if (styp == StepType::rosenbrock4)
+        if (styp == StepType::rosenbrock4 || styp == StepType::rosenbrock4_banded ||
+            styp == StepType::rosenbrock4_sparse || styp == StepType::ros34pw2)
             return true;
         else
             return false;
     }
 
+    // fehlberg78, cash_karp54 & verner65 have no interpolant (no single_pass, Stepping or simple_dense).
+    bool has_dense_output(StepType styp){
+        if (styp == StepType::fehlberg78 || styp == StepType::cash_karp54 || styp == StepType::verner65)
+            return false;
+        else
+            return true;
+    }
+
+    // Order of the local error estimate of a step (used by estimate_dx0).
+    int step_order(StepType styp){
+        if (styp == StepType::dopri5 || styp == StepType::bulirsch_stoer || styp == StepType::cash_karp54)
+            return 5;
+        else if (styp == StepType::fehlberg78)
+            return 8;
+        else if (styp == StepType::verner65)
+            return 6;
+        else if (styp == StepType::ros34pw2)
+            return 3;
+        else
+            return 4;
+    }
+
+    // Initial step size (Hairer, Norsett & Wanner, Solving ODEs I, II.4) from the norms (scaled by the tolerances)
+    // of y0, f(x0, y0) and the change of f over an explicit Euler step: two calls of rhs (counted in nfev).
+    // The sign follows xend - x0, the size is limited by |xend - x0| and dx_max. Falls back to 100*eps (relative
+    // to x0) if rhs fails.
+    template <class OdeSys>
+    double estimate_dx0(OdeSys * const odesys, const double x0, const double xend, const double * const y0,
+                        const double atol, const double rtol, const int order, const double dx_max=INFINITY){
+        const int ny = odesys->get_ny();
+        const double fallback = std::numeric_limits<double>::epsilon() * 100 * ((x0 == 0) ? 1 : std::abs(x0));
+        const double dir = (xend < x0) ? -1 : 1;
+        std::vector<double> work(3*ny);
+        double * const f0 = &work[0], * const y1 = &work[ny], * const f1 = &work[2*ny];
+        if (odesys->rhs(x0, y0, f0) != AnyODE::Status::success)
+            return dir*fallback;
+        auto norm = [&](const double * v, const double * w){  // rms of (v - w)/(atol + rtol*|y0|)
+            double sum = 0;
+            for (int i=0; i<ny; ++i){
+                const double d = (v[i] - (w ? w[i] : 0))/(atol + rtol*std::abs(y0[i]));
+                sum += d*d;
+            }
+            return std::sqrt(sum/ny);
+        };
+        const double d0 = norm(y0, nullptr), d1 = norm(f0, nullptr);
+        double h0 = (d0 < 1e-5 || d1 < 1e-5) ? 1e-6 : 0.01*d0/d1;
+        const double span = std::abs(xend - x0), h_max = std::min(dx_max, (span > 0) ? span : INFINITY);
+        h0 = std::min(h0, h_max);
+        for (int i=0; i<ny; ++i)
+            y1[i] = y0[i] + dir*h0*f0[i];
+        if (odesys->rhs(x0 + dir*h0, y1, f1) != AnyODE::Status::success)
+            return dir*std::min(fallback, h_max);
+        const double d2 = norm(f1, f0)/h0;
+        const double d_max = std::max(d1, d2);
+        const double h1 = (d_max <= 1e-15) ? std::max(1e-6, h0*1e-3) : std::pow(0.01/d_max, 1.0/(order + 1));
+        const double h = std::min(std::min(100*h0, h1), h_max);
+        return dir*(std::isfinite(h) && h > 0 ? h : fallback);
+    }
+
+    // dx0 unless 0, then odesys->get_dx0, then estimate_dx0 (towards xend).
+    template <class OdeSys>
+    double resolve_dx0(OdeSys * const odesys, double dx0, const double x0, const double xend, const double * const y0,
+                       const double atol, const double rtol, const StepType styp, const double dx_max=INFINITY){
+        if (dx0 == 0.0)
+            dx0 = odesys->get_dx0(x0, y0);
+        if (dx0 == 0.0)
+            dx0 = estimate_dx0(odesys, x0, xend, y0, atol, rtol, step_order(styp), dx_max);
+        return dx0;
+    }
+
     vector_type vec_from_ptr(const value_type * const arr, std::size_t len){
         vector_type vec(len);
         for (std::size_t i=0; i<len; ++i)
@@ -97,12 +202,161 @@ namespace odeint_anyode{
         return vec;
     }
 
+    // Let the state continue in the caller memory ``out`` (if the state type supports it).
+    template<class State>
+    inline void bind_output(State & /* y */, value_type * const /* out */, bool /* keep_values */) {}
+    inline void bind_output(buffer_type &y, value_type * const out, bool keep_values){
+        if (keep_values)
+            std::copy(y.begin(), y.end(), out);
+        y.rebind(out);
+    }
+
+    template<class State>
+    inline void store_output(const State &y, value_type * const out){
+        std::copy(y.begin(), y.end(), out);
+    }
+    inline void store_output(const buffer_type &y, value_type * const out){
+        if (y.data() != out)
+            std::copy(y.begin(), y.end(), out);
+    }
+
+    // States initialized from caller memory, ``view`` refers to that memory if the state type supports it.
+    template<class State>
+    struct state_init {  // fixed size (std::array)
+        static State copy(const value_type * const y, std::size_t /* n */){
+            State s;
+            std::copy(y, y + s.size(), s.begin());
+            return s;
+        }
+        static State view(value_type * const y, std::size_t n){ return copy(y, n); }
+    };
+    template<>
+    struct state_init<vector_type> {
+        static vector_type copy(const value_type * const y, std::size_t n){ return vec_from_ptr(y, n); }
+        static vector_type view(value_type * const y, std::size_t n){ return vec_from_ptr(y, n); }
+    };
+    template<>
+    struct state_init<buffer_type> {
+        static buffer_type copy(const value_type * const y, std::size_t n){
+            buffer_type s(n);
+            std::copy(y, y + n, s.begin());
+            return s;
+        }
+        static buffer_type view(value_type * const y, std::size_t n){ return buffer_type(y, n); }
+    };
 
-    // Integr will be specialzed for: rosenbrock, dopri5 and bulrisch-stoer
-    // adaptive and predefined cannot be put here since make_dense_output
-    // is a function and bulirsch_stoer_dense_out is a class
+    // A system may declare its size at compile time: ``static constexpr int fixed_ny = 5;``
+    template<class OdeSys, class Enable=void>
+    struct system_fixed_ny : std::integral_constant<std::size_t, 0> {};
     template<class OdeSys>
+    struct system_fixed_ny<OdeSys, typename std::enable_if<(OdeSys::fixed_ny > 0)>::type> :
+        std::integral_constant<std::size_t, OdeSys::fixed_ny> {};
+
+    // State and stepper types used by Integr for a system of size N (known at compile time),
+    // everything is of fixed size: no allocations in the step loop and loops of known length.
+    template<std::size_t N>
+    struct integr_types {
+        typedef std::array<value_type, N> state_type;
+        typedef std::array<value_type, N> rosenbrock4_state_type;
+        typedef typename dense_lu_fixed<value_type, N>::matrix_type jacobian_type;
+        typedef dense_lu_fixed<value_type, N> dense_solver_type;
+        typedef rosenbrock4_dense_output_t<dense_lu_fixed<value_type, N> > rosenbrock4_type;
+        static rosenbrock4_type make_rosenbrock4(value_type atol, value_type rtol, value_type dx_max,
+                                                 long int *jac_cache_hits, step_trace *trace=nullptr){
+            return make_rosenbrock4_dense_output<dense_lu_fixed<value_type, N> >(
+                atol, rtol, dx_max, dense_lu_fixed<value_type, N>(), jac_cache_hits, trace);
+        }
+    };
+
+    // N == 0: size only known at run-time
+    template<>
+    struct integr_types<0> {
+        typedef buffer_type state_type;
+        typedef vector_type rosenbrock4_state_type;  // odeint's rosenbrock4 requires ublas types
+        typedef matrix_type jacobian_type;
+        typedef dense_lu<value_type, buffer_type> dense_solver_type;
+        typedef rosenbrock4<value_type, rosenbrock4_coefficients<value_type> > rosenbrock4_stepper_type;
+        typedef boost::numeric::odeint::rosenbrock4_controller<rosenbrock4_stepper_type> rosenbrock4_controller_type;
+        typedef boost::numeric::odeint::rosenbrock4_dense_output<rosenbrock4_controller_type> rosenbrock4_type;
+        static rosenbrock4_type make_rosenbrock4(value_type atol, value_type rtol, value_type dx_max,
+                                                 long int *jac_cache_hits, step_trace *trace=nullptr){
+            rosenbrock4_controller_type controller(atol, rtol, dx_max);
+            controller.count_jacobian_cache_hits(jac_cache_hits);
+            controller.trace(trace);
+            return rosenbrock4_type(controller);
+        }
+    };
+
+
+    // Dense output stepper together with its system and state (type erased), kept between calls by Stepping.
+    struct dense_stepper_base {
+        virtual ~dense_stepper_base() {}
+        virtual void initialize(const value_type * const y, value_type x, value_type dx) = 0;
+        virtual void do_step() = 0;
+        virtual void calc_state(value_type x, value_type * const y) = 0;  // x within the last step
+        virtual void current_state(value_type * const y) const = 0;
+        virtual value_type current_time() const = 0;
+        virtual value_type previous_time() const = 0;
+        virtual value_type current_time_step() const = 0;
+    };
+
+    template<class Stepper, class System, class State>
+    struct dense_stepper_impl : public dense_stepper_base {
+        Stepper m_stepper;
+        System m_sys;
+        State m_y;
+
+        dense_stepper_impl(Stepper stepper, System sys, State y) :
+            m_stepper(std::move(stepper)), m_sys(std::move(sys)), m_y(std::move(y)) {}
+
+        void initialize(const value_type * const y, value_type x, value_type dx) override {
+            std::copy(y, y + m_y.size(), m_y.begin());
+            m_stepper.initialize(m_y, x, dx);
+        }
+        void do_step() override { m_stepper.do_step(m_sys); }
+        void calc_state(value_type x, value_type * const y) override {
+            m_stepper.calc_state(x, m_y);
+            std::copy(m_y.begin(), m_y.end(), y);
+        }
+        void current_state(value_type * const y) const override {
+            const auto &s = m_stepper.current_state();
+            std::copy(s.begin(), s.end(), y);
+        }
+        value_type current_time() const override { return m_stepper.current_time(); }
+        value_type previous_time() const override { return m_stepper.previous_time(); }
+        value_type current_time_step() const override { return m_stepper.current_time_step(); }
+    };
+
+    template<class Stepper, class System, class State>
+    std::unique_ptr<dense_stepper_base> make_dense_stepper(Stepper stepper, System sys, State y){
+        return std::unique_ptr<dense_stepper_base>(
+            new dense_stepper_impl<Stepper, System, State>(std::move(stepper), std::move(sys), std::move(y)));
+    }
+
+    // Which of the accepted steps Integr::adaptive stores (step control is not affected): every stride-th step,
+    // of those only steps which advanced x by at least dx or changed a component by more than dy_rel (relative to
+    // the last stored step) when either is > 0, or only the final state (final_only). The first and the last step
+    // are always stored.
+    struct output_policy {
+        long int stride = 1;
+        value_type dx = 0;
+        value_type dy_rel = 0;
+        bool final_only = false;
+    };
+
+    // Integrates an OdeSys with the stepper chosen at run-time (m_styp). N is the system size when OdeSys
+    // declares fixed_ny (std::array states, fixed size Jacobian & LU, see integr_types<N>), 0 otherwise
+    // (buffer_vector & ublas states sized by get_ny()); the steppers are built per call by the
+    // adaptive_*/predefined_* members as their types depend on the state type.
+    template<class OdeSys, std::size_t N=system_fixed_ny<OdeSys>::value>
     struct Integr {
+        typedef typename integr_types<N>::state_type state_type;
+        typedef typename integr_types<N>::rosenbrock4_state_type rosenbrock4_state_type;
+        typedef typename integr_types<N>::jacobian_type jacobian_type;
+        typedef banded_lu<value_type, state_type> banded_solver_type;
+        typedef sparse_lu<value_type, state_type> sparse_solver_type;
+        typedef typename integr_types<N>::dense_solver_type dense_solver_type;
+
         OdeSys * m_odesys;
         double m_time_cpu = -1.0, m_time_wall = -1.0;
         value_type m_dx0, m_dx_max, m_atol, m_rtol;
@@ -110,15 +364,37 @@ namespace odeint_anyode{
         long int m_mxsteps;
         int m_autorestart;
         long int m_nsteps;
+        long int m_njev_cached = 0;  // rosenbrock4*: Jacobian evaluations saved on rejected steps
         bool m_return_on_error;
+        bool m_single_pass;
+        bool m_keep_symbolic = false;  // rosenbrock4_sparse: reuse the symbolic analysis in later calls
+        std::shared_ptr<typename sparse_solver_type::symbolic_type> m_sparse_symbolic;  // rosenbrock4_sparse
+        rosenbrock_w_policy m_w_policy;  // ros34pw2
+        rosenbrock_w_stats m_w_stats;
+        std::vector<value_type> m_restarts;  // x of every autorestart
+        output_policy m_output;  // adaptive
+        trajectory_sink * m_sink = nullptr;  // adaptive: hand the steps over in chunks (nothing is returned)
+        long int m_sink_rows = 0;  // rows per chunk (0: about 1 MiB)
+        IntegrStatus m_status = IntegrStatus::success;
+        std::string * m_diagnostics = nullptr;  // messages (failures, autorestarts) appended here instead of std::cerr
+        step_trace * m_trace = nullptr;  // opt-in instrumentation (counts, timings & step history)
 
         void rhs(const vector_type &yarr, vector_type &dydx, value_type xval);
         void jac(const vector_type & yarr, matrix_type &Jmat,
                  const value_type & xval, vector_type &dfdx);
+        // dx0 = 0: resolved (see resolve_dx0) by adaptive & predefined, where a failure of rhs at x0 is handled
+        // as that of a step (return_on_error).
         Integr(OdeSys * odesys, value_type dx0, value_type dx_max, value_type atol, value_type rtol, StepType styp,
-               long int mxsteps, int autorestart=0, bool return_on_error=false) :
+               long int mxsteps, int autorestart=0, bool return_on_error=false, bool single_pass=false) :
             m_odesys(odesys), m_dx0(dx0), m_dx_max(dx_max), m_atol(atol), m_rtol(rtol), m_styp(styp),
-            m_mxsteps(mxsteps), m_autorestart(autorestart), m_return_on_error(return_on_error) {}
+            m_mxsteps(mxsteps), m_autorestart(autorestart), m_return_on_error(return_on_error),
+            m_single_pass(single_pass) {
+            if (N > 0 && static_cast<std::size_t>(odesys->get_ny()) != N)
+                throw std::runtime_error(StreamFmt() << "get_ny() (" << odesys->get_ny() << ") does not match fixed_ny ("
+                                         << N << ")");
+            if (single_pass && !has_dense_output(styp))
+                throw std::runtime_error("single_pass requires a stepper with dense output");
+        }
 
         std::pair<std::vector<value_type>, std::vector<value_type> >
         adaptive(const value_type x0,
@@ -126,47 +402,79 @@ namespace odeint_anyode{
                  const value_type * const ANYODE_RESTRICT y0){
             std::time_t cputime0 = std::clock();
             auto t_start = std::chrono::high_resolution_clock::now();
-            std::pair<std::vector<value_type>, std::vector<value_type> > result;
-            try{
-                if ( m_styp == StepType::bulirsch_stoer ) {
-                    this->adaptive_bulirsch_stoer(x0, xend, y0);
-                } else if ( m_styp == StepType::dopri5 ) {
-                    this->adaptive_dopri5(x0, xend, y0);
-                } else if ( m_styp == StepType::rosenbrock4 ) {
-                    this->adaptive_rosenbrock4(x0, xend, y0);
-                } else {
-                    goto impossible_adaptive;
-                }
-            } catch (const std::exception& e) {
-                if (m_autorestart > 0){
-                    std::cerr << e.what() << std::endl;
-                    if (this->m_xout.size() > 0){
-                        std::cerr << "odeint_anyode.hpp:" << __LINE__ << ": Autorestart (" << m_autorestart
-                                  << ") x=" << this->m_xout.back() << "\n";
-                        m_autorestart--;
-                        auto c_nsteps = this->m_nsteps;
-                        auto c_xout = this->m_xout;
-                        auto c_yout = this->m_yout;
-                        adaptive(c_xout.back(), xend, &c_yout[c_yout.size() - m_odesys->get_ny()]);
-                        c_xout.insert(c_xout.end(), m_xout.begin(), m_xout.end());
-                        c_yout.insert(c_yout.end(), m_yout.begin(), m_yout.end());
-                        m_xout = c_xout;
-                        m_yout = c_yout;
-                        m_nsteps += c_nsteps;
+            const int ny = this->m_odesys->get_ny();
+            // Start out with room for a decent number of steps (growth is geometric thereafter).
+            std::size_t nreserve = (this->m_mxsteps > 0 && this->m_mxsteps < 1024) ? this->m_mxsteps + 1 : 1024;
+            if (this->m_sink){
+                this->m_chunk_rows = (this->m_sink_rows > 0) ? this->m_sink_rows :
+                    std::max<long int>(1, (1 << 20)/(sizeof(value_type)*(ny + 1)));
+                nreserve = this->m_chunk_rows + 1;
+            }
+            this->m_xout.reserve(nreserve);
+            this->m_yout.reserve(nreserve*ny);
+            this->reset();
+            this->start(x0);
+            value_type x_start = x0;
+            const value_type * y_start = y0;
+            std::vector<value_type> y_restart;
+            while (true) {
+                try{
+                    if (this->m_dx0 == 0)
+                        this->m_dx0 = resolve_dx0(this->m_odesys, 0.0, x0, xend, y0, m_atol, m_rtol, m_styp, m_dx_max);
+                    if ( m_styp == StepType::bulirsch_stoer ) {
+                        this->adaptive_bulirsch_stoer(x_start, xend, y_start);
+                    } else if ( m_styp == StepType::dopri5 ) {
+                        this->adaptive_dopri5(x_start, xend, y_start);
+                    } else if ( m_styp == StepType::fehlberg78 ) {
+                        this->template adaptive_explicit<runge_kutta_fehlberg78<state_type, value_type> >(
+                            x_start, xend, y_start);
+                    } else if ( m_styp == StepType::cash_karp54 ) {
+                        this->template adaptive_explicit<runge_kutta_cash_karp54<state_type, value_type> >(
+                            x_start, xend, y_start);
+                    } else if ( m_styp == StepType::verner65 ) {
+                        this->template adaptive_explicit<runge_kutta_verner65<state_type, value_type> >(
+                            x_start, xend, y_start);
+                    } else if ( m_styp == StepType::rosenbrock4 ) {
+                        this->adaptive_rosenbrock4(x_start, xend, y_start);
+                    } else if ( m_styp == StepType::rosenbrock4_banded ) {
+                        this->adaptive_rosenbrock4_banded(x_start, xend, y_start);
+                    } else if ( m_styp == StepType::rosenbrock4_sparse ) {
+                        this->adaptive_rosenbrock4_sparse(x_start, xend, y_start);
+                    } else if ( m_styp == StepType::ros34pw2 ) {
+                        this->adaptive_ros34pw2(x_start, xend, y_start);
                     } else {
-                        std::cerr << "odeint_anyode.hpp:" << __LINE__ << ": Autorestart failed." << "\n";
-                        if (!m_return_on_error)
-                            throw;
+                        goto impossible_adaptive;
                     }
-                } else {
-                    if (!m_return_on_error)
+                } catch (const std::exception& e) {
+                    this->m_status = IntegrStatus::step_failed;
+                    this->diagnose(e.what(), m_autorestart > 0);
+                    if (this->restart_adaptive(x_start, y_start, y_restart))
+                        continue;
+                    if (!m_return_on_error){
+                        this->close_sink();
                         throw;
+                    }
+                    break;
                 }
+                if (this->m_status == IntegrStatus::success)
+                    break;
+                // stopped early (mxsteps) without an exception
+                if (this->m_diagnostics || m_autorestart > 0)
+                    this->diagnose(this->status_message());
+                if (this->restart_adaptive(x_start, y_start, y_restart))
+                    continue;
+                if (!m_return_on_error){
+                    this->close_sink();
+                    throw std::runtime_error(this->status_message());
+                }
+                break;
             }
+            this->close_sink();
             this->m_time_cpu = (std::clock() - cputime0) / (double)CLOCKS_PER_SEC;
             this->m_time_wall = std::chrono::duration<double>(
                 std::chrono::high_resolution_clock::now() - t_start).count();
-            return std::make_pair(this->m_xout, this->m_yout);
+            // The trajectory is handed over to the caller, the integrator's buffers are left empty.
+            return std::make_pair(std::move(this->m_xout), std::move(this->m_yout));
         impossible_adaptive:
             throw std::runtime_error("Impossible: unknown StepType!");
         }
@@ -175,42 +483,79 @@ namespace odeint_anyode{
                        const value_type * const ANYODE_RESTRICT xout,
                        const value_type * const ANYODE_RESTRICT y0,
                        value_type * const ANYODE_RESTRICT yout){
-            int nreached;
+            int nreached = 0;
             std::time_t cputime0 = std::clock();
             auto t_start = std::chrono::high_resolution_clock::now();
-            std::copy(y0, y0 + (this->m_odesys->get_ny()), yout);
-            try {
-                if ( m_styp == StepType::bulirsch_stoer ) {
-                    this->predefined_bulirsch_stoer(nx, xout, y0, yout, &nreached);
-                } else if ( m_styp == StepType::dopri5 ) {
-                    this->predefined_dopri5(nx, xout, y0, yout, &nreached);
-                } else if ( m_styp == StepType::rosenbrock4 ) {
-                    this->predefined_rosenbrock4(nx, xout, y0, yout, &nreached);
-                } else {
-                    goto impossible_predefined;
-                }
-            } catch (const std::exception& e) {
-                if (m_autorestart > 0){
-                    std::cerr << e.what() << std::endl;
-                    if (this->m_xout.size() > 0) {
-                        std::cerr << "odeint_anyode.hpp:" << __LINE__ << ": Autorestart (" << m_autorestart
-                                  << ") x=" << this->m_xout.back() << "\n";
-                        m_autorestart--;
-                        auto c_nsteps = this->m_nsteps;
-                        nreached += predefined(nx - nreached, xout + nreached,
-                                               yout + nreached*m_odesys->get_ny(),
-                                               yout + nreached*m_odesys->get_ny());
-                        this->m_nsteps += c_nsteps;
+            const int ny = this->m_odesys->get_ny();
+            std::copy(y0, y0 + ny, yout);
+            this->reset();
+            this->start(xout[0]);
+            int ix0 = 0;  // the current attempt starts from xout[ix0] & yout[ix0*ny]
+            long int nsteps_before = 0;
+            while (true) {
+                int nreached_attempt = 0;
+                const int nx_attempt = nx - ix0;
+                const value_type * const xout_attempt = xout + ix0;
+                value_type * const yout_attempt = yout + ix0*ny;
+                try {
+                    if (this->m_dx0 == 0)  // rhs may fail already at xout[0]: handled as a failed step
+                        this->predefined_guarded([&]{
+                            this->m_dx0 = resolve_dx0(this->m_odesys, 0.0, xout[0], xout[nx - 1], y0, m_atol, m_rtol,
+                                                      m_styp, m_dx_max);
+                        }, &nreached_attempt);
+                    if ( this->m_status != IntegrStatus::success ) {
+                        // nothing reached (return_on_error)
+                    } else if ( m_styp == StepType::bulirsch_stoer ) {
+                        this->predefined_bulirsch_stoer(nx_attempt, xout_attempt, yout_attempt,
+                                                        &nreached_attempt);
+                    } else if ( m_styp == StepType::dopri5 ) {
+                        this->predefined_dopri5(nx_attempt, xout_attempt, yout_attempt, &nreached_attempt);
+                    } else if ( m_styp == StepType::fehlberg78 ) {
+                        this->template predefined_explicit<runge_kutta_fehlberg78<state_type, value_type> >(
+                            nx_attempt, xout_attempt, yout_attempt, &nreached_attempt);
+                    } else if ( m_styp == StepType::cash_karp54 ) {
+                        this->template predefined_explicit<runge_kutta_cash_karp54<state_type, value_type> >(
+                            nx_attempt, xout_attempt, yout_attempt, &nreached_attempt);
+                    } else if ( m_styp == StepType::verner65 ) {
+                        this->template predefined_explicit<runge_kutta_verner65<state_type, value_type> >(
+                            nx_attempt, xout_attempt, yout_attempt, &nreached_attempt);
+                    } else if ( m_styp == StepType::rosenbrock4 ) {
+                        this->predefined_rosenbrock4(nx_attempt, xout_attempt, yout_attempt,
+                                                     &nreached_attempt);
+                    } else if ( m_styp == StepType::rosenbrock4_banded ) {
+                        this->predefined_rosenbrock4_banded(nx_attempt, xout_attempt, yout_attempt,
+                                                            &nreached_attempt);
+                    } else if ( m_styp == StepType::rosenbrock4_sparse ) {
+                        this->predefined_rosenbrock4_sparse(nx_attempt, xout_attempt, yout_attempt,
+                                                            &nreached_attempt);
+                    } else if ( m_styp == StepType::ros34pw2 ) {
+                        this->predefined_ros34pw2(nx_attempt, xout_attempt, yout_attempt,
+                                                  &nreached_attempt);
                     } else {
-                        std::cerr << "odeint_anyode.hpp:" << __LINE__ << ": Autorestart failed." << "\n";
-                        if (!m_return_on_error)
-                            throw;
+                        goto impossible_predefined;
                     }
-                } else {
+                } catch (const std::exception& e) {
+                    this->m_status = IntegrStatus::step_failed;
+                    nreached = ix0 + nreached_attempt;
+                    if (this->restart_predefined(xout, nreached, ix0, nsteps_before))
+                        continue;
                     if (!m_return_on_error)
                         throw;
+                    break;
                 }
+                nreached = ix0 + nreached_attempt;
+                if (this->m_status == IntegrStatus::success)
+                    break;
+                // stopped early (mxsteps) without an exception
+                if (this->m_diagnostics)
+                    this->diagnose(this->status_message());
+                if (this->restart_predefined(xout, nreached, ix0, nsteps_before))
+                    continue;
+                if (!m_return_on_error)
+                    throw std::runtime_error(this->status_message());
+                break;
             }
+            this->m_nsteps += nsteps_before;
             this->m_time_cpu = (std::clock() - cputime0) / (double)CLOCKS_PER_SEC;
             this->m_time_wall = std::chrono::duration<double>(
                 std::chrono::high_resolution_clock::now() - t_start).count();
@@ -218,28 +563,429 @@ namespace odeint_anyode{
         impossible_predefined:
             throw std::runtime_error("Impossible: unknown StepType!");
         }
+
+        // Dense output stepper of m_styp started at (x0, y0) with a step size of m_dx0, see Stepping.
+        // It refers to this instance, which must outlive it (and must not be moved).
+        std::unique_ptr<dense_stepper_base> dense_stepper(const value_type x0, const value_type * const y0){
+            if (!has_dense_output(m_styp))
+                throw std::runtime_error("Stepping requires a stepper with dense output");
+            const int ny = this->m_odesys->get_ny();
+            std::unique_ptr<dense_stepper_base> ds;
+            auto f = [this](const state_type &yarr, state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
+            };
+            if ( m_styp == StepType::bulirsch_stoer ) {
+                ds = make_dense_stepper(bulirsch_stoer_dense_out< state_type, value_type >(
+                                            this->m_atol, this->m_rtol, 1.0, 1.0, this->m_dx_max),
+                                        f, state_init<state_type>::copy(y0, ny));
+            } else if ( m_styp == StepType::dopri5 ) {
+                ds = make_dense_stepper(make_dense_output<runge_kutta_dopri5<state_type, value_type> >(
+                                            this->m_atol, this->m_rtol, this->m_dx_max),
+                                        f, state_init<state_type>::copy(y0, ny));
+            } else if ( m_styp == StepType::rosenbrock4 ) {
+                auto f4 = [this](const rosenbrock4_state_type &yarr, rosenbrock4_state_type &dydx, value_type xval) {
+                    this->eval_rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
+                };
+                auto j4 = [this, ny](const rosenbrock4_state_type & yarr, jacobian_type &Jmat,
+                                     const value_type & xval, rosenbrock4_state_type &dfdx) {
+                    this->eval_dense_jac(xval, &(yarr.data()[0]), &(Jmat.data()[0]), ny, &(dfdx.data()[0]));
+                };
+                ds = make_dense_stepper(integr_types<N>::make_rosenbrock4(this->m_atol, this->m_rtol, this->m_dx_max,
+                                                                          &this->m_njev_cached, this->m_trace),
+                                        std::make_pair(f4, j4), state_init<rosenbrock4_state_type>::copy(y0, ny));
+            } else if ( m_styp == StepType::rosenbrock4_banded ) {
+                auto scratch = std::make_shared<state_type>(state_init<state_type>::copy(y0, ny));
+                auto j = [this, scratch](const state_type & yarr, std::vector<value_type> &Jmat,
+                                         const value_type & xval, state_type &dfdx) {
+                    this->banded_jac(yarr, Jmat, xval, dfdx, *scratch);
+                };
+                ds = make_dense_stepper(make_rosenbrock4_dense_output<banded_solver_type>(
+                                            this->m_atol, this->m_rtol, this->m_dx_max, this->banded_solver(),
+                                            &this->m_njev_cached, this->m_trace),
+                                        std::make_pair(f, j), state_init<state_type>::copy(y0, ny));
+            } else if ( m_styp == StepType::rosenbrock4_sparse ) {
+                auto scratch = std::make_shared<state_type>(state_init<state_type>::copy(y0, ny));
+                auto j = [this, scratch](const state_type & yarr, typename sparse_solver_type::matrix_type &Jmat,
+                                         const value_type & xval, state_type &dfdx) {
+                    this->sparse_jac(yarr, Jmat, xval, dfdx, *scratch);
+                };
+                ds = make_dense_stepper(make_rosenbrock4_dense_output<sparse_solver_type>(
+                                            this->m_atol, this->m_rtol, this->m_dx_max, this->sparse_solver(),
+                                            &this->m_njev_cached, this->m_trace),
+                                        std::make_pair(f, j), state_init<state_type>::copy(y0, ny));
+            } else if ( m_styp == StepType::ros34pw2 ) {
+                auto j = [this, ny](const state_type & yarr, typename dense_solver_type::matrix_type &Jmat,
+                                    const value_type & xval, state_type &dfdx) {
+                    this->eval_dense_jac(xval, &(yarr.data()[0]), &(Jmat.data()[0]), ny, &(dfdx.data()[0]));
+                };
+                ds = make_dense_stepper(rosenbrock_w_dense_output<dense_solver_type>(
+                                            this->m_atol, this->m_rtol, this->m_dx_max, this->m_w_policy,
+                                            dense_solver_type(), &this->m_w_stats, this->m_trace),
+                                        std::make_pair(f, j), state_init<state_type>::copy(y0, ny));
+            } else {
+                throw std::runtime_error("Impossible: unknown StepType!");
+            }
+            ds->initialize(y0, x0, this->m_dx0);
+            return ds;
+        }
+
     private:
         std::vector<value_type> m_xout, m_yout;
 
+        long int m_nsteps_attempt = 0;  // m_nsteps when the current attempt started (autorestart)
+        value_type m_x_obs = 0, m_dx_last = 0;  // last observed x & last accepted step size
+        value_type m_dx_resume = 0;  // initial step size of a resumed integration (0: m_dx0)
+        bool m_resume_at_step = false;  // single_pass: resume from (m_x_resume, m_y_resume)
+        value_type m_x_resume = 0;
+        std::vector<value_type> m_y_resume;
+
         void reset() {
             this->m_nsteps = 0;
+            this->m_nskipped = 0;
+            this->m_nsteps_attempt = 0;
             this->m_xout.clear();
             this->m_yout.clear();
         }
 
-        void obs_adaptive(const vector_type &yarr, value_type xval){
+        void start(value_type x0) {
+            this->m_status = IntegrStatus::success;
+            this->m_x_obs = x0;
+            this->m_dx_last = 0;
+            this->m_dx_resume = 0;
+            this->m_resume_at_step = false;
+            this->m_restarts.clear();
+        }
+
+        // Autorestart at x: continue with the last accepted step size and a fresh budget of mxsteps.
+        void resume(value_type x) {
+            this->m_status = IntegrStatus::success;
+            this->m_restarts.push_back(x);
+            this->m_x_obs = x;
+            this->m_dx_resume = this->m_dx_last;
+            this->m_nsteps_attempt = this->m_nsteps;
+        }
+
+        // Appended to m_diagnostics if given, written to std::cerr otherwise (if ``to_cerr``).
+        void diagnose(const std::string &msg, bool to_cerr=true){
+            if (this->m_diagnostics)
+                this->m_diagnostics->append(msg).push_back('\n');
+            else if (to_cerr)
+                std::cerr << msg << std::endl;
+        }
+
+        // Ends the integration early without an exception (the observers return false).
+        bool stop(IntegrStatus status){
+            this->m_status = status;
+            return false;
+        }
+
+        std::string status_message() const {
+            if (this->m_status == IntegrStatus::mxsteps_reached)
+                return StreamFmt() << "Maximum number of steps reached: " << this->m_mxsteps;
+            return "";
+        }
+
+        // Autorestart of adaptive (if any left): resume from the last accepted step (which is observed again),
+        // the output stays in place.
+        bool restart_adaptive(value_type &x_start, const value_type * &y_start, std::vector<value_type> &y_restart){
+            if (m_autorestart <= 0)
+                return false;
+            if (this->m_xout.empty()){
+                this->diagnose(StreamFmt() << "odeint_anyode.hpp:" << __LINE__ << ": Autorestart failed.");
+                return false;
+            }
+            const std::size_t ny = this->m_odesys->get_ny();
+            x_start = this->m_xout.back();
+            this->diagnose(StreamFmt() << "odeint_anyode.hpp:" << __LINE__ << ": Autorestart (" << m_autorestart
+                           << ") x=" << x_start);
+            m_autorestart--;
+            y_restart.assign(this->m_yout.end() - ny, this->m_yout.end());
+            y_start = y_restart.data();
+            this->m_xout.pop_back();
+            this->m_yout.resize(this->m_yout.size() - ny);
+            this->resume(x_start);
+            return true;
+        }
+
+        // Autorestart of predefined (if any left): resume after the last point reached (the earlier rows of
+        // yout stay as they are): from the last accepted step (single_pass) or from that point (stepper
+        // restarted in every interval otherwise).
+        bool restart_predefined(const value_type * const xout, int nreached, int &ix0, long int &nsteps_before){
+            if (m_autorestart <= 0)
+                return false;
+            if (nreached - ix0 == 0){
+                this->diagnose(StreamFmt() << "odeint_anyode.hpp:" << __LINE__ << ": Autorestart failed.");
+                return false;
+            }
+            ix0 = nreached - 1;
+            this->m_resume_at_step = this->m_single_pass;
+            const value_type x_resume = this->m_single_pass ? this->m_x_resume : xout[ix0];
+            this->diagnose(StreamFmt() << "odeint_anyode.hpp:" << __LINE__ << ": Autorestart (" << m_autorestart
+                           << ") x=" << x_resume);
+            m_autorestart--;
+            nsteps_before += this->m_nsteps;
+            this->resume(x_resume);
+            return true;
+        }
+
+        // Initial step size of an integration: m_dx0 (or the last accepted step size when resuming).
+        value_type dx_start() {
+            const value_type dx = (this->m_dx_resume != 0) ? this->m_dx_resume : this->m_dx0;
+            this->m_dx_resume = 0;
+            return dx;
+        }
+
+        void track_step(value_type xval) {
+            if (xval != this->m_x_obs){
+                this->m_dx_last = xval - this->m_x_obs;
+                this->trace_step(this->m_x_obs, this->m_dx_last);
+                this->m_x_obs = xval;
+            }
+        }
+
+        // Accepted step of the explicit steppers (the controllers of the implicit steppers record theirs).
+        void trace_step(value_type x0, value_type dx){
+            if (this->m_trace && !this->m_trace->rejections_known)
+                this->m_trace->step(x0, dx, NAN, true);
+        }
+
+        // A callback which reports an error (recoverable or not) fails the step.
+        static void check_status(AnyODE::Status status, const char * const what, value_type x){
+            if (status != AnyODE::Status::success)
+                throw std::runtime_error(StreamFmt() << what << " returned status " << static_cast<int>(status)
+                                         << " at x=" << x);
+        }
+
+        // The callbacks of the system, timed when m_trace is set (banded_jac & sparse_jac time themselves).
+        void eval_rhs(value_type x, const value_type * const y, value_type * const f){
+            trace_timer timer(this->m_trace ? &this->m_trace->time_rhs : nullptr);
+            check_status(this->m_odesys->rhs(x, y, f), "rhs", x);
+        }
+
+        void eval_dense_jac(value_type x, const value_type * const y, value_type * const jac, long int ldim,
+                            value_type * const dfdx){
+            trace_timer timer(this->m_trace ? &this->m_trace->time_jac : nullptr);
+            check_status(this->m_odesys->dense_jac_rmaj(x, y, nullptr, jac, ldim, dfdx), "jac", x);
+        }
+
+        long int m_chunk_rows = 0;  // m_sink
+
+        // Hands the buffered steps over to m_sink, except for the last one (autorestart resumes from it)
+        // unless ``all``.
+        void flush_sink(bool all){
+            const long int n = this->m_xout.size() - (all ? 0 : 1);
+            if (n <= 0)
+                return;
+            const long int ny = this->m_odesys->get_ny();
+            this->m_sink->put(n, this->m_xout.data(), this->m_yout.data());
+            this->m_xout.erase(this->m_xout.begin(), this->m_xout.begin() + n);
+            this->m_yout.erase(this->m_yout.begin(), this->m_yout.begin() + n*ny);
+        }
+
+        void close_sink(){
+            if (this->m_sink){
+                if (!this->m_sink->failed)  // (the steps after a failed write are dropped)
+                    this->flush_sink(true);
+                this->m_sink->finish();
+            }
+        }
+
+        long int m_nskipped = 0;  // m_output: steps not stored since the last stored one
+
+        template<class State>
+        bool keep_step(const State &yarr, value_type xval){
+            const output_policy &pol = this->m_output;
+            if (this->m_xout.empty())
+                return true;  // (final_only: replaced by obs_final, autorestart resumes from it meanwhile)
+            if (pol.final_only || ++this->m_nskipped < pol.stride)
+                return false;
+            if (pol.dx > 0 || pol.dy_rel > 0){
+                using std::abs;
+                bool changed = pol.dx > 0 && abs(xval - this->m_xout.back()) >= pol.dx;
+                const value_type * const ylast = &this->m_yout[this->m_yout.size() - yarr.size()];
+                for (std::size_t i=0; pol.dy_rel > 0 && !changed && i<yarr.size(); ++i)
+                    changed = abs(yarr[i] - ylast[i]) > pol.dy_rel*abs(ylast[i]);
+                if (!changed)
+                    return false;
+            }
+            this->m_nskipped = 0;
+            return true;
+        }
+
+        template<class State>
+        void store_step(const State &yarr, value_type xval){
+            if (this->m_sink && static_cast<long int>(this->m_xout.size()) > this->m_chunk_rows)
+                this->flush_sink(false);
             this->m_xout.push_back(xval);
-            for(int i=0 ; i < this->m_odesys->get_ny() ; ++i)
-                this->m_yout.push_back(yarr[i]);
-            if (this->m_nsteps == this->m_mxsteps)
-                throw std::runtime_error(StreamFmt() << "Maximum number of steps reached: " << this->m_nsteps);
+            this->m_yout.insert(this->m_yout.end(), yarr.begin(), yarr.end());
+        }
+
+        template<class State>
+        bool obs_adaptive(const State &yarr, value_type xval){
+            const bool mxsteps_reached = this->m_nsteps - this->m_nsteps_attempt == this->m_mxsteps;
+            if (mxsteps_reached || this->keep_step(yarr, xval))  // (autorestart resumes from the last stored step)
+                this->store_step(yarr, xval);
+            this->track_step(xval);
+            if (mxsteps_reached)
+                return this->stop(IntegrStatus::mxsteps_reached);
             m_nsteps++;
+            return true;
         }
 
-        void obs_predefined(const vector_type & /* yarr */, value_type /* xval */){
+        // The final state (last step observed at m_x_obs) unless stored already.
+        template<class State>
+        void obs_final(const State &yarr){
+            if (!this->m_xout.empty() && this->m_xout.back() == this->m_x_obs)
+                return;
+            if (this->m_output.final_only && this->m_xout.size() == 1){
+                this->m_xout[0] = this->m_x_obs;
+                std::copy(yarr.begin(), yarr.end(), this->m_yout.begin());
+            } else {
+                this->store_step(yarr, this->m_x_obs);
+            }
+            this->m_nskipped = 0;
+        }
+
+        template<class State>
+        bool obs_predefined(const State & /* yarr */, value_type xval){
+            this->track_step(xval);
             if (this->m_nsteps == this->m_mxsteps)
-                throw std::runtime_error(StreamFmt() << "Maximum number of steps reached: " << this->m_nsteps);
+                return this->stop(IntegrStatus::mxsteps_reached);
             m_nsteps++;
+            return true;
+        }
+
+        // odeint's integrate_adaptive for dense output steppers (same steps, the stepper is copied as well),
+        // but ends as soon as obs(y, x) returns false (y_ then keeps its value).
+        template<class Stepper, class System, class State, class Observer>
+        bool integrate_steps(Stepper stepper, System sys, State &y_, value_type x0, value_type xend, value_type dx,
+                             Observer obs){
+            using boost::numeric::odeint::detail::less_with_sign;
+            using boost::numeric::odeint::detail::less_eq_with_sign;
+            stepper.initialize(y_, x0, dx);
+            while (less_with_sign(stepper.current_time(), xend, stepper.current_time_step())){
+                while (less_eq_with_sign(static_cast<value_type>(stepper.current_time() + stepper.current_time_step()),
+                                         xend, stepper.current_time_step())){
+                    if (!obs(stepper.current_state(), stepper.current_time()))
+                        return false;
+                    stepper.do_step(sys);
+                }
+                // arrive exactly at xend
+                stepper.initialize(stepper.current_state(), stepper.current_time(), xend - stepper.current_time());
+            }
+            if (!obs(stepper.current_state(), stepper.current_time()))
+                return false;
+            boost::numeric::odeint::copy(stepper.current_state(), y_);
+            return true;
+        }
+
+        // Restarts the stepper (from m_dx0) for every interval in xout.
+        template<class Stepper, class System, class State>
+        void predefined_intervals(Stepper &stepper, System sys,
+                                  const int nx,
+                                  const value_type * const ANYODE_RESTRICT xout,
+                                  State &y_,
+                                  value_type * const ANYODE_RESTRICT yout,
+                                  int * nreached){
+            const auto ny = this->m_odesys->get_ny();
+            for (*nreached=1; *nreached < nx; ++*nreached){
+                const int ix = *nreached;
+                this->reset();
+                bind_output(y_, yout + ix*ny, true);
+                if (!this->integrate_steps(stepper, sys, y_, xout[ix - 1], xout[ix], this->dx_start(),
+                                           std::bind(&Integr::obs_predefined<State>, this, _1, _2)))
+                    return;
+                store_output(y_, yout + ix*ny);
+            }
+        }
+
+        // Integrates once over [xout[0], xout[nx-1]] and interpolates (dense output)
+        // at each point in xout, keeping the step size controller warm throughout.
+        // mxsteps limits the number of steps between two consecutive points in xout.
+        template<class Stepper, class System, class State>
+        void predefined_single_pass(Stepper &stepper, System sys,
+                                    const int nx,
+                                    const value_type * const ANYODE_RESTRICT xout,
+                                    State &y_,
+                                    value_type * const ANYODE_RESTRICT yout,
+                                    int * nreached){
+            using boost::numeric::odeint::detail::less_with_sign;
+            const auto ny = this->m_odesys->get_ny();
+            const value_type xend = xout[nx - 1];
+            long int nsteps_interval = 0;
+            this->reset();
+            if (this->m_resume_at_step){  // autorestart: continue from the last accepted step (within xout[0:2])
+                this->m_resume_at_step = false;
+                stepper.initialize(state_init<State>::copy(this->m_y_resume.data(), ny), this->m_x_resume,
+                                   this->dx_start());
+            } else {
+                stepper.initialize(y_, xout[0], this->dx_start());
+            }
+            for (*nreached=1; *nreached < nx; ++*nreached){
+                const int ix = *nreached;
+                try {
+                    while (less_with_sign(stepper.current_time(), xout[ix], stepper.current_time_step())){
+                        if (nsteps_interval == this->m_mxsteps){
+                            const auto &y_acc = stepper.current_state();
+                            this->m_x_resume = stepper.current_time();
+                            this->m_y_resume.assign(y_acc.begin(), y_acc.end());
+                            this->stop(IntegrStatus::mxsteps_reached);
+                            return;
+                        }
+                        if (less_with_sign(xend, stepper.current_time() + stepper.current_time_step(),
+                                           stepper.current_time_step())){
+                            // make sure we don't go beyond xend
+                            stepper.initialize(stepper.current_state(), stepper.current_time(),
+                                               xend - stepper.current_time());
+                        }
+                        stepper.do_step(sys);
+                        this->m_dx_last = stepper.current_time() - stepper.previous_time();
+                        this->trace_step(stepper.previous_time(), this->m_dx_last);
+                        nsteps_interval++;
+                        this->m_nsteps++;
+                    }
+                } catch (const std::exception &) {
+                    // the stepper still holds the last accepted step
+                    const auto &y_acc = stepper.current_state();
+                    this->m_x_resume = stepper.current_time();
+                    this->m_y_resume.assign(y_acc.begin(), y_acc.end());
+                    throw;
+                }
+                bind_output(y_, yout + ix*ny, false);
+                stepper.calc_state(xout[ix], y_);
+                store_output(y_, yout + ix*ny);
+                nsteps_interval = 0;
+            }
+        }
+
+        template<class Stepper, class System, class State>
+        void predefined_stepper(Stepper &stepper, System sys,
+                                const int nx,
+                                const value_type * const ANYODE_RESTRICT xout,
+                                State &y_,
+                                value_type * const ANYODE_RESTRICT yout,
+                                int * nreached){
+            this->predefined_guarded([&]{
+                if (this->m_single_pass)
+                    this->predefined_single_pass(stepper, sys, nx, xout, y_, yout, nreached);
+                else
+                    this->predefined_intervals(stepper, sys, nx, xout, y_, yout, nreached);
+            }, nreached);
+        }
+
+        // Runs one of the predefined drivers, a failed step ends the integration (m_status) with
+        // return_on_error (unless autorestart is left to predefined()).
+        template<class Driver>
+        void predefined_guarded(Driver run, int * nreached){
+            *nreached = 0;
+            try {
+                run();
+            } catch (const std::exception& e) {
+                this->diagnose(StreamFmt() << __FILE__ << ":" << __LINE__ << ":" << e.what());
+                if (!m_return_on_error || m_autorestart > 0)
+                    throw;
+                this->m_status = IntegrStatus::step_failed;
+            }
         }
 
         void adaptive_bulirsch_stoer(const value_type x0,
@@ -247,159 +993,345 @@ namespace odeint_anyode{
                                      const value_type * const ANYODE_RESTRICT y0
                                      ){
             const int ny = this->m_odesys->get_ny();
-            auto f = [&](const vector_type &yarr, vector_type &dydx, value_type xval) {
-                this->m_odesys->rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
+            auto f = [&](const state_type &yarr, state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, yarr.data(), dydx.data());
             };
-            auto stepper = bulirsch_stoer_dense_out< vector_type, value_type >(
+            auto stepper = bulirsch_stoer_dense_out< state_type, value_type >(
                 this->m_atol, this->m_rtol, 1.0, 1.0, this->m_dx_max);
-            auto y_ = vec_from_ptr(y0, ny);
-            this->reset();
-            integrate_adaptive(stepper, f, y_, x0, xend, this->m_dx0,
-                               std::bind(&Integr::obs_adaptive, this, _1, _2));
+            auto y_ = state_init<state_type>::copy(y0, ny);
+            if (this->integrate_steps(stepper, f, y_, x0, xend, this->dx_start(),
+                                      std::bind(&Integr::obs_adaptive<state_type>, this, _1, _2)))
+                this->obs_final(y_);
         }
 
         void predefined_bulirsch_stoer(const int nx,
                                        const value_type * const ANYODE_RESTRICT xout,
-                                       const value_type * const ANYODE_RESTRICT y0,
                                        value_type * const ANYODE_RESTRICT yout,
                                        int * nreached){
-            *nreached = 0;
             const auto ny = this->m_odesys->get_ny();
-            vector_type y_ = vec_from_ptr(y0, ny);
-            vector_type xout_ = vec_from_ptr(xout, nx);
-            auto f = [&](const vector_type &yarr, vector_type &dydx, value_type xval) {
-                this->m_odesys->rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
+            auto y_ = state_init<state_type>::view(yout, ny);  // first row of yout holds y0, see predefined()
+            auto f = [&](const state_type &yarr, state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, yarr.data(), dydx.data());
             };
-            try{
-                auto stepper = bulirsch_stoer_dense_out< vector_type, value_type >(
-                    this->m_atol, this->m_rtol, 1.0, 1.0, this->m_dx_max);
-                for (*nreached=1; *nreached < nx; ++*nreached){
-                    const int ix = *nreached;
-                    this->reset();
-                    integrate_adaptive(stepper, f, y_, xout[ix-1], xout[ix], this->m_dx0,
-                                       std::bind(&Integr::obs_predefined, this, _1, _2));
-                    for (int iy=0; iy < ny; ++iy)
-                        yout[ix*ny + iy] = y_[iy];
-                }
-            } catch (const std::exception& e) {
-                std::cerr << __FILE__ << ":" << __LINE__ << ":";
-                std::cerr << e.what() << std::endl;
-                nreached--;
-                if (!m_return_on_error)
-                    throw;
-            }
+            auto stepper = bulirsch_stoer_dense_out< state_type, value_type >(
+                this->m_atol, this->m_rtol, 1.0, 1.0, this->m_dx_max);
+            this->predefined_stepper(stepper, f, nx, xout, y_, yout, nreached);
         }
 
         void adaptive_dopri5(const value_type x0,
                              const value_type xend,
                              const value_type * const ANYODE_RESTRICT y0){
             const int ny = this->m_odesys->get_ny();
-            auto f = [&](const vector_type &yarr, vector_type &dydx, value_type xval) {
-                this->m_odesys->rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
+            auto f = [&](const state_type &yarr, state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, yarr.data(), dydx.data());
             };
 
-            auto stepper = make_dense_output<runge_kutta_dopri5<vector_type, value_type> >(
+            auto stepper = make_dense_output<runge_kutta_dopri5<state_type, value_type> >(
                 this->m_atol, this->m_rtol, this->m_dx_max);
-            auto y_ = vec_from_ptr(y0, ny);
-            this->reset();
-            integrate_adaptive(stepper, f, y_, x0, xend, this->m_dx0,
-                               std::bind(&Integr::obs_adaptive, this, _1, _2));
+            auto y_ = state_init<state_type>::copy(y0, ny);
+            if (this->integrate_steps(stepper, f, y_, x0, xend, this->dx_start(),
+                                      std::bind(&Integr::obs_adaptive<state_type>, this, _1, _2)))
+                this->obs_final(y_);
         }
 
         void predefined_dopri5(const int nx,
                                const value_type * const ANYODE_RESTRICT xout,
-                               const value_type * const ANYODE_RESTRICT y0,
                               value_type * const ANYODE_RESTRICT yout,
                               int * nreached){
-            *nreached = 0;
             const auto ny = this->m_odesys->get_ny();
-            vector_type y_ = vec_from_ptr(y0, ny);
-            vector_type xout_ = vec_from_ptr(xout, nx);
-            auto f = [&](const vector_type &yarr, vector_type &dydx, value_type xval) {
-                this->m_odesys->rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
+            auto y_ = state_init<state_type>::view(yout, ny);  // first row of yout holds y0, see predefined()
+            auto f = [&](const state_type &yarr, state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, yarr.data(), dydx.data());
             };
-            try {
-                auto stepper = make_dense_output<runge_kutta_dopri5<vector_type, value_type> >(
-                    this->m_atol, this->m_rtol, this->m_dx_max);
-                for (*nreached=1; *nreached < nx; ++*nreached){
-                    const int ix = *nreached;
-                    this->reset();
-                    integrate_adaptive(stepper, f, y_, xout[ix - 1], xout[ix], this->m_dx0,
-                                       std::bind(&Integr::obs_predefined, this, _1, _2));
-                    for (int iy=0; iy < ny; ++iy)
-                        yout[ix*ny + iy] = y_[iy];
-                }
-            } catch (const std::exception& e) {
-                std::cerr << __FILE__ << ":" << __LINE__ << ":";
-                std::cerr << e.what() << std::endl;
-                nreached--;
-                if (!m_return_on_error)
-                    throw;
-            }
+            auto stepper = make_dense_output<runge_kutta_dopri5<state_type, value_type> >(
+                this->m_atol, this->m_rtol, this->m_dx_max);
+            this->predefined_stepper(stepper, f, nx, xout, y_, yout, nreached);
+        }
+
+        // fehlberg78, cash_karp54 & verner65 (see explicit_controlled_stepper)
+        template<class ErrorStepper>
+        void adaptive_explicit(const value_type x0,
+                               const value_type xend,
+                               const value_type * const ANYODE_RESTRICT y0){
+            const int ny = this->m_odesys->get_ny();
+            auto f = [this](const state_type &yarr, state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, yarr.data(), dydx.data());
+            };
+            auto stepper = explicit_controlled_stepper<ErrorStepper>(this->m_atol, this->m_rtol, this->m_dx_max);
+            auto y_ = state_init<state_type>::copy(y0, ny);
+            if (this->integrate_steps(stepper, f, y_, x0, xend, this->dx_start(),
+                                      std::bind(&Integr::obs_adaptive<state_type>, this, _1, _2)))
+                this->obs_final(y_);
+        }
+
+        template<class ErrorStepper>
+        void predefined_explicit(const int nx,
+                                 const value_type * const ANYODE_RESTRICT xout,
+                                 value_type * const ANYODE_RESTRICT yout,
+                                 int * nreached){
+            const auto ny = this->m_odesys->get_ny();
+            auto y_ = state_init<state_type>::view(yout, ny);  // first row of yout holds y0, see predefined()
+            auto f = [this](const state_type &yarr, state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, yarr.data(), dydx.data());
+            };
+            auto stepper = explicit_controlled_stepper<ErrorStepper>(this->m_atol, this->m_rtol, this->m_dx_max);
+            this->predefined_guarded([&]{  // (no single_pass, see the constructor)
+                this->predefined_intervals(stepper, f, nx, xout, y_, yout, nreached);
+            }, nreached);
         }
 
         void adaptive_rosenbrock4(const value_type x0,
                                   const value_type xend,
                                   const value_type * const ANYODE_RESTRICT y0){
             const int ny = this->m_odesys->get_ny();
-            auto f = [&](const vector_type &yarr, vector_type &dydx, value_type xval) {
-                this->m_odesys->rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
+            auto f = [&](const rosenbrock4_state_type &yarr, rosenbrock4_state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
             };
-            auto j = [&](const vector_type & yarr, matrix_type &Jmat,
-                                     const value_type & xval, vector_type &dfdx) {
-                this->m_odesys->dense_jac_rmaj(xval, &(yarr.data()[0]), nullptr, &(Jmat.data()[0]), ny, &(dfdx.data()[0]));
+            auto j = [&](const rosenbrock4_state_type & yarr, jacobian_type &Jmat,
+                                     const value_type & xval, rosenbrock4_state_type &dfdx) {
+                this->eval_dense_jac(xval, &(yarr.data()[0]), &(Jmat.data()[0]), ny, &(dfdx.data()[0]));
             };
-            auto stepper = make_dense_output<rosenbrock4<value_type> >(this->m_atol, this->m_rtol, this->m_dx_max);
-            auto y_ = vec_from_ptr(y0, ny);
-            this->reset();
-            integrate_adaptive(stepper, std::make_pair(f, j), y_, x0, xend, this->m_dx0,
-                                              std::bind(&Integr::obs_adaptive, this, _1, _2));
+            auto stepper = integr_types<N>::make_rosenbrock4(this->m_atol, this->m_rtol, this->m_dx_max,
+                                                             &this->m_njev_cached, this->m_trace);
+            auto y_ = state_init<rosenbrock4_state_type>::copy(y0, ny);
+            if (this->integrate_steps(stepper, std::make_pair(f, j), y_, x0, xend, this->dx_start(),
+                                      std::bind(&Integr::obs_adaptive<rosenbrock4_state_type>, this, _1, _2)))
+                this->obs_final(y_);
         }
 
         void predefined_rosenbrock4(const int nx,
                                     const value_type * const ANYODE_RESTRICT xout,
-                                    const value_type * const ANYODE_RESTRICT y0,
                                     value_type * const ANYODE_RESTRICT yout,
                                     int * nreached){
-            *nreached = 0;
             const auto ny = this->m_odesys->get_ny();
-            vector_type y_ = vec_from_ptr(y0, ny);
-            vector_type xout_ = vec_from_ptr(xout, nx);
-            auto f = [&](const vector_type &yarr, vector_type &dydx, value_type xval) {
-                this->m_odesys->rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
+            auto y_ = state_init<rosenbrock4_state_type>::copy(yout, ny);  // first row of yout holds y0, see predefined()
+            auto f = [&](const rosenbrock4_state_type &yarr, rosenbrock4_state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
             };
-            auto j = [&](const vector_type & yarr, matrix_type &Jmat,
-                                     const value_type & xval, vector_type &dfdx) {
-                this->m_odesys->dense_jac_rmaj(xval, &(yarr.data()[0]), nullptr, &(Jmat.data()[0]), ny, &(dfdx.data()[0]));
+            auto j = [&](const rosenbrock4_state_type & yarr, jacobian_type &Jmat,
+                                     const value_type & xval, rosenbrock4_state_type &dfdx) {
+                this->eval_dense_jac(xval, &(yarr.data()[0]), &(Jmat.data()[0]), ny, &(dfdx.data()[0]));
             };
-            try {
-                auto stepper = make_dense_output<rosenbrock4<value_type> >(this->m_atol, this->m_rtol, this->m_dx_max);
-                for (*nreached=1; *nreached < nx; ++*nreached){
-                    const int ix = *nreached;
-                    this->reset();
-                    integrate_adaptive(stepper, std::make_pair(f, j), y_, xout[ix - 1], xout[ix], this->m_dx0,
-                                       std::bind(&Integr::obs_predefined, this, _1, _2));
-                    for (int iy=0; iy < ny; ++iy)
-                        yout[ix*ny + iy] = y_[iy];
-                }
-            } catch (const std::exception& e) {
-                std::cerr << __FILE__ << ":" << __LINE__ << ":";
-                std::cerr << e.what() << std::endl;
-                nreached--;
-                if (!m_return_on_error)
-                    throw;
+            auto stepper = integr_types<N>::make_rosenbrock4(this->m_atol, this->m_rtol, this->m_dx_max,
+                                                             &this->m_njev_cached, this->m_trace);
+            this->predefined_stepper(stepper, std::make_pair(f, j), nx, xout, y_, yout, nreached);
+        }
+
+        banded_solver_type banded_solver() const {
+            const int ml = this->m_odesys->get_mlower(), mu = this->m_odesys->get_mupper();
+            if (ml < 0 || mu < 0)
+                throw std::runtime_error(StreamFmt() << "rosenbrock4_banded requires mlower >= 0 and mupper >= 0, got: "
+                                         << ml << ", " << mu);
+            return banded_solver_type(ml, mu);
+        }
+
+        // banded_jac_cmaj & sparse_jac_csc do not provide dfdt: it is zero for autonomous systems
+        // (autonomous_exprs) and approximated by a forward difference otherwise, which costs two calls
+        // of rhs (counted in nfev) per Jacobian evaluation (``scratch`` holds f(x, y)).
+        void dfdt(const state_type &yarr, const value_type &xval, state_type &dfdx, state_type &scratch){
+            if (this->m_odesys->autonomous_exprs){
+                std::fill(dfdx.begin(), dfdx.end(), 0.0);
+            } else {
+                using std::abs;
+                const value_type h = std::sqrt(std::numeric_limits<value_type>::epsilon())*std::max(abs(xval), 1.0);
+                check_status(this->m_odesys->rhs(xval, &(yarr.data()[0]), &(scratch.data()[0])), "rhs", xval);
+                check_status(this->m_odesys->rhs(xval + h, &(yarr.data()[0]), &(dfdx.data()[0])), "rhs", xval + h);
+                for (std::size_t i=0; i<dfdx.size(); ++i)
+                    dfdx[i] = (dfdx[i] - scratch[i])/h;
             }
         }
 
+        void banded_jac(const state_type &yarr, std::vector<value_type> &Jmat, const value_type &xval,
+                        state_type &dfdx, state_type &scratch){
+            trace_timer timer(this->m_trace ? &this->m_trace->time_jac : nullptr);
+            const long int ldim = this->m_odesys->get_mlower() + this->m_odesys->get_mupper() + 1;
+            check_status(this->m_odesys->banded_jac_cmaj(xval, &(yarr.data()[0]), nullptr, &Jmat[0], ldim), "jac",
+                         xval);
+            this->dfdt(yarr, xval, dfdx, scratch);
+        }
+
+        void adaptive_rosenbrock4_banded(const value_type x0,
+                                         const value_type xend,
+                                         const value_type * const ANYODE_RESTRICT y0){
+            const int ny = this->m_odesys->get_ny();
+            auto scratch = state_init<state_type>::copy(y0, ny);
+            auto f = [&](const state_type &yarr, state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
+            };
+            auto j = [&](const state_type & yarr, std::vector<value_type> &Jmat,
+                         const value_type & xval, state_type &dfdx) {
+                this->banded_jac(yarr, Jmat, xval, dfdx, scratch);
+            };
+            auto stepper = make_rosenbrock4_dense_output<banded_solver_type>(
+                this->m_atol, this->m_rtol, this->m_dx_max, this->banded_solver(), &this->m_njev_cached,
+                this->m_trace);
+            auto y_ = state_init<state_type>::copy(y0, ny);
+            if (this->integrate_steps(stepper, std::make_pair(f, j), y_, x0, xend, this->dx_start(),
+                                      std::bind(&Integr::obs_adaptive<state_type>, this, _1, _2)))
+                this->obs_final(y_);
+        }
+
+        void predefined_rosenbrock4_banded(const int nx,
+                                           const value_type * const ANYODE_RESTRICT xout,
+                                           value_type * const ANYODE_RESTRICT yout,
+                                           int * nreached){
+            const auto ny = this->m_odesys->get_ny();
+            auto y_ = state_init<state_type>::view(yout, ny);  // first row of yout holds y0, see predefined()
+            auto scratch = state_init<state_type>::copy(yout, ny);
+            auto f = [&](const state_type &yarr, state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
+            };
+            auto j = [&](const state_type & yarr, std::vector<value_type> &Jmat,
+                         const value_type & xval, state_type &dfdx) {
+                this->banded_jac(yarr, Jmat, xval, dfdx, scratch);
+            };
+            auto stepper = make_rosenbrock4_dense_output<banded_solver_type>(
+                this->m_atol, this->m_rtol, this->m_dx_max, this->banded_solver(), &this->m_njev_cached,
+                this->m_trace);
+            this->predefined_stepper(stepper, std::make_pair(f, j), nx, xout, y_, yout, nreached);
+        }
+
+        sparse_solver_type sparse_solver() {
+            const int nnz = this->m_odesys->get_nnz();
+            if (nnz < 0)
+                throw std::runtime_error(StreamFmt() << "rosenbrock4_sparse requires nnz >= 0, got: " << nnz);
+            if (!this->m_keep_symbolic || !this->m_sparse_symbolic)
+                this->m_sparse_symbolic = std::make_shared<typename sparse_solver_type::symbolic_type>();
+            return sparse_solver_type(nnz, this->m_sparse_symbolic);
+        }
+
+        void sparse_jac(const state_type &yarr, typename sparse_solver_type::matrix_type &Jmat, const value_type &xval,
+                        state_type &dfdx, state_type &scratch){
+            trace_timer timer(this->m_trace ? &this->m_trace->time_jac : nullptr);
+            check_status(this->m_odesys->sparse_jac_csc(xval, &(yarr.data()[0]), nullptr, Jmat.data.data(),
+                                                        Jmat.colptrs.data(), Jmat.rowvals.data()), "jac", xval);
+            this->dfdt(yarr, xval, dfdx, scratch);
+        }
+
+        void adaptive_rosenbrock4_sparse(const value_type x0,
+                                         const value_type xend,
+                                         const value_type * const ANYODE_RESTRICT y0){
+            const int ny = this->m_odesys->get_ny();
+            auto scratch = state_init<state_type>::copy(y0, ny);
+            auto f = [&](const state_type &yarr, state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
+            };
+            auto j = [&](const state_type & yarr, typename sparse_solver_type::matrix_type &Jmat,
+                         const value_type & xval, state_type &dfdx) {
+                this->sparse_jac(yarr, Jmat, xval, dfdx, scratch);
+            };
+            auto stepper = make_rosenbrock4_dense_output<sparse_solver_type>(
+                this->m_atol, this->m_rtol, this->m_dx_max, this->sparse_solver(), &this->m_njev_cached,
+                this->m_trace);
+            auto y_ = state_init<state_type>::copy(y0, ny);
+            if (this->integrate_steps(stepper, std::make_pair(f, j), y_, x0, xend, this->dx_start(),
+                                      std::bind(&Integr::obs_adaptive<state_type>, this, _1, _2)))
+                this->obs_final(y_);
+        }
+
+        void predefined_rosenbrock4_sparse(const int nx,
+                                           const value_type * const ANYODE_RESTRICT xout,
+                                           value_type * const ANYODE_RESTRICT yout,
+                                           int * nreached){
+            const auto ny = this->m_odesys->get_ny();
+            auto y_ = state_init<state_type>::view(yout, ny);  // first row of yout holds y0, see predefined()
+            auto scratch = state_init<state_type>::copy(yout, ny);
+            auto f = [&](const state_type &yarr, state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
+            };
+            auto j = [&](const state_type & yarr, typename sparse_solver_type::matrix_type &Jmat,
+                         const value_type & xval, state_type &dfdx) {
+                this->sparse_jac(yarr, Jmat, xval, dfdx, scratch);
+            };
+            auto stepper = make_rosenbrock4_dense_output<sparse_solver_type>(
+                this->m_atol, this->m_rtol, this->m_dx_max, this->sparse_solver(), &this->m_njev_cached,
+                this->m_trace);
+            this->predefined_stepper(stepper, std::make_pair(f, j), nx, xout, y_, yout, nreached);
+        }
+
+        void adaptive_ros34pw2(const value_type x0,
+                               const value_type xend,
+                               const value_type * const ANYODE_RESTRICT y0){
+            const int ny = this->m_odesys->get_ny();
+            auto f = [&](const state_type &yarr, state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
+            };
+            auto j = [&](const state_type & yarr, typename dense_solver_type::matrix_type &Jmat,
+                         const value_type & xval, state_type &dfdx) {
+                this->eval_dense_jac(xval, &(yarr.data()[0]), &(Jmat.data()[0]), ny, &(dfdx.data()[0]));
+            };
+            auto stepper = rosenbrock_w_dense_output<dense_solver_type>(
+                this->m_atol, this->m_rtol, this->m_dx_max, this->m_w_policy, dense_solver_type(), &this->m_w_stats,
+                this->m_trace);
+            auto y_ = state_init<state_type>::copy(y0, ny);
+            if (this->integrate_steps(stepper, std::make_pair(f, j), y_, x0, xend, this->dx_start(),
+                                      std::bind(&Integr::obs_adaptive<state_type>, this, _1, _2)))
+                this->obs_final(y_);
+        }
+
+        void predefined_ros34pw2(const int nx,
+                                 const value_type * const ANYODE_RESTRICT xout,
+                                 value_type * const ANYODE_RESTRICT yout,
+                                 int * nreached){
+            const auto ny = this->m_odesys->get_ny();
+            auto y_ = state_init<state_type>::view(yout, ny);  // first row of yout holds y0, see predefined()
+            auto f = [&](const state_type &yarr, state_type &dydx, value_type xval) {
+                this->eval_rhs(xval, &(yarr.data()[0]), &(dydx.data()[0]));
+            };
+            auto j = [&](const state_type & yarr, typename dense_solver_type::matrix_type &Jmat,
+                         const value_type & xval, state_type &dfdx) {
+                this->eval_dense_jac(xval, &(yarr.data()[0]), &(Jmat.data()[0]), ny, &(dfdx.data()[0]));
+            };
+            auto stepper = rosenbrock_w_dense_output<dense_solver_type>(
+                this->m_atol, this->m_rtol, this->m_dx_max, this->m_w_policy, dense_solver_type(), &this->m_w_stats,
+                this->m_trace);
+            this->predefined_stepper(stepper, std::make_pair(f, j), nx, xout, y_, yout, nreached);
+        }
+
     };
 
-    template <class OdeSys>
-    void set_integration_info(OdeSys * odesys, const Integr<OdeSys>& integrator){
+    template <class OdeSys, std::size_t N>
+    void set_integration_info(OdeSys * odesys, const Integr<OdeSys, N>& integrator){
         odesys->current_info.nfo_int["n_steps"] = integrator.m_nsteps;
+        odesys->current_info.nfo_int["status"] = static_cast<int>(integrator.m_status);
         odesys->current_info.nfo_int["nfev"] = odesys->nfev;
         odesys->current_info.nfo_int["njev"] = odesys->njev;
         odesys->current_info.nfo_dbl["time_wall"] = integrator.m_time_wall;
         odesys->current_info.nfo_dbl["time_cpu"] = integrator.m_time_cpu;
+        odesys->current_info.nfo_int["n_restarts"] = integrator.m_restarts.size();
+        odesys->current_info.nfo_vecdbl["x_restarts"] = integrator.m_restarts;
+        if (integrator.m_styp == StepType::rosenbrock4 || integrator.m_styp == StepType::rosenbrock4_banded ||
+            integrator.m_styp == StepType::rosenbrock4_sparse){
+            odesys->current_info.nfo_int["njev_cached"] = integrator.m_njev_cached;
+        }
+        if (integrator.m_styp == StepType::ros34pw2){
+            odesys->current_info.nfo_int["n_factorizations"] = integrator.m_w_stats.nfactor;
+            odesys->current_info.nfo_int["n_rejected"] = integrator.m_w_stats.nreject;
+        }
+        if (integrator.m_trace){
+            const step_trace &tr = *integrator.m_trace;
+            odesys->current_info.nfo_int["n_accepted"] = tr.n_accepted;
+            if (tr.rejections_known)
+                odesys->current_info.nfo_int["n_rejected"] = tr.n_rejected;
+            odesys->current_info.nfo_int["n_lu_factorizations"] = tr.n_factorizations;
+            odesys->current_info.nfo_int["n_lu_solves"] = tr.n_solves;
+            odesys->current_info.nfo_dbl["time_rhs"] = tr.time_rhs;
+            odesys->current_info.nfo_dbl["time_jac"] = tr.time_jac;
+            odesys->current_info.nfo_dbl["time_linalg"] = tr.time_linalg;
+            if (tr.history){
+                odesys->current_info.nfo_vecdbl["steps_x"] = tr.x;
+                odesys->current_info.nfo_vecdbl["steps_dt"] = tr.dt;
+                odesys->current_info.nfo_vecdbl["steps_err"] = tr.err;
+                odesys->current_info.nfo_vecint["steps_accepted"] = tr.accepted;
+            }
+        }
+        if (integrator.m_sparse_symbolic && integrator.m_sparse_symbolic->analyzed){
+            const auto &sym = *integrator.m_sparse_symbolic;
+            odesys->current_info.nfo_int["nnz"] = sym.nnz();
+            odesys->current_info.nfo_int["nnz_lu"] = sym.nnz_lu();
+            odesys->current_info.nfo_vecint["jac_colptrs"] = std::vector<int>(sym.colptrs.begin(), sym.colptrs.end());
+            odesys->current_info.nfo_vecint["jac_rowvals"] = std::vector<int>(sym.rowvals.begin(), sym.rowvals.end());
+        }
     }
 
     template <class OdeSys>
@@ -415,26 +1347,30 @@ namespace odeint_anyode{
                     double dx0=0.0,
                     double dx_max=0.0,
                     int autorestart=0,
-                    bool return_on_error=false
+                    bool return_on_error=false,
+                    int max_jac_age=10,
+                    trajectory_sink * sink=nullptr,  // steps handed over in chunks of sink_rows (nothing is returned)
+                    long int sink_rows=0,
+                    output_policy output=output_policy(),
+                    step_trace * trace=nullptr,  // counts, timings (and history) of the steps, see set_integration_info
+                    std::string * diagnostics=nullptr  // messages appended here instead of std::cerr
                     )
                     //,
                     // const double dx_min=0.0,
 
                     // long int mxsteps=0)
     {
-        if (dx0 == 0.0)
-            dx0 = odesys->get_dx0(x0, y0);
-        if (dx0 == 0.0){
-            if (x0 == 0)
-                dx0 = std::numeric_limits<double>::epsilon() * 100;
-            else
-                dx0 = std::numeric_limits<double>::epsilon() * 100 * x0;
-        }
         if (dx_max == 0.0)
             dx_max = odesys->get_dx_max(x0, y0);
         if (mxsteps == 0)
             mxsteps = 500;
         auto integr = Integr<OdeSys>(odesys, dx0, dx_max, atol, rtol, styp, mxsteps, autorestart, return_on_error);
+        integr.m_w_policy.max_jac_age = max_jac_age;
+        integr.m_sink = sink;
+        integr.m_sink_rows = sink_rows;
+        integr.m_output = output;
+        integr.m_trace = trace;
+        integr.m_diagnostics = diagnostics;
         auto result = integr.adaptive(x0, xend, y0);
         odesys->current_info.clear();
         set_integration_info<OdeSys>(odesys, integr);
@@ -454,30 +1390,264 @@ namespace odeint_anyode{
                           double dx0=0.0,
                           double dx_max=0.0,
                           int autorestart=0,
-                          bool return_on_error=false
+                          bool return_on_error=false,
+                          bool single_pass=false,
+                          int max_jac_age=10,
+                          step_trace * trace=nullptr,
+                          std::string * diagnostics=nullptr
                           )
     // const double dx_min=0.0,
     {
-        if (dx0 == 0.0)
-            dx0 = odesys->get_dx0(xout[0], y0);
-        if (dx0 == 0.0){
-            if (xout[0] == 0)
-                dx0 = std::numeric_limits<double>::epsilon() * 100;
-            else
-                dx0 = std::numeric_limits<double>::epsilon() * 100 * xout[0];
-        }
         if (dx_max == 0.0)
             dx_max = INFINITY;
         if (mxsteps == 0)
             mxsteps = 500;
-        auto integr = Integr<OdeSys>(odesys, dx0, dx_max, atol, rtol, styp, mxsteps, autorestart, return_on_error);
+        auto integr = Integr<OdeSys>(odesys, dx0, dx_max, atol, rtol, styp, mxsteps, autorestart, return_on_error,
+                                     single_pass);
+        integr.m_w_policy.max_jac_age = max_jac_age;
+        integr.m_trace = trace;
+        integr.m_diagnostics = diagnostics;
         int nreached = integr.predefined(nout, xout, y0, yout);
-        odesys->current_info.nfo_int.clear();
-        odesys->current_info.nfo_dbl.clear();
+        odesys->current_info.clear();
         set_integration_info(odesys, integr);
         return nreached;
     }
 
+    // Repeated integrations of one system with the same settings (e.g. in parameter estimation):
+    // the settings are resolved once, the symbolic analysis of rosenbrock4_sparse is kept between
+    // calls and the info is only assembled on request (set_info). The counters refer to the last call.
+    template <class OdeSys>
+    class Session {
+        OdeSys * const m_odesys;
+        Integr<OdeSys> m_integr;
+        const double m_dx0;  // 0: resolved in every call (as in simple_predefined)
+        const int m_autorestart;
+
+    public:
+        Session(OdeSys * const odesys,
+                const double atol,
+                const double rtol,
+                const StepType styp,
+                long int mxsteps=0,
+                double dx0=0.0,
+                double dx_max=0.0,
+                int autorestart=0,
+                bool return_on_error=false,
+                bool single_pass=false,
+                int max_jac_age=10
+                ) :
+            m_odesys(odesys),
+            m_integr(odesys, dx0, (dx_max == 0.0) ? INFINITY : dx_max, atol, rtol, styp,
+                     (mxsteps == 0) ? 500 : mxsteps, autorestart, return_on_error, single_pass),
+            m_dx0(dx0), m_autorestart(autorestart)
+        {
+            m_integr.m_w_policy.max_jac_age = max_jac_age;
+            m_integr.m_keep_symbolic = true;
+        }
+
+        // Same as simple_predefined (without assembling the info).
+        int predefined(const double * const y0, const int nout, const double * const xout, double * const yout){
+            m_odesys->nfev = 0;
+            m_odesys->njev = 0;
+            m_integr.m_dx0 = m_dx0;
+            m_integr.m_autorestart = m_autorestart;
+            m_integr.m_njev_cached = 0;
+            m_integr.m_w_stats = rosenbrock_w_stats();
+            return m_integr.predefined(nout, xout, y0, yout);
+        }
+
+        // Info of the last call in odesys->current_info.
+        void set_info() const {
+            m_odesys->current_info.clear();
+            set_integration_info(m_odesys, m_integr);
+        }
+    };
+
+    // Integration in increments chosen by the caller (e.g. co-simulation, or events handled by the caller):
+    // the dense output stepper is kept between calls, every call continues from the last accepted step with
+    // its step size (and step size controller history). A negative dx0 integrates towards smaller x.
+    // mxsteps limits the number of steps per call of advance_to, the info covers all calls. dx0 = 0: see resolve_dx0
+    // (estimated towards larger x).
+    template <class OdeSys>
+    class Stepping {
+        OdeSys * const m_odesys;
+        Integr<OdeSys> m_integr;
+        std::unique_ptr<dense_stepper_base> m_stepper;
+        std::vector<double> m_y;
+        double m_x;
+
+        template <class F>
+        void timed(F f){
+            std::time_t cputime0 = std::clock();
+            auto t_start = std::chrono::high_resolution_clock::now();
+            f();
+            m_integr.m_time_cpu += (std::clock() - cputime0) / (double)CLOCKS_PER_SEC;
+            m_integr.m_time_wall += std::chrono::duration<double>(
+                std::chrono::high_resolution_clock::now() - t_start).count();
+        }
+
+        void do_step(){
+            m_stepper->do_step();
+            m_integr.m_nsteps++;
+        }
+
+    public:
+        Stepping(OdeSys * const odesys,
+                 const double atol,
+                 const double rtol,
+                 const StepType styp,
+                 const double * const y0,
+                 const double x0,
+                 long int mxsteps=0,
+                 double dx0=0.0,
+                 double dx_max=0.0,
+                 int max_jac_age=10
+                 ) :
+            m_odesys(odesys),
+            m_integr(odesys, dx0, (dx_max == 0.0) ? INFINITY : dx_max, atol, rtol, styp,
+                     (mxsteps == 0) ? 500 : mxsteps),
+            m_y(y0, y0 + odesys->get_ny()), m_x(x0)
+        {
+            odesys->nfev = 0;
+            odesys->njev = 0;
+            m_integr.m_dx0 = resolve_dx0(odesys, dx0, x0, INFINITY, y0, atol, rtol, styp, m_integr.m_dx_max);
+            m_integr.m_w_policy.max_jac_age = max_jac_age;
+            m_integr.m_nsteps = 0;
+            m_integr.m_time_cpu = 0.0;
+            m_integr.m_time_wall = 0.0;
+            m_stepper = m_integr.dense_stepper(x0, y0);
+        }
+        Stepping(const Stepping &) = delete;
+        Stepping& operator=(const Stepping &) = delete;
+
+        double x() const { return m_x; }
+        const double * y() const { return m_y.data(); }
+        double dx() const { return m_stepper->current_time_step(); }  // size of the next step
+        long int n_steps() const { return m_integr.m_nsteps; }
+
+        // Takes one step (beyond the last x reached by advance_to), returns the new x.
+        double step(){
+            timed([&]{
+                this->do_step();
+                m_x = m_stepper->current_time();
+                m_stepper->current_state(m_y.data());
+            });
+            return m_x;
+        }
+
+        // As step() but shortened to end on xend if it would pass xend (rhs/jac are not called beyond xend).
+        double step(const double xend){
+            using boost::numeric::odeint::detail::less_with_sign;
+            const double x = m_stepper->current_time(), dx = m_stepper->current_time_step();
+            if (less_with_sign(xend, x + dx, dx)){
+                std::vector<double> y(m_y.size());
+                m_stepper->current_state(y.data());
+                m_stepper->initialize(y.data(), x, xend - x);
+            }
+            return this->step();
+        }
+
+        // Ends the integration early (return_on_error), reported as info['status'] by set_info.
+        void stop(IntegrStatus status){
+            m_integr.m_status = status;
+        }
+
+        // Integrates up to x (no step is taken if x lies within the last step), returns the number of steps taken.
+        // Before the first step the state at x0 is the only one known: the first step then ends on x at the latest.
+        long int advance_to(const double x){
+            using boost::numeric::odeint::detail::less_with_sign;
+            if (x == m_x)
+                return 0;
+            if (less_with_sign(x, m_x, m_stepper->current_time_step()))
+                throw std::runtime_error(StreamFmt() << "advance_to: x=" << x << " lies behind the current x="
+                                         << m_x);
+            long int nsteps = 0;
+            timed([&]{
+                if (m_integr.m_nsteps == 0 &&
+                    less_with_sign(x, m_x + m_stepper->current_time_step(), m_stepper->current_time_step()))
+                    m_stepper->initialize(m_y.data(), m_x, x - m_x);
+                while (less_with_sign(m_stepper->current_time(), x, m_stepper->current_time_step())){
+                    if (nsteps == m_integr.m_mxsteps)
+                        throw std::runtime_error(StreamFmt() << "Maximum number of steps reached: " << nsteps);
+                    this->do_step();
+                    nsteps++;
+                }
+                if (x == m_stepper->current_time())
+                    m_stepper->current_state(m_y.data());
+                else
+                    m_stepper->calc_state(x, m_y.data());
+                m_x = x;
+            });
+            return nsteps;
+        }
+
+        // y at x within the last step taken (e.g. by step()), without changing the state.
+        void calc_state(const double x, double * const y) const {
+            m_stepper->calc_state(x, y);
+        }
+
+        // Info of all calls so far in odesys->current_info.
+        void set_info() const {
+            m_odesys->current_info.clear();
+            set_integration_info(m_odesys, m_integr);
+        }
+    };
+
+    // Integrates from x0 to xend and keeps the dense output of every step (see dense_solution), which may
+    // then be evaluated anywhere in [x0, xend] without further calls of rhs. The last step is shortened to end
+    // on xend. With return_on_error the integration ends early (info['status']) at the last accepted step
+    // instead of throwing when mxsteps is reached or a step fails (its message is appended to diagnostics).
+    template <class OdeSys>
+    dense_solution
+    simple_dense(OdeSys * const odesys,
+                 const double atol,
+                 const double rtol,
+                 const StepType styp,
+                 const double * const y0,
+                 const double x0,
+                 const double xend,
+                 long int mxsteps=0,
+                 double dx0=0.0,
+                 double dx_max=0.0,
+                 int max_jac_age=10,
+                 bool return_on_error=false,
+                 std::string * diagnostics=nullptr)
+    {
+        using boost::numeric::odeint::detail::less_with_sign;
+        if (mxsteps == 0)
+            mxsteps = 500;
+        Stepping<OdeSys> stepping(odesys, atol, rtol, styp, y0, x0, mxsteps, dx0, dx_max, max_jac_age);
+        if (xend != x0 && (xend - x0)*stepping.dx() < 0)
+            throw std::runtime_error(StreamFmt() << "simple_dense: dx0 (" << stepping.dx()
+                                     << ") points away from xend");
+        dense_solution sol(odesys->get_ny(), x0, y0);
+        IntegrStatus status = IntegrStatus::success;
+        while (less_with_sign(stepping.x(), xend, stepping.dx())){
+            if (stepping.n_steps() == mxsteps){
+                if (!return_on_error)
+                    throw std::runtime_error(StreamFmt() << "Maximum number of steps reached: " << mxsteps);
+                status = IntegrStatus::mxsteps_reached;
+                if (diagnostics)
+                    diagnostics->append(StreamFmt() << "Maximum number of steps reached: " << mxsteps).push_back('\n');
+                break;
+            }
+            try {
+                stepping.step(xend);
+            } catch (const std::exception& e) {
+                if (!return_on_error)
+                    throw;
+                status = IntegrStatus::step_failed;
+                if (diagnostics)
+                    diagnostics->append(e.what()).push_back('\n');
+                break;
+            }
+            sol.add_step(stepping.x(), stepping.y(), [&](double x, double * y){ stepping.calc_state(x, y); });
+        }
+        sol.set_x_end(status == IntegrStatus::success ? xend : stepping.x());
+        stepping.stop(status);
+        stepping.set_info();
+        return sol;
+    }
 }
 
 #endif /* ODEINT_ANYODE_H_6D2AAAD4880011E6AC5C734FA77443A3 */
@@ -5,13 +5,57 @@ from libcpp.string cimport string
 from libcpp.utility cimport pair
 from libcpp cimport bool
 
+cdef extern from "odeint_anyode_sink.hpp" namespace "odeint_anyode":
+    cdef cppclass trajectory_sink:
+        long int nrows
+        double x_last
+
+    cdef cppclass npy_sink(trajectory_sink):
+        npy_sink(const string&, int) except +
+
+cdef extern from "odeint_anyode_dense.hpp" namespace "odeint_anyode":
+    cdef cppclass dense_solution:
+        dense_solution()
+        int ny()
+        long int n_steps()
+        double x_begin()
+        double x_end()
+        const vector[double]& breakpoints()
+        void operator()(long int, const double * const, double * const) except + nogil
+
+cdef extern from "odeint_anyode_trace.hpp" namespace "odeint_anyode":
+    cdef cppclass step_trace:
+        bool history
+
 cdef extern from "odeint_anyode.hpp" namespace "odeint_anyode":
     cdef cppclass StepType:
         pass
 
+    cdef cppclass output_policy:
+        long int stride
+        double dx, dy_rel
+        bool final_only
+
     cdef cppclass Integr[U]:
         double m_time_cpu, m_time_wall
 
+    cdef cppclass Session[U]:
+        Session(U * const, const double, const double, const StepType, long int, double, double, int, bool, bool,
+                int)
+        int predefined(const double * const, const int, const double * const, double * const) except + nogil
+        void set_info()
+
+    cdef cppclass Stepping[U]:
+        Stepping(U * const, const double, const double, const StepType, const double * const, const double, long int,
+                 double, double, int) except +
+        double x()
+        const double * y()
+        double dx()
+        long int n_steps()
+        double step() except + nogil
+        long int advance_to(const double) except + nogil
+        void set_info()
+
     cdef int simple_predefined[U](
         U * const,
         const double,
@@ -25,8 +69,12 @@ cdef extern from "odeint_anyode.hpp" namespace "odeint_anyode":
         double,
         double,
         int,
-        bool
-    ) except +
+        bool,
+        bool,
+        int,
+        step_trace *,
+        string *
+    ) except + nogil
 
     cdef pair[vector[double], vector[double]] simple_adaptive[U](
         U * const,
@@ -41,7 +89,29 @@ cdef extern from "odeint_anyode.hpp" namespace "odeint_anyode":
         double,
         int,
         bool,
-    ) except +
+        int,
+        trajectory_sink *,
+        long int,
+        output_policy,
+        step_trace *,
+        string *
+    ) except + nogil
+
+    cdef dense_solution simple_dense[U](
+        U * const,
+        const double,
+        const double,
+        const StepType,
+        const double * const,
+        const double,
+        const double,
+        long int,
+        double,
+        double,
+        int,
+        bool,
+        string *
+    ) except + nogil
 
     cdef StepType styp_from_name(string) except + nogil
     cdef bool requires_jacobian(StepType) nogil
@@ -51,3 +121,9 @@ cdef extern from "odeint_anyode.hpp" namespace "odeint_anyode::StepType":
     cdef StepType bulirsch_stoer
     cdef StepType rosenbrock4
     cdef StepType dopri5
+    cdef StepType rosenbrock4_banded
+    cdef StepType rosenbrock4_sparse
+    cdef StepType ros34pw2
+    cdef StepType fehlberg78
+    cdef StepType cash_karp54
+    cdef StepType verner65
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <boost/numeric/odeint/algebra/algebra_dispatcher.hpp>
+#include <boost/numeric/odeint/algebra/norm_result_type.hpp>
+#include <boost/numeric/odeint/util/is_resizeable.hpp>
+
+namespace odeint_anyode {
+
+    // State type for odeint which either refers to caller provided (contiguous) memory,
+    // or owns its memory (the latter is how odeint creates the temporaries of a stepper).
+    // Assignment copies values (into the caller memory if that is what is referred to).
+    template<typename T>
+    class buffer_vector {
+        std::vector<T> m_own;
+        T * m_data = nullptr;
+        std::size_t m_size = 0;
+    public:
+        typedef T value_type;
+        typedef std::size_t size_type;
+        typedef T * iterator;
+        typedef const T * const_iterator;
+
+        buffer_vector() {}
+        explicit buffer_vector(std::size_t n) : m_own(n), m_data(m_own.data()), m_size(n) {}
+        buffer_vector(T * const data, std::size_t n) : m_data(data), m_size(n) {}
+        buffer_vector(const buffer_vector &other) :
+            m_own(other.begin(), other.end()), m_data(m_own.data()), m_size(other.m_size) {}
+        buffer_vector(buffer_vector &&other) :
+            m_own(std::move(other.m_own)), m_data(other.m_data), m_size(other.m_size) {
+            other.m_data = nullptr;
+            other.m_size = 0;
+        }
+        buffer_vector& operator=(const buffer_vector &other) {
+            if (this != &other) {
+                this->resize(other.m_size);
+                std::copy(other.begin(), other.end(), this->m_data);
+            }
+            return *this;
+        }
+
+        // Contents are not preserved when the size changes (odeint only resizes its temporaries).
+        void resize(std::size_t n) {
+            if (n == this->m_size)
+                return;
+            this->m_own.resize(n);
+            this->m_data = this->m_own.data();
+            this->m_size = n;
+        }
+        // Refer to caller memory (of the same size) from now on, e.g. a row of an output array.
+        void rebind(T * const data) {
+            this->m_data = data;
+        }
+        bool owns_data() const { return !this->m_own.empty() && this->m_data == this->m_own.data(); }
+
+        std::size_t size() const { return this->m_size; }
+        T * data() { return this->m_data; }
+        const T * data() const { return this->m_data; }
+        T& operator[](std::size_t i) { return this->m_data[i]; }
+        const T& operator[](std::size_t i) const { return this->m_data[i]; }
+        iterator begin() { return this->m_data; }
+        iterator end() { return this->m_data + this->m_size; }
+        const_iterator begin() const { return this->m_data; }
+        const_iterator end() const { return this->m_data + this->m_size; }
+    };
+
+    // odeint algebra for buffer_vector: plain index loops over contiguous memory.
+    struct buffer_algebra {
+        template<class S1, class Op>
+        static void for_each1(S1 &s1, Op op) { apply(op, s1); }
+
+        template<class S1, class S2, class Op>
+        static void for_each2(S1 &s1, S2 &s2, Op op) { apply(op, s1, s2); }
+
+        template<class S1, class S2, class S3, class Op>
+        static void for_each3(S1 &s1, S2 &s2, S3 &s3, Op op) { apply(op, s1, s2, s3); }
+
+        template<class S1, class S2, class S3, class S4, class Op>
+        static void for_each4(S1 &s1, S2 &s2, S3 &s3, S4 &s4, Op op) { apply(op, s1, s2, s3, s4); }
+
+        template<class S1, class S2, class S3, class S4, class S5, class Op>
+        static void for_each5(S1 &s1, S2 &s2, S3 &s3, S4 &s4, S5 &s5, Op op) { apply(op, s1, s2, s3, s4, s5); }
+
+        template<class S1, class S2, class S3, class S4, class S5, class S6, class Op>
+        static void for_each6(S1 &s1, S2 &s2, S3 &s3, S4 &s4, S5 &s5, S6 &s6, Op op) { apply(op, s1, s2, s3, s4, s5, s6); }
+
+        template<class S1, class S2, class S3, class S4, class S5, class S6, class S7, class Op>
+        static void for_each7(S1 &s1, S2 &s2, S3 &s3, S4 &s4, S5 &s5, S6 &s6, S7 &s7, Op op) { apply(op, s1, s2, s3, s4, s5, s6, s7); }
+
+        template<class S1, class S2, class S3, class S4, class S5, class S6, class S7, class S8, class Op>
+        static void for_each8(S1 &s1, S2 &s2, S3 &s3, S4 &s4, S5 &s5, S6 &s6, S7 &s7, S8 &s8, Op op) { apply(op, s1, s2, s3, s4, s5, s6, s7, s8); }
+
+        template<class S1, class S2, class S3, class S4, class S5, class S6, class S7, class S8, class S9, class Op>
+        static void for_each9(S1 &s1, S2 &s2, S3 &s3, S4 &s4, S5 &s5, S6 &s6, S7 &s7, S8 &s8, S9 &s9, Op op) { apply(op, s1, s2, s3, s4, s5, s6, s7, s8, s9); }
+
+        template<class S1, class S2, class S3, class S4, class S5, class S6, class S7, class S8, class S9, class S10, class Op>
+        static void for_each10(S1 &s1, S2 &s2, S3 &s3, S4 &s4, S5 &s5, S6 &s6, S7 &s7, S8 &s8, S9 &s9, S10 &s10, Op op) { apply(op, s1, s2, s3, s4, s5, s6, s7, s8, s9, s10); }
+
+        template<class S1, class S2, class S3, class S4, class S5, class S6, class S7, class S8, class S9, class S10, class S11, class Op>
+        static void for_each11(S1 &s1, S2 &s2, S3 &s3, S4 &s4, S5 &s5, S6 &s6, S7 &s7, S8 &s8, S9 &s9, S10 &s10, S11 &s11, Op op) { apply(op, s1, s2, s3, s4, s5, s6, s7, s8, s9, s10, s11); }
+
+        template<class S1, class S2, class S3, class S4, class S5, class S6, class S7, class S8, class S9, class S10, class S11, class S12, class Op>
+        static void for_each12(S1 &s1, S2 &s2, S3 &s3, S4 &s4, S5 &s5, S6 &s6, S7 &s7, S8 &s8, S9 &s9, S10 &s10, S11 &s11, S12 &s12, Op op) { apply(op, s1, s2, s3, s4, s5, s6, s7, s8, s9, s10, s11, s12); }
+
+        template<class S1, class S2, class S3, class S4, class S5, class S6, class S7, class S8, class S9, class S10, class S11, class S12, class S13, class Op>
+        static void for_each13(S1 &s1, S2 &s2, S3 &s3, S4 &s4, S5 &s5, S6 &s6, S7 &s7, S8 &s8, S9 &s9, S10 &s10, S11 &s11, S12 &s12, S13 &s13, Op op) { apply(op, s1, s2, s3, s4, s5, s6, s7, s8, s9, s10, s11, s12, s13); }
+
+        template<class S1, class S2, class S3, class S4, class S5, class S6, class S7, class S8, class S9, class S10, class S11, class S12, class S13, class S14, class Op>
+        static void for_each14(S1 &s1, S2 &s2, S3 &s3, S4 &s4, S5 &s5, S6 &s6, S7 &s7, S8 &s8, S9 &s9, S10 &s10, S11 &s11, S12 &s12, S13 &s13, S14 &s14, Op op) { apply(op, s1, s2, s3, s4, s5, s6, s7, s8, s9, s10, s11, s12, s13, s14); }
+
+        template<class S1, class S2, class S3, class S4, class S5, class S6, class S7, class S8, class S9, class S10, class S11, class S12, class S13, class S14, class S15, class Op>
+        static void for_each15(S1 &s1, S2 &s2, S3 &s3, S4 &s4, S5 &s5, S6 &s6, S7 &s7, S8 &s8, S9 &s9, S10 &s10, S11 &s11, S12 &s12, S13 &s13, S14 &s14, S15 &s15, Op op) { apply(op, s1, s2, s3, s4, s5, s6, s7, s8, s9, s10, s11, s12, s13, s14, s15); }
+
+        template<class S>
+        static typename boost::numeric::odeint::norm_result_type<S>::type norm_inf(const S &s) {
+            typename boost::numeric::odeint::norm_result_type<S>::type result = 0;
+            for (std::size_t i=0; i<s.size(); ++i)
+                result = std::max(result, std::abs(s[i]));
+            return result;
+        }
+    private:
+        template<class Op, class S1, class... S>
+        static void apply(Op &op, S1 &s1, S&... s) {
+            const std::size_t n = s1.size();
+            for (std::size_t i=0; i<n; ++i)
+                op(s1[i], s[i]...);
+        }
+    };
+}
+
+namespace boost { namespace numeric { namespace odeint {
+    template<typename T>
+    struct is_resizeable< odeint_anyode::buffer_vector<T> > : boost::true_type {};
+
+    template<typename T>
+    struct algebra_dispatcher< odeint_anyode::buffer_vector<T> > {
+        typedef odeint_anyode::buffer_algebra algebra_type;
+    };
+} } }
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace odeint_anyode {
+
+    // Continuous solution of an integration (see simple_dense): the dense output of every accepted step
+    // [x[i], x[i+1]] sampled at nodes + 1 equidistant points (shared between neighbouring steps) and evaluated
+    // as the interpolating polynomial of degree ``nodes`` (barycentric form), i.e. no calls of rhs.
+    // This reproduces the dense output of dopri5 (degree 5), rosenbrock4* & ros34pw2 (degree 3) exactly and
+    // approximates the one of bulirsch_stoer (order 5 within each step).
+    class dense_solution {
+        int m_ny = 0;
+        double m_x_end = NAN;  // may lie within the last step
+        std::vector<double> m_x;  // breakpoints, increasing or decreasing
+        std::vector<double> m_y;  // (nodes*n_steps() + 1) x ny (row major)
+
+        long int step_index(double x) const {
+            const long int nsteps = this->n_steps();
+            if (nsteps == 0)
+                return 0;
+            const auto first = m_x.begin() + 1, last = m_x.end() - 1;
+            const auto it = (m_x.back() > m_x.front()) ? std::upper_bound(first, last, x) :
+                std::upper_bound(first, last, x, [](double a, double b){ return a > b; });
+            return it - m_x.begin() - 1;
+        }
+
+    public:
+        static constexpr int nodes = 5;
+
+        dense_solution() {}
+        dense_solution(int ny, double x0, const double * const y0) :
+            m_ny(ny), m_x_end(x0), m_x(1, x0), m_y(y0, y0 + ny) {}
+
+        int ny() const { return m_ny; }
+        long int n_steps() const { return static_cast<long int>(m_x.size()) - 1; }
+        double x_begin() const { return m_x.front(); }
+        double x_end() const { return m_x_end; }
+        const std::vector<double>& breakpoints() const { return m_x; }
+        const double * y_breakpoint(long int i) const { return &m_y[i*nodes*m_ny]; }  // i in [0, n_steps()]
+
+        // Appends the step ending in (x, y), calc_state(xi, yi) gives the dense output within it.
+        template <class CalcState>
+        void add_step(double x, const double * const y, CalcState calc_state){
+            const double x_prev = m_x.back();
+            const std::size_t offset = m_y.size();
+            m_y.resize(offset + nodes*m_ny);
+            for (int j=1; j<nodes; ++j)
+                calc_state(x_prev + (x - x_prev)*j/nodes, &m_y[offset + (j - 1)*m_ny]);
+            std::copy(y, y + m_ny, &m_y[offset + (nodes - 1)*m_ny]);
+            m_x.push_back(x);
+            m_x_end = x;
+        }
+
+        // Restricts the domain to [x_begin(), x] (x within the last step).
+        void set_x_end(double x){ m_x_end = x; }
+
+        // y[ny] at x in [x_begin(), x_end()].
+        void eval(double x, double * const y) const {
+            const double lo = std::min(m_x.front(), m_x_end), hi = std::max(m_x.front(), m_x_end);
+            if (!(x >= lo && x <= hi)){
+                std::ostringstream msg;
+                msg << "dense_solution: x=" << x << " outside [" << lo << ", " << hi << "]";
+                throw std::domain_error(msg.str());
+            }
+            const long int i = this->step_index(x);
+            const double * const rows = this->y_breakpoint(i);
+            if (this->n_steps() == 0){
+                std::copy(rows, rows + m_ny, y);
+                return;
+            }
+            const double t = (x - m_x[i])/(m_x[i + 1] - m_x[i])*nodes;  // in [0, nodes]
+            // barycentric weights of equidistant nodes: (-1)**j * binomial(nodes, j)
+            static constexpr double w[nodes + 1] = {1, -5, 10, -10, 5, -1};
+            double c[nodes + 1], csum = 0;
+            for (int j=0; j<=nodes; ++j){
+                if (t == j){
+                    std::copy(rows + j*m_ny, rows + (j + 1)*m_ny, y);
+                    return;
+                }
+                c[j] = w[j]/(t - j);
+                csum += c[j];
+            }
+            std::fill(y, y + m_ny, 0.0);
+            for (int j=0; j<=nodes; ++j)
+                for (int k=0; k<m_ny; ++k)
+                    y[k] += c[j]/csum*rows[j*m_ny + k];
+        }
+
+        // y[n*ny] at x[n] (any order).
+        void operator()(long int n, const double * const x, double * const y) const {
+            for (long int i=0; i<n; ++i)
+                this->eval(x[i], y + i*m_ny);
+        }
+    };
+
+}
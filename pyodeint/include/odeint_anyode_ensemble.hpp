@@ -0,0 +1,960 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "odeint_anyode_parallel.hpp"
+#include "odeint_anyode_rosenbrock4.hpp"
+
+// Vector width (number of lanes) of the lockstep ensemble integrator, doubles per SIMD register.
+#ifndef ODEINT_ANYODE_ENSEMBLE_WIDTH
+  #if defined(__AVX512F__)
+    #define ODEINT_ANYODE_ENSEMBLE_WIDTH 8
+  #else
+    #define ODEINT_ANYODE_ENSEMBLE_WIDTH 4
+  #endif
+#endif
+
+#if defined(_OPENMP)
+  #define ODEINT_ANYODE_SIMD _Pragma("omp simd")
+#else
+  #define ODEINT_ANYODE_SIMD
+#endif
+
+namespace odeint_anyode_parallel {
+
+    // Right-hand side (and Jacobian) of several ensemble members in a single call, e.g. a
+    // vectorized Python callback. Row k belongs to member idx[k] (k < n): t[n], y & f [n*ny],
+    // jac [n*ny*ny] (row major, zeroed before the call) and dfdt [n*ny] (zeroed before the call).
+    struct ensemble_batch {
+        virtual ~ensemble_batch() {}
+        virtual void rhs(int n, const int * idx, const double * t, const double * y, double * f) = 0;
+        virtual void jac(int, const int *, const double *, const double *, double *, double *){
+            throw std::runtime_error("ensemble_batch: no Jacobian callback");
+        }
+    };
+
+    // Member of an ensemble which is evaluated by an ensemble_batch (holds ny, the counters & the info).
+    struct ensemble_member : public AnyODE::OdeSysBase<double, int> {
+        const int m_ny;
+        explicit ensemble_member(int ny) : m_ny(ny) {}
+        int get_ny() const override { return m_ny; }
+        AnyODE::Status rhs(double, const double * const, double * const) override {
+            throw std::runtime_error("ensemble_member: the right-hand side is given by an ensemble_batch");
+        }
+    };
+
+    // Lane bookkeeping of the lockstep ensemble steppers (ensemble_dopri5 & ensemble_rosenbrock4):
+    // the state of W instances ("lanes") is stored in structure-of-arrays layout (component i of
+    // lane l at [i*W + l]) so that the stage combinations and the error norm are vectorized across
+    // lanes. Every lane has its own time, step size and step size control, lanes which are finished
+    // (or failed) are masked and refilled with the next instance (W == 0: number of lanes given at
+    // runtime). The right-hand side is either called per lane (the only scalar part: the state of
+    // a lane is gathered to, and its derivative scattered from, contiguous memory, which limits the
+    // gain to small systems, see tests/bench_ensemble.cpp), or once for all active lanes through
+    // an ensemble_batch.
+    template <class Derived, class OdeSys, int W>
+    class ensemble_lanes {
+    protected:
+        static constexpr int max_fails = 500;  // consecutive rejected steps (cf. odeint's failed_step_checker)
+        enum class Lane { idle, active };
+
+        const int m_ny, m_width;
+        const double m_atol, m_rtol;
+        const long int m_mxsteps;
+        ensemble_batch * const m_batch;
+        std::vector<double> m_y, m_ytmp;
+        std::vector<double> m_ybuf, m_fbuf, m_tbuf;  // gathered rows (one per lane, or per batch)
+        std::vector<int> m_ibuf, m_lbuf;  // member & lane of the gathered rows
+        std::vector<Lane> m_lane;
+        std::vector<int> m_idx, m_istop, m_nfails;
+        std::vector<long int> m_nsteps, m_nsteps_stop, m_nrejected;
+        std::vector<double> m_t, m_dt, m_h, m_dx_max, m_err;
+        std::vector<char> m_clamped, m_accept;
+        std::vector<std::clock_t> m_cputime0;
+        std::vector<std::chrono::high_resolution_clock::time_point> m_wall0;
+
+        ensemble_lanes(int ny, double atol, double rtol, long int mxsteps, ensemble_batch * batch, int width) :
+            m_ny(ny), m_width(W > 0 ? W : width), m_atol(atol), m_rtol(rtol), m_mxsteps(mxsteps), m_batch(batch),
+            m_y(ny*m_width), m_ytmp(ny*m_width), m_ybuf(ny*m_width), m_fbuf(ny*m_width), m_tbuf(m_width),
+            m_ibuf(m_width), m_lbuf(m_width), m_lane(m_width, Lane::idle), m_idx(m_width), m_istop(m_width),
+            m_nfails(m_width), m_nsteps(m_width), m_nsteps_stop(m_width), m_nrejected(m_width), m_t(m_width),
+            m_dt(m_width), m_h(m_width), m_dx_max(m_width), m_err(m_width), m_clamped(m_width),
+            m_accept(m_width), m_cputime0(m_width), m_wall0(m_width) {
+            if (m_width < 1)
+                throw std::runtime_error("ensemble: the number of lanes needs to be positive");
+        }
+
+        // number of lanes (a compile time constant unless W == 0)
+        int width() const { return W > 0 ? W : m_width; }
+        Derived& derived() { return static_cast<Derived&>(*this); }
+
+    public:
+        // Integrates odesys[begin:end], ``Output`` provides the initial values, the points to
+        // stop at (the last one ends the integration, the others are interpolated if
+        // Output::interpolate) and receives the results:
+        //   x0(idx), y0(idx), dx0(idx), nstops(idx), stop(idx, istop), start(idx, t, y),
+        //   step(idx, t, y) (accepted steps, if Output::record_steps), stopped(idx, istop, y),
+        //   failed(idx, message)
+        template <class Output>
+        void run(const std::vector<OdeSys *> &odesys, int begin, const int end, Output &out,
+                 const double * const dx_max){
+            const int nl = width();
+            while (true) {
+                bool busy = false;
+                for (int l=0; l<nl; ++l){
+                    if (m_lane[l] == Lane::idle && begin < end)
+                        load(odesys, l, begin++, out, dx_max);
+                    busy = busy || m_lane[l] == Lane::active;
+                }
+                if (!busy)
+                    break;
+                derived().try_step(odesys, out);
+            }
+        }
+
+    protected:
+        template <class Output>
+        void load(const std::vector<OdeSys *> &odesys, int l, int idx, Output &out, const double * const dx_max){
+            const int nl = width();
+            m_cputime0[l] = std::clock();
+            m_wall0[l] = std::chrono::high_resolution_clock::now();
+            m_lane[l] = Lane::active;
+            m_idx[l] = idx;
+            m_istop[l] = 0;
+            m_nfails[l] = 0;
+            m_nsteps[l] = m_nsteps_stop[l] = m_nrejected[l] = 0;
+            m_t[l] = out.x0(idx);
+            m_dx_max[l] = std::isfinite(dx_max[idx]) ? std::abs(dx_max[idx]) : 0.0;
+            const double * const y0 = out.y0(idx);
+            for (int i=0; i<m_ny; ++i)
+                m_y[i*nl + l] = y0[i];
+            out.start(idx, m_t[l], y0);
+            if (out.nstops(idx) == 0){
+                this->unload(odesys, l);
+                return;
+            }
+            m_dt[l] = std::copysign(out.dx0(idx), out.stop(idx, 0) - m_t[l]);
+            derived().reset_lane(l);
+        }
+
+        void unload(const std::vector<OdeSys *> &odesys, int l){
+            OdeSys * const sys = odesys[m_idx[l]];
+            sys->current_info.clear();
+            sys->current_info.nfo_int["n_steps"] = m_nsteps[l];
+            sys->current_info.nfo_int["n_rejected"] = m_nrejected[l];
+            sys->current_info.nfo_int["nfev"] = sys->nfev;
+            sys->current_info.nfo_int["njev"] = sys->njev;
+            sys->current_info.nfo_dbl["time_cpu"] = (std::clock() - m_cputime0[l]) / (double)CLOCKS_PER_SEC;
+            sys->current_info.nfo_dbl["time_wall"] = std::chrono::duration<double>(
+                std::chrono::high_resolution_clock::now() - m_wall0[l]).count();
+            derived().write_info(sys->current_info, l);
+            m_lane[l] = Lane::idle;
+        }
+
+        template <class Output>
+        void fail(const std::vector<OdeSys *> &odesys, int l, Output &out, const std::string &msg){
+            this->unload(odesys, l);
+            out.failed(m_idx[l], msg);
+        }
+
+        // step size of each lane: limited by dx_max and the next stop, zero for masked lanes
+        template <class Output>
+        void set_steps(Output &out){
+            const int nl = width();
+            for (int l=0; l<nl; ++l){
+                m_clamped[l] = false;
+                m_accept[l] = false;
+                if (m_lane[l] != Lane::active){
+                    m_h[l] = 0;
+                    continue;
+                }
+                double dt = m_dt[l];
+                if (m_dx_max[l] > 0 && std::abs(dt) > m_dx_max[l])
+                    dt = std::copysign(m_dx_max[l], dt);
+                const int idx = m_idx[l];
+                const double remaining = out.stop(idx, Output::interpolate ? out.nstops(idx) - 1 : m_istop[l]) - m_t[l];
+                if (std::abs(dt) >= std::abs(remaining)){
+                    dt = remaining;
+                    m_clamped[l] = true;
+                }
+                m_h[l] = dt;
+            }
+        }
+
+        // f(t + c*h, src) into dst for the active lanes (only those with sel[l] if given)
+        void rhs(const std::vector<OdeSys *> &odesys, double c, const std::vector<double> &src,
+                 std::vector<double> &dst, const char * const sel=nullptr){
+            const int nl = width();
+            int n = 0;
+            for (int l=0; l<nl; ++l){
+                if (m_lane[l] != Lane::active || (sel && !sel[l]))
+                    continue;
+                double * const yrow = &m_ybuf[n*m_ny];
+                for (int i=0; i<m_ny; ++i)
+                    yrow[i] = src[i*nl + l];
+                if (m_batch){
+                    m_ibuf[n] = m_idx[l];
+                    m_lbuf[n] = l;
+                    m_tbuf[n] = m_t[l] + c*m_h[l];
+                    odesys[m_idx[l]]->nfev++;
+                    ++n;
+                } else {
+                    odesys[m_idx[l]]->rhs(m_t[l] + c*m_h[l], yrow, &m_fbuf[0]);
+                    for (int i=0; i<m_ny; ++i)
+                        dst[i*nl + l] = m_fbuf[i];
+                }
+            }
+            if (n > 0){
+                m_batch->rhs(n, &m_ibuf[0], &m_tbuf[0], &m_ybuf[0], &m_fbuf[0]);
+                for (int k=0; k<n; ++k){
+                    for (int i=0; i<m_ny; ++i)
+                        dst[i*nl + m_lbuf[k]] = m_fbuf[k*m_ny + i];
+                }
+            }
+        }
+
+        template <class Output>
+        void reject(const std::vector<OdeSys *> &odesys, int l, Output &out){
+            ++m_nrejected[l];
+            if (++m_nfails[l] == max_fails)
+                this->fail(odesys, l, out, StreamFmt() << "Max number of iterations exceeded ("
+                           << int(max_fails) << "). A new step size was not found.");
+        }
+
+        // New step size of a lane after an accepted step (m_accept[l] is set by the caller).
+        void accepted(int l, double dt){
+            if (m_clamped[l] && std::abs(dt) < std::abs(m_dt[l]))
+                dt = m_dt[l];  // a step shortened to reach a stop does not shrink the next one
+            if (m_dx_max[l] > 0 && std::abs(dt) > m_dx_max[l])
+                dt = std::copysign(m_dx_max[l], dt);
+            m_dt[l] = dt;
+            m_nfails[l] = 0;
+        }
+
+        // Output::interpolate: the stops within the accepted steps (before their end) from the dense output of
+        // the engine (calc_state), called before m_y is updated.
+        template <class Output>
+        void interpolate(Output &out){
+            const int nl = width();
+            for (int l=0; l<nl; ++l){
+                if (!m_accept[l])
+                    continue;
+                const int idx = m_idx[l], last = out.nstops(idx) - 1;
+                const double t_new = m_t[l] + m_h[l];
+                while (m_istop[l] < last && (out.stop(idx, m_istop[l]) - t_new)*m_h[l] < 0){
+                    derived().calc_state(l, (out.stop(idx, m_istop[l]) - m_t[l])/m_h[l], &m_ybuf[0]);
+                    out.stopped(idx, m_istop[l]++, &m_ybuf[0]);
+                    m_nsteps_stop[l] = 0;
+                }
+            }
+        }
+
+        // Time, output & stops of the lanes with an accepted step (m_y already updated).
+        template <class Output>
+        void advance(const std::vector<OdeSys *> &odesys, Output &out){
+            const int nl = width();
+            for (int l=0; l<nl; ++l){
+                if (!m_accept[l])
+                    continue;
+                const int idx = m_idx[l];
+                m_t[l] = m_clamped[l] ? out.stop(idx, m_istop[l]) : m_t[l] + m_h[l];
+                ++m_nsteps[l];
+                ++m_nsteps_stop[l];
+                if (Output::record_steps || m_clamped[l]){
+                    for (int i=0; i<m_ny; ++i)
+                        m_ybuf[i] = m_y[i*nl + l];
+                }
+                if (Output::record_steps)
+                    out.step(idx, m_t[l], &m_ybuf[0]);
+                if (m_clamped[l]){
+                    out.stopped(idx, m_istop[l], &m_ybuf[0]);
+                    m_nsteps_stop[l] = 0;
+                    if (++m_istop[l] == out.nstops(idx)){
+                        this->unload(odesys, l);
+                        continue;
+                    }
+                }
+                if (m_nsteps_stop[l] == m_mxsteps)
+                    this->fail(odesys, l, out, StreamFmt() << "Maximum number of steps reached: " << m_nsteps_stop[l]);
+            }
+        }
+    };
+
+    // dopri5 in lockstep, step size control as in odeint's controlled_runge_kutta with
+    // default_error_checker (i.e. the one used by multi_adaptive).
+    template <class OdeSys, int W=ODEINT_ANYODE_ENSEMBLE_WIDTH>
+    class ensemble_dopri5 : public ensemble_lanes<ensemble_dopri5<OdeSys, W>, OdeSys, W> {
+        using Base = ensemble_lanes<ensemble_dopri5<OdeSys, W>, OdeSys, W>;
+        friend Base;
+        using Base::m_ny; using Base::m_atol; using Base::m_rtol; using Base::m_lane; using Base::m_y;
+        using Base::m_ytmp; using Base::m_t; using Base::m_dt; using Base::m_h; using Base::m_err;
+        using Base::m_accept; using typename Base::Lane;
+
+        std::vector<double> m_ynew, m_k1, m_k2, m_k3, m_k4, m_k5, m_k6, m_k7;
+        std::vector<char> m_fresh;  // k1 not yet evaluated (newly loaded lane)
+
+    public:
+        ensemble_dopri5(int ny, double atol, double rtol, long int mxsteps, ensemble_batch * batch=nullptr,
+                        int width=0) :
+            Base(ny, atol, rtol, mxsteps, batch, width), m_ynew(ny*this->m_width), m_k1(ny*this->m_width),
+            m_k2(ny*this->m_width), m_k3(ny*this->m_width), m_k4(ny*this->m_width), m_k5(ny*this->m_width),
+            m_k6(ny*this->m_width), m_k7(ny*this->m_width), m_fresh(this->m_width) {}
+
+    private:
+        void reset_lane(int l) { m_fresh[l] = true; }
+        void write_info(AnyODE::Info &, int) {}
+
+        // y of lane l at t + s*h from the last step (before y & k1 are updated): the continuous extension of
+        // Dormand & Prince as in odeint's runge_kutta_dopri5::calc_state.
+        void calc_state(int l, double s, double * const yout) const {
+            static constexpr double b1 = 35.0/384, b3 = 500.0/1113, b4 = 125.0/192, b5 = -2187.0/6784, b6 = 11.0/84;
+            const double X1 = 5*(2558722523.0 - 31403016.0*s)/11282082432.0;
+            const double X3 = 100*(882725551.0 - 15701508.0*s)/32700410799.0;
+            const double X4 = 25*(443332067.0 - 31403016.0*s)/1880347072.0;
+            const double X5 = 32805*(23143187.0 - 3489224.0*s)/199316789632.0;
+            const double X6 = 55*(29972135.0 - 7076736.0*s)/822651844.0;
+            const double X7 = 10*(7414447.0 - 829305.0*s)/29380423.0;
+            const double A = s*s*(3 - 2*s), B = s*s*(s - 1), C = s*s*(s - 1)*(s - 1), D = s*(s - 1)*(s - 1);
+            const int nl = this->width();
+            const double h = m_h[l];
+            const double h1 = h*(A*b1 - C*X1 + D), h3 = h*(A*b3 + C*X3), h4 = h*(A*b4 - C*X4),
+                h5 = h*(A*b5 + C*X5), h6 = h*(A*b6 - C*X6), h7 = h*(B + C*X7);
+            for (int i=0; i<m_ny; ++i){
+                const int k = i*nl + l;
+                yout[i] = m_y[k] + h1*m_k1[k] + h3*m_k3[k] + h4*m_k4[k] + h5*m_k5[k] + h6*m_k6[k] + h7*m_k7[k];
+            }
+        }
+
+        template <class Output>
+        void try_step(const std::vector<OdeSys *> &odesys, Output &out){
+            // Dormand & Prince (1980), coefficients as in odeint's runge_kutta_dopri5
+            static constexpr double a21 = 1.0/5;
+            static constexpr double a31 = 3.0/40, a32 = 9.0/40;
+            static constexpr double a41 = 44.0/45, a42 = -56.0/15, a43 = 32.0/9;
+            static constexpr double a51 = 19372.0/6561, a52 = -25360.0/2187, a53 = 64448.0/6561, a54 = -212.0/729;
+            static constexpr double a61 = 9017.0/3168, a62 = -355.0/33, a63 = 46732.0/5247, a64 = 49.0/176,
+                a65 = -5103.0/18656;
+            static constexpr double b1 = 35.0/384, b3 = 500.0/1113, b4 = 125.0/192, b5 = -2187.0/6784, b6 = 11.0/84;
+            static constexpr double d1 = b1 - 5179.0/57600, d3 = b3 - 7571.0/16695, d4 = b4 - 393.0/640,
+                d5 = b5 + 92097.0/339200, d6 = b6 - 187.0/2100, d7 = -1.0/40;
+            const int nl = this->width();
+            const int n = m_ny*nl;
+
+            if (std::find(m_fresh.begin(), m_fresh.end(), true) != m_fresh.end()){
+                this->rhs(odesys, 0.0, m_y, m_k1, &m_fresh[0]);
+                std::fill(m_fresh.begin(), m_fresh.end(), false);
+            }
+            this->set_steps(out);
+
+            double * const y = &m_y[0];
+            double * const ytmp = &m_ytmp[0];
+            double * const ynew = &m_ynew[0];
+            double * const k1 = &m_k1[0];
+            const double * const k2 = &m_k2[0];
+            const double * const k3 = &m_k3[0];
+            const double * const k4 = &m_k4[0];
+            const double * const k5 = &m_k5[0];
+            const double * const k6 = &m_k6[0];
+            const double * const k7 = &m_k7[0];
+            const double * const ANYODE_RESTRICT h = &m_h[0];
+
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    ytmp[i+l] = y[i+l] + h[l]*a21*k1[i+l];
+            }
+            this->rhs(odesys, 1.0/5, m_ytmp, m_k2);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    ytmp[i+l] = y[i+l] + h[l]*(a31*k1[i+l] + a32*k2[i+l]);
+            }
+            this->rhs(odesys, 3.0/10, m_ytmp, m_k3);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    ytmp[i+l] = y[i+l] + h[l]*(a41*k1[i+l] + a42*k2[i+l] + a43*k3[i+l]);
+            }
+            this->rhs(odesys, 4.0/5, m_ytmp, m_k4);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    ytmp[i+l] = y[i+l] + h[l]*(a51*k1[i+l] + a52*k2[i+l] + a53*k3[i+l] + a54*k4[i+l]);
+            }
+            this->rhs(odesys, 8.0/9, m_ytmp, m_k5);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    ytmp[i+l] = y[i+l] + h[l]*(a61*k1[i+l] + a62*k2[i+l] + a63*k3[i+l] + a64*k4[i+l] +
+                                               a65*k5[i+l]);
+            }
+            this->rhs(odesys, 1.0, m_ytmp, m_k6);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    ynew[i+l] = y[i+l] + h[l]*(b1*k1[i+l] + b3*k3[i+l] + b4*k4[i+l] + b5*k5[i+l] + b6*k6[i+l]);
+            }
+            this->rhs(odesys, 1.0, m_ynew, m_k7);
+
+            // error relative to atol + rtol*(|y| + |h|*|dydt|), maximum norm
+            double * const ANYODE_RESTRICT err = &m_err[0];
+            std::fill(m_err.begin(), m_err.end(), 0.0);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l){
+                    const double e = h[l]*(d1*k1[i+l] + d3*k3[i+l] + d4*k4[i+l] + d5*k5[i+l] + d6*k6[i+l] +
+                                           d7*k7[i+l]);
+                    const double sk = m_atol + m_rtol*(std::abs(y[i+l]) + std::abs(h[l])*std::abs(k1[i+l]));
+                    err[l] = std::max(err[l], std::abs(e)/sk);
+                }
+            }
+
+            // per lane step size control (odeint's default_step_adjuster)
+            for (int l=0; l<nl; ++l){
+                if (m_lane[l] != Lane::active)
+                    continue;
+                if (!std::isfinite(err[l])){
+                    this->fail(odesys, l, out, StreamFmt() << "Non-finite error estimate at x=" << m_t[l]);
+                } else if (err[l] > 1){
+                    m_dt[l] = h[l]*std::max(0.9*std::pow(err[l], -1.0/3), 0.2);
+                    this->reject(odesys, l, out);
+                } else {
+                    m_accept[l] = true;
+                    double dt = h[l];
+                    if (err[l] < 0.5)
+                        dt *= 0.9*std::pow(std::max(std::pow(5.0, -5.0), err[l]), -1.0/5);
+                    this->accepted(l, dt);
+                }
+            }
+            if (Output::interpolate)
+                this->interpolate(out);
+            const char * const ANYODE_RESTRICT accept = &m_accept[0];
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l){
+                    y[i+l] = accept[l] ? ynew[i+l] : y[i+l];
+                    k1[i+l] = accept[l] ? k7[i+l] : k1[i+l];  // FSAL
+                }
+            }
+            this->advance(odesys, out);
+        }
+    };
+
+    // rosenbrock4 (Shampine's L-stable method, coefficients as in odeint) in lockstep, step size
+    // control as in odeint's rosenbrock4_controller. The Jacobian comes from dense_jac_rmaj per
+    // lane (or ensemble_batch::jac), each lane has its own LU factorization, and a lane retrying a
+    // rejected step reuses its Jacobian (reported as "njev_cached").
+    template <class OdeSys, int W=ODEINT_ANYODE_ENSEMBLE_WIDTH>
+    class ensemble_rosenbrock4 : public ensemble_lanes<ensemble_rosenbrock4<OdeSys, W>, OdeSys, W> {
+        using Base = ensemble_lanes<ensemble_rosenbrock4<OdeSys, W>, OdeSys, W>;
+        friend Base;
+        using Base::m_ny; using Base::m_atol; using Base::m_rtol; using Base::m_batch; using Base::m_lane;
+        using Base::m_y; using Base::m_ytmp; using Base::m_ybuf; using Base::m_fbuf; using Base::m_tbuf;
+        using Base::m_ibuf; using Base::m_lbuf; using Base::m_idx; using Base::m_t; using Base::m_dt;
+        using Base::m_h; using Base::m_err; using Base::m_accept; using Base::m_dx_max; using typename Base::Lane;
+
+        const odeint_anyode::rosenbrock4_coefficients<double> m_coef;
+        std::vector<double> m_f, m_fnew, m_dfdt, m_g1, m_g2, m_g3, m_g4, m_g5, m_xerr, m_ynew;
+        std::vector<double> m_jac, m_lu, m_jbuf;  // per lane: ny*ny (row major)
+        std::vector<int> m_piv;
+        std::vector<char> m_jac_ok, m_first_step, m_last_rejected, m_need;
+        std::vector<double> m_err_old, m_dt_old, m_inv_h;
+        std::vector<long int> m_njev_cached;
+
+    public:
+        ensemble_rosenbrock4(int ny, double atol, double rtol, long int mxsteps, ensemble_batch * batch=nullptr,
+                             int width=0) :
+            Base(ny, atol, rtol, mxsteps, batch, width), m_f(ny*this->m_width), m_fnew(ny*this->m_width),
+            m_dfdt(ny*this->m_width), m_g1(ny*this->m_width), m_g2(ny*this->m_width), m_g3(ny*this->m_width),
+            m_g4(ny*this->m_width), m_g5(ny*this->m_width), m_xerr(ny*this->m_width), m_ynew(ny*this->m_width),
+            m_jac(ny*ny*this->m_width), m_lu(ny*ny*this->m_width), m_jbuf(batch ? ny*ny*this->m_width : 0),
+            m_piv(ny*this->m_width), m_jac_ok(this->m_width), m_first_step(this->m_width),
+            m_last_rejected(this->m_width), m_need(this->m_width), m_err_old(this->m_width),
+            m_dt_old(this->m_width), m_inv_h(this->m_width), m_njev_cached(this->m_width) {}
+
+    private:
+        void reset_lane(int l){
+            m_jac_ok[l] = false;
+            m_first_step[l] = true;
+            m_last_rejected[l] = false;
+            m_err_old[l] = m_dt_old[l] = 0;
+            m_njev_cached[l] = 0;
+        }
+        void write_info(AnyODE::Info &nfo, int l) { nfo.nfo_int["njev_cached"] = m_njev_cached[l]; }
+
+        // y of lane l at t + s*h from the last step (before y is updated), as odeint's rosenbrock4::calc_state.
+        void calc_state(int l, double s, double * const yout) const {
+            const auto &c = m_coef;
+            const int nl = this->width();
+            for (int i=0; i<m_ny; ++i){
+                const int k = i*nl + l;
+                const double cont3 = c.d21*m_g1[k] + c.d22*m_g2[k] + c.d23*m_g3[k] + c.d24*m_g4[k] + c.d25*m_g5[k];
+                const double cont4 = c.d31*m_g1[k] + c.d32*m_g2[k] + c.d33*m_g3[k] + c.d34*m_g4[k] + c.d35*m_g5[k];
+                yout[i] = m_y[k]*(1 - s) + s*(m_ynew[k] + (1 - s)*(cont3 + s*cont4));
+            }
+        }
+
+        // Jacobian & dfdt at (t, y) of the active lanes with m_need[l]
+        void jacobian(const std::vector<OdeSys *> &odesys){
+            const int nl = this->width(), nn = m_ny*m_ny;
+            int n = 0;
+            for (int l=0; l<nl; ++l){
+                if (m_lane[l] != Lane::active || !m_need[l])
+                    continue;
+                double * const yrow = &m_ybuf[n*m_ny];
+                for (int i=0; i<m_ny; ++i)
+                    yrow[i] = m_y[i*nl + l];
+                if (m_batch){
+                    m_ibuf[n] = m_idx[l];
+                    m_lbuf[n] = l;
+                    m_tbuf[n] = m_t[l];
+                    odesys[m_idx[l]]->njev++;
+                    ++n;
+                } else {
+                    std::fill(&m_jac[l*nn], &m_jac[(l + 1)*nn], 0.0);
+                    std::fill(m_fbuf.begin(), m_fbuf.begin() + m_ny, 0.0);
+                    odesys[m_idx[l]]->dense_jac_rmaj(m_t[l], yrow, nullptr, &m_jac[l*nn], m_ny, &m_fbuf[0]);
+                    for (int i=0; i<m_ny; ++i)
+                        m_dfdt[i*nl + l] = m_fbuf[i];
+                }
+            }
+            if (n > 0){
+                std::fill(m_jbuf.begin(), m_jbuf.begin() + n*nn, 0.0);
+                std::fill(m_fbuf.begin(), m_fbuf.begin() + n*m_ny, 0.0);
+                m_batch->jac(n, &m_ibuf[0], &m_tbuf[0], &m_ybuf[0], &m_jbuf[0], &m_fbuf[0]);
+                for (int k=0; k<n; ++k){
+                    const int l = m_lbuf[k];
+                    std::copy(&m_jbuf[k*nn], &m_jbuf[(k + 1)*nn], &m_jac[l*nn]);
+                    for (int i=0; i<m_ny; ++i)
+                        m_dfdt[i*nl + l] = m_fbuf[k*m_ny + i];
+                }
+            }
+        }
+
+        // LU factorization (partial pivoting) of 1/(gamma*h)*I - J for every active lane
+        void factorize(){
+            const int nl = this->width(), nn = m_ny*m_ny;
+            for (int l=0; l<nl; ++l){
+                if (m_lane[l] != Lane::active)
+                    continue;
+                double * const lu = &m_lu[l*nn];
+                int * const piv = &m_piv[l*m_ny];
+                for (int i=0; i<nn; ++i)
+                    lu[i] = -m_jac[l*nn + i];
+                for (int i=0; i<m_ny; ++i)
+                    lu[i*m_ny + i] += 1.0/(m_coef.gamma*m_h[l]);
+                for (int k=0; k<m_ny; ++k){
+                    int p = k;
+                    for (int i=k+1; i<m_ny; ++i){
+                        if (std::abs(lu[i*m_ny + k]) > std::abs(lu[p*m_ny + k]))
+                            p = i;
+                    }
+                    piv[k] = p;
+                    if (p != k){
+                        for (int j=0; j<m_ny; ++j)
+                            std::swap(lu[k*m_ny + j], lu[p*m_ny + j]);
+                    }
+                    for (int i=k+1; i<m_ny; ++i){
+                        const double f = lu[i*m_ny + k] /= lu[k*m_ny + k];
+                        for (int j=k+1; j<m_ny; ++j)
+                            lu[i*m_ny + j] -= f*lu[k*m_ny + j];
+                    }
+                }
+            }
+        }
+
+        // g := (1/(gamma*h)*I - J)^-1 g for every active lane
+        void solve(std::vector<double> &g){
+            const int nl = this->width(), nn = m_ny*m_ny;
+            double * const b = &m_ybuf[0];
+            for (int l=0; l<nl; ++l){
+                if (m_lane[l] != Lane::active)
+                    continue;
+                const double * const lu = &m_lu[l*nn];
+                const int * const piv = &m_piv[l*m_ny];
+                for (int i=0; i<m_ny; ++i)
+                    b[i] = g[i*nl + l];
+                for (int k=0; k<m_ny; ++k){
+                    if (piv[k] != k)
+                        std::swap(b[k], b[piv[k]]);
+                }
+                for (int i=1; i<m_ny; ++i){
+                    for (int j=0; j<i; ++j)
+                        b[i] -= lu[i*m_ny + j]*b[j];
+                }
+                for (int i=m_ny-1; i>=0; --i){
+                    for (int j=i+1; j<m_ny; ++j)
+                        b[i] -= lu[i*m_ny + j]*b[j];
+                    b[i] /= lu[i*m_ny + i];
+                }
+                for (int i=0; i<m_ny; ++i)
+                    g[i*nl + l] = b[i];
+            }
+        }
+
+        template <class Output>
+        void try_step(const std::vector<OdeSys *> &odesys, Output &out){
+            const auto &c = m_coef;
+            const int nl = this->width();
+            const int n = m_ny*nl;
+            this->set_steps(out);
+
+            // f(y), J & dfdt: only for lanes which did not just reject a step from the same (t, y)
+            bool any = false;
+            for (int l=0; l<nl; ++l){
+                m_need[l] = m_lane[l] == Lane::active && !m_jac_ok[l];
+                any = any || m_need[l];
+                if (m_lane[l] == Lane::active && m_jac_ok[l])
+                    ++m_njev_cached[l];
+                m_inv_h[l] = (m_h[l] != 0) ? 1/m_h[l] : 0;
+            }
+            if (any){
+                this->rhs(odesys, 0.0, m_y, m_f, &m_need[0]);
+                this->jacobian(odesys);
+            }
+            for (int l=0; l<nl; ++l)
+                m_jac_ok[l] = m_lane[l] == Lane::active;
+            this->factorize();
+
+            double * const y = &m_y[0];
+            double * const ytmp = &m_ytmp[0];
+            double * const ynew = &m_ynew[0];
+            const double * const f = &m_f[0];
+            const double * const fnew = &m_fnew[0];
+            const double * const dfdt = &m_dfdt[0];
+            double * const g1 = &m_g1[0];
+            double * const g2 = &m_g2[0];
+            double * const g3 = &m_g3[0];
+            double * const g4 = &m_g4[0];
+            double * const g5 = &m_g5[0];
+            double * const xerr = &m_xerr[0];
+            const double * const ANYODE_RESTRICT h = &m_h[0];
+            const double * const ANYODE_RESTRICT ih = &m_inv_h[0];
+
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    g1[i+l] = f[i+l] + h[l]*c.d1*dfdt[i+l];
+            }
+            this->solve(m_g1);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    ytmp[i+l] = y[i+l] + c.a21*g1[i+l];
+            }
+            this->rhs(odesys, c.c2, m_ytmp, m_fnew);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    g2[i+l] = fnew[i+l] + h[l]*c.d2*dfdt[i+l] + c.c21*g1[i+l]*ih[l];
+            }
+            this->solve(m_g2);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    ytmp[i+l] = y[i+l] + c.a31*g1[i+l] + c.a32*g2[i+l];
+            }
+            this->rhs(odesys, c.c3, m_ytmp, m_fnew);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    g3[i+l] = fnew[i+l] + h[l]*c.d3*dfdt[i+l] + (c.c31*g1[i+l] + c.c32*g2[i+l])*ih[l];
+            }
+            this->solve(m_g3);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    ytmp[i+l] = y[i+l] + c.a41*g1[i+l] + c.a42*g2[i+l] + c.a43*g3[i+l];
+            }
+            this->rhs(odesys, c.c4, m_ytmp, m_fnew);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    g4[i+l] = fnew[i+l] + h[l]*c.d4*dfdt[i+l] +
+                        (c.c41*g1[i+l] + c.c42*g2[i+l] + c.c43*g3[i+l])*ih[l];
+            }
+            this->solve(m_g4);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    ytmp[i+l] = y[i+l] + c.a51*g1[i+l] + c.a52*g2[i+l] + c.a53*g3[i+l] + c.a54*g4[i+l];
+            }
+            this->rhs(odesys, 1.0, m_ytmp, m_fnew);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    g5[i+l] = fnew[i+l] + (c.c51*g1[i+l] + c.c52*g2[i+l] + c.c53*g3[i+l] + c.c54*g4[i+l])*ih[l];
+            }
+            this->solve(m_g5);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    ytmp[i+l] += g5[i+l];
+            }
+            this->rhs(odesys, 1.0, m_ytmp, m_fnew);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    xerr[i+l] = fnew[i+l] + (c.c61*g1[i+l] + c.c62*g2[i+l] + c.c63*g3[i+l] + c.c64*g4[i+l] +
+                                             c.c65*g5[i+l])*ih[l];
+            }
+            this->solve(m_xerr);
+
+            // error relative to atol + rtol*max(|y|, |ynew|), root mean square
+            double * const ANYODE_RESTRICT err = &m_err[0];
+            std::fill(m_err.begin(), m_err.end(), 0.0);
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l){
+                    ynew[i+l] = ytmp[i+l] + xerr[i+l];
+                    const double sk = m_atol + m_rtol*std::max(std::abs(y[i+l]), std::abs(ynew[i+l]));
+                    err[l] += xerr[i+l]*xerr[i+l]/(sk*sk);
+                }
+            }
+
+            // per lane step size control (Gustafsson's predictive controller, cf. rosenbrock4_controller)
+            static constexpr double safe = 0.9, fac1 = 5.0, fac2 = 1.0/6;
+            for (int l=0; l<nl; ++l){
+                if (m_lane[l] != Lane::active)
+                    continue;
+                err[l] = std::sqrt(err[l]/m_ny);
+                if (!std::isfinite(err[l])){
+                    this->fail(odesys, l, out, StreamFmt() << "Non-finite error estimate at x=" << m_t[l]);
+                    continue;
+                }
+                double fac = std::max(fac2, std::min(fac1, std::pow(err[l], 0.25)/safe));
+                double dt_new = h[l]/fac;
+                if (err[l] <= 1){
+                    if (m_first_step[l]){
+                        m_first_step[l] = false;
+                    } else {
+                        double fac_pred = (m_dt_old[l]/h[l])*std::pow(err[l]*err[l]/m_err_old[l], 0.25)/safe;
+                        fac_pred = std::max(fac2, std::min(fac1, fac_pred));
+                        fac = std::max(fac, fac_pred);
+                        dt_new = h[l]/fac;
+                    }
+                    m_dt_old[l] = h[l];
+                    m_err_old[l] = std::max(0.01, err[l]);
+                    if (m_last_rejected[l])
+                        dt_new = (h[l] >= 0) ? std::min(dt_new, h[l]) : std::max(dt_new, h[l]);
+                    m_last_rejected[l] = false;
+                    m_accept[l] = true;
+                    m_jac_ok[l] = false;
+                    this->accepted(l, dt_new);
+                } else {
+                    m_dt[l] = dt_new;
+                    m_last_rejected[l] = true;
+                    this->reject(odesys, l, out);
+                }
+            }
+            if (Output::interpolate)
+                this->interpolate(out);
+            const char * const ANYODE_RESTRICT accept = &m_accept[0];
+            for (int i=0; i<n; i+=nl){
+                ODEINT_ANYODE_SIMD
+                for (int l=0; l<nl; ++l)
+                    y[i+l] = accept[l] ? ynew[i+l] : y[i+l];
+            }
+            this->advance(odesys, out);
+        }
+    };
+
+    struct ensemble_adaptive_output {
+        static constexpr bool record_steps = true;
+        static constexpr bool interpolate = false;
+        const double * const m_y0, * const m_t0, * const m_tend;
+        const std::vector<double> &m_dx0;
+        const int m_ny;
+        std::vector<sa_t> &m_results;
+        std::vector<std::string> &m_errors;
+
+        double x0(int idx) const { return m_t0[idx]; }
+        const double * y0(int idx) const { return m_y0 + idx*m_ny; }
+        double dx0(int idx) const { return m_dx0[idx]; }
+        int nstops(int idx) const { return m_tend[idx] == m_t0[idx] ? 0 : 1; }
+        double stop(int idx, int) const { return m_tend[idx]; }
+        void start(int idx, double t, const double * const y) { step(idx, t, y); }
+        void step(int idx, double t, const double * const y){
+            m_results[idx].first.push_back(t);
+            m_results[idx].second.insert(m_results[idx].second.end(), y, y + m_ny);
+        }
+        void stopped(int, int, const double * const) {}
+        void failed(int idx, const std::string &msg) { m_errors[idx] = msg; }
+    };
+
+    struct ensemble_predefined_output {
+        static constexpr bool record_steps = false;
+        static constexpr bool interpolate = true;  // steps end on the last stop only
+        const double * const m_y0, * const m_tout;
+        double * const m_yout;
+        const std::vector<double> &m_dx0;
+        const int m_ny, m_nout;
+        std::vector<int> &m_nreached;
+        std::vector<std::string> &m_errors;
+
+        double x0(int idx) const { return m_tout[idx*m_nout]; }
+        const double * y0(int idx) const { return m_y0 + idx*m_ny; }
+        double dx0(int idx) const { return m_dx0[idx]; }
+        int nstops(int) const { return m_nout - 1; }
+        double stop(int idx, int istop) const { return m_tout[idx*m_nout + istop + 1]; }
+        void start(int idx, double, const double * const y){
+            std::copy(y, y + m_ny, m_yout + idx*m_nout*m_ny);
+            m_nreached[idx] = 1;
+        }
+        void step(int, double, const double * const) {}
+        void stopped(int idx, int istop, const double * const y){
+            std::copy(y, y + m_ny, m_yout + (idx*m_nout + istop + 1)*m_ny);
+            m_nreached[idx] = istop + 2;
+        }
+        void failed(int idx, const std::string &msg) { m_errors[idx] = msg; }
+    };
+
+    // dx0 & dx_max resolved as in simple_adaptive/simple_predefined (x0[idx*stride] to xend[idx*stride]), with a
+    // batch (no rhs per system) the initial step size is not estimated but 100*eps (relative to x0).
+    template <class OdeSys>
+    void ensemble_resolve_steps(const std::vector<OdeSys *> &odesys, const double * const x0,
+                                const double * const xend, int stride, const double * const y0,
+                                const double * const dx0, const double * const dx_max, const double atol,
+                                const double rtol, StepType styp, const ensemble_batch * const batch,
+                                std::vector<double> &dx0_, std::vector<double> &dx_max_){
+        const int ny = odesys[0]->get_ny();
+        for (std::size_t idx=0; idx<odesys.size(); ++idx){
+            const double x = x0[idx*stride];
+            dx_max_[idx] = (dx_max[idx] == 0.0) ? odesys[idx]->get_dx_max(x, y0 + idx*ny) : dx_max[idx];
+            if (batch){
+                double d = dx0[idx];
+                if (d == 0.0)
+                    d = odesys[idx]->get_dx0(x, y0 + idx*ny);
+                if (d == 0.0)
+                    d = std::numeric_limits<double>::epsilon() * 100 * ((x == 0) ? 1 : x);
+                dx0_[idx] = d;
+            } else {
+                dx0_[idx] = odeint_anyode::resolve_dx0(odesys[idx], dx0[idx], x, xend[idx*stride], y0 + idx*ny, atol,
+                                                       rtol, styp, dx_max_[idx]);
+            }
+        }
+    }
+
+    template <template <class, int> class Engine, int W, class OdeSys, class Output>
+    void ensemble_chunks(const std::vector<OdeSys *> &odesys, const double atol, const double rtol,
+                         const long int mxsteps, Output &out, const double * const dx_max,
+                         ensemble_batch * const batch, const int chunk, const int width){
+        const int ny = odesys[0]->get_ny();
+        const int nsys = odesys.size();
+        const int nchunks = (nsys + chunk - 1)/chunk;
+        parallel_for(nchunks, [&](int ic){
+            Engine<OdeSys, W> engine(ny, atol, rtol, mxsteps, batch, width);
+            engine.run(odesys, ic*chunk, std::min(nsys, (ic + 1)*chunk), out, dx_max);
+        });
+    }
+
+    template <template <class, int> class Engine, class OdeSys, class Output>
+    void ensemble_dispatch(const std::vector<OdeSys *> &odesys, const double atol, const double rtol,
+                           const long int mxsteps, Output &out, const double * const dx_max,
+                           ensemble_batch * const batch, int batch_size){
+        constexpr int W = ODEINT_ANYODE_ENSEMBLE_WIDTH;
+        const int nsys = odesys.size();
+        if (batch){
+            // one task per thread, lanes (i.e. rows per batch call) given at runtime
+            const int nt = num_threads();
+            const int chunk = (nsys + nt - 1)/nt;
+            const int width = (batch_size > 0) ? std::min(batch_size, chunk) : chunk;
+            ensemble_chunks<Engine, 0>(odesys, atol, rtol, mxsteps, out, dx_max, batch, chunk, width);
+        } else {
+            // instances per task, lanes are refilled within a task
+            ensemble_chunks<Engine, W>(odesys, atol, rtol, mxsteps, out, dx_max, nullptr, 16*W, W);
+        }
+    }
+
+    template <class OdeSys, class Output>
+    void ensemble_run(const std::vector<OdeSys *> &odesys, const double atol, const double rtol,
+                      const long int mxsteps, Output &out, const double * const dx_max,
+                      const std::vector<std::string> &errors, bool return_on_error,
+                      StepType styp, ensemble_batch * const batch, int batch_size){
+        if (styp == StepType::dopri5)
+            ensemble_dispatch<ensemble_dopri5>(odesys, atol, rtol, mxsteps, out, dx_max, batch, batch_size);
+        else if (styp == StepType::rosenbrock4)
+            ensemble_dispatch<ensemble_rosenbrock4>(odesys, atol, rtol, mxsteps, out, dx_max, batch, batch_size);
+        else
+            throw std::runtime_error("ensemble: only dopri5 and rosenbrock4 are supported");
+        if (!return_on_error){
+            for (const auto &msg : errors)
+                if (!msg.empty())
+                    throw std::runtime_error(msg);
+        }
+    }
+
+    // Same as multi_adaptive (dopri5 or rosenbrock4) but integrated by ensemble_dopri5 or
+    // ensemble_rosenbrock4 (all systems of the same size). With ``batch`` the right-hand side (and
+    // Jacobian) of up to ``batch_size`` (default: all of a thread's) systems is evaluated per call.
+    template <class OdeSys>
+    std::vector<sa_t>
+    ensemble_adaptive(std::vector<OdeSys *> odesys, // vectorized
+                      const double atol,
+                      const double rtol,
+                      const double * const y0,  // vectorized
+                      const double * t0,  // vectorized
+                      const double * tend,  // vectorized
+                      long int mxsteps,
+                      const double * dx0,  // vectorized
+                      const double * dx_max,  // vectorized
+                      bool return_on_error=false,
+                      StepType styp=StepType::dopri5,
+                      ensemble_batch * batch=nullptr,
+                      int batch_size=0
+                      ){
+        const int ny = odesys[0]->get_ny();
+        const int nsys = odesys.size();
+        auto results = std::vector<sa_t>(nsys);
+        std::vector<std::string> errors(nsys);
+        std::vector<double> dx0_(nsys), dx_max_(nsys);
+        ensemble_resolve_steps(odesys, t0, tend, 1, y0, dx0, dx_max, atol, rtol, styp, batch, dx0_, dx_max_);
+        if (mxsteps == 0)
+            mxsteps = 500;
+        ensemble_adaptive_output out {y0, t0, tend, dx0_, ny, results, errors};
+        ensemble_run(odesys, atol, rtol, mxsteps, out, &dx_max_[0], errors, return_on_error, styp, batch, batch_size);
+        return results;
+    }
+
+    // Same as multi_predefined with single_pass but integrated as in ensemble_adaptive: only the last
+    // step is shortened (to end on the last point in tout), the other points are interpolated from the
+    // dense output of the steps containing them.
+    template <class OdeSys>
+    std::vector<int>
+    ensemble_predefined(std::vector<OdeSys *> odesys,  // vectorized
+                        const double atol,
+                        const double rtol,
+                        const double * const y0, // vectorized
+                        const std::size_t nout,
+                        const double * const tout, // vectorized
+                        double * const yout,  // vectorized
+                        long int mxsteps,
+                        const double * dx0,  // vectorized
+                        const double * dx_max,  // vectorized
+                        bool return_on_error=false,
+                        StepType styp=StepType::dopri5,
+                        ensemble_batch * batch=nullptr,
+                        int batch_size=0
+                        ){
+        const int ny = odesys[0]->get_ny();
+        const int nsys = odesys.size();
+        std::vector<int> nreached(nsys);
+        std::vector<std::string> errors(nsys);
+        std::vector<double> dx0_(nsys), dx_max_(nsys);
+        ensemble_resolve_steps(odesys, tout, tout + nout - 1, nout, y0, dx0, dx_max, atol, rtol, styp, batch,
+                               dx0_, dx_max_);
+        if (mxsteps == 0)
+            mxsteps = 500;
+        ensemble_predefined_output out {y0, tout, yout, dx0_, ny, static_cast<int>(nout), nreached, errors};
+        ensemble_run(odesys, atol, rtol, mxsteps, out, &dx_max_[0], errors, return_on_error, styp, batch, batch_size);
+        return nreached;
+    }
+
+}
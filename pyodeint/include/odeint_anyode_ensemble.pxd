@@ -0,0 +1,50 @@
+# -*- coding: utf-8; mode: cython -*-
+
+from libcpp cimport bool
+from libcpp.vector cimport vector
+from libcpp.utility cimport pair
+from anyode cimport Info
+from odeint_anyode cimport StepType
+
+cdef extern from "odeint_anyode_ensemble.hpp" namespace "odeint_anyode_parallel":
+    cdef cppclass ensemble_batch:
+        pass
+
+    cdef cppclass ensemble_member:
+        ensemble_member(int)
+        int get_ny()
+        int nfev, njev
+        Info current_info
+
+    cdef vector[pair[vector[double], vector[double]]] ensemble_adaptive[U](
+        vector[U*],
+        double,
+        double,
+        const double * const,
+        const double *,
+        const double *,
+        long int,
+        const double *,
+        const double *,
+        bool,
+        StepType,
+        ensemble_batch *,
+        int
+    ) nogil except +
+
+    cdef vector[int] ensemble_predefined[U](
+        vector[U*],
+        double,
+        double,
+        const double * const,
+        size_t,
+        const double * const,
+        double * const,
+        long int,
+        const double *,
+        const double *,
+        bool,
+        StepType,
+        ensemble_batch *,
+        int
+    ) nogil except +
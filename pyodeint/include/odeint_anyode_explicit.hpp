@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+#include <boost/array.hpp>
+#include <boost/fusion/container/generation/make_vector.hpp>
+#include <boost/numeric/odeint/algebra/algebra_dispatcher.hpp>
+#include <boost/numeric/odeint/algebra/operations_dispatcher.hpp>
+#include <boost/numeric/odeint/integrate/max_step_checker.hpp>
+#include <boost/numeric/odeint/stepper/controlled_runge_kutta.hpp>  // default_error_checker & _step_adjuster
+#include <boost/numeric/odeint/stepper/detail/generic_rk_operations.hpp>
+#include <boost/numeric/odeint/stepper/explicit_error_generic_rk.hpp>
+#include <boost/numeric/odeint/stepper/stepper_categories.hpp>
+#include <boost/numeric/odeint/util/resizer.hpp>
+
+namespace boost { namespace numeric { namespace odeint { namespace detail {
+
+    // odeint only provides the error sums of its own pairs (up to 6 & 13 stages), runge_kutta_verner65 has 8.
+    template<class Operations, class Fac, class Time>
+    struct generic_rk_scale_sum_err<8, Operations, Fac, Time> : public Operations::template scale_sum8<Time> {
+        generic_rk_scale_sum_err(const boost::array<Fac, 8> &a, Time dt) :
+            Operations::template scale_sum8<Time>(a[0]*dt, a[1]*dt, a[2]*dt, a[3]*dt, a[4]*dt, a[5]*dt, a[6]*dt,
+                                                  a[7]*dt) {}
+
+        typedef void result_type;
+    };
+
+}}}}
+
+namespace odeint_anyode {
+
+    template<class T, std::size_t N>
+    boost::array<T, N> rk_coefficients(const T (&values)[N]){
+        boost::array<T, N> arr;
+        std::copy(values, values + N, arr.begin());
+        return arr;
+    }
+
+    // Verner's 6(5) pair (as in DVERK, Hull, Enright & Jackson 1976): 8 stages, the solution of order 6
+    // is propagated, the embedded one of order 5 gives the error estimate.
+    template<class State, class Value=double, class Deriv=State, class Time=Value,
+             class Algebra=typename boost::numeric::odeint::algebra_dispatcher<State>::algebra_type,
+             class Operations=typename boost::numeric::odeint::operations_dispatcher<State>::operations_type,
+             class Resizer=boost::numeric::odeint::initially_resizer>
+    class runge_kutta_verner65 : public boost::numeric::odeint::explicit_error_generic_rk<
+        8, 6, 6, 5, State, Value, Deriv, Time, Algebra, Operations, Resizer> {
+    public:
+        typedef boost::numeric::odeint::explicit_error_generic_rk<
+            8, 6, 6, 5, State, Value, Deriv, Time, Algebra, Operations, Resizer> stepper_base_type;
+        typedef typename stepper_base_type::algebra_type algebra_type;
+
+        runge_kutta_verner65(const algebra_type &algebra=algebra_type()) : stepper_base_type(
+            boost::fusion::make_vector(
+                rk_coefficients<Value>({Value(1)/6}),
+                rk_coefficients<Value>({Value(4)/75, Value(16)/75}),
+                rk_coefficients<Value>({Value(5)/6, Value(-8)/3, Value(5)/2}),
+                rk_coefficients<Value>({Value(-165)/64, Value(55)/6, Value(-425)/64, Value(85)/96}),
+                rk_coefficients<Value>({Value(12)/5, Value(-8), Value(4015)/612, Value(-11)/36, Value(88)/255}),
+                rk_coefficients<Value>({Value(-8263)/15000, Value(124)/75, Value(-643)/680, Value(-81)/250,
+                                        Value(2484)/10625, Value(0)}),
+                rk_coefficients<Value>({Value(3501)/1720, Value(-300)/43, Value(297275)/52632, Value(-319)/2322,
+                                        Value(24068)/84065, Value(0), Value(3850)/26703})),
+            rk_coefficients<Value>({Value(3)/40, Value(0), Value(875)/2244, Value(23)/72, Value(264)/1955, Value(0),
+                                    Value(125)/11592, Value(43)/616}),
+            // b - bhat (order 5: 13/160, 0, 2375/5984, 5/16, 12/85, 3/44, 0, 0)
+            rk_coefficients<Value>({Value(3)/40 - Value(13)/160, Value(0), Value(875)/2244 - Value(2375)/5984,
+                                    Value(23)/72 - Value(5)/16, Value(264)/1955 - Value(12)/85, Value(-3)/44,
+                                    Value(125)/11592, Value(43)/616}),
+            rk_coefficients<Value>({Value(0), Value(1)/6, Value(4)/15, Value(2)/3, Value(5)/6, Value(1), Value(1)/15,
+                                    Value(1)}),
+            algebra) {}
+    };
+
+    // Drives the explicit error steppers which lack a dense output (runge_kutta_fehlberg78,
+    // runge_kutta_cash_karp54 & runge_kutta_verner65) through the interface of a dense output stepper used by
+    // Integr::integrate_steps. The step size control is that of odeint's controlled_runge_kutta (which copies a
+    // default constructed stepper: -Wuninitialized for the scratch of std::array states), the derivative at the end of
+    // a step is reused by the next one (as dopri5 does). There is no calc_state: these pairs come without an
+    // interpolant of their order, so single_pass and Stepping are not offered for them (see has_dense_output).
+    template<class ErrorStepper>
+    class explicit_controlled_stepper {
+    public:
+        typedef typename ErrorStepper::state_type state_type;
+        typedef typename ErrorStepper::value_type value_type;
+        typedef typename ErrorStepper::time_type time_type;
+        typedef boost::numeric::odeint::default_error_checker<
+            value_type, typename ErrorStepper::algebra_type, typename ErrorStepper::operations_type> checker_type;
+        typedef boost::numeric::odeint::default_step_adjuster<value_type, time_type> adjuster_type;
+
+    private:
+        ErrorStepper m_stepper;
+        checker_type m_checker;
+        adjuster_type m_adjuster;
+        state_type m_x{}, m_xnew{}, m_xerr{}, m_dxdt{};
+        time_type m_t = 0, m_dt = 0;
+        bool m_deriv_valid = false;
+
+        template<class System>
+        bool try_step(System &sys){
+            if (!m_adjuster.check_step_size_limit(m_dt)){
+                m_dt = m_adjuster.get_max_dt();
+                return false;
+            }
+            m_stepper.do_step(sys, m_x, m_dxdt, m_t, m_xnew, m_dt, m_xerr);
+            const value_type err = m_checker.error(m_stepper.algebra(), m_x, m_dxdt, m_xerr, m_dt);
+            if (err > 1){
+                m_dt = m_adjuster.decrease_step(m_dt, err, m_stepper.error_order());
+                return false;
+            }
+            m_t += m_dt;
+            m_dt = m_adjuster.increase_step(m_dt, err, m_stepper.stepper_order());
+            return true;
+        }
+
+    public:
+        // dx_max: maximum step size (as in odeint's make_dense_output)
+        explicit_controlled_stepper(value_type atol, value_type rtol, time_type dx_max) :
+            m_checker(atol, rtol), m_adjuster(dx_max) {}
+        // (integrate_steps takes its stepper by value) m_stepper holds nothing but its coefficients & scratch
+        explicit_controlled_stepper(const explicit_controlled_stepper &other) :
+            m_stepper(), m_checker(other.m_checker), m_adjuster(other.m_adjuster), m_x(other.m_x),
+            m_xnew(other.m_xnew), m_xerr(other.m_xerr), m_dxdt(other.m_dxdt), m_t(other.m_t), m_dt(other.m_dt),
+            m_deriv_valid(other.m_deriv_valid) {}
+
+        template<class StateType>
+        void initialize(const StateType &x0, time_type t0, time_type dt0){
+            m_x = x0;
+            m_t = t0;
+            m_dt = dt0;
+            m_deriv_valid = false;
+        }
+
+        template<class System>
+        std::pair<time_type, time_type> do_step(System sys){
+            if (!m_deriv_valid){
+                m_dxdt = m_xnew = m_xerr = m_x;  // (size)
+                sys(m_x, m_dxdt, m_t);
+                m_deriv_valid = true;
+            }
+            const time_type t_old = m_t;
+            boost::numeric::odeint::failed_step_checker fail_checker;
+            while (!this->try_step(sys))
+                fail_checker();
+            std::swap(m_x, m_xnew);
+            sys(m_x, m_dxdt, m_t);  // first stage of the next step
+            return std::make_pair(t_old, m_t);
+        }
+
+        const state_type& current_state() const { return m_x; }
+        time_type current_time() const { return m_t; }
+        time_type current_time_step() const { return m_dt; }
+    };
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cmath>
+#include <stdexcept>
+#include "anyode/anyode.hpp"
+
+namespace odeint_anyode_native {
+
+    // C callbacks (e.g. from ctypes, cffi or numba.cfunc), return value: 0 (success),
+    // 1 (recoverable error) or anything else (unrecoverable error), either error fails the step.
+    extern "C" {
+        typedef int (*rhs_t)(double t, const double * y, double * f, void * user_data);
+        // jmat: element (i, j) at jmat[i*ldim + j] (row major), banded: jmat[mupper + i - j + j*ldim]
+        // (column major, dfdt is NULL)
+        typedef int (*jac_t)(double t, const double * y, const double * fy, double * jmat, long int ldim,
+                             double * dfdt, void * user_data);
+        typedef int (*jac_csc_t)(double t, const double * y, const double * fy, double * data, int * colptrs,
+                                 int * rowvals, void * user_data);
+        typedef double (*dx_t)(double t, const double * y, void * user_data);
+    }
+
+    // System defined by C function pointers: no Python (and no GIL) involved when integrating.
+    // ``jac`` is a jac_csc_t when nnz >= 0, otherwise a jac_t.
+    struct NativeOdeSys : public AnyODE::OdeSysBase<double, int> {
+        using Status = AnyODE::Status;
+        int m_ny, m_mlower, m_mupper, m_nnz;
+        rhs_t m_rhs;
+        void * m_jac;
+        dx_t m_dx0, m_dx_max;
+        void * m_user_data;
+
+        NativeOdeSys(int ny, void * rhs, void * jac=nullptr, void * dx0=nullptr, void * dx_max=nullptr,
+                     void * user_data=nullptr, int mlower=-1, int mupper=-1, int nnz=-1) :
+            m_ny(ny), m_mlower(mlower), m_mupper(mupper), m_nnz(nnz), m_rhs(reinterpret_cast<rhs_t>(rhs)),
+            m_jac(jac), m_dx0(reinterpret_cast<dx_t>(dx0)), m_dx_max(reinterpret_cast<dx_t>(dx_max)),
+            m_user_data(user_data)
+        {
+            if (rhs == nullptr)
+                throw std::runtime_error("NativeOdeSys: rhs must not be NULL");
+        }
+
+        static Status as_status(int result){
+            if (result == 0)
+                return Status::success;
+            else if (result == 1)
+                return Status::recoverable_error;
+            return Status::unrecoverable_error;
+        }
+        void require_jac() const {
+            if (m_jac == nullptr)
+                throw std::runtime_error("NativeOdeSys: no jac callback given");
+        }
+
+        int get_ny() const override { return m_ny; }
+        int get_mlower() const override { return m_mlower; }
+        int get_mupper() const override { return m_mupper; }
+        int get_nnz() const override { return m_nnz; }
+        double get_dx0(double t, const double * const y) override {
+            return m_dx0 ? m_dx0(t, y, m_user_data) : this->default_dx0;
+        }
+        double get_dx_max(double t, const double * const y) override {
+            return m_dx_max ? m_dx_max(t, y, m_user_data) : INFINITY;
+        }
+        Status rhs(double t, const double * const y, double * const f) override {
+            this->nfev++;
+            return as_status(m_rhs(t, y, f, m_user_data));
+        }
+        Status dense_jac_rmaj(double t, const double * const ANYODE_RESTRICT y, const double * const ANYODE_RESTRICT fy,
+                              double * const ANYODE_RESTRICT jac, long int ldim,
+                              double * const ANYODE_RESTRICT dfdt=nullptr) override {
+            require_jac();
+            this->njev++;
+            return as_status(reinterpret_cast<jac_t>(m_jac)(t, y, fy, jac, ldim, dfdt, m_user_data));
+        }
+        Status banded_jac_cmaj(double t, const double * const ANYODE_RESTRICT y, const double * const ANYODE_RESTRICT fy,
+                               double * const ANYODE_RESTRICT jac, long int ldim) override {
+            require_jac();
+            this->njev++;
+            return as_status(reinterpret_cast<jac_t>(m_jac)(t, y, fy, jac, ldim, nullptr, m_user_data));
+        }
+        Status sparse_jac_csc(double t, const double * const ANYODE_RESTRICT y, const double * const ANYODE_RESTRICT fy,
+                              double * const ANYODE_RESTRICT data, int * const ANYODE_RESTRICT colptrs,
+                              int * const ANYODE_RESTRICT rowvals) override {
+            require_jac();
+            this->njev++;
+            return as_status(reinterpret_cast<jac_csc_t>(m_jac)(t, y, fy, data, colptrs, rowvals, m_user_data));
+        }
+    };
+
+}
@@ -0,0 +1,9 @@
+# -*- coding: utf-8; mode: cython -*-
+from anyode cimport Info
+
+cdef extern from "odeint_anyode_native.hpp" namespace "odeint_anyode_native":
+    cdef cppclass NativeOdeSys:
+        NativeOdeSys(int, void *, void *, void *, void *, void *, int, int, int) except +
+        int get_ny()
+        int nfev, njev
+        Info current_info
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "anyode/anyode_numpy.hpp"
+#include "odeint_anyode_ensemble.hpp"
+
+namespace odeint_anyode_numpy {
+
+    // Takes the GIL for as long as it is in scope.
+    class gil_guard {
+        PyGILState_STATE m_state;
+    public:
+        gil_guard() : m_state(PyGILState_Ensure()) {}
+        ~gil_guard() { PyGILState_Release(m_state); }
+        gil_guard(const gil_guard&) = delete;
+        gil_guard& operator=(const gil_guard&) = delete;
+    };
+
+    // Holds the first Python exception fetched (e.g. in a callback called from a thread without the GIL
+    // otherwise) until it is restored in the caller's thread (or dropped on destruction).
+    class kept_error {
+        PyObject * m_exc[3] = {nullptr, nullptr, nullptr};  // type, value & traceback
+    public:
+        kept_error() = default;
+        kept_error(const kept_error&) = delete;
+        kept_error& operator=(const kept_error&) = delete;
+        ~kept_error() {
+            if (m_exc[0]){
+                gil_guard gil;
+                Py_XDECREF(m_exc[0]); Py_XDECREF(m_exc[1]); Py_XDECREF(m_exc[2]);
+            }
+        }
+
+        // Fetches (and clears) the pending Python exception, returns "<type>: <message>". The exception is
+        // kept unless one is already (only the first is kept). Requires the GIL.
+        std::string fetch(){
+            PyObject *type, *value, *tb;
+            PyErr_Fetch(&type, &value, &tb);
+            PyErr_NormalizeException(&type, &value, &tb);
+            std::string msg = (type && PyType_Check(type)) ? reinterpret_cast<PyTypeObject *>(type)->tp_name : "?";
+            PyObject * str = value ? PyObject_Str(value) : nullptr;
+            const char * cstr = str ? PyUnicode_AsUTF8(str) : nullptr;
+            if (cstr)
+                msg += std::string(": ") + cstr;
+            Py_XDECREF(str);
+            PyErr_Clear();
+            if (m_exc[0] == nullptr){
+                m_exc[0] = type; m_exc[1] = value; m_exc[2] = tb;
+            } else {
+                Py_XDECREF(type); Py_XDECREF(value); Py_XDECREF(tb);
+            }
+            return msg;
+        }
+
+        // Raises the exception kept (as the pending Python exception, requires the GIL), returns whether
+        // there was one.
+        bool restore(){
+            if (m_exc[0] == nullptr)
+                return false;
+            PyErr_Restore(m_exc[0], m_exc[1], m_exc[2]);
+            m_exc[0] = m_exc[1] = m_exc[2] = nullptr;
+            return true;
+        }
+    };
+
+    // AnyODE::PyOdeSys which takes the GIL in every Python callback, so that the integration
+    // itself (e.g. multi_adaptive & multi_predefined on several threads) may run without it.
+    // An exception raised by a callback is fetched before the GIL is released (it would be lost or left
+    // pending on another thread's state otherwise): its message is added to the C++ exception which fails
+    // the step and the first one is kept until restore_error (or destruction).
+    template<typename Real_t=double, typename Index_t=int>
+    struct PyOdeSysGIL : public AnyODE::PyOdeSys<Real_t, Index_t> {
+        using Base = AnyODE::PyOdeSys<Real_t, Index_t>;
+        using Status = AnyODE::Status;
+        using Base::Base;
+
+        // Raises the first exception kept (requires the GIL), returns whether there was one.
+        bool restore_error() { return m_error.restore(); }
+
+        Real_t get_dx0(Real_t t, const Real_t * const y) override {
+            return this->call([&]{ return Base::get_dx0(t, y); });
+        }
+        Real_t get_dx_max(Real_t t, const Real_t * const y) override {
+            return this->call([&]{ return Base::get_dx_max(t, y); });
+        }
+        Status rhs(Real_t t, const Real_t * const y, Real_t * const f) override {
+            return this->call([&]{ return Base::rhs(t, y, f); });
+        }
+        Status dense_jac_rmaj(Real_t t, const Real_t * const ANYODE_RESTRICT y, const Real_t * const ANYODE_RESTRICT fy,
+                              Real_t * const ANYODE_RESTRICT jac, long int ldim,
+                              Real_t * const ANYODE_RESTRICT dfdt=nullptr) override {
+            return this->call([&]{ return Base::dense_jac_rmaj(t, y, fy, jac, ldim, dfdt); });
+        }
+        Status dense_jac_cmaj(Real_t t, const Real_t * const ANYODE_RESTRICT y, const Real_t * const ANYODE_RESTRICT fy,
+                              Real_t * const ANYODE_RESTRICT jac, long int ldim,
+                              Real_t * const ANYODE_RESTRICT dfdt=nullptr) override {
+            return this->call([&]{ return Base::dense_jac_cmaj(t, y, fy, jac, ldim, dfdt); });
+        }
+        Status banded_jac_cmaj(Real_t t, const Real_t * const ANYODE_RESTRICT y, const Real_t * const ANYODE_RESTRICT fy,
+                               Real_t * const ANYODE_RESTRICT jac, long int ldim) override {
+            return this->call([&]{ return Base::banded_jac_cmaj(t, y, fy, jac, ldim); });
+        }
+        Status sparse_jac_csc(Real_t t, const Real_t * const ANYODE_RESTRICT y, const Real_t * const ANYODE_RESTRICT fy,
+                              Real_t * const ANYODE_RESTRICT data, Index_t * const ANYODE_RESTRICT colptrs,
+                              Index_t * const ANYODE_RESTRICT rowvals) override {
+            return this->call([&]{ return Base::sparse_jac_csc(t, y, fy, data, colptrs, rowvals); });
+        }
+
+    private:
+        kept_error m_error;
+
+        template<class F>
+        auto call(F f) -> decltype(f()) {
+            gil_guard gil;
+            try {
+                return f();
+            } catch (const std::exception &e) {
+                if (!PyErr_Occurred())
+                    throw;
+                throw std::runtime_error(std::string(e.what()) + ": " + m_error.fetch());
+            }
+        }
+    };
+
+    // Raises (see PyOdeSysGIL::restore_error) the exception kept by the first of the systems which kept one,
+    // returns whether there was one. Requires the GIL.
+    template<class OdeSys>
+    bool restore_first_error(const std::vector<OdeSys *> &systems){
+        for (auto odesys : systems){
+            auto pysys = dynamic_cast<PyOdeSysGIL<> *>(odesys);
+            if (pysys && pysys->restore_error())
+                return true;
+        }
+        return false;
+    }
+
+    // NumPy array referring to data (not owned), read-only unless ``writeable``.
+    inline PyObject * as_array(int nd, npy_intp * dims, int typenum, const void * data, bool writeable){
+        PyObject * arr = PyArray_SimpleNewFromData(nd, dims, typenum, const_cast<void *>(data));
+        if (!writeable)
+            PyArray_CLEARFLAGS(reinterpret_cast<PyArrayObject*>(arr), NPY_ARRAY_WRITEABLE);
+        return arr;
+    }
+
+    // Vectorized Python callbacks of an ensemble (see odeint_anyode_parallel::ensemble_batch):
+    //   rhs(t[n], y[n, ny], fout[n, ny], idx[n]) and jac(t[n], y[n, ny], jmat_out[n, ny, ny], dfdx_out[n, ny], idx[n])
+    // where idx holds the indices of the systems in the batch. Takes the GIL in every call.
+    struct PyEnsembleBatch : public odeint_anyode_parallel::ensemble_batch {
+        const int m_ny;
+        PyObject * const m_py_rhs, * const m_py_jac;
+
+        PyEnsembleBatch(int ny, PyObject * py_rhs, PyObject * py_jac) :
+            m_ny(ny), m_py_rhs(py_rhs), m_py_jac(py_jac) {}
+
+        static void handle_result(PyObject * py_result, const char * what){
+            if (py_result == nullptr)
+                throw std::runtime_error(std::string(what) + " failed");
+            const long result = (py_result == Py_None) ? 0 : PyLong_AsLong(py_result);
+            Py_DECREF(py_result);
+            if (result != 0)
+                throw std::runtime_error(std::string(what) + " returned a non-zero status (not supported by ensembles)");
+        }
+
+        void rhs(int n, const int * idx, const double * t, const double * y, double * f) override {
+            gil_guard gil;
+            npy_intp ndims[1] { n }, ydims[2] { n, m_ny };
+            PyObject * py_t = as_array(1, ndims, NPY_DOUBLE, t, false);
+            PyObject * py_y = as_array(2, ydims, NPY_DOUBLE, y, false);
+            PyObject * py_f = as_array(2, ydims, NPY_DOUBLE, f, true);
+            PyObject * py_idx = as_array(1, ndims, NPY_INT, idx, false);
+            PyObject * py_result = PyObject_CallFunctionObjArgs(m_py_rhs, py_t, py_y, py_f, py_idx, nullptr);
+            Py_DECREF(py_t); Py_DECREF(py_y); Py_DECREF(py_f); Py_DECREF(py_idx);
+            handle_result(py_result, "rhs");
+        }
+        void jac(int n, const int * idx, const double * t, const double * y, double * jmat, double * dfdt) override {
+            if (m_py_jac == Py_None)
+                throw std::runtime_error("PyEnsembleBatch: no jac callback given");
+            gil_guard gil;
+            npy_intp ndims[1] { n }, ydims[2] { n, m_ny }, jdims[3] { n, m_ny, m_ny };
+            PyObject * py_t = as_array(1, ndims, NPY_DOUBLE, t, false);
+            PyObject * py_y = as_array(2, ydims, NPY_DOUBLE, y, false);
+            PyObject * py_jmat = as_array(3, jdims, NPY_DOUBLE, jmat, true);
+            PyObject * py_dfdt = as_array(2, ydims, NPY_DOUBLE, dfdt, true);
+            PyObject * py_idx = as_array(1, ndims, NPY_INT, idx, false);
+            PyObject * py_result = PyObject_CallFunctionObjArgs(m_py_jac, py_t, py_y, py_jmat, py_dfdt, py_idx, nullptr);
+            Py_DECREF(py_t); Py_DECREF(py_y); Py_DECREF(py_jmat); Py_DECREF(py_dfdt); Py_DECREF(py_idx);
+            handle_result(py_result, "jac");
+        }
+    };
+
+    // Python callable receiving the accepted steps in chunks: callback(x[n], y[n, ny]) (read-only arrays,
+    // only valid during the call). Takes the GIL in every call. An exception raised by the callback is kept
+    // (as in PyOdeSysGIL) and fails the integration, the sink is not called again (trajectory_sink::failed).
+    struct PyTrajectorySink : public odeint_anyode::trajectory_sink {
+        const int m_ny;
+        PyObject * const m_py_cb;
+
+        PyTrajectorySink(int ny, PyObject * py_cb) : m_ny(ny), m_py_cb(py_cb) {}
+
+        void write(long int n, const double * x, const double * y) override {
+            gil_guard gil;
+            npy_intp xdims[1] { n }, ydims[2] { n, m_ny };
+            PyObject * py_x = as_array(1, xdims, NPY_DOUBLE, x, false);
+            PyObject * py_y = as_array(2, ydims, NPY_DOUBLE, y, false);
+            PyObject * py_result = PyObject_CallFunctionObjArgs(m_py_cb, py_x, py_y, nullptr);
+            Py_DECREF(py_x); Py_DECREF(py_y);
+            if (py_result == nullptr)
+                throw std::runtime_error("sink callback failed: " + m_error.fetch());
+            Py_DECREF(py_result);
+        }
+
+        // Raises the exception kept (requires the GIL), returns whether there was one.
+        bool restore_error() { return m_error.restore(); }
+
+    private:
+        kept_error m_error;
+    };
+
+    // Raises (see PyTrajectorySink::restore_error) the exception kept by the first of the sinks which kept one,
+    // returns whether there was one. Requires the GIL.
+    inline bool restore_sink_error(odeint_anyode::trajectory_sink * const * sinks, std::size_t n){
+        for (std::size_t i=0; i<n; ++i){
+            auto pysink = dynamic_cast<PyTrajectorySink *>(sinks[i]);
+            if (pysink && pysink->restore_error())
+                return true;
+        }
+        return false;
+    }
+
+}
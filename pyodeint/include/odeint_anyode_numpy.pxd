@@ -0,0 +1,24 @@
+# -*- coding: utf-8; mode: cython -*-
+from cpython.object cimport PyObject
+from libcpp cimport bool
+from libcpp.vector cimport vector
+from anyode cimport Info
+from odeint_anyode cimport trajectory_sink
+
+cdef extern from "odeint_anyode_numpy.hpp" namespace "odeint_anyode_numpy":
+    cdef cppclass PyOdeSysGIL[Real_t, Index_t]:
+        PyOdeSysGIL(int, PyObject*, PyObject*, PyObject*, PyObject*, PyObject*, PyObject*, int, int, int, int,
+                    PyObject*, PyObject*, int)
+        int get_ny()
+        int nfev, njev
+        Info current_info
+
+    cdef bool restore_first_error[U](const vector[U*]&)
+
+    cdef cppclass PyEnsembleBatch:
+        PyEnsembleBatch(int, PyObject*, PyObject*)
+
+    cdef cppclass PyTrajectorySink(trajectory_sink):
+        PyTrajectorySink(int, PyObject*)
+
+    cdef bool restore_sink_error(trajectory_sink **, size_t)
@@ -1,17 +1,234 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+  #include <pthread.h>
+#endif
 #include "anyode/anyode_parallel.hpp"
 #include "odeint_anyode.hpp"
 
 namespace odeint_anyode_parallel {
 
     using odeint_anyode::StepType;
+    using odeint_anyode::output_policy;
     using odeint_anyode::simple_adaptive;
     using odeint_anyode::simple_predefined;
+    using odeint_anyode::trajectory_sink;
 
     using sa_t = std::pair<std::vector<double>, std::vector<double> >;
 
+    // Number of threads used by multi_* & ensemble_*: ANYODE_NUM_THREADS (default: 1).
+    inline int num_threads(){
+        char * num_threads_var = std::getenv("ANYODE_NUM_THREADS");
+        int nt = (num_threads_var) ? std::atoi(num_threads_var) : 1;
+        return (nt < 1) ? 1 : nt;
+    }
+
+    // Persistent pool of worker threads: tasks are handed out one at a time (dynamic scheduling),
+    // the calling thread takes part as thread 0. Threads are started once and reused by later
+    // batches (see ``shared``). A run started from within a run (e.g. ensemble_* called by a task
+    // of multi_*) is executed serially by the calling thread.
+    class thread_pool {
+        std::vector<std::thread> m_workers;
+        std::vector<std::thread::id> m_worker_ids;
+        std::atomic<std::thread::id> m_caller;  // thread 0 of the current run
+        std::mutex m_lock, m_run_lock;
+        std::condition_variable m_wake, m_done;
+        std::function<void(int)> m_job;
+        unsigned long m_generation = 0;
+        int m_nbusy = 0;
+        bool m_stop = false;
+        std::vector<double> m_busy_time;  // per thread, during the current run
+
+        void work(int tid){
+            unsigned long seen = 0;
+            while (true) {
+                std::function<void(int)> job;
+                {
+                    std::unique_lock<std::mutex> guard(m_lock);
+                    m_wake.wait(guard, [&]{ return m_stop || m_generation != seen; });
+                    if (m_stop)
+                        return;
+                    seen = m_generation;
+                    job = m_job;
+                }
+                job(tid);
+                {
+                    std::unique_lock<std::mutex> guard(m_lock);
+                    if (--m_nbusy == 0)
+                        m_done.notify_one();
+                }
+            }
+        }
+
+    public:
+        // Whether the calling thread takes part in a run of this pool.
+        bool in_run() const {
+            const std::thread::id id = std::this_thread::get_id();
+            return id == m_caller.load() || std::find(m_worker_ids.begin(), m_worker_ids.end(), id) !=
+                m_worker_ids.end();
+        }
+
+        struct shared_state {
+            std::mutex lock;
+            std::shared_ptr<thread_pool> pool;
+        };
+
+        // A child process (fork) inherits the shared pool but none of its worker threads: the child
+        // drops it (without destruction, there are no threads to join) and starts a new one when needed.
+        static shared_state& shared_instance(){
+            static shared_state st;
+#if defined(__unix__) || defined(__APPLE__)
+            static const int atfork = pthread_atfork(
+                []{ shared_instance().lock.lock(); },
+                []{ shared_instance().lock.unlock(); },
+                []{
+                    shared_state &child = shared_instance();
+                    new std::shared_ptr<thread_pool>(std::move(child.pool));  // leaked on purpose
+                    child.lock.unlock();
+                });
+            (void)atfork;
+#endif
+            return st;
+        }
+
+    public:
+        explicit thread_pool(int nthreads) : m_caller(std::thread::id()), m_busy_time(std::max(nthreads, 1)) {
+            for (int tid=1; tid<nthreads; ++tid){
+                m_workers.emplace_back(&thread_pool::work, this, tid);
+                m_worker_ids.push_back(m_workers.back().get_id());
+            }
+        }
+
+        ~thread_pool(){
+            {
+                std::unique_lock<std::mutex> guard(m_lock);
+                m_stop = true;
+            }
+            m_wake.notify_all();
+            for (auto &w : m_workers)
+                w.join();
+        }
+
+        int size() const { return m_workers.size() + 1; }
+
+        // Calls f(order[i]) for i in [0, ntasks), order defaults to 0, 1, ..., ntasks - 1, and
+        // stores the seconds each thread spent in f in ``busy_time``.
+        // Calls from several threads are serialized, nested calls (from f) run on the calling thread.
+        template <class F>
+        void run(int ntasks, F f, const int * const order=nullptr, std::vector<double> * const busy_time=nullptr){
+            run_tid(ntasks, [&](int idx, int /* tid */){ f(idx); }, order, busy_time);
+        }
+
+        // As run, but calls f(order[i], tid) where tid (in [0, size())) identifies the calling thread.
+        template <class F>
+        void run_tid(int ntasks, F f, const int * const order=nullptr, std::vector<double> * const busy_time=nullptr){
+            if (this->in_run()){
+                // nested: the workers are busy with (or waiting for) the enclosing run
+                auto t_start = std::chrono::high_resolution_clock::now();
+                for (int i = 0; i < ntasks; ++i)
+                    f(order ? order[i] : i, 0);
+                if (busy_time){
+                    busy_time->assign(size(), 0.0);
+                    (*busy_time)[0] = std::chrono::duration<double>(
+                        std::chrono::high_resolution_clock::now() - t_start).count();
+                }
+                return;
+            }
+            std::unique_lock<std::mutex> run_guard(m_run_lock);
+            m_caller = std::this_thread::get_id();
+            std::atomic<int> next(0);
+            std::fill(m_busy_time.begin(), m_busy_time.end(), 0.0);
+            std::function<void(int)> job = [&](int tid){
+                for (int i = next++; i < ntasks; i = next++){
+                    auto t_start = std::chrono::high_resolution_clock::now();
+                    f(order ? order[i] : i, tid);
+                    m_busy_time[tid] += std::chrono::duration<double>(
+                        std::chrono::high_resolution_clock::now() - t_start).count();
+                }
+            };
+            if (!m_workers.empty()){
+                std::unique_lock<std::mutex> guard(m_lock);
+                m_job = job;
+                m_nbusy = m_workers.size();
+                ++m_generation;
+            }
+            m_wake.notify_all();
+            job(0);
+            std::unique_lock<std::mutex> guard(m_lock);
+            m_done.wait(guard, [&]{ return m_nbusy == 0; });
+            m_job = nullptr;
+            m_caller = std::thread::id();
+            if (busy_time)
+                *busy_time = m_busy_time;
+        }
+
+        // Process wide pool of nthreads threads (replaced if nthreads changes, new after fork).
+        static std::shared_ptr<thread_pool> shared(int nthreads){
+            shared_state &st = shared_instance();
+            std::unique_lock<std::mutex> guard(st.lock);
+            if (!st.pool || st.pool->size() != nthreads)
+                st.pool = std::make_shared<thread_pool>(nthreads);
+            return st.pool;
+        }
+    };
+
+    // Runs f(idx, tid) for idx in [0, n) on the shared pool of nthreads threads (tid in [0, nthreads)),
+    // most expensive first if ``cost`` is given (e.g. n_steps of a previous run), and stores the busy
+    // time per thread in ``busy_time``.
+    template <class F>
+    void parallel_for_tid(int nthreads, int n, F f, const double * const cost=nullptr,
+                          std::vector<double> * const busy_time=nullptr){
+        std::vector<int> order;
+        if (cost){
+            order.resize(n);
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&](int a, int b){ return cost[a] > cost[b]; });
+        }
+        anyode_parallel::ThreadException te;
+        auto pool = thread_pool::shared(nthreads);
+        pool->run_tid(n, [&](int idx, int tid){ te.run(f, idx, tid); }, cost ? &order[0] : nullptr, busy_time);
+        te.rethrow();
+    }
+
+    // Runs f(idx) for idx in [0, n) on the shared pool (see parallel_for_tid).
+    template <class F>
+    void parallel_for(int n, F f, const double * const cost=nullptr, std::vector<double> * const busy_time=nullptr){
+        parallel_for_tid(num_threads(), n, [&](int idx, int /* tid */){ f(idx); }, cost, busy_time);
+    }
+
+    // Trajectories of several systems in three flat buffers (CSR layout): the steps of system idx are
+    // the rows [offsets[idx], offsets[idx + 1]) of xout (nrows) and yout (nrows*ny, row major).
+    struct ragged_trajectories {
+        std::vector<double> xout, yout;
+        std::vector<long int> offsets;  // nsys + 1
+
+        long int nrows(int idx) const { return offsets[idx + 1] - offsets[idx]; }
+    };
+
+    // Steps of all systems integrated by one thread, appended to two growing buffers.
+    struct arena_sink : public trajectory_sink {
+        const int m_ny;
+        std::vector<double> m_x, m_y;
+
+        explicit arena_sink(int ny) : m_ny(ny) {}
+        void write(long int n, const double * x, const double * y) override {
+            m_x.insert(m_x.end(), x, x + n);
+            m_y.insert(m_y.end(), y, y + n*m_ny);
+        }
+    };
+
     template <class OdeSys>
     std::vector<sa_t>
     multi_adaptive(std::vector<OdeSys *> odesys, // vectorized
@@ -25,30 +242,92 @@ namespace odeint_anyode_parallel {
                    const double * dx0,  // vectorized
                    const double * dx_max,  // vectorized
                    int autorestart=0,
-                   bool return_on_error=false
+                   bool return_on_error=false,
+                   const double * cost=nullptr,  // vectorized (optional)
+                   std::vector<double> * busy_time=nullptr,  // per thread (optional output)
+                   int max_jac_age=10,
+                   trajectory_sink * const * sinks=nullptr,  // vectorized (optional)
+                   long int sink_rows=0,
+                   output_policy output=output_policy(),
+                   std::vector<std::string> * diagnostics=nullptr  // per system (optional output)
                    ){
         const int ny = odesys[0]->get_ny();
         const int nsys = odesys.size();
         auto results = std::vector<sa_t>(nsys);
+        if (diagnostics)
+            diagnostics->assign(nsys, std::string());
 
-        anyode_parallel::ThreadException te;
-        char * num_threads_var = std::getenv("ANYODE_NUM_THREADS");
-        int nt = (num_threads_var) ? std::atoi(num_threads_var) : 1;
-        if (nt < 0)
-            nt = 1;
-        #pragma omp parallel for num_threads(nt) // OMP_NUM_THREADS should be 1 for openblas LU (small matrices)
+        // ANYODE_NUM_THREADS > 1 with LAPACK: OMP_NUM_THREADS should be 1 for openblas LU (small matrices)
+        parallel_for(nsys, [&](int idx){
+            results[idx] = simple_adaptive<OdeSys>(
+                odesys[idx], atol, rtol, styp, y0 + idx*ny, t0[idx], tend[idx],
+                mxsteps, dx0[idx], dx_max[idx], autorestart, return_on_error, max_jac_age,
+                sinks ? sinks[idx] : nullptr, sink_rows, output, nullptr,
+                diagnostics ? &(*diagnostics)[idx] : nullptr);
+        }, cost, busy_time);
+        return results;
+    }
+
+    // As multi_adaptive (without sinks), but the steps are collected in one arena per thread (handed
+    // over in chunks of sink_rows, default: 256) and then gathered in system order, i.e. a handful of
+    // allocations in total instead of two growing vectors per system.
+    template <class OdeSys>
+    ragged_trajectories
+    multi_adaptive_ragged(std::vector<OdeSys *> odesys, // vectorized
+                          const double atol,
+                          const double rtol,
+                          const StepType styp,
+                          const double * const y0,  // vectorized
+                          const double * t0,  // vectorized
+                          const double * tend,  // vectorized
+                          const long int mxsteps,
+                          const double * dx0,  // vectorized
+                          const double * dx_max,  // vectorized
+                          int autorestart=0,
+                          bool return_on_error=false,
+                          const double * cost=nullptr,  // vectorized (optional)
+                          std::vector<double> * busy_time=nullptr,  // per thread (optional output)
+                          int max_jac_age=10,
+                          long int sink_rows=0,
+                          output_policy output=output_policy(),
+                          std::vector<std::string> * diagnostics=nullptr  // per system (optional output)
+                          ){
+        const int ny = odesys[0]->get_ny();
+        const int nsys = odesys.size();
+        const int nthreads = num_threads();
+        std::vector<std::unique_ptr<arena_sink> > arenas(nthreads);
+        std::vector<int> owner(nsys);  // thread which integrated system idx
+        std::vector<long int> first(nsys), nrows(nsys);  // rows in the arena of owner[idx]
+        if (diagnostics)
+            diagnostics->assign(nsys, std::string());
+
+        parallel_for_tid(nthreads, nsys, [&](int idx, int tid){
+            if (!arenas[tid])
+                arenas[tid].reset(new arena_sink(ny));
+            arena_sink &arena = *arenas[tid];
+            owner[idx] = tid;
+            first[idx] = arena.m_x.size();
+            simple_adaptive<OdeSys>(odesys[idx], atol, rtol, styp, y0 + idx*ny, t0[idx], tend[idx],
+                                    mxsteps, dx0[idx], dx_max[idx], autorestart, return_on_error, max_jac_age,
+                                    &arena, (sink_rows > 0) ? sink_rows : 256, output, nullptr,
+                                    diagnostics ? &(*diagnostics)[idx] : nullptr);
+            nrows[idx] = arena.m_x.size() - first[idx];
+        }, cost, busy_time);
+
+        ragged_trajectories result;
+        result.offsets.resize(nsys + 1);
+        result.offsets[0] = 0;
+        std::partial_sum(nrows.begin(), nrows.end(), result.offsets.begin() + 1);
+        result.xout.resize(result.offsets[nsys]);
+        result.yout.resize(result.offsets[nsys]*ny);
         for (int idx=0; idx<nsys; ++idx){
-            sa_t local_result;
-            te.run([&]{
-                local_result = simple_adaptive<OdeSys>(
-                    odesys[idx], atol, rtol, styp, y0 + idx*ny, t0[idx], tend[idx],
-                    mxsteps, dx0[idx], dx_max[idx], autorestart, return_on_error);
-            });
-            results[idx] = local_result;
+            const arena_sink &arena = *arenas[owner[idx]];
+            std::copy(arena.m_x.begin() + first[idx], arena.m_x.begin() + first[idx] + nrows[idx],
+                      result.xout.begin() + result.offsets[idx]);
+            std::copy(arena.m_y.begin() + first[idx]*ny, arena.m_y.begin() + (first[idx] + nrows[idx])*ny,
+                      result.yout.begin() + result.offsets[idx]*ny);
         }
-        te.rethrow();
-
-        return results;
+        return result;
     }
 
     template <class OdeSys>
@@ -65,22 +344,26 @@ namespace odeint_anyode_parallel {
                      const double * dx0,  // vectorized
                      const double * dx_max,  // vectorized
                      int autorestart=0,
-                     bool return_on_error=false
+                     bool return_on_error=false,
+                     bool single_pass=false,
+                     const double * cost=nullptr,  // vectorized (optional)
+                     std::vector<double> * busy_time=nullptr,  // per thread (optional output)
+                     int max_jac_age=10,
+                     std::vector<std::string> * diagnostics=nullptr  // per system (optional output)
                      ){
         const int ny = odesys[0]->get_ny();
         const int nsys = odesys.size();
         std::vector<int> result(nsys);
+        if (diagnostics)
+            diagnostics->assign(nsys, std::string());
 
-        anyode_parallel::ThreadException te;
-        #pragma omp parallel for
-        for (int idx=0; idx<nsys; ++idx){
-            te.run([&]{
-                result[idx] = simple_predefined<OdeSys>(odesys[idx], atol, rtol, styp, y0 + idx*ny,
-                                                        nout, tout + idx*nout, yout + idx*ny*nout,
-                                                        mxsteps, dx0[idx], dx_max[idx], autorestart, return_on_error);
-            });
-        }
-        te.rethrow();
+        parallel_for(nsys, [&](int idx){
+            result[idx] = simple_predefined<OdeSys>(odesys[idx], atol, rtol, styp, y0 + idx*ny,
+                                                    nout, tout + idx*nout, yout + idx*ny*nout,
+                                                    mxsteps, dx0[idx], dx_max[idx], autorestart, return_on_error,
+                                                    single_pass, max_jac_age, nullptr,
+                                                    diagnostics ? &(*diagnostics)[idx] : nullptr);
+        }, cost, busy_time);
         return result;
     }
 
@@ -1,9 +1,11 @@
 # -*- mode: cython -*-
 # -*- coding: utf-8 -*-
 
+from libcpp cimport bool
+from libcpp.string cimport string
 from libcpp.vector cimport vector
 from libcpp.utility cimport pair
-from odeint_anyode cimport StepType
+from odeint_anyode cimport StepType, output_policy, trajectory_sink
 
 cdef extern from "odeint_anyode_parallel.hpp" namespace "odeint_anyode_parallel":
     cdef vector[pair[vector[double], vector[double]]] multi_adaptive[U](
@@ -18,7 +20,39 @@ cdef extern from "odeint_anyode_parallel.hpp" namespace "odeint_anyode_parallel"
         double *,
         double *,
         int,
-        bool
+        bool,
+        const double *,
+        vector[double] *,
+        int,
+        trajectory_sink **,
+        long int,
+        output_policy,
+        vector[string] *
+    ) nogil except +
+
+    cdef cppclass ragged_trajectories:
+        vector[double] xout, yout
+        vector[long int] offsets
+
+    cdef ragged_trajectories multi_adaptive_ragged[U](
+        vector[U*],
+        double,
+        double,
+        StepType,
+        const double * const,
+        const double *,
+        const double *,
+        long int,
+        double *,
+        double *,
+        int,
+        bool,
+        const double *,
+        vector[double] *,
+        int,
+        long int,
+        output_policy,
+        vector[string] *
     ) nogil except +
 
     cdef vector[int] multi_predefined[U](
@@ -34,5 +68,10 @@ cdef extern from "odeint_anyode_parallel.hpp" namespace "odeint_anyode_parallel"
         double *,
         double *,
         int,
-        bool
+        bool,
+        bool,
+        const double *,
+        vector[double] *,
+        int,
+        vector[string] *
     ) nogil except +
@@ -0,0 +1,641 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/numeric/odeint/stepper/rosenbrock4.hpp>
+#include <boost/numeric/odeint/stepper/rosenbrock4_controller.hpp>
+#include <boost/numeric/odeint/stepper/rosenbrock4_dense_output.hpp>
+#include <boost/numeric/odeint/util/resizer.hpp>
+#include <boost/numeric/odeint/util/state_wrapper.hpp>
+
+#include "odeint_anyode_trace.hpp"
+
+namespace odeint_anyode {
+
+    // Coefficients of the rosenbrock4 steppers: odeint's defaults but for the sign of d4 (the sum of the 4th row
+    // of gamma_ij is -0.0362), which only matters for non-autonomous systems (dfdt != 0): first order otherwise.
+    template<class Value>
+    struct rosenbrock4_coefficients : public boost::numeric::odeint::default_rosenbrock_coefficients<Value> {
+        const Value d4;
+        rosenbrock4_coefficients() : d4(static_cast<Value>(-0.3620000000000023e-01)) {}
+    };
+
+
+    // Linear solver for rosenbrock4_stepper: LU factorization with partial pivoting
+    // of a dense N x N (row major) matrix, everything is of fixed size (no allocations).
+    //
+    // Interface expected by rosenbrock4_stepper:
+    //   - state_type: type of the state (and of the right hand sides of the linear systems)
+    //   - matrix_type: type of the Jacobian passed to the Jacobian callback
+    //   - resize(n), jacobian()
+    //   - factorize(diag): factorize W = diag*I - J (J is left untouched)
+    //   - solve(b): b := W^-1 b
+    template<typename T, std::size_t N>
+    struct dense_lu_fixed {
+        typedef T value_type;
+        typedef std::array<T, N> state_type;
+        typedef std::array<T, N*N> matrix_type;
+
+        void resize(std::size_t /* n */) {}
+
+        matrix_type& jacobian() { return m_jac; }
+        const matrix_type& jacobian() const { return m_jac; }
+
+        void factorize(T diag) {
+            using std::abs;
+            for (std::size_t i=0; i<N*N; ++i)
+                m_lu[i] = -m_jac[i];
+            for (std::size_t i=0; i<N; ++i)
+                m_lu[i*N + i] += diag;
+            for (std::size_t k=0; k<N; ++k) {
+                std::size_t piv = k;
+                for (std::size_t i=k+1; i<N; ++i) {
+                    if (abs(m_lu[i*N + k]) > abs(m_lu[piv*N + k]))
+                        piv = i;
+                }
+                m_piv[k] = piv;
+                if (piv != k) {
+                    for (std::size_t j=0; j<N; ++j)
+                        std::swap(m_lu[k*N + j], m_lu[piv*N + j]);
+                }
+                for (std::size_t i=k+1; i<N; ++i) {
+                    const T l = m_lu[i*N + k] /= m_lu[k*N + k];
+                    for (std::size_t j=k+1; j<N; ++j)
+                        m_lu[i*N + j] -= l*m_lu[k*N + j];
+                }
+            }
+        }
+
+        template<class State>
+        void solve(State &b) const {
+            for (std::size_t k=0; k<N; ++k) {
+                if (m_piv[k] != k)
+                    std::swap(b[k], b[m_piv[k]]);
+            }
+            for (std::size_t i=1; i<N; ++i) {
+                for (std::size_t j=0; j<i; ++j)
+                    b[i] -= m_lu[i*N + j]*b[j];
+            }
+            for (std::size_t i=N; i-- > 0;) {
+                for (std::size_t j=i+1; j<N; ++j)
+                    b[i] -= m_lu[i*N + j]*b[j];
+                b[i] /= m_lu[i*N + i];
+            }
+        }
+
+    private:
+        matrix_type m_jac, m_lu;
+        std::array<std::size_t, N> m_piv;
+    };
+
+
+    // As dense_lu_fixed but for a size known only at run-time (see resize).
+    template<typename T, class State>
+    struct dense_lu {
+        typedef T value_type;
+        typedef State state_type;
+        typedef std::vector<T> matrix_type;
+
+        void resize(std::size_t n) {
+            m_n = n;
+            m_jac.assign(n*n, 0);
+            m_lu.assign(n*n, 0);
+            m_piv.resize(n);
+        }
+
+        matrix_type& jacobian() { return m_jac; }
+        const matrix_type& jacobian() const { return m_jac; }
+
+        void factorize(T diag) {
+            using std::abs;
+            const std::size_t n = m_n;
+            for (std::size_t i=0; i<n*n; ++i)
+                m_lu[i] = -m_jac[i];
+            for (std::size_t i=0; i<n; ++i)
+                m_lu[i*n + i] += diag;
+            for (std::size_t k=0; k<n; ++k) {
+                std::size_t piv = k;
+                for (std::size_t i=k+1; i<n; ++i) {
+                    if (abs(m_lu[i*n + k]) > abs(m_lu[piv*n + k]))
+                        piv = i;
+                }
+                m_piv[k] = piv;
+                if (piv != k) {
+                    for (std::size_t j=0; j<n; ++j)
+                        std::swap(m_lu[k*n + j], m_lu[piv*n + j]);
+                }
+                for (std::size_t i=k+1; i<n; ++i) {
+                    const T l = m_lu[i*n + k] /= m_lu[k*n + k];
+                    for (std::size_t j=k+1; j<n; ++j)
+                        m_lu[i*n + j] -= l*m_lu[k*n + j];
+                }
+            }
+        }
+
+        template<class Vec>
+        void solve(Vec &b) const {
+            const std::size_t n = m_n;
+            for (std::size_t k=0; k<n; ++k) {
+                if (m_piv[k] != k)
+                    std::swap(b[k], b[m_piv[k]]);
+            }
+            for (std::size_t i=1; i<n; ++i) {
+                for (std::size_t j=0; j<i; ++j)
+                    b[i] -= m_lu[i*n + j]*b[j];
+            }
+            for (std::size_t i=n; i-- > 0;) {
+                for (std::size_t j=i+1; j<n; ++j)
+                    b[i] -= m_lu[i*n + j]*b[j];
+                b[i] /= m_lu[i*n + i];
+            }
+        }
+
+    private:
+        std::size_t m_n = 0;
+        matrix_type m_jac, m_lu;
+        std::vector<std::size_t> m_piv;
+    };
+
+
+    // Linear solver for rosenbrock4_stepper: LU factorization with partial pivoting of a
+    // banded matrix (mlower sub- and mupper super-diagonals), O(n*mlower*(mlower+mupper)).
+    //
+    // The Jacobian is stored column major in LAPACK band storage (cf. AnyODE's banded_jac_cmaj):
+    // element (i, j) at jacobian()[mupper + i - j + j*ldim()], ldim() == mlower + mupper + 1.
+    // The factorization follows LAPACK's dgbtf2/dgbtrs (mlower extra rows hold the fill-in).
+    template<typename T, class State>
+    struct banded_lu {
+        typedef T value_type;
+        typedef State state_type;
+        typedef std::vector<T> matrix_type;
+
+        banded_lu(int mlower=0, int mupper=0) : m_ml(mlower), m_mu(mupper) {}
+
+        void resize(std::size_t n) {
+            m_n = n;
+            m_jac.assign(ldim()*n, 0);
+            m_lu.assign((2*m_ml + m_mu + 1)*n, 0);
+            m_piv.resize(n);
+        }
+
+        std::size_t ldim() const { return m_ml + m_mu + 1; }
+        matrix_type& jacobian() { return m_jac; }
+        const matrix_type& jacobian() const { return m_jac; }
+
+        void factorize(T diag) {
+            using std::abs;
+            const std::size_t n = m_n, ml = m_ml, mu = m_mu, kv = ml + mu, ld = kv + ml + 1, ldj = ldim();
+            for (std::size_t j=0; j<n; ++j){
+                for (std::size_t k=0; k<ml; ++k)
+                    m_lu[k + j*ld] = 0;
+                for (std::size_t k=0; k<ldj; ++k)
+                    m_lu[ml + k + j*ld] = -m_jac[k + j*ldj];
+                m_lu[kv + j*ld] += diag;
+            }
+            std::size_t ju = 0;  // last column affected by the row interchanges so far
+            for (std::size_t j=0; j<n; ++j){
+                const std::size_t km = std::min(ml, n - 1 - j);
+                std::size_t jp = 0;
+                for (std::size_t p=1; p<=km; ++p){
+                    if (abs(m_lu[kv + p + j*ld]) > abs(m_lu[kv + jp + j*ld]))
+                        jp = p;
+                }
+                m_piv[j] = j + jp;
+                ju = std::max(ju, std::min(j + mu + jp, n - 1));
+                if (jp != 0){
+                    for (std::size_t c=j; c<=ju; ++c)
+                        std::swap(m_lu[kv + j - c + c*ld], m_lu[kv + j + jp - c + c*ld]);
+                }
+                const T pivot = m_lu[kv + j*ld];
+                for (std::size_t p=1; p<=km; ++p)
+                    m_lu[kv + p + j*ld] /= pivot;
+                for (std::size_t c=j+1; c<=ju; ++c){
+                    const T u = m_lu[kv + j - c + c*ld];
+                    for (std::size_t p=1; p<=km; ++p)
+                        m_lu[kv + j + p - c + c*ld] -= m_lu[kv + p + j*ld]*u;
+                }
+            }
+        }
+
+        template<class Vec>
+        void solve(Vec &b) const {
+            const std::size_t n = m_n, ml = m_ml, kv = ml + m_mu, ld = kv + ml + 1;
+            for (std::size_t j=0; j+1<n; ++j){
+                const std::size_t lm = std::min(ml, n - 1 - j);
+                if (m_piv[j] != j)
+                    std::swap(b[j], b[m_piv[j]]);
+                for (std::size_t p=1; p<=lm; ++p)
+                    b[j + p] -= m_lu[kv + p + j*ld]*b[j];
+            }
+            for (std::size_t j=n; j-- > 0;){
+                b[j] /= m_lu[kv + j*ld];
+                for (std::size_t i=(j > kv ? j - kv : 0); i<j; ++i)
+                    b[i] -= m_lu[kv + i - j + j*ld]*b[j];
+            }
+        }
+
+    private:
+        std::size_t m_ml, m_mu, m_n = 0;
+        matrix_type m_jac, m_lu;
+        std::vector<std::size_t> m_piv;
+    };
+
+
+    // Jacobian in compressed sparse column format (cf. AnyODE's sparse_jac_csc).
+    template<typename T, typename Index=int>
+    struct csc_matrix {
+        std::vector<T> data;
+        std::vector<Index> colptrs, rowvals;
+    };
+
+    // Symbolic analysis for sparse_lu, computed from the pattern of the first Jacobian (validated, see check):
+    //   - fill-reducing ordering: minimum degree on the graph of W + W^T
+    //   - pattern of the factors (symmetric: L below and U above the diagonal)
+    //   - positions of the Jacobian entries and of the updates of every pivot in the factors
+    // The values of the factors are stored as: n diagonal elements, then L by column, then U by row.
+    template<typename Index=int>
+    struct sparse_lu_symbolic {
+        bool analyzed = false;
+        std::size_t n = 0;
+        std::vector<Index> colptrs, rowvals;  // pattern of the Jacobian
+        std::vector<Index> perm;  // perm[k]: (original) index of the k:th pivot
+        std::vector<std::size_t> ptr;  // nbr[ptr[k]:ptr[k+1]]: later pivots coupled to pivot k (ascending)
+        std::vector<Index> nbr;
+        std::vector<std::size_t> jac_pos;
+        std::vector<std::size_t> upd_ptr, upd_pos;
+
+        std::size_t nnz() const { return rowvals.size(); }
+        std::size_t nnz_lu() const { return n + 2*nbr.size(); }
+        std::size_t lower_offset() const { return n; }
+        std::size_t upper_offset() const { return n + nbr.size(); }
+
+        // Throws unless colptrs_ & rowvals_ describe an ny x ny matrix with at most nnz elements: colptrs_[0] == 0,
+        // colptrs_ non-decreasing, colptrs_[ny] <= nnz and every row index in [0, ny).
+        static void check(std::size_t ny, std::size_t nnz, const Index * const colptrs_, const Index * const rowvals_) {
+            if (colptrs_[0] != 0)
+                throw std::runtime_error("sparse Jacobian: colptrs[0] != 0");
+            for (std::size_t c=0; c<ny; ++c){
+                if (colptrs_[c+1] < colptrs_[c])
+                    throw std::runtime_error("sparse Jacobian: colptrs decreasing at column " + std::to_string(c));
+            }
+            if (static_cast<std::size_t>(colptrs_[ny]) > nnz)
+                throw std::runtime_error("sparse Jacobian: colptrs[ny] (" + std::to_string(colptrs_[ny]) +
+                                         ") exceeds nnz (" + std::to_string(nnz) + ")");
+            for (Index e=0; e<colptrs_[ny]; ++e){
+                if (rowvals_[e] < 0 || static_cast<std::size_t>(rowvals_[e]) >= ny)
+                    throw std::runtime_error("sparse Jacobian: row index " + std::to_string(rowvals_[e]) +
+                                             " out of range");
+            }
+        }
+
+        // Whether colptrs_ & rowvals_ is the pattern analyzed.
+        bool same_pattern(const Index * const colptrs_, const Index * const rowvals_) const {
+            return std::equal(colptrs.begin(), colptrs.end(), colptrs_) &&
+                std::equal(rowvals.begin(), rowvals.end(), rowvals_);
+        }
+
+        void analyze(std::size_t ny, std::size_t nnz_max, const Index * const colptrs_, const Index * const rowvals_) {
+            check(ny, nnz_max, colptrs_, rowvals_);
+            n = ny;
+            colptrs.assign(colptrs_, colptrs_ + n + 1);
+            rowvals.assign(rowvals_, rowvals_ + colptrs[n]);
+            std::vector<std::set<Index> > adj(n);
+            for (std::size_t c=0; c<n; ++c){
+                for (Index e=colptrs[c]; e<colptrs[c+1]; ++e){
+                    const Index r = rowvals[e];
+                    if (static_cast<std::size_t>(r) != c){
+                        adj[r].insert(c);
+                        adj[c].insert(r);
+                    }
+                }
+            }
+            std::set<std::pair<std::size_t, Index> > queue;  // (degree, node), ties broken by index
+            for (std::size_t i=0; i<n; ++i)
+                queue.insert(std::make_pair(adj[i].size(), static_cast<Index>(i)));
+            std::vector<Index> iperm(n);
+            std::vector<std::vector<Index> > elim(n);
+            perm.resize(n);
+            for (std::size_t k=0; k<n; ++k){
+                const Index v = queue.begin()->second;
+                queue.erase(queue.begin());
+                perm[k] = v;
+                iperm[v] = k;
+                elim[k].assign(adj[v].begin(), adj[v].end());
+                for (const Index u : elim[k]){  // eliminating v: its neighbours form a clique
+                    queue.erase(std::make_pair(adj[u].size(), u));
+                    adj[u].erase(v);
+                    for (const Index w : elim[k]){
+                        if (w != u)
+                            adj[u].insert(w);
+                    }
+                    queue.insert(std::make_pair(adj[u].size(), u));
+                }
+                adj[v].clear();
+            }
+            ptr.assign(1, 0);
+            nbr.clear();
+            for (std::size_t k=0; k<n; ++k){
+                for (const Index u : elim[k])
+                    nbr.push_back(iperm[u]);
+                std::sort(nbr.begin() + ptr[k], nbr.end());
+                ptr.push_back(nbr.size());
+            }
+            jac_pos.resize(rowvals.size());
+            for (std::size_t c=0; c<n; ++c){
+                for (Index e=colptrs[c]; e<colptrs[c+1]; ++e)
+                    jac_pos[e] = position(iperm[rowvals[e]], iperm[c]);
+            }
+            upd_ptr.assign(1, 0);
+            upd_pos.clear();
+            for (std::size_t k=0; k<n; ++k){
+                for (std::size_t p=ptr[k]; p<ptr[k+1]; ++p){
+                    for (std::size_t q=ptr[k]; q<ptr[k+1]; ++q)
+                        upd_pos.push_back(position(nbr[p], nbr[q]));
+                }
+                upd_ptr.push_back(upd_pos.size());
+            }
+            analyzed = true;
+        }
+
+    private:
+        // position of element (i, j) (pivot order) in the values of the factors
+        std::size_t position(std::size_t i, std::size_t j) const {
+            if (i == j)
+                return i;
+            const std::size_t k = std::min(i, j), other = std::max(i, j);
+            const auto it = std::lower_bound(nbr.begin() + ptr[k], nbr.begin() + ptr[k+1], static_cast<Index>(other));
+            return (i > j ? lower_offset() : upper_offset()) + (it - nbr.begin());
+        }
+    };
+
+    // Linear solver for rosenbrock4_stepper: sparse LU factorization (right looking, no numerical
+    // pivoting: the pivots are the diagonal elements in the fill-reducing order) of a matrix with
+    // the sparsity pattern of the Jacobian (CSC, nnz elements). The symbolic analysis is done on
+    // the first factorization and shared between copies of the solver (i.e. once per integration),
+    // the pattern of the Jacobian must not change (throws otherwise), nor may a pivot vanish (or be
+    // non-finite): factorize throws, i.e. the step fails.
+    template<typename T, class State, typename Index=int>
+    struct sparse_lu {
+        typedef T value_type;
+        typedef State state_type;
+        typedef csc_matrix<T, Index> matrix_type;
+        typedef sparse_lu_symbolic<Index> symbolic_type;
+
+        sparse_lu(int nnz=0, std::shared_ptr<symbolic_type> symbolic=nullptr) :
+            m_nnz(nnz), m_symbolic(symbolic ? symbolic : std::make_shared<symbolic_type>()) {}
+
+        void resize(std::size_t n) {
+            m_n = n;
+            m_jac.data.resize(m_nnz);
+            m_jac.colptrs.resize(n + 1);
+            m_jac.rowvals.resize(m_nnz);
+            m_x.resize(n);
+        }
+
+        matrix_type& jacobian() { return m_jac; }
+        const matrix_type& jacobian() const { return m_jac; }
+        const symbolic_type& symbolic() const { return *m_symbolic; }
+
+        void factorize(T diag) {
+            symbolic_type &sym = *m_symbolic;
+            if (!sym.analyzed)
+                sym.analyze(m_n, m_nnz, m_jac.colptrs.data(), m_jac.rowvals.data());
+            else if (!sym.same_pattern(m_jac.colptrs.data(), m_jac.rowvals.data()))
+                throw std::runtime_error("sparse Jacobian: the pattern changed since the first evaluation");
+            m_val.assign(sym.nnz_lu(), 0);
+            for (std::size_t i=0; i<m_n; ++i)
+                m_val[i] = diag;
+            for (std::size_t e=0; e<sym.nnz(); ++e)
+                m_val[sym.jac_pos[e]] -= m_jac.data[e];
+            const std::size_t lo = sym.lower_offset(), uo = sym.upper_offset();
+            for (std::size_t k=0; k<m_n; ++k){
+                const std::size_t b = sym.ptr[k], m = sym.ptr[k+1] - b;
+                const T pivot = m_val[k];
+                if (pivot == 0 || !std::isfinite(pivot))
+                    throw std::runtime_error("sparse_lu: zero or non-finite pivot (row " + std::to_string(sym.perm[k]) +
+                                             ")");
+                for (std::size_t p=0; p<m; ++p)
+                    m_val[lo + b + p] /= pivot;
+                const std::size_t * const upd = &sym.upd_pos[sym.upd_ptr[k]];
+                for (std::size_t p=0; p<m; ++p){
+                    const T l = m_val[lo + b + p];
+                    for (std::size_t q=0; q<m; ++q)
+                        m_val[upd[p*m + q]] -= l*m_val[uo + b + q];
+                }
+            }
+        }
+
+        template<class Vec>
+        void solve(Vec &b) {
+            const symbolic_type &sym = *m_symbolic;
+            const std::size_t lo = sym.lower_offset(), uo = sym.upper_offset();
+            for (std::size_t k=0; k<m_n; ++k)
+                m_x[k] = b[sym.perm[k]];
+            for (std::size_t k=0; k<m_n; ++k){
+                for (std::size_t p=sym.ptr[k]; p<sym.ptr[k+1]; ++p)
+                    m_x[sym.nbr[p]] -= m_val[lo + p]*m_x[k];
+            }
+            for (std::size_t k=m_n; k-- > 0;){
+                for (std::size_t p=sym.ptr[k]; p<sym.ptr[k+1]; ++p)
+                    m_x[k] -= m_val[uo + p]*m_x[sym.nbr[p]];
+                m_x[k] /= m_val[k];
+            }
+            for (std::size_t k=0; k<m_n; ++k)
+                b[sym.perm[k]] = m_x[k];
+        }
+
+    private:
+        std::size_t m_nnz, m_n = 0;
+        std::shared_ptr<symbolic_type> m_symbolic;
+        matrix_type m_jac;
+        std::vector<T> m_val, m_x;
+    };
+
+
+    // Same method (and coefficients) as boost::numeric::odeint::rosenbrock4 but with the
+    // state type and the linear algebra supplied by LinearSolver (odeint's version is tied
+    // to ublas). It can be used with odeint's rosenbrock4_controller and rosenbrock4_dense_output.
+    template<class LinearSolver,
+             class Coefficients=rosenbrock4_coefficients<typename LinearSolver::value_type>,
+             class Resizer=boost::numeric::odeint::initially_resizer>
+    class rosenbrock4_stepper {
+    public:
+        typedef LinearSolver linear_solver_type;
+        typedef typename LinearSolver::value_type value_type;
+        typedef typename LinearSolver::state_type state_type;
+        typedef state_type deriv_type;
+        typedef value_type time_type;
+        typedef typename LinearSolver::matrix_type matrix_type;
+        typedef Resizer resizer_type;
+        typedef Coefficients rosenbrock_coefficients;
+        typedef boost::numeric::odeint::stepper_tag stepper_category;
+        typedef unsigned short order_type;
+
+        typedef boost::numeric::odeint::state_wrapper<state_type> wrapped_state_type;
+        typedef boost::numeric::odeint::state_wrapper<deriv_type> wrapped_deriv_type;
+
+        typedef rosenbrock4_stepper<LinearSolver, Coefficients, Resizer> stepper_type;
+
+        const static order_type stepper_order = rosenbrock_coefficients::stepper_order;
+        const static order_type error_order = rosenbrock_coefficients::error_order;
+
+        explicit rosenbrock4_stepper(const linear_solver_type &solver=linear_solver_type()) : m_solver(solver) {}
+
+        order_type order() const { return stepper_order; }
+
+        template<class System>
+        void do_step(System system, const state_type &x, time_type t, state_type &xout, time_type dt, state_type &xerr) {
+            typedef typename boost::numeric::odeint::unwrap_reference<System>::type system_type;
+            typedef typename boost::numeric::odeint::unwrap_reference<typename system_type::first_type>::type deriv_func_type;
+            typedef typename boost::numeric::odeint::unwrap_reference<typename system_type::second_type>::type jacobi_func_type;
+            system_type &sys = system;
+            deriv_func_type &deriv_func = sys.first;
+            jacobi_func_type &jacobi_func = sys.second;
+            const auto &c = m_coef;
+            const std::size_t n = x.size();
+
+            m_resizer.adjust_size(x, [this](const state_type &x_){ return this->resize_impl(x_); });
+
+            deriv_func(x, m_dxdt.m_v, t);
+            jacobi_func(x, m_solver.jacobian(), t, m_dfdt.m_v);
+            m_solver.factorize(1.0 / c.gamma / dt);
+
+            for (std::size_t i=0; i<n; ++i)
+                m_g1.m_v[i] = m_dxdt.m_v[i] + dt * c.d1 * m_dfdt.m_v[i];
+            m_solver.solve(m_g1.m_v);
+
+            for (std::size_t i=0; i<n; ++i)
+                m_xtmp.m_v[i] = x[i] + c.a21 * m_g1.m_v[i];
+            deriv_func(m_xtmp.m_v, m_dxdtnew.m_v, t + c.c2 * dt);
+            for (std::size_t i=0; i<n; ++i)
+                m_g2.m_v[i] = m_dxdtnew.m_v[i] + dt * c.d2 * m_dfdt.m_v[i] + c.c21 * m_g1.m_v[i] / dt;
+            m_solver.solve(m_g2.m_v);
+
+            for (std::size_t i=0; i<n; ++i)
+                m_xtmp.m_v[i] = x[i] + c.a31 * m_g1.m_v[i] + c.a32 * m_g2.m_v[i];
+            deriv_func(m_xtmp.m_v, m_dxdtnew.m_v, t + c.c3 * dt);
+            for (std::size_t i=0; i<n; ++i)
+                m_g3.m_v[i] = m_dxdtnew.m_v[i] + dt * c.d3 * m_dfdt.m_v[i] + (c.c31 * m_g1.m_v[i] + c.c32 * m_g2.m_v[i]) / dt;
+            m_solver.solve(m_g3.m_v);
+
+            for (std::size_t i=0; i<n; ++i)
+                m_xtmp.m_v[i] = x[i] + c.a41 * m_g1.m_v[i] + c.a42 * m_g2.m_v[i] + c.a43 * m_g3.m_v[i];
+            deriv_func(m_xtmp.m_v, m_dxdtnew.m_v, t + c.c4 * dt);
+            for (std::size_t i=0; i<n; ++i)
+                m_g4.m_v[i] = m_dxdtnew.m_v[i] + dt * c.d4 * m_dfdt.m_v[i] +
+                    (c.c41 * m_g1.m_v[i] + c.c42 * m_g2.m_v[i] + c.c43 * m_g3.m_v[i]) / dt;
+            m_solver.solve(m_g4.m_v);
+
+            for (std::size_t i=0; i<n; ++i)
+                m_xtmp.m_v[i] = x[i] + c.a51 * m_g1.m_v[i] + c.a52 * m_g2.m_v[i] + c.a53 * m_g3.m_v[i] + c.a54 * m_g4.m_v[i];
+            deriv_func(m_xtmp.m_v, m_dxdtnew.m_v, t + dt);
+            for (std::size_t i=0; i<n; ++i)
+                m_g5.m_v[i] = m_dxdtnew.m_v[i] +
+                    (c.c51 * m_g1.m_v[i] + c.c52 * m_g2.m_v[i] + c.c53 * m_g3.m_v[i] + c.c54 * m_g4.m_v[i]) / dt;
+            m_solver.solve(m_g5.m_v);
+
+            for (std::size_t i=0; i<n; ++i)
+                m_xtmp.m_v[i] += m_g5.m_v[i];
+            deriv_func(m_xtmp.m_v, m_dxdtnew.m_v, t + dt);
+            for (std::size_t i=0; i<n; ++i)
+                xerr[i] = m_dxdtnew.m_v[i] + (c.c61 * m_g1.m_v[i] + c.c62 * m_g2.m_v[i] + c.c63 * m_g3.m_v[i] +
+                                              c.c64 * m_g4.m_v[i] + c.c65 * m_g5.m_v[i]) / dt;
+            m_solver.solve(xerr);
+
+            for (std::size_t i=0; i<n; ++i)
+                xout[i] = m_xtmp.m_v[i] + xerr[i];
+        }
+
+        template<class System>
+        void do_step(System system, state_type &x, time_type t, time_type dt, state_type &xerr) {
+            do_step(system, x, t, x, dt, xerr);
+        }
+
+        void prepare_dense_output() {
+            const auto &c = m_coef;
+            const std::size_t n = m_g1.m_v.size();
+            for (std::size_t i=0; i<n; ++i) {
+                m_cont3.m_v[i] = c.d21 * m_g1.m_v[i] + c.d22 * m_g2.m_v[i] + c.d23 * m_g3.m_v[i] + c.d24 * m_g4.m_v[i] + c.d25 * m_g5.m_v[i];
+                m_cont4.m_v[i] = c.d31 * m_g1.m_v[i] + c.d32 * m_g2.m_v[i] + c.d33 * m_g3.m_v[i] + c.d34 * m_g4.m_v[i] + c.d35 * m_g5.m_v[i];
+            }
+        }
+
+        template<class StateOut>
+        void calc_state(time_type t, StateOut &x,
+                        const state_type &x_old, time_type t_old,
+                        const state_type &x_new, time_type t_new) const {
+            const std::size_t n = m_g1.m_v.size();
+            const time_type s = (t - t_old) / (t_new - t_old);
+            const time_type s1 = 1.0 - s;
+            for (std::size_t i=0; i<n; ++i)
+                x[i] = x_old[i] * s1 + s * (x_new[i] + s1 * (m_cont3.m_v[i] + s * m_cont4.m_v[i]));
+        }
+
+        template<class StateType>
+        void adjust_size(const StateType &x) {
+            resize_impl(x);
+        }
+
+        linear_solver_type& linear_solver() { return m_solver; }
+
+    protected:
+        template<class StateIn>
+        bool resize_impl(const StateIn &x) {
+            using boost::numeric::odeint::adjust_size_by_resizeability;
+            using boost::numeric::odeint::is_resizeable;
+            typedef typename is_resizeable<state_type>::type resizeable;
+            bool resized = false;
+            resized |= adjust_size_by_resizeability(m_dxdt, x, resizeable());
+            resized |= adjust_size_by_resizeability(m_dfdt, x, resizeable());
+            resized |= adjust_size_by_resizeability(m_dxdtnew, x, resizeable());
+            resized |= adjust_size_by_resizeability(m_xtmp, x, resizeable());
+            resized |= adjust_size_by_resizeability(m_g1, x, resizeable());
+            resized |= adjust_size_by_resizeability(m_g2, x, resizeable());
+            resized |= adjust_size_by_resizeability(m_g3, x, resizeable());
+            resized |= adjust_size_by_resizeability(m_g4, x, resizeable());
+            resized |= adjust_size_by_resizeability(m_g5, x, resizeable());
+            resized |= adjust_size_by_resizeability(m_cont3, x, resizeable());
+            resized |= adjust_size_by_resizeability(m_cont4, x, resizeable());
+            m_solver.resize(x.size());  // also for states of fixed size (never "resized")
+            return resized;
+        }
+
+    private:
+        resizer_type m_resizer;
+        linear_solver_type m_solver;
+        wrapped_deriv_type m_dfdt, m_dxdt, m_dxdtnew;
+        wrapped_state_type m_g1, m_g2, m_g3, m_g4, m_g5;
+        wrapped_state_type m_cont3, m_cont4;
+        wrapped_state_type m_xtmp;
+        const rosenbrock_coefficients m_coef;
+    };
+
+    // Dense output rosenbrock4_stepper with odeint's step size control (cf. make_dense_output).
+    template<class LinearSolver>
+    using rosenbrock4_dense_output_t = boost::numeric::odeint::rosenbrock4_dense_output<
+        boost::numeric::odeint::rosenbrock4_controller<rosenbrock4_stepper<LinearSolver> > >;
+
+    template<class LinearSolver>
+    rosenbrock4_dense_output_t<LinearSolver>
+    make_rosenbrock4_dense_output(typename LinearSolver::value_type atol,
+                                  typename LinearSolver::value_type rtol,
+                                  typename LinearSolver::value_type max_dt,
+                                  const LinearSolver &solver=LinearSolver(),
+                                  long int *jac_cache_hits=nullptr,
+                                  step_trace *trace=nullptr) {
+        typedef boost::numeric::odeint::rosenbrock4_controller<rosenbrock4_stepper<LinearSolver> > controller_type;
+        controller_type controller(atol, rtol, max_dt, rosenbrock4_stepper<LinearSolver>(solver));
+        controller.count_jacobian_cache_hits(jac_cache_hits);
+        controller.trace(trace);
+        return rosenbrock4_dense_output_t<LinearSolver>(controller);
+    }
+}
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+#include <boost/numeric/odeint/integrate/max_step_checker.hpp>
+#include <boost/numeric/odeint/stepper/stepper_categories.hpp>
+#include <boost/numeric/odeint/util/unwrap_reference.hpp>
+
+#include "odeint_anyode_trace.hpp"
+
+namespace odeint_anyode {
+
+    // Coefficients of ROS34PW2 (Rang & Angermann 2005): W-method of order 3 (embedded order 2),
+    // stiffly accurate. Stored in the transformed form (cf. Hairer & Wanner, section IV.7):
+    //   (I/(h*gamma) - W) U_i = f(t + alpha_i*h, y + sum_j a_ij*U_j) + sum_j c_ij/h*U_j + gamma_i*h*dfdt
+    //   y_new = y + sum_i m_i*U_i,  error estimate: sum_i e_i*U_i
+    // where W only needs to approximate the Jacobian.
+    template<typename T>
+    struct ros34pw2_coefficients {
+        static const std::size_t stages = 4;
+        static const unsigned short stepper_order = 3;
+        static const unsigned short error_order = 2;
+        T gamma, alpha[stages], gamma_sum[stages], a[stages][stages], c[stages][stages], m[stages], e[stages];
+
+        ros34pw2_coefficients() : gamma(4.3586652150845900e-1) {
+            const T A[stages][stages] = {
+                {0, 0, 0, 0},
+                {8.7173304301691801e-1, 0, 0, 0},
+                {8.4457060015369423e-1, -1.1299064236484185e-1, 0, 0},
+                {0, 0, 1, 0}};
+            const T G[stages][stages] = {
+                {gamma, 0, 0, 0},
+                {-8.7173304301691801e-1, gamma, 0, 0},
+                {-9.0338057013044082e-1, 5.4180672388095326e-2, gamma, 0},
+                {2.4212380706095346e-1, -1.2232505839045147, 5.4526025533510214e-1, gamma}};
+            const T b[stages] = {2.4212380706095346e-1, -1.2232505839045147, 1.5452602553351020,
+                                 4.3586652150845900e-1};
+            const T bhat[stages] = {3.7810903145819369e-1, -9.6042292212423178e-2, 0.5, 2.1793326075422950e-1};
+            T Ginv[stages][stages] = {};  // inverse of the (lower triangular) G
+            for (std::size_t i=0; i<stages; ++i){
+                Ginv[i][i] = 1/G[i][i];
+                for (std::size_t j=0; j<i; ++j){
+                    T sum = 0;
+                    for (std::size_t k=j; k<i; ++k)
+                        sum += G[i][k]*Ginv[k][j];
+                    Ginv[i][j] = -sum/G[i][i];
+                }
+            }
+            for (std::size_t i=0; i<stages; ++i){
+                alpha[i] = gamma_sum[i] = m[i] = e[i] = 0;
+                for (std::size_t j=0; j<stages; ++j){
+                    alpha[i] += A[i][j];
+                    gamma_sum[i] += G[i][j];
+                    a[i][j] = c[i][j] = 0;
+                    for (std::size_t k=0; k<stages; ++k)
+                        a[i][j] += A[i][k]*Ginv[k][j];
+                    if (j < i)
+                        c[i][j] = -Ginv[i][j];
+                    m[i] += b[j]*Ginv[j][i];
+                    e[i] += (b[j] - bhat[j])*Ginv[j][i];
+                }
+            }
+        }
+    };
+
+    // When to evaluate the Jacobian and factorize W again (the Jacobian is reused across steps):
+    //   - max_jac_age: maximum number of accepted steps using the same Jacobian (1: every step)
+    //   - jac_on_reject: evaluate the Jacobian after a rejected step (unless it is already current)
+    //   - dt_keep_max: step size increases by at most this factor are not taken (the factorization of W
+    //     depends on the step size and can then be reused as well)
+    struct rosenbrock_w_policy {
+        int max_jac_age = 10;
+        bool jac_on_reject = true;
+        double dt_keep_max = 1.2;
+    };
+
+    struct rosenbrock_w_stats {
+        long int njac = 0;  // Jacobian evaluations
+        long int nfactor = 0;  // factorizations of W
+        long int nreject = 0;
+    };
+
+    // Dense output (Hermite interpolation) Rosenbrock-W stepper with step size control,
+    // the linear algebra (and state type) is supplied by LinearSolver (cf. rosenbrock4_stepper).
+    // The system is a pair of callables: f(x, dxdt, t) and jac(x, J, t, dfdt).
+    template<class LinearSolver, class Coefficients=ros34pw2_coefficients<typename LinearSolver::value_type> >
+    class rosenbrock_w_dense_output {
+    public:
+        typedef LinearSolver linear_solver_type;
+        typedef typename LinearSolver::value_type value_type;
+        typedef typename LinearSolver::state_type state_type;
+        typedef state_type deriv_type;
+        typedef value_type time_type;
+        typedef Coefficients coefficients_type;
+        typedef unsigned short order_type;
+        typedef boost::numeric::odeint::dense_output_stepper_tag stepper_category;
+
+        rosenbrock_w_dense_output(value_type atol, value_type rtol, time_type max_dt=0,
+                                  const rosenbrock_w_policy &policy=rosenbrock_w_policy(),
+                                  const linear_solver_type &solver=linear_solver_type(),
+                                  rosenbrock_w_stats * stats=nullptr, step_trace * trace=nullptr) :
+            m_atol(atol), m_rtol(rtol), m_max_dt(max_dt), m_policy(policy), m_solver(solver), m_stats(stats),
+            m_trace(trace) {
+            if (m_trace)
+                m_trace->rejections_known = true;
+        }
+
+        order_type order() const { return coefficients_type::stepper_order; }
+
+        template<class StateType>
+        void initialize(const StateType &x0, time_type t0, time_type dt0) {
+            if (!m_initialized){
+                m_x = m_x_old = m_f = m_f_old = m_dfdt = m_xtmp = m_ftmp = x0;
+                for (auto &u : m_u)
+                    u = x0;
+                m_solver.resize(x0.size());
+                m_initialized = true;
+            } else {
+                m_x = x0;
+            }
+            m_t = t0;
+            m_dt = dt0;
+            m_f_current = false;
+        }
+
+        template<class System>
+        std::pair<time_type, time_type> do_step(System system) {
+            boost::numeric::odeint::failed_step_checker fail_checker;
+            while (!try_step(system))
+                fail_checker();
+            return std::make_pair(m_t_old, m_t);
+        }
+
+        template<class StateOut>
+        void calc_state(time_type t, StateOut &x) const {
+            const time_type h = m_t - m_t_old;
+            const time_type s = (t - m_t_old)/h, s2 = s*s, s3 = s2*s;
+            const time_type h00 = 2*s3 - 3*s2 + 1, h10 = s3 - 2*s2 + s, h01 = -2*s3 + 3*s2, h11 = s3 - s2;
+            for (std::size_t i=0; i<m_x.size(); ++i)
+                x[i] = h00*m_x_old[i] + h10*h*m_f_old[i] + h01*m_x[i] + h11*h*m_f[i];
+        }
+
+        const state_type& current_state() const { return m_x; }
+        time_type current_time() const { return m_t; }
+        const state_type& previous_state() const { return m_x_old; }
+        time_type previous_time() const { return m_t_old; }
+        time_type current_time_step() const { return m_dt; }
+        linear_solver_type& linear_solver() { return m_solver; }
+
+    private:
+        template<class System>
+        bool try_step(System system) {
+            typedef typename boost::numeric::odeint::unwrap_reference<System>::type system_type;
+            system_type &sys = system;
+            auto &deriv_func = sys.first;
+            auto &jacobi_func = sys.second;
+            const coefficients_type &c = m_coef;
+            const std::size_t n = m_x.size(), ns = coefficients_type::stages;
+            using std::abs;
+            using std::pow;
+
+            if (m_max_dt != 0 && abs(m_dt) > m_max_dt)
+                m_dt = m_dt > 0 ? m_max_dt : -m_max_dt;
+            const time_type dt = m_dt;
+            if (!m_f_current){
+                deriv_func(m_x, m_f, m_t);
+                m_f_current = true;
+            }
+            if (m_jac_age < 0 || m_jac_age >= m_policy.max_jac_age || (m_last_rejected && m_policy.jac_on_reject && m_jac_age > 0)){
+                jacobi_func(m_x, m_solver.jacobian(), m_t, m_dfdt);
+                m_jac_age = 0;
+                m_dt_factor = 0;
+                if (m_stats)
+                    m_stats->njac++;
+            }
+            if (dt != m_dt_factor){
+                this->factorize(1/(c.gamma*dt));
+                m_dt_factor = dt;
+                if (m_stats)
+                    m_stats->nfactor++;
+            }
+            for (std::size_t i=0; i<ns; ++i){
+                const state_type * f = &m_f;
+                if (i > 0){
+                    for (std::size_t k=0; k<n; ++k){
+                        value_type xk = m_x[k];
+                        for (std::size_t j=0; j<i; ++j)
+                            xk += c.a[i][j]*m_u[j][k];
+                        m_xtmp[k] = xk;
+                    }
+                    deriv_func(m_xtmp, m_ftmp, m_t + c.alpha[i]*dt);
+                    f = &m_ftmp;
+                }
+                for (std::size_t k=0; k<n; ++k){
+                    value_type uk = (*f)[k] + c.gamma_sum[i]*dt*m_dfdt[k];
+                    for (std::size_t j=0; j<i; ++j)
+                        uk += c.c[i][j]/dt*m_u[j][k];
+                    m_u[i][k] = uk;
+                }
+                this->solve(m_u[i]);
+            }
+            value_type err = 0;
+            for (std::size_t k=0; k<n; ++k){
+                value_type xk = m_x[k], ek = 0;
+                for (std::size_t i=0; i<ns; ++i){
+                    xk += c.m[i]*m_u[i][k];
+                    ek += c.e[i]*m_u[i][k];
+                }
+                m_xtmp[k] = xk;
+                const value_type sk = m_atol + m_rtol*std::max(abs(m_x[k]), abs(xk));
+                err += ek*ek/sk/sk;
+            }
+            err = std::sqrt(err/n);
+            const value_type safe = 0.9, fac_min = 0.2, fac_max = 5.0;
+            const value_type expo = value_type(1)/(coefficients_type::error_order + 1);
+            value_type fac = std::min(fac_max, std::max(fac_min, safe*pow(err, -expo)));
+            if (!(err <= 1)){  // also rejects NaN
+                if (!(fac > fac_min))
+                    fac = fac_min;
+                m_dt = dt*fac;
+                m_last_rejected = true;
+                if (m_stats)
+                    m_stats->nreject++;
+                if (m_trace)
+                    m_trace->step(m_t, dt, err, false);
+                return false;
+            }
+            if (m_last_rejected)
+                fac = std::min(fac, value_type(1));
+            if (fac >= 1 && fac <= m_policy.dt_keep_max)
+                fac = 1;  // keep the factorization of W
+            m_x_old = m_x;
+            m_f_old = m_f;
+            m_x = m_xtmp;
+            m_t_old = m_t;
+            m_t += dt;
+            deriv_func(m_x, m_f, m_t);  // needed for the interpolation & the next step
+            m_dt = dt*fac;
+            m_jac_age++;
+            m_last_rejected = false;
+            if (m_trace)
+                m_trace->step(m_t_old, dt, err, true);
+            return true;
+        }
+
+        void factorize(value_type diag){
+            trace_timer timer(m_trace ? &m_trace->time_linalg : nullptr);
+            m_solver.factorize(diag);
+            if (m_trace)
+                m_trace->n_factorizations++;
+        }
+
+        void solve(state_type &b){
+            trace_timer timer(m_trace ? &m_trace->time_linalg : nullptr);
+            m_solver.solve(b);
+            if (m_trace)
+                m_trace->n_solves++;
+        }
+
+        value_type m_atol, m_rtol;
+        time_type m_max_dt;
+        rosenbrock_w_policy m_policy;
+        linear_solver_type m_solver;
+        rosenbrock_w_stats * m_stats;
+        step_trace * m_trace;
+        const coefficients_type m_coef;
+        bool m_initialized = false, m_f_current = false, m_last_rejected = false;
+        int m_jac_age = -1;  // -1: no Jacobian yet
+        time_type m_t = 0, m_t_old = 0, m_dt = 0, m_dt_factor = 0;
+        state_type m_x, m_x_old, m_f, m_f_old, m_dfdt, m_xtmp, m_ftmp;
+        state_type m_u[Coefficients::stages];
+    };
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace odeint_anyode {
+
+    // Receives the accepted steps of Integr::adaptive in chunks instead of keeping all of them in memory:
+    // x[n] and y[n*ny] (row major), the pointers are only valid during the call of write.
+    struct trajectory_sink {
+        long int nrows = 0;  // rows received so far
+        double x_last = NAN;
+        bool failed = false;  // a write threw: no further chunks are written
+
+        virtual ~trajectory_sink() {}
+        virtual void write(long int n, const double * x, const double * y) = 0;
+        virtual void finish() {}  // after the last chunk (also when the integration fails)
+
+        void put(long int n, const double * x, const double * y){
+            if (this->failed)
+                throw std::runtime_error("trajectory_sink: failed earlier");
+            try {
+                this->write(n, x, y);
+            } catch (...) {
+                this->failed = true;
+                throw;
+            }
+            this->nrows += n;
+            this->x_last = x[n - 1];
+        }
+    };
+
+    struct callback_sink : public trajectory_sink {
+        std::function<void(long int, const double *, const double *)> m_cb;
+
+        explicit callback_sink(std::function<void(long int, const double *, const double *)> cb) :
+            m_cb(std::move(cb)) {}
+        void write(long int n, const double * x, const double * y) override { m_cb(n, x, y); }
+    };
+
+    // Streams the rows (x, y[0], ..., y[ny-1]) to an .npy file (float64, shape (nrows, 1 + ny)) through a
+    // buffer of fixed size, finish() writes the final shape to the header. The file may then be memory
+    // mapped, e.g. numpy.load(path, mmap_mode='r').
+    class npy_sink : public trajectory_sink {
+        std::FILE * m_file;
+        const std::string m_path;
+        const int m_ny;
+        static constexpr std::size_t header_len = 128;  // room for any shape, multiple of 64
+
+        static bool little_endian(){
+            const std::uint16_t one = 1;
+            return *reinterpret_cast<const unsigned char *>(&one) == 1;
+        }
+        void check(bool ok){
+            if (!ok)
+                throw std::runtime_error("npy_sink: could not write to " + m_path);
+        }
+        void write_header(long int n){
+            std::ostringstream dict;
+            dict << "{'descr': '" << (little_endian() ? '<' : '>') << "f8', 'fortran_order': False, 'shape': ("
+                 << n << ", " << 1 + m_ny << "), }";
+            std::string header = dict.str();
+            header.resize(header_len - 10 - 1, ' ');
+            header += '\n';
+            // magic string, format version 1.0, header length (little endian)
+            const unsigned char preamble[10] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+                                                (header_len - 10) & 0xff, (header_len - 10) >> 8};
+            check(std::fseek(m_file, 0, SEEK_SET) == 0);
+            check(std::fwrite(preamble, 1, 10, m_file) == 10);
+            check(std::fwrite(header.data(), 1, header.size(), m_file) == header.size());
+        }
+
+    public:
+        npy_sink(const std::string &path, int ny, std::size_t buffer_size=1 << 20) :
+            m_file(std::fopen(path.c_str(), "wb")), m_path(path), m_ny(ny)
+        {
+            if (m_file == nullptr)
+                throw std::runtime_error("npy_sink: could not open " + path);
+            std::setvbuf(m_file, nullptr, _IOFBF, buffer_size);
+            write_header(0);
+        }
+        ~npy_sink(){
+            if (m_file)
+                std::fclose(m_file);
+        }
+        npy_sink(const npy_sink &) = delete;
+        npy_sink& operator=(const npy_sink &) = delete;
+
+        void write(long int n, const double * x, const double * y) override {
+            if (m_file == nullptr)
+                throw std::runtime_error("npy_sink: already finished: " + m_path);
+            for (long int i=0; i<n; ++i){
+                check(std::fwrite(x + i, sizeof(double), 1, m_file) == 1);
+                check(std::fwrite(y + i*m_ny, sizeof(double), m_ny, m_file) == static_cast<std::size_t>(m_ny));
+            }
+        }
+        void finish() override {
+            if (m_file == nullptr)
+                return;
+            write_header(this->nrows);
+            const bool ok = std::fclose(m_file) == 0;
+            m_file = nullptr;
+            check(ok);
+        }
+    };
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+namespace odeint_anyode {
+
+    // Opt-in instrumentation of an integration (Integr::m_trace, nullptr: nothing is recorded and the
+    // callbacks are not timed). Steps are counted (and recorded with ``history``) by the controllers of the
+    // implicit steppers (rosenbrock4*, ros34pw2), which also see the rejected steps; the dense output steppers
+    // of dopri5 & bulirsch_stoer only expose their accepted steps (err: NaN).
+    struct step_trace {
+        typedef std::chrono::steady_clock clock;
+
+        bool history = false;  // record every attempted step in x, dt, err & accepted
+        bool rejections_known = false;  // n_rejected counts the rejected steps (set by the stepper)
+        long int n_accepted = 0, n_rejected = 0;
+        long int n_factorizations = 0, n_solves = 0;  // LU factorizations & back substitutions
+        double time_rhs = 0, time_jac = 0, time_linalg = 0;  // seconds
+        std::vector<double> x, dt, err;  // start, size and error norm (scaled by the tolerances) of each step
+        std::vector<int> accepted;
+
+        void step(double x0, double dt0, double err0, bool acc){
+            if (acc)
+                this->n_accepted++;
+            else
+                this->n_rejected++;
+            if (this->history){
+                this->x.push_back(x0);
+                this->dt.push_back(dt0);
+                this->err.push_back(err0);
+                this->accepted.push_back(acc);
+            }
+        }
+
+        static double seconds_since(clock::time_point t0){
+            return std::chrono::duration<double>(clock::now() - t0).count();
+        }
+    };
+
+    // Adds the time spent in its scope to *total (nothing if total is nullptr).
+    class trace_timer {
+        double * const m_total;
+        const step_trace::clock::time_point m_t0;
+    public:
+        explicit trace_timer(double * total) :
+            m_total(total), m_t0(total ? step_trace::clock::now() : step_trace::clock::time_point()) {}
+        ~trace_timer() {
+            if (m_total)
+                *m_total += step_trace::seconds_since(m_t0);
+        }
+        trace_timer(const trace_timer&) = delete;
+        trace_timer& operator=(const trace_timer&) = delete;
+    };
+
+}
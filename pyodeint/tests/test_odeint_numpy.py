@@ -5,7 +5,9 @@ import sys
 import numpy as np
 import pytest
 
-from pyodeint import integrate_adaptive, integrate_predefined
+from pyodeint import (integrate_adaptive, integrate_predefined, integrate_adaptive_multi,
+                      integrate_predefined_multi, integrate_adaptive_ensemble, integrate_predefined_ensemble,
+                      DenseSolution, Integrator, Stepper)
 
 def _get_refcount_None():
     if hasattr(sys, 'getrefcount'):
@@ -68,8 +70,14 @@ methods = [
     #   - https://github.com/headmyshoulder/odeint-v2/issues/189
     #   - https://github.com/bjodah/pyodeint/pull/16
     # this affects odeint provided by Boost 1.60 and 1.61
-    ('rosenbrock4', True)
+    ('rosenbrock4', True),
+    ('ros34pw2', True),
+    ('fehlberg78', False),
+    ('cash_karp54', False),
+    ('verner65', False)
 ]
+explicit_pairs = ('fehlberg78', 'cash_karp54', 'verner65')  # no dense output
+methods_dense = [(method, use_jac) for method, use_jac in methods if method not in explicit_pairs]
 
 
 @pytest.mark.parametrize("method,use_jac", methods)
@@ -100,6 +108,21 @@ def test_integrate_adaptive(method, use_jac):
     assert np.allclose(yout, yref)
 
 
+def test_integrate_adaptive_no_copy():
+    k = 2.0, 3.0, 4.0
+    y0 = [0.7, 0.3, 0.5]
+    f, j = _get_f_j(k)
+    xout, yout, info = integrate_adaptive(f, j, y0, 0, 3, 1e-8, 1e-8, 1e-10)
+    # the arrays use the buffers of the integrator's std::vector<double>s
+    assert not xout.flags.owndata
+    assert not yout.base.flags.owndata
+    assert xout.flags.writeable and yout.flags.c_contiguous
+    xcopy = xout.copy()
+    del xout
+    gc.collect()
+    assert np.allclose(yout, decay_get_Cref(k, y0, xcopy))
+
+
 @pytest.mark.parametrize("method,use_jac", methods)
 def test_integrate_predefined(method, use_jac):
     k = k0, k1, k2 = 2.0, 3.0, 4.0
@@ -126,6 +149,137 @@ def test_integrate_predefined(method, use_jac):
         assert info['time_cpu'] >= 0
 
 
+@pytest.mark.parametrize("method,use_jac", methods_dense)
+def test_integrate_predefined_single_pass(method, use_jac):
+    k = k0, k1, k2 = 2.0, 3.0, 4.0
+    y0 = [0.7, 0.3, 0.5]
+    f, j = _get_f_j(k)
+    if not use_jac:
+        j = None
+    xout = np.linspace(0, 3, 200)
+    yout_ref, info_ref = integrate_predefined(f, j, y0, xout, 1e-9, 1e-9, 1e-10, method=method)
+    yout, info = integrate_predefined(f, j, y0, xout, 1e-9, 1e-9, 1e-10, method=method, single_pass=True)
+    assert info['success']
+    assert info['nreached'] == xout.size
+    assert np.allclose(yout, decay_get_Cref(k, y0, xout))
+    assert info['nfev'] < info_ref['nfev']
+    if use_jac:
+        assert 0 < info['njev'] < info_ref['njev']
+
+
+@pytest.mark.parametrize("method", explicit_pairs)
+def test_explicit_pairs_tight_tolerance(method):
+    k = (2.0, 3.0, 4.0)
+    y0 = [0.7, 0.3, 0.5]
+    f, _ = _get_f_j(k)
+    xout = np.linspace(0, 3, 7)
+    yout, info = integrate_predefined(f, None, y0, xout, 1e-13, 1e-13, 1e-10, method=method, nsteps=5000)
+    assert info['success']
+    assert np.allclose(yout, decay_get_Cref(k, y0, xout), rtol=1e-11, atol=1e-12)
+    _, info_ref = integrate_predefined(f, None, y0, xout, 1e-13, 1e-13, 1e-10, method='dopri5', nsteps=5000)
+    if method == 'fehlberg78':
+        assert info['nfev'] < info_ref['nfev']
+    with pytest.raises(RuntimeError):  # no interpolant
+        integrate_predefined(f, None, y0, xout, 1e-13, 1e-13, 1e-10, method=method, single_pass=True)
+    with pytest.raises(RuntimeError):
+        integrate_adaptive(f, None, y0, 0, 3, 1e-13, 1e-13, 1e-10, method=method, dense_output=True)
+    with pytest.raises(RuntimeError):
+        Stepper(f, None, y0, 0, 1e-13, 1e-13, method=method)
+
+
+def _get_j_banded(k):
+    k0, k1, k2 = k
+
+    def j(t, y, jmat_out, dfdx_out):  # mlower=1, mupper=0: jmat_out[i - j, j]
+        jmat_out[0, 0] = -k0
+        jmat_out[0, 1] = -k1
+        jmat_out[0, 2] = -k2
+        jmat_out[1, 0] = k0
+        jmat_out[1, 1] = k1
+        jmat_out[1, 2] = 0  # outside the matrix
+    return j
+
+
+def test_rosenbrock4_banded():
+    k = 2.0, 3.0, 4.0
+    y0 = [0.7, 0.3, 0.5]
+    f, _ = _get_f_j(k)
+    j = _get_j_banded(k)
+    xout = np.linspace(0, 3)
+    yout, info = integrate_predefined(f, j, y0, xout, 1e-9, 1e-9, 1e-10, method='rosenbrock4_banded',
+                                      mlower=1, mupper=0)
+    assert info['success']
+    assert info['njev'] > 0
+    assert np.allclose(yout, decay_get_Cref(k, y0, xout))
+    x, y, info = integrate_adaptive(f, j, y0, 0, 3, 1e-9, 1e-9, 1e-10, method='rosenbrock4_banded',
+                                    mlower=1, mupper=0)
+    assert info['success']
+    assert np.allclose(y, decay_get_Cref(k, y0, x))
+    # dfdx is zero for autonomous systems, otherwise a forward difference (two calls of rhs per Jacobian)
+    x_aut, y_aut, info_aut = integrate_adaptive(f, j, y0, 0, 3, 1e-9, 1e-9, 1e-10, method='rosenbrock4_banded',
+                                                mlower=1, mupper=0, autonomous_exprs=True)
+    assert np.array_equal(x_aut, x) and np.array_equal(y_aut, y)
+    assert info_aut['njev'] == info['njev']
+    assert info_aut['nfev'] == info['nfev'] - 2*info['njev']
+    with pytest.raises(RuntimeError):
+        integrate_adaptive(f, j, y0, 0, 3, 1e-9, 1e-9, 1e-10, method='rosenbrock4_banded')
+
+
+def _get_j_sparse(k):
+    k0, k1, k2 = k
+
+    def j(t, y, data, colptrs, rowvals):
+        colptrs[:] = [0, 2, 4, 5]
+        rowvals[:] = [0, 1, 1, 2, 2]
+        data[:] = [-k0, k0, -k1, k1, -k2]
+    return j
+
+
+@pytest.mark.parametrize("single_pass", [False, True])
+def test_rosenbrock4_sparse(single_pass):
+    k = 2.0, 3.0, 4.0
+    y0 = [0.7, 0.3, 0.5]
+    f, _ = _get_f_j(k)
+    j = _get_j_sparse(k)
+    xout = np.linspace(0, 3)
+    yout, info = integrate_predefined(f, j, y0, xout, 1e-9, 1e-9, 1e-10, method='rosenbrock4_sparse', nnz=5,
+                                      single_pass=single_pass)
+    assert info['success']
+    assert info['njev'] > 0
+    assert np.allclose(yout, decay_get_Cref(k, y0, xout))
+    assert info['nnz'] == 5 and info['nnz_lu'] == 7  # the pattern of the factors is symmetric
+    assert info['jac_colptrs'].tolist() == [0, 2, 4, 5]
+    assert info['jac_rowvals'].tolist() == [0, 1, 1, 2, 2]
+    x, y, info = integrate_adaptive(f, j, y0, 0, 3, 1e-9, 1e-9, 1e-10, method='rosenbrock4_sparse', nnz=5)
+    assert info['success']
+    assert np.allclose(y, decay_get_Cref(k, y0, x))
+    with pytest.raises(RuntimeError):
+        integrate_adaptive(f, j, y0, 0, 3, 1e-9, 1e-9, 1e-10, method='rosenbrock4_sparse')
+
+
+def test_rosenbrock4_jacobian_cache():
+    k = 2e2, 3e2, 4e2
+    y0 = [0.7, 0.3, 0.5]
+    f, j = _get_f_j(k)
+    xout = np.linspace(0, 3, 7)
+    yout, info = integrate_predefined(f, j, y0, xout, 1e-9, 1e-9, dx0=1.0, method='rosenbrock4', nsteps=5000)
+    assert info['success']
+    assert np.allclose(yout, decay_get_Cref(k, y0, xout), atol=1e-8)
+    assert info['njev_cached'] > 0  # the first step (dx0) is rejected, the Jacobian is reused
+
+def test_ros34pw2_max_jac_age():
+    k = 2.0, 3.0, 4.0
+    y0 = [0.7, 0.3, 0.5]
+    f, j = _get_f_j(k)
+    x, y, info = integrate_adaptive(f, j, y0, 0, 3, 1e-9, 1e-9, 1e-10, method='ros34pw2', nsteps=5000)
+    assert info['success']
+    assert np.allclose(y, decay_get_Cref(k, y0, x))
+    assert 0 < info['njev'] < info['n_factorizations'] < info['n_steps']
+    x, y, info1 = integrate_adaptive(f, j, y0, 0, 3, 1e-9, 1e-9, 1e-10, method='ros34pw2', nsteps=5000,
+                                    max_jac_age=1)
+    assert info1['success']
+    assert info1['njev'] > 5*info['njev']
+
 def test_adaptive_return_on_error():
     k = k0, k1, k2 = 2.0, 3.0, 4.0
     y0 = [0.7, 0.3, 0.5]
@@ -166,6 +320,10 @@ def test_adaptive_autorestart():
     assert info['njev'] > 0
     assert info['success']
     assert xout[-1] == kwargs['xend']
+    assert np.all(np.diff(xout) > 0)  # resumed in place
+    assert 0 < info['n_restarts'] <= 8
+    assert info['x_restarts'].size == info['n_restarts']
+    assert np.all(np.isin(info['x_restarts'], xout))
 
 
 def test_predefined_autorestart():
@@ -211,6 +369,26 @@ def test_predefined_return_on_error():
     assert info['success'] is False
 
 
+def test_predefined_single_pass_return_on_error():
+    k = k0, k1, k2 = 2.0, 3.0, 4.0
+    y0 = [0.7, 0., 0.]
+    atol, rtol = 1e-8, 1e-8
+    kwargs = dict(dx0=1e-10, atol=atol, rtol=rtol, method='rosenbrock4',
+                  return_on_error=True, single_pass=True)
+    f, j = _get_f_j(k)
+    xout = np.logspace(-3, 1)
+    # the stepper is not restarted from dx0 in every interval:
+    yout, info = integrate_predefined(f, j, y0, xout, nsteps=12, **kwargs)
+    yref = decay_get_Cref(k, y0, xout - xout[0])
+    assert np.allclose(yout, yref, rtol=10*rtol, atol=10*atol)
+    assert info['nreached'] == xout.size
+    assert info['success'] is True
+
+    yout, info = integrate_predefined(f, j, y0, xout, nsteps=6, **kwargs)
+    assert info['nreached'] == 1
+    assert info['success'] is False
+
+
 def test_dx0cb():  # this test works for GSL and CVode, but it is a weak test for odeint
     k = 1e23, 3.0, 4.0
     y0 = [.7, .0, .0]
@@ -224,3 +402,472 @@ def test_dx0cb():  # this test works for GSL and CVode, but it is a weak test fo
     assert info['njev'] > 0
     assert info['success'] is True
     assert xout[-1] == xend
+
+
+@pytest.mark.parametrize("nthreads", ['1', '3'])
+@pytest.mark.parametrize("method,use_jac", methods)
+def test_integrate_multi(monkeypatch, method, use_jac, nthreads):
+    monkeypatch.setenv('ANYODE_NUM_THREADS', nthreads)
+    ks = [(2.0, 3.0, 4.0), (5.0, 0.5, 1.0), (1.0, 7.0, 2.0)]
+    fj = [_get_f_j(k) for k in ks]
+    y0 = np.array([[0.7, 0.3, 0.5], [1.0, 0.0, 0.0], [0.1, 0.2, 0.3]])
+    jac = [j for _, j in fj] if use_jac else None
+    xend = [3.0, 2.0, 1.0]
+    xs, ys, infos = integrate_adaptive_multi([f for f, _ in fj], jac, y0, 0, xend, 1e-8, 1e-8, 1e-10,
+                                             method=method, nsteps=2000, cost=[1, 3, 2])
+    assert len(xs) == len(ys) == len(infos) == len(ks)
+    for k, y0_i, xend_i, x, y, info in zip(ks, y0, xend, xs, ys, infos):
+        assert info['success'] and x[-1] == xend_i
+        assert np.allclose(y, decay_get_Cref(k, y0_i, x))
+        x_ref, y_ref, info_ref = integrate_adaptive(*_get_f_j(k), y0_i, 0, xend_i, 1e-8, 1e-8, 1e-10,
+                                                      method=method, nsteps=2000)
+        assert np.allclose(x, x_ref) and info['nfev'] == info_ref['nfev']
+
+    xout = np.linspace(0, 3)
+    yout, infos = integrate_predefined_multi([f for f, _ in fj], jac, y0, xout, 1e-9, 1e-9, 1e-10, method=method)
+    assert yout.shape == (len(ks), xout.size, 3)
+    for k, y0_i, y, info in zip(ks, y0, yout, infos):
+        assert info['success'] and info['nreached'] == xout.size
+        assert np.allclose(y, decay_get_Cref(k, y0_i, xout))
+
+
+@pytest.mark.parametrize("nthreads", ['1', '3'])
+def test_integrate_adaptive_multi_ragged(monkeypatch, nthreads):
+    monkeypatch.setenv('ANYODE_NUM_THREADS', nthreads)
+    ks = [(2.0, 3.0, 4.0), (5.0, 0.5, 1.0), (1.0, 7.0, 2.0), (0.5, 1.5, 2.5)]
+    y0 = np.array([[0.7, 0.3, 0.5], [1.0, 0.0, 0.0], [0.1, 0.2, 0.3], [1.0, 1.0, 1.0]])
+    xend = [3.0, 2.0, 1.0, 4.0]
+    args = ([_get_f_j(k)[0] for k in ks], [_get_f_j(k)[1] for k in ks], y0, 0, xend, 1e-8, 1e-8, 1e-10)
+    xs, ys, infos = integrate_adaptive_multi(*args, chunk_size=5)
+    xflat, yflat, offsets, infos_flat = integrate_adaptive_multi(*args, ragged=True)
+    assert offsets.shape == (len(ks) + 1,) and offsets[0] == 0 and offsets[-1] == xflat.size
+    assert yflat.shape == (xflat.size, 3)
+    for idx, (x, y) in enumerate(zip(xs, ys)):
+        assert np.all(xflat[offsets[idx]:offsets[idx + 1]] == x)
+        assert np.all(yflat[offsets[idx]:offsets[idx + 1]] == y)
+        assert x[-1] == xend[idx] and infos_flat[idx]['success']
+        assert np.allclose(y, decay_get_Cref(ks[idx], y0[idx], x))
+    with pytest.raises(ValueError):
+        integrate_adaptive_multi(*args, ragged=True, sink=[lambda x, y: None]*len(ks))
+
+
+def test_integrate_multi_errors():
+    f, j = _get_f_j((2.0, 3.0, 4.0))
+    y0 = [[0.7, 0.3, 0.5], [1.0, 0.0, 0.0]]
+
+    def f_bad(t, y, fout):
+        raise ZeroDivisionError()
+    with pytest.raises(ZeroDivisionError):  # also when raised in a worker thread
+        integrate_predefined_multi([f, f_bad], j, y0, [0, 1, 2], 1e-8, 1e-8, 1e-10)
+    with pytest.raises(ValueError):
+        integrate_adaptive_multi([f], j, y0, 0, 1, 1e-8, 1e-8, 1e-10)
+    with pytest.raises(ValueError):
+        integrate_adaptive_multi(f, None, y0, 0, 1, 1e-8, 1e-8, 1e-10, method='rosenbrock4')
+    yout, infos = integrate_predefined_multi(f, j, y0, [[0, 1, 2], [0, 2, 4]], 1e-8, 1e-8, 1e-10)
+    assert np.allclose(yout[1], decay_get_Cref((2.0, 3.0, 4.0), y0[1], np.array([0, 2, 4])))
+
+
+@pytest.mark.parametrize("nthreads", ['1', '3'])
+def test_integrate_multi_return_on_error(monkeypatch, nthreads):
+    monkeypatch.setenv('ANYODE_NUM_THREADS', nthreads)
+    k = (2.0, 3.0, 4.0)
+    f, j = _get_f_j(k)
+    y0 = [[0.7, 0.3, 0.5], [1.0, 0.0, 0.0], [0.1, 0.2, 0.3], [0.5, 0.5, 0.5]]
+
+    def f_late(t, y, fout):  # fails after a few steps
+        if t > 0.5:
+            raise ValueError("f_late")
+        return f(t, y, fout)
+
+    def f_x0(t, y, fout):  # fails already when estimating dx0
+        raise KeyError("f_x0")
+    rhs = [f, f_late, f, f_x0]
+    xout = np.linspace(0, 1, 5)
+    for kw in [dict(), dict(single_pass=True)]:
+        with pytest.raises(ValueError, match="f_late"):
+            integrate_predefined_multi(rhs, j, y0, xout, 1e-8, 1e-8, 0, method='dopri5', **kw)
+        yout, infos = integrate_predefined_multi(rhs, j, y0, xout, 1e-8, 1e-8, 0, method='dopri5',
+                                                 return_on_error=True, diagnostics=True, **kw)
+        for idx in (0, 2):
+            assert infos[idx]['success'] and infos[idx]['nreached'] == xout.size
+            assert np.allclose(yout[idx], decay_get_Cref(k, y0[idx], xout))
+        assert not infos[1]['success'] and infos[1]['status'] == 'step_failed'
+        assert 1 < infos[1]['nreached'] < xout.size and 'ValueError: f_late' in infos[1]['diagnostics']
+        assert not infos[3]['success'] and infos[3]['nreached'] == 0 and 'f_x0' in infos[3]['diagnostics']
+
+    with pytest.raises(KeyError):
+        integrate_adaptive_multi(rhs[2:], j, y0[2:], 0, 1, 1e-8, 1e-8, 0, method='dopri5')
+    xs, ys, infos = integrate_adaptive_multi(rhs, j, y0, 0, 1, 1e-8, 1e-8, 0, method='dopri5',
+                                             return_on_error=True)
+    assert infos[0]['success'] and infos[2]['success'] and xs[2][-1] == 1
+    assert not infos[1]['success'] and 0.5 >= xs[1][-1] > 0
+    assert not infos[3]['success'] and xs[3].size == 0
+
+
+def _get_native_f_j():
+    import ctypes
+    dbl_p = ctypes.POINTER(ctypes.c_double)
+
+    @ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_double, dbl_p, dbl_p, ctypes.c_void_p)
+    def f(t, y, fout, user_data):
+        k0, k1, k2 = ctypes.cast(user_data, dbl_p)[:3]
+        fout[0] = -k0*y[0]
+        fout[1] = k0*y[0] - k1*y[1]
+        fout[2] = k1*y[1] - k2*y[2]
+        return 0
+
+    @ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_double, dbl_p, dbl_p, dbl_p, ctypes.c_long, dbl_p, ctypes.c_void_p)
+    def j(t, y, fy, jmat, ldim, dfdt, user_data):
+        k0, k1, k2 = ctypes.cast(user_data, dbl_p)[:3]
+        for i, row in enumerate([(-k0, 0, 0), (k0, -k1, 0), (0, k1, -k2)]):
+            for jj, v in enumerate(row):
+                jmat[i*ldim + jj] = v
+            dfdt[i] = 0
+        return 0
+    return f, j
+
+
+@pytest.mark.parametrize("method", ['dopri5', 'rosenbrock4'])
+def test_native_callbacks(method):
+    k = np.array([2.0, 3.0, 4.0])
+    y0 = [0.7, 0.3, 0.5]
+    f, j = _get_native_f_j()
+    xout, yout, info = integrate_adaptive(f, j, y0, 0, 3, 1e-8, 1e-8, 1e-10, method=method, user_data=k,
+                                          check_callable=True)
+    assert info['success'] and info['nfev'] > 0
+    assert np.allclose(yout, decay_get_Cref(k, y0, xout))
+    x_ref, _, info_ref = integrate_adaptive(*_get_f_j(k), y0, 0, 3, 1e-8, 1e-8, 1e-10, method=method)
+    assert np.allclose(xout, x_ref) and info['nfev'] == info_ref['nfev']
+
+    tout = np.linspace(0, 3)
+    yout, info = integrate_predefined(f, j, y0, tout, 1e-9, 1e-9, 1e-10, method=method, user_data=k)
+    assert info['success'] and np.allclose(yout, decay_get_Cref(k, y0, tout))
+
+    ks = [k, np.array([5.0, 0.5, 1.0])]
+    yout, infos = integrate_predefined_multi(f, j, [y0, y0], tout, 1e-9, 1e-9, 1e-10, method=method, user_data=ks)
+    for k_i, y in zip(ks, yout):
+        assert np.allclose(y, decay_get_Cref(k_i, y0, tout))
+
+    with pytest.raises(ValueError):  # mixing Python & C callbacks
+        integrate_adaptive(f, _get_f_j(k)[1], y0, 0, 3, 1e-8, 1e-8, 1e-10, user_data=k)
+    with pytest.raises(ValueError):  # user_data with Python callbacks
+        integrate_adaptive(*_get_f_j(k), y0, 0, 3, 1e-8, 1e-8, 1e-10, user_data=k)
+
+
+def test_native_callbacks_status():
+    import ctypes
+    dbl_p = ctypes.POINTER(ctypes.c_double)
+
+    @ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_double, dbl_p, dbl_p, ctypes.c_void_p)
+    def f(t, y, fout, user_data):
+        fout[0] = -y[0]
+        return 1 if t > 0.5 else 0  # recoverable error
+
+    with pytest.raises(RuntimeError):
+        integrate_adaptive(f, None, [1.0], 0, 1, 1e-8, 1e-8, 1e-10, method='dopri5')
+    xout, yout, info = integrate_adaptive(f, None, [1.0], 0, 1, 1e-8, 1e-8, 1e-10, method='dopri5',
+                                          return_on_error=True, diagnostics=True)
+    assert not info['success'] and info['status'] == 'step_failed'
+    assert xout[-1] <= 0.5 and 'rhs returned status 1' in info['diagnostics']
+
+
+def _get_vectorized_f_j(ks):
+    ks = np.asarray(ks)
+    ncalls = [0, 0]
+
+    def f(t, y, fout, idx):
+        k0, k1, k2 = ks[idx].T
+        fout[:, 0] = -k0*y[:, 0]
+        fout[:, 1] = k0*y[:, 0] - k1*y[:, 1]
+        fout[:, 2] = k1*y[:, 1] - k2*y[:, 2]
+        ncalls[0] += 1
+
+    def j(t, y, jmat_out, dfdx_out, idx):
+        k0, k1, k2 = ks[idx].T
+        jmat_out[:, 0, 0] = -k0
+        jmat_out[:, 1, 0] = k0
+        jmat_out[:, 1, 1] = -k1
+        jmat_out[:, 2, 1] = k1
+        jmat_out[:, 2, 2] = -k2
+        ncalls[1] += 1
+    return f, j, ncalls
+
+
+@pytest.mark.parametrize("nthreads", ['1', '2'])
+@pytest.mark.parametrize("method", ['dopri5', 'rosenbrock4'])
+def test_integrate_ensemble(monkeypatch, method, nthreads):
+    monkeypatch.setenv('ANYODE_NUM_THREADS', nthreads)
+    nsys = 20
+    ks = np.array([(2.0 + 0.1*i, 3.05 - 0.1*i, 0.51 + 0.05*i) for i in range(nsys)])
+    y0 = np.array([[0.7, 0.3, 0.5 + 0.01*i] for i in range(nsys)])
+    f, j, ncalls = _get_vectorized_f_j(ks)
+    xs, ys, infos = integrate_adaptive_ensemble(f, j, y0, 0, 2.0, 1e-8, 1e-8, 1e-10, method=method)
+    nfev = 0
+    for k, y0_i, x, y, info in zip(ks, y0, xs, ys, infos):
+        assert info['success'] and x[-1] == 2.0
+        assert np.allclose(y, decay_get_Cref(k, y0_i, x))
+        x_ref, _, info_ref = integrate_adaptive(*_get_f_j(k), y0_i, 0, 2.0, 1e-8, 1e-8, 1e-10, method=method)
+        assert abs(len(x) - len(x_ref)) <= 2
+        nfev += info['nfev']
+    assert ncalls[0] < nfev/5
+
+    xout = np.linspace(0, 2)
+    yout, infos = integrate_predefined_ensemble(f, j, y0, xout, 1e-9, 1e-9, 1e-10, method=method, batch_size=7)
+    assert yout.shape == (nsys, xout.size, 3)
+    for k, y0_i, y, info in zip(ks, y0, yout, infos):
+        assert info['success'] and info['nreached'] == xout.size
+        assert np.allclose(y, decay_get_Cref(k, y0_i, xout))
+
+
+def test_integrate_ensemble_no_idx():
+    k = (2.0, 3.0, 4.0)
+    f, j, _ = _get_vectorized_f_j([k])
+
+    def f_no_idx(t, y, fout):
+        f(t, y, fout, np.zeros(len(t), dtype=int))
+    y0 = [[0.7, 0.3, 0.5], [1.0, 0.0, 0.0]]
+    yout, infos = integrate_predefined_ensemble(f_no_idx, None, y0, [0, 1, 2], 1e-9, 1e-9, 1e-10)
+    for y0_i, y in zip(y0, yout):
+        assert np.allclose(y, decay_get_Cref(k, np.array(y0_i), np.array([0, 1, 2])))
+    with pytest.raises(ValueError):
+        integrate_predefined_ensemble(f_no_idx, None, y0, [0, 1, 2], 1e-9, 1e-9, method='rosenbrock4')
+    with pytest.raises(ValueError):
+        integrate_predefined_ensemble(f_no_idx, None, y0, [0, 1, 2], 1e-9, 1e-9, method='bulirsch_stoer')
+
+    def f_bad(t, y, fout):
+        raise ZeroDivisionError()
+    with pytest.raises((ZeroDivisionError, RuntimeError)):
+        integrate_predefined_ensemble(f_bad, None, y0, [0, 1, 2], 1e-9, 1e-9)
+
+
+@pytest.mark.parametrize("method", ['dopri5', 'rosenbrock4', 'bulirsch_stoer'])
+def test_Integrator(method):
+    k = (2.0, 3.0, 4.0)
+    f, j = _get_f_j(k)
+    xout = np.linspace(0, 2, 7)
+    integrator = Integrator(f, j, 3, 1e-9, 1e-9, method=method, dx0=1e-10, nsteps=1000)
+    out = np.empty((xout.size, 3))
+    for y0 in ([0.7, 0.3, 0.5], [1.0, 0.0, 0.0]):
+        y0 = np.array(y0)
+        yref, info_ref = integrate_predefined(f, j, y0, xout, 1e-9, 1e-9, 1e-10, method=method, nsteps=1000)
+        assert integrator.solve(y0, xout, out) is out
+        assert np.array_equal(out, yref)
+        info = integrator.info()
+        assert info['success'] and info['nreached'] == xout.size
+        for key in ('nfev', 'njev', 'n_steps'):
+            assert info[key] == info_ref[key]
+    assert np.allclose(integrator.solve(y0, xout), decay_get_Cref(k, y0, xout))
+
+    with pytest.raises(ValueError):
+        integrator.solve(np.array([1.0, 0.0]), xout)
+    with pytest.raises(ValueError):
+        integrator.solve(np.array([np.nan, 0.0, 0.0]), xout)
+    with pytest.raises(ValueError):
+        integrator.solve(y0, xout, np.empty((xout.size, 2)))
+    with pytest.raises(ValueError):
+        Integrator(f, None, 3, 1e-9, 1e-9, method='rosenbrock4')
+
+
+@pytest.mark.parametrize("method", ['dopri5', 'rosenbrock4', 'bulirsch_stoer'])
+def test_Stepper(method):
+    k = (2.0, 3.0, 4.0)
+    y0 = np.array([0.7, 0.3, 0.5])
+    f, j = _get_f_j(k)
+    xout = np.linspace(0, 2, 7)
+    yref, info_ref = integrate_predefined(f, j, y0, xout, 1e-9, 1e-9, 1e-10, method=method, nsteps=1000,
+                                          single_pass=True)
+    stepper = Stepper(f, j, y0, xout[0], 1e-9, 1e-9, method=method, dx0=1e-10, nsteps=1000)
+    assert np.array_equal(stepper.state()[1], y0)
+    out = np.empty(3)
+    for ix in range(1, xout.size - 1):  # (single_pass shortens the very last step)
+        assert stepper.advance_to(xout[ix], out) is out
+        assert np.array_equal(out, yref[ix])
+    assert np.allclose(stepper.advance_to(xout[-1]), decay_get_Cref(k, y0, xout[-1:])[0], rtol=1e-7, atol=1e-7)
+    info = stepper.info()
+    assert info['n_steps'] == stepper.n_steps
+    assert info['nfev'] <= 1.1*info_ref['nfev']
+    with pytest.raises(RuntimeError):
+        stepper.advance_to(1.0)
+    x, y = stepper.step()
+    assert x > xout[-1] and x == stepper.x
+    assert np.allclose(y, decay_get_Cref(k, y0, np.array([x]))[0], rtol=1e-7, atol=1e-7)
+    assert stepper.info()['n_steps'] == info['n_steps'] + 1
+
+
+@pytest.mark.parametrize("method", ['dopri5', 'rosenbrock4', 'bulirsch_stoer', 'ros34pw2'])
+def test_integrate_adaptive_dense_output(method):
+    k = (2.0, 3.0, 4.0)
+    y0 = np.array([0.7, 0.3, 0.5])
+    f, j = _get_f_j(k)
+    xout, yout, info, sol = integrate_adaptive(f, j, y0, 0, 2, 1e-9, 1e-9, 1e-10, method=method, nsteps=1000,
+                                               dense_output=True)
+    assert isinstance(sol, DenseSolution)
+    assert info['success'] and info['n_steps'] == sol.n_steps == xout.size - 1
+    assert xout[0] == sol.x_begin == 0 and xout[-1] == sol.x_end == 2
+    assert sol.ny == 3 and sol.breakpoints.size == xout.size
+    assert np.allclose(yout, decay_get_Cref(k, y0, xout), rtol=1e-7, atol=1e-7)
+    nfev = info['nfev']
+    x = np.linspace(0, 2, 101)
+    y = sol(x)
+    assert y.shape == (101, 3)
+    assert np.allclose(y, decay_get_Cref(k, y0, x), rtol=1e-6, atol=1e-7)
+    assert np.array_equal(sol(x[::-1].reshape(1, 101)), y[::-1].reshape(1, 101, 3))
+    assert np.array_equal(sol(1.0), y[50])
+    assert np.array_equal(sol(xout[:-1]), yout[:-1])  # breakpoints exactly
+    with pytest.raises(ValueError):
+        sol(2.5)
+    with pytest.raises(ValueError):
+        integrate_adaptive(f, j, y0, 0, 2, 1e-9, 1e-9, 1e-10, method=method, dense_output=True, autorestart=1)
+    _, _, info = integrate_adaptive(f, j, y0, 0, 2, 1e-9, 1e-9, 1e-10, method=method, nsteps=1000)
+    assert nfev <= 1.1*info['nfev']  # the dense output needs no additional calls of rhs
+
+    xs = []
+
+    def f_xmax(x, y, fout):
+        xs.append(x)
+        f(x, y, fout)
+
+    integrate_adaptive(f_xmax, j, y0, 0, 2, 1e-9, 1e-9, 1e-10, method=method, nsteps=1000, dense_output=True)
+    assert max(xs) <= 2  # the last step ends on xend
+
+    with pytest.raises(RuntimeError):
+        integrate_adaptive(f, j, y0, 0, 2, 1e-9, 1e-9, 1e-10, method=method, nsteps=5, dense_output=True)
+    xout, yout, info, sol = integrate_adaptive(f, j, y0, 0, 2, 1e-9, 1e-9, 1e-10, method=method, nsteps=5,
+                                               dense_output=True, return_on_error=True, diagnostics=True)
+    assert not info['success'] and info['status'] == 'mxsteps_reached'
+    assert info['n_steps'] == sol.n_steps == 5 and xout[-1] == sol.x_end < 2
+    assert 'Maximum number of steps reached' in info['diagnostics']
+    assert np.allclose(yout, decay_get_Cref(k, y0, xout), rtol=1e-7, atol=1e-7)
+
+
+@pytest.mark.parametrize("method", ['dopri5', 'rosenbrock4', 'ros34pw2'])
+def test_integrate_adaptive_trace(method):
+    k = (2.0, 3.0, 4.0)
+    y0 = [0.7, 0.3, 0.5]
+    f, j = _get_f_j(k)
+    kwargs = dict(x0=0, xend=3, dx0=1e-10, atol=1e-8, rtol=1e-8, method=method, nsteps=1000)
+    xref, yref, info_ref = integrate_adaptive(f, j, y0, **kwargs)
+    assert 'n_accepted' not in info_ref and 'steps_x' not in info_ref
+    xout, yout, info = integrate_adaptive(f, j, y0, trace_history=True, **kwargs)
+    assert np.array_equal(xout, xref) and np.array_equal(yout, yref)
+    assert info['n_accepted'] == xout.size - 1
+    assert info['time_rhs'] > 0 and info['time_rhs'] + info['time_jac'] + info['time_linalg'] < info['time_wall']
+    acc = info['steps_accepted']
+    assert acc.dtype == bool and acc.sum() == info['n_accepted']
+    assert np.array_equal(info['steps_x'][acc], xout[:-1])
+    if method == 'dopri5':
+        assert 'n_rejected' not in info and info['n_lu_factorizations'] == 0
+        assert np.all(np.isnan(info['steps_err']))
+    else:
+        assert info['n_rejected'] == acc.size - acc.sum()
+        assert np.array_equal(info['steps_err'] <= 1, acc)
+        assert info['time_jac'] > 0 and info['time_linalg'] > 0
+        assert 0 < info['n_lu_factorizations'] < info['n_lu_solves']
+    yout2, info2 = integrate_predefined(f, j, y0, xout, 1e-8, 1e-8, 1e-10, method=method, single_pass=True,
+                                        trace=True)
+    assert info2['n_accepted'] == info2['n_steps'] and 'steps_x' not in info2
+
+
+@pytest.mark.parametrize("method", ['dopri5', 'rosenbrock4'])
+def test_return_on_error_status(method):
+    k = (2.0, 3.0, 4.0)
+    y0 = [0.7, 0.3, 0.5]
+    f, j = _get_f_j(k)
+    kwargs = dict(dx0=1e-10, atol=1e-8, rtol=1e-8, method=method, nsteps=7)
+    msg = 'Maximum number of steps reached: 7\n'
+    xout, yout, info = integrate_adaptive(f, j, y0, 0, 3, return_on_error=True, diagnostics=True, **kwargs)
+    assert not info['success'] and info['status'] == 'mxsteps_reached' and xout[-1] < 3
+    assert info['diagnostics'] == msg
+    with pytest.raises(RuntimeError):
+        integrate_adaptive(f, j, y0, 0, 3, **kwargs)
+    xout = np.linspace(0, 3, 7)
+    yout, info = integrate_predefined(f, j, y0, xout, return_on_error=True, diagnostics=True, **kwargs)
+    assert info['status'] == 'mxsteps_reached' and 1 <= info['nreached'] < xout.size
+    assert 'Maximum number of steps reached' in info['diagnostics']
+    yout, info = integrate_predefined(f, j, y0, xout, autorestart=50, single_pass=True, diagnostics=True,
+                                      **kwargs)
+    assert info['success'] and info['status'] == 'success' and info['nreached'] == xout.size
+    assert 'Autorestart' in info['diagnostics']
+    y0s = np.array([y0, y0])
+    res = integrate_adaptive_multi(f, j, y0s, 0, [3, 1e-9], return_on_error=True, diagnostics=True, **kwargs)
+    assert [nfo['status'] for nfo in res[-1]] == ['mxsteps_reached', 'success']
+    assert [nfo['diagnostics'] for nfo in res[-1]] == [msg, '']
+    yout, info = integrate_predefined_multi(f, j, y0s, xout, return_on_error=True, diagnostics=True, **kwargs)
+    assert all(nfo['status'] == 'mxsteps_reached' for nfo in info)
+
+
+@pytest.mark.parametrize("method", ['dopri5', 'rosenbrock4'])
+def test_integrate_adaptive_sink(method, tmp_path):
+    k = (2.0, 3.0, 4.0)
+    y0 = [0.7, 0.3, 0.5]
+    f, j = _get_f_j(k)
+    kwargs = dict(x0=0, xend=3, dx0=1e-10, atol=1e-8, rtol=1e-8, method=method)
+    xref, yref, info_ref = integrate_adaptive(f, j, y0, **kwargs)
+    path = str(tmp_path / 'traj.npy')
+    xout, yout, info = integrate_adaptive(f, j, y0, sink=path, chunk_size=5, **kwargs)
+    assert isinstance(xout.base, np.memmap) or isinstance(xout, np.memmap)
+    assert np.array_equal(xout, xref) and np.array_equal(yout, yref)
+    assert info['success'] and info['n_steps'] == info_ref['n_steps']
+    chunks = []
+    xout, yout, info = integrate_adaptive(f, j, y0, sink=lambda x, y: chunks.append((x.copy(), y.copy())),
+                                          chunk_size=5, **kwargs)
+    assert xout is None and yout is None and info['success']
+    assert max(len(x) for x, _ in chunks) == 5
+    assert np.array_equal(np.concatenate([x for x, _ in chunks]), xref)
+    assert np.array_equal(np.concatenate([y for _, y in chunks]), yref)
+    paths = [str(tmp_path / ('traj%d.npy' % i)) for i in range(2)]
+    xout, yout, info = integrate_adaptive_multi(f, j, [y0, y0], sink=paths, **kwargs)
+    for i in range(2):
+        assert np.array_equal(xout[i], xref) and np.array_equal(yout[i], yref)
+        assert np.array_equal(np.load(paths[i])[:, 1:], yref)
+
+
+
+@pytest.mark.parametrize("nthreads", ['1', '2'])
+def test_integrate_adaptive_sink_errors(nthreads, monkeypatch):
+    k = (2.0, 3.0, 4.0)
+    y0 = [0.7, 0.3, 0.5]
+    f, j = _get_f_j(k)
+    kwargs = dict(x0=0, xend=3, dx0=1e-10, atol=1e-8, rtol=1e-8, method='dopri5', chunk_size=5)
+    calls = []
+
+    def sink(x, y):
+        calls.append(x[-1])
+        if len(calls) == 2:
+            raise ValueError("sink full")
+
+    with pytest.raises(ValueError, match="sink full"):
+        integrate_adaptive(f, j, y0, sink=sink, **kwargs)
+    assert len(calls) == 2  # not called again when closed
+    calls[:] = []
+    xout, yout, info = integrate_adaptive(f, j, y0, sink=sink, return_on_error=True, diagnostics=True, **kwargs)
+    assert len(calls) == 2 and not info['success'] and info['status'] == 'step_failed'
+    assert 'ValueError: sink full' in info['diagnostics']
+    monkeypatch.setenv('ANYODE_NUM_THREADS', nthreads)
+    calls[:] = []
+    with pytest.raises(ValueError, match="sink full"):
+        integrate_adaptive_multi(f, j, [y0, y0], sink=[sink, lambda x, y: None], **kwargs)
+    calls[:] = []
+    xout, yout, info = integrate_adaptive_multi(f, j, [y0, y0], sink=[sink, lambda x, y: None],
+                                                return_on_error=True, diagnostics=True, **kwargs)
+    assert [nfo['success'] for nfo in info] == [False, True]
+    assert 'ValueError: sink full' in info[0]['diagnostics']
+
+def test_integrate_adaptive_output_policy():
+    k = (2.0, 3.0, 4.0)
+    y0 = [0.7, 0.3, 0.5]
+    f, j = _get_f_j(k)
+    kwargs = dict(x0=0, xend=3, dx0=1e-10, atol=1e-8, rtol=1e-8, method='rosenbrock4')
+    xref, yref, info_ref = integrate_adaptive(f, j, y0, **kwargs)
+    xout, yout, info = integrate_adaptive(f, j, y0, output_stride=4, **kwargs)
+    assert np.array_equal(xout[:-1], xref[:-1:4]) and np.array_equal(yout[:-1], yref[:-1:4])
+    assert xout[-1] == 3 and np.array_equal(yout[-1], yref[-1])
+    assert info['n_steps'] == info_ref['n_steps'] and info['nfev'] == info_ref['nfev']
+    xout, yout, info = integrate_adaptive(f, j, y0, output_dx=0.5, **kwargs)
+    assert xout.size < 9 and np.all(np.diff(xout[:-1]) >= 0.5)
+    xout, yout, info = integrate_adaptive(f, j, y0, output_final_only=True, **kwargs)
+    assert xout.tolist() == [3] and np.array_equal(yout, yref[-1:])
+    xout, yout, info = integrate_adaptive_multi(f, j, [y0, y0], output_final_only=True, **kwargs)
+    assert all(np.array_equal(y, yref[-1:]) for y in yout)
+    with pytest.raises(ValueError):
+        integrate_adaptive(f, j, y0, output_stride=0, **kwargs)
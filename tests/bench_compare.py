@@ -0,0 +1,65 @@
+# -*- coding: utf-8 -*-
+# Compares two result files of bench_suite (or bench_latency.py --json) and flags regressions:
+# a time per call (time_wall, time_cpu) larger by more than ``--rtol`` (measurements shorter than
+# ``--min-time`` are ignored) or more steps/evaluations (n_steps, nfev, njev are deterministic).
+# Usage: python3 bench_compare.py baseline.json new.json [--rtol 0.15]; exit status 1 on regression.
+import argparse
+import json
+import sys
+
+TIMES = ('time_wall', 'time_cpu')
+COUNTS = ('n_steps', 'nfev', 'njev')
+METRICS = TIMES + COUNTS + ('ncalls',)
+ORDER = ('api', 'problem', 'stepper', 'rhs', 'nsys', 'nthreads')
+
+
+def load(path):
+    with open(path) as fh:
+        records = json.load(fh)['records']
+    return {tuple(sorted((k, v) for k, v in rec.items() if k not in METRICS)): rec for rec in records}
+
+
+def label(key):
+    fields = dict(key)
+    names = [k for k in ORDER if k in fields] + sorted(k for k in fields if k not in ORDER)
+    return ' '.join('%s=%s' % (k, fields[k]) if k in ('nsys', 'nthreads') else str(fields[k]) for k in names)
+
+
+def compare(old, new, rtol=0.15, min_time=1e-6):
+    """ Returns a list of (key, metric, old value, new value) of the regressions. """
+    regressions = []
+    print("%-64s %12s %12s %8s" % ("benchmark", "old [us]", "new [us]", "ratio"))
+    for key in sorted(set(old) & set(new), key=label):
+        o, n = old[key], new[key]
+        flag = []
+        for m in TIMES:
+            if m in o and m in n and max(o[m], n[m]) >= min_time and n[m] > o[m]*(1 + rtol):
+                flag.append(m)
+        for m in COUNTS:
+            if m in o and m in n and n[m] > o[m]:
+                flag.append(m)
+        regressions.extend((key, m, o[m], n[m]) for m in flag)
+        print("%-64s %12.4g %12.4g %8.3f %s" % (label(key), o['time_wall']*1e6, n['time_wall']*1e6,
+                                                n['time_wall']/o['time_wall'], ' '.join(flag)))
+    for key in sorted(set(old) - set(new), key=label):
+        print("missing in new: %s" % label(key))
+    for key in sorted(set(new) - set(old), key=label):
+        print("new: %s" % label(key))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('old')
+    parser.add_argument('new')
+    parser.add_argument('--rtol', type=float, default=0.15, help='allowed relative increase of the times')
+    parser.add_argument('--min-time', type=float, default=1e-6, help='shorter times (s) are not compared')
+    args = parser.parse_args()
+    regressions = compare(load(args.old), load(args.new), args.rtol, args.min_time)
+    for key, m, o, n in regressions:
+        print("REGRESSION %s: %s %.4g -> %.4g" % (label(key), m, o, n))
+    return 1 if regressions else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,49 @@
+// Compares n_steps/nfev of simple_adaptive started from the former default initial step
+// (100*eps, relative to x0) with the estimated one (dx0 = 0, see odeint_anyode::estimate_dx0).
+#include <cstdio>
+#include <limits>
+#include <vector>
+#include "anyode/anyode.hpp"
+#include "odeint_anyode.hpp"
+#include "testing_utils.hpp"
+#include "cetsa_case.hpp"
+
+
+template <class System>
+void bench(const char * label, System &odesys, const std::vector<double> &y0, double x0, double xend,
+           const char * name, bool estimate){
+    const double dx0 = estimate ? 0.0 : std::numeric_limits<double>::epsilon() * 100 * ((x0 == 0) ? 1 : x0);
+    odesys.nfev = odesys.njev = 0;
+    auto result = odeint_anyode::simple_adaptive(&odesys, 1e-8, 1e-8, odeint_anyode::styp_from_name(name), &y0[0],
+                                                 x0, xend, 100000, dx0);
+    std::printf("%-8s %-16s %-10s %8d %10d %8d %12.3g\n", label, name, estimate ? "estimated" : "100*eps",
+                odesys.current_info.nfo_int["n_steps"], odesys.current_info.nfo_int["nfev"],
+                odesys.current_info.nfo_int["njev"], result.first[1] - result.first[0]);
+}
+
+int main(){
+    std::vector<double> p = {{298.15, 39390, -135.3, 18010, 44960, 48.2, 65919.5, -93.8304, 1780, 3790, 57.44, 19700, -157.4}};
+    std::vector<double> y0_cetsa = {{8.99937e-07, 0.000693731, 0.000264211, 0.000340312, 4.11575e-05}};
+    std::vector<double> y0_decay = {{1.0}}, y0_vdp = {{2.0, 0.0}};
+    std::printf("%-8s %-16s %-10s %8s %10s %8s %12s\n",
+                "problem", "stepper", "dx0", "n_steps", "nfev", "njev", "first_step");
+    for (bool estimate : {false, true}){  // explicit steppers are stability limited on cetsa
+        for (auto name : {"rosenbrock4", "ros34pw2"}){
+            OdeSys cetsa(&p[0]);
+            bench("cetsa", cetsa, y0_cetsa, 0.0, 60.0, name, estimate);
+        }
+    }
+    for (auto name : {"dopri5", "bulirsch_stoer"}){
+        for (bool estimate : {false, true}){
+            Decay decay(1.0);
+            bench("decay", decay, y0_decay, 0.0, 10.0, name, estimate);
+        }
+    }
+    for (auto name : {"dopri5", "bulirsch_stoer", "rosenbrock4", "ros34pw2"}){
+        for (bool estimate : {false, true}){
+            VanDerPol vdp(1.0);
+            bench("vdp", vdp, y0_vdp, 0.0, 10.0, name, estimate);
+        }
+    }
+    return 0;
+}
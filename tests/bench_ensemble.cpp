@@ -0,0 +1,80 @@
+// Throughput of the lockstep ensemble integrator (SoA, vectorized across instances) vs. one
+// Integr per instance (multi_*), for a parameter sweep of van der Pol oscillators (dopri5), with the
+// mean number of rhs calls per system (the predefined drivers interpolate the dense output).
+// Usage: ./bench_ensemble [nsys], threads: ANYODE_NUM_THREADS, e.g. EXTRA_FLAGS=-march=native
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "odeint_anyode_ensemble.hpp"
+#include "testing_utils.hpp"
+
+template <class F>
+void bench(const char * label, std::vector<VanDerPol> &vdp, F f){
+    const int nsys = vdp.size();
+    double t = 0, err = 0;
+    for (int i=0; i<3; ++i){  // best of three
+        for (auto& s : vdp)
+            s.nfev = s.njev = 0;
+        auto t_start = std::chrono::high_resolution_clock::now();
+        err = f();
+        const double ti = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t_start).count();
+        t = (i == 0) ? ti : std::min(t, ti);
+    }
+    double nfev = 0;
+    for (auto& s : vdp)
+        nfev += s.current_info.nfo_int["nfev"];
+    std::printf("%-20s %8d %10.3g %14.4g %10.1f %12.3g\n", label, nsys, t, nsys/t, nfev/nsys, err);
+}
+
+int main(int argc, char **argv){
+    const int nsys = (argc > 1) ? std::atoi(argv[1]) : 20000;
+    const int nout = 11;
+    const double atol = 1e-8, rtol = 1e-8;
+    std::vector<VanDerPol> vdp;
+    for (int idx=0; idx<nsys; ++idx)
+        vdp.emplace_back(0.1 + 1.9*idx/nsys);
+    std::vector<VanDerPol *> systems;
+    for (auto& s : vdp)
+        systems.push_back(&s);
+    std::vector<double> y0, t0(nsys, 0.0), tend(nsys, 10.0), tout, dx0(nsys, 1e-6), dx_max(nsys, 0.0);
+    for (int idx=0; idx<nsys; ++idx){
+        y0.push_back(2.0);
+        y0.push_back(0.0);
+        for (int j=0; j<nout; ++j)
+            tout.push_back(j*10.0/(nout - 1));
+    }
+    std::vector<double> yref(nsys*nout*2), yout(nsys*nout*2);
+    std::vector<odeint_anyode_parallel::sa_t> ref;
+
+    std::printf("%-20s %8s %10s %14s %10s %12s\n", "driver", "nsys", "time", "systems_per_s", "nfev", "max_diff");
+    bench("multi_adaptive", vdp, [&]{
+        ref = odeint_anyode_parallel::multi_adaptive(
+            systems, atol, rtol, odeint_anyode::StepType::dopri5, &y0[0], &t0[0], &tend[0], 100000, &dx0[0], &dx_max[0]);
+        return 0.0;
+    });
+    bench("ensemble_adaptive", vdp, [&]{
+        auto res = odeint_anyode_parallel::ensemble_adaptive(
+            systems, atol, rtol, &y0[0], &t0[0], &tend[0], 100000, &dx0[0], &dx_max[0]);
+        double err = 0;
+        for (int idx=0; idx<nsys; ++idx)
+            err = std::max(err, std::abs(res[idx].second.back() - ref[idx].second.back()));
+        return err;
+    });
+    bench("multi_predefined", vdp, [&]{
+        odeint_anyode_parallel::multi_predefined(
+            systems, atol, rtol, odeint_anyode::StepType::dopri5, &y0[0], nout, &tout[0], &yref[0], 100000,
+            &dx0[0], &dx_max[0], 0, false, true);
+        return 0.0;
+    });
+    bench("ensemble_predefined", vdp, [&]{
+        odeint_anyode_parallel::ensemble_predefined(
+            systems, atol, rtol, &y0[0], nout, &tout[0], &yout[0], 100000, &dx0[0], &dx_max[0]);
+        double err = 0;
+        for (std::size_t i=0; i<yout.size(); ++i)
+            err = std::max(err, std::abs(yout[i] - yref[i]));
+        return err;
+    });
+    return 0;
+}
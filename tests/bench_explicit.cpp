@@ -0,0 +1,71 @@
+// Work-precision of the explicit steppers: nfev needed by dopri5, cash_karp54, verner65 & fehlberg78 (and
+// bulirsch_stoer) to reach a given global error on a Kepler orbit (eccentricity 0.5, three periods: the
+// exact solution is the initial state) over a sweep of tolerances (atol == rtol).
+// Usage: ./bench_explicit [eccentricity]
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "anyode/anyode.hpp"
+#include "odeint_anyode.hpp"
+
+struct Kepler : public AnyODE::OdeSysBase<double> {
+    int get_ny() const override { return 4; }
+    AnyODE::Status rhs(double t, const double * const __restrict__ y, double * const __restrict__ f) override {
+        AnyODE::ignore(t);
+        const double r = std::sqrt(y[0]*y[0] + y[1]*y[1]);
+        const double r3 = r*r*r;
+        f[0] = y[2];
+        f[1] = y[3];
+        f[2] = -y[0]/r3;
+        f[3] = -y[1]/r3;
+        this->nfev++;
+        return AnyODE::Status::success;
+    }
+};
+
+int main(int argc, char **argv){
+    const double ecc = (argc > 1) ? std::atof(argv[1]) : 0.5;
+    const std::vector<double> y0 = {{1 - ecc, 0, 0, std::sqrt((1 + ecc)/(1 - ecc))}};  // pericenter, period: 2 pi
+    const double xend = 3*2*M_PI;
+    const std::vector<double> targets = {{1e-4, 1e-6, 1e-8, 1e-10}};
+    const char * const steppers[] = {"dopri5", "cash_karp54", "verner65", "fehlberg78", "bulirsch_stoer"};
+    std::vector<std::vector<long int> > best;  // least nfev per stepper & target (0: not reached)
+    std::printf("%-16s %8s %8s %9s %12s\n", "stepper", "tol", "n_steps", "nfev", "error");
+    for (auto name : steppers){
+        best.emplace_back(targets.size(), 0);
+        for (int i=8; i<=26; ++i){
+            const double tol = std::pow(10.0, -0.5*i);
+            Kepler odesys;
+            auto res = odeint_anyode::simple_adaptive(&odesys, tol, tol, odeint_anyode::styp_from_name(name),
+                                                      &y0[0], 0.0, xend, 1000000);
+            double err = 0;
+            for (int j=0; j<4; ++j)
+                err = std::max(err, std::abs(res.second[res.second.size() - 4 + j] - y0[j]));
+            const long int nfev = odesys.current_info.nfo_int["nfev"];
+            std::printf("%-16s %8.1e %8d %9ld %12.3e\n", name, tol, odesys.current_info.nfo_int["n_steps"], nfev,
+                        err);
+            for (std::size_t k=0; k<targets.size(); ++k)
+                if (err <= targets[k] && (best.back()[k] == 0 || nfev < best.back()[k]))
+                    best.back()[k] = nfev;
+        }
+    }
+    std::printf("\nnfev at matching accuracy (relative to dopri5)\n%-16s", "error <=");
+    for (auto target : targets)
+        std::printf(" %16.0e", target);
+    std::printf("\n");
+    for (std::size_t s=0; s<best.size(); ++s){
+        std::printf("%-16s", steppers[s]);
+        for (std::size_t k=0; k<targets.size(); ++k){
+            if (best[s][k] == 0)
+                std::printf(" %16s", "-");
+            else if (best[0][k] == 0)
+                std::printf(" %16ld", best[s][k]);
+            else
+                std::printf(" %8ld (%5.2f)", best[s][k], best[s][k]/(double)best[0][k]);
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+// Compares Integr for a system of run-time size with the same system declaring
+// its size at compile time (fixed_ny: std::array states, fixed size Jacobian & LU).
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "anyode/anyode.hpp"
+#include "odeint_anyode.hpp"
+#include "testing_utils.hpp"
+#include "cetsa_case.hpp"
+
+struct OdeSysFixed : public OdeSys {
+    static constexpr int fixed_ny = 5;
+    using OdeSys::OdeSys;
+};
+
+template <class System>
+void bench(const char * label, const std::vector<double> &p, const std::vector<double> &y0,
+           const char * name, int nrepeat){
+    double tot = 0.0;
+    int nfev = 0;
+    std::size_t npoints = 0;
+    for (int i=0; i<nrepeat; ++i){
+        System odesys(&p[0]);
+        auto t_start = std::chrono::high_resolution_clock::now();
+        auto result = odeint_anyode::simple_adaptive(
+            &odesys, 1e-8, 1e-8, odeint_anyode::styp_from_name(name), &y0[0], 0.0, 60.0, 100000, 1e-13);
+        tot += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t_start).count();
+        nfev = odesys.current_info.nfo_int["nfev"];
+        npoints = result.first.size();
+    }
+    std::printf("%-8s %-16s %-8s %8zu %10d %12.3g\n", "cetsa", name, label, npoints, nfev, tot/nrepeat);
+}
+
+int main(){
+    std::vector<double> p = {{298.15, 39390, -135.3, 18010, 44960, 48.2, 65919.5, -93.8304, 1780, 3790, 57.44, 19700, -157.4}};
+    std::vector<double> y0 = {{8.99937e-07, 0.000693731, 0.000264211, 0.000340312, 4.11575e-05}};
+    std::printf("%-8s %-16s %-8s %8s %10s %12s\n", "problem", "stepper", "size", "npoints", "nfev", "time_per_call");
+    // explicit steppers are stability limited on cetsa (exceeding mxsteps)
+    bench<OdeSys>("dynamic", p, y0, "rosenbrock4", 2000);
+    bench<OdeSysFixed>("fixed", p, y0, "rosenbrock4", 2000);
+    return 0;
+}
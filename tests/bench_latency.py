@@ -0,0 +1,75 @@
+# -*- coding: utf-8 -*-
+# Per-call latency of repeated short integrations (e.g. parameter estimation):
+# integrate_predefined (new system, settings & info every call) vs. Integrator.solve.
+# Run from the repository root after ``python setup.py build_ext -i``, ``--json path``
+# writes the results in the format of bench_suite (see bench_compare.py).
+import argparse
+import ctypes
+import json
+import timeit
+
+import numpy as np
+
+from pyodeint import integrate_predefined, Integrator
+
+
+def f(t, y, fout):
+    fout[0] = -y[0]
+
+
+def j(t, y, jmat_out, dfdx_out):
+    jmat_out[0, 0] = -1
+    dfdx_out[0] = 0
+
+
+_rhs_t = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_double, ctypes.POINTER(ctypes.c_double),
+                          ctypes.POINTER(ctypes.c_double), ctypes.c_void_p)
+_jac_t = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_double, ctypes.POINTER(ctypes.c_double),
+                          ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double), ctypes.c_long,
+                          ctypes.POINTER(ctypes.c_double), ctypes.c_void_p)
+
+
+@_rhs_t
+def f_native(t, y, fout, user_data):
+    fout[0] = -y[0]
+    return 0
+
+
+@_jac_t
+def j_native(t, y, fy, jmat, ldim, dfdt, user_data):
+    jmat[0] = -1
+    if dfdt:
+        dfdt[0] = 0
+    return 0
+
+
+def _record(api, method, label, number, t, info):
+    return dict(api=api, problem='decay', stepper=method, rhs=label, nsys=1, nthreads=1, n_steps=info['n_steps'],
+                nfev=info['nfev'], njev=info['njev'], ncalls=number, time_wall=t)
+
+
+def main(number=20000, json_path=None):
+    y0, xout, out = np.array([1.0]), np.array([0.0, 1e-3]), np.empty((2, 1))
+    records = []
+    print("%-12s %-8s %16s %16s %8s" % ("stepper", "rhs", "integrate [us]", "solve [us]", "speedup"))
+    for method in ('dopri5', 'rosenbrock4'):
+        for label, rhs, jac in (('python', f, j), ('ctypes', f_native, j_native)):
+            t_call = timeit.timeit(lambda: integrate_predefined(rhs, jac, y0, xout, 1e-8, 1e-8, 1e-3, method=method),
+                                   number=number)/number
+            integrator = Integrator(rhs, jac, 1, 1e-8, 1e-8, method=method, dx0=1e-3)
+            t_solve = timeit.timeit(lambda: integrator.solve(y0, xout, out), number=number)/number
+            print("%-12s %-8s %16.2f %16.2f %8.1f" % (method, label, t_call*1e6, t_solve*1e6, t_call/t_solve))
+            info = integrate_predefined(rhs, jac, y0, xout, 1e-8, 1e-8, 1e-3, method=method)[1]
+            records.append(_record('integrate_predefined', method, label, number, t_call, info))
+            records.append(_record('Integrator.solve', method, label, number, t_solve, integrator.info()))
+    if json_path is not None:
+        with open(json_path, 'w') as fh:
+            json.dump(dict(suite='bench_latency', records=records), fh, indent=1)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--number', type=int, default=20000, help='calls per measurement')
+    parser.add_argument('--json', dest='json_path', help='write the results to this file')
+    args = parser.parse_args()
+    main(args.number, args.json_path)
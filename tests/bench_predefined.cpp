@@ -0,0 +1,46 @@
+// Compares nfev/njev of the two drivers of Integr::predefined:
+// one integrate_adaptive call per interval vs. a single pass with dense output.
+#include <cstdio>
+#include <vector>
+#include "anyode/anyode.hpp"
+#include "odeint_anyode.hpp"
+#include "testing_utils.hpp"
+#include "cetsa_case.hpp"
+
+
+template <class System>
+void bench(const char * label, System &odesys, const std::vector<double> &y0,
+           const std::vector<double> &tout, const char * name, bool single_pass){
+    std::vector<double> yout(tout.size()*odesys.get_ny());
+    int nreached = odeint_anyode::simple_predefined(
+        &odesys, 1e-8, 1e-8, odeint_anyode::styp_from_name(name), &y0[0], tout.size(), &tout[0], &yout[0],
+        100000, 1e-13, 0.0, 0, false, single_pass);
+    std::printf("%-8s %-16s %-12s %8d %10d %8d %10.3g\n", label, name, single_pass ? "single_pass" : "intervals",
+                nreached, odesys.current_info.nfo_int["nfev"], odesys.current_info.nfo_int["njev"],
+                odesys.current_info.nfo_dbl["time_wall"]);
+}
+
+int main(){
+    const int nout = 2000;
+    std::vector<double> p = {{298.15, 39390, -135.3, 18010, 44960, 48.2, 65919.5, -93.8304, 1780, 3790, 57.44, 19700, -157.4}};
+    std::vector<double> y0_cetsa = {{8.99937e-07, 0.000693731, 0.000264211, 0.000340312, 4.11575e-05}};
+    std::vector<double> y0_decay = {{1.0}};
+    std::vector<double> tout_cetsa(nout), tout_decay(nout);
+    for (int i=0; i<nout; ++i){
+        tout_cetsa[i] = 60.0*i/(nout - 1);
+        tout_decay[i] = 10.0*i/(nout - 1);
+    }
+    std::printf("%-8s %-16s %-12s %8s %10s %8s %10s\n",
+                "problem", "stepper", "driver", "nreached", "nfev", "njev", "time_wall");
+    for (bool single_pass : {false, true}){  // explicit steppers are stability limited on cetsa
+        OdeSys cetsa(&p[0]);
+        bench("cetsa", cetsa, y0_cetsa, tout_cetsa, "rosenbrock4", single_pass);
+    }
+    for (auto name : {"dopri5", "bulirsch_stoer"}){
+        for (bool single_pass : {false, true}){
+            Decay decay(1.0);
+            bench("decay", decay, y0_decay, tout_decay, name, single_pass);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,223 @@
+// Benchmark suite: time per call, steps, nfev & njev of simple_adaptive, simple_predefined, multi_adaptive &
+// multi_predefined for every stepper applicable to decay, van der Pol, cetsa & Robertson (the only problem with
+// banded & sparse Jacobians, the explicit steppers are stability limited on cetsa & Robertson), and the thread
+// scaling of multi_adaptive. The results are printed and written as JSON (see bench_compare.py).
+// Usage: ./bench_suite [results.json] [min_time (s) per measurement] [max threads], e.g. EXTRA_FLAGS=-march=native
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "anyode/anyode.hpp"
+#include "odeint_anyode.hpp"
+#include "odeint_anyode_parallel.hpp"
+#include "testing_utils.hpp"
+#include "cetsa_case.hpp"
+
+typedef AnyODE::OdeSysBase<double> system_t;
+
+struct problem {
+    const char * name;
+    std::function<system_t *()> make;
+    std::vector<double> y0;
+    double xend;
+    std::vector<double> xout;  // integrate_predefined (from xout[0] == 0)
+    std::vector<const char *> steppers;
+};
+
+struct counts {
+    long int n_steps = 0, nfev = 0, njev = 0;
+
+    void add(system_t * odesys){
+        n_steps += odesys->current_info.nfo_int["n_steps"];
+        nfev += odesys->current_info.nfo_int["nfev"];
+        njev += odesys->current_info.nfo_int["njev"];
+    }
+};
+
+struct record {
+    std::string api, problem, stepper;
+    int nsys, nthreads;
+    counts c;
+    long int ncalls;
+    double time_wall, time_cpu;  // per call (best batch)
+};
+
+const double abstol = 1e-8, reltol = 1e-8;
+const long int mxsteps = 100000;
+
+// Calls f (returning the counts of one call) in batches of at least min_time/3 and keeps the fastest batch.
+template <class F>
+record measure(std::string api, const char * prob, const char * stepper, int nsys, int nthreads, double min_time,
+               F f){
+    record r{api, prob, stepper, nsys, nthreads, counts(), 1, 0, 0};
+    auto batch = [&](long int n, double &wall, double &cpu){
+        std::clock_t cputime0 = std::clock();
+        auto t_start = std::chrono::high_resolution_clock::now();
+        for (long int i=0; i<n; ++i)
+            r.c = f();
+        wall = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t_start).count()/n;
+        cpu = (std::clock() - cputime0) / (double)CLOCKS_PER_SEC / n;
+    };
+    double wall, cpu;
+    batch(1, wall, cpu);  // warm up & calibration
+    r.ncalls = std::max(1L, static_cast<long int>(std::ceil(min_time/3/std::max(wall, 1e-9))));
+    r.time_wall = INFINITY;
+    for (int i=0; i<3; ++i){
+        batch(r.ncalls, wall, cpu);
+        if (wall < r.time_wall){
+            r.time_wall = wall;
+            r.time_cpu = cpu;
+        }
+    }
+    std::printf("%-18s %-9s %-20s %5d %4d %8ld %9ld %7ld %12.4g %12.4g\n", r.api.c_str(), prob, stepper, nsys,
+                nthreads, r.c.n_steps, r.c.nfev, r.c.njev, r.time_wall*1e6, r.time_cpu*1e6);
+    return r;
+}
+
+void set_num_threads(int nthreads){
+    setenv("ANYODE_NUM_THREADS", std::to_string(nthreads).c_str(), 1);
+}
+
+struct ensemble {
+    std::vector<std::unique_ptr<system_t> > owned;
+    std::vector<system_t *> systems;
+    std::vector<double> y0, x0, xend, xout, dx0, dx_max;
+
+    ensemble(const problem &p, int nsys) : x0(nsys, 0.0), xend(nsys, p.xend), dx0(nsys, 0.0), dx_max(nsys, 0.0) {
+        for (int idx=0; idx<nsys; ++idx){
+            owned.emplace_back(p.make());
+            systems.push_back(owned.back().get());
+            y0.insert(y0.end(), p.y0.begin(), p.y0.end());
+            xout.insert(xout.end(), p.xout.begin(), p.xout.end());
+        }
+    }
+    counts reset(){
+        for (auto s : systems)
+            s->nfev = s->njev = 0;
+        return counts();
+    }
+};
+
+record bench_multi_adaptive(const problem &p, const char * name, int nsys, int nthreads, double min_time){
+    ensemble e(p, nsys);
+    set_num_threads(nthreads);
+    return measure("multi_adaptive", p.name, name, nsys, nthreads, min_time, [&]{
+        counts c = e.reset();
+        odeint_anyode_parallel::multi_adaptive(e.systems, abstol, reltol, odeint_anyode::styp_from_name(name),
+                                               &e.y0[0], &e.x0[0], &e.xend[0], mxsteps, &e.dx0[0], &e.dx_max[0]);
+        for (auto s : e.systems)
+            c.add(s);
+        return c;
+    });
+}
+
+record bench_multi_predefined(const problem &p, const char * name, int nsys, int nthreads, double min_time){
+    ensemble e(p, nsys);
+    std::vector<double> yout(nsys*p.xout.size()*p.y0.size());
+    set_num_threads(nthreads);
+    return measure("multi_predefined", p.name, name, nsys, nthreads, min_time, [&]{
+        counts c = e.reset();
+        odeint_anyode_parallel::multi_predefined(e.systems, abstol, reltol, odeint_anyode::styp_from_name(name),
+                                                 &e.y0[0], p.xout.size(), &e.xout[0], &yout[0], mxsteps,
+                                                 &e.dx0[0], &e.dx_max[0]);
+        for (auto s : e.systems)
+            c.add(s);
+        return c;
+    });
+}
+
+void write_json(const char * path, const std::vector<record> &records, double min_time){
+    FILE * fh = std::fopen(path, "w");
+    if (!fh){
+        std::fprintf(stderr, "Could not open %s\n", path);
+        std::exit(1);
+    }
+    std::fprintf(fh, "{\n  \"suite\": \"bench_suite\",\n  \"compiler\": \"%s\",\n", __VERSION__);
+    std::fprintf(fh, "  \"hardware_concurrency\": %u,\n  \"min_time\": %g,\n  \"records\": [\n",
+                 std::thread::hardware_concurrency(), min_time);
+    for (std::size_t i=0; i<records.size(); ++i){
+        const record &r = records[i];
+        std::fprintf(fh, "    {\"api\": \"%s\", \"problem\": \"%s\", \"stepper\": \"%s\", \"nsys\": %d, "
+                     "\"nthreads\": %d, \"n_steps\": %ld, \"nfev\": %ld, \"njev\": %ld, \"ncalls\": %ld, "
+                     "\"time_wall\": %.6e, \"time_cpu\": %.6e}%s\n", r.api.c_str(), r.problem.c_str(),
+                     r.stepper.c_str(), r.nsys, r.nthreads, r.c.n_steps, r.c.nfev, r.c.njev, r.ncalls,
+                     r.time_wall, r.time_cpu, (i + 1 < records.size()) ? "," : "");
+    }
+    std::fprintf(fh, "  ]\n}\n");
+    std::fclose(fh);
+}
+
+std::vector<double> linspace(double a, double b, int n){
+    std::vector<double> v(n);
+    for (int i=0; i<n; ++i)
+        v[i] = a + (b - a)*i/(n - 1);
+    return v;
+}
+
+int main(int argc, char **argv){
+    const char * path = (argc > 1) ? argv[1] : "bench_suite.json";
+    const double min_time = (argc > 2) ? std::atof(argv[2]) : 0.3;
+    const int max_threads = (argc > 3) ? std::atoi(argv[3]) :
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    const int nsys = 16;
+    static const std::vector<double> p_cetsa = {{298.15, 39390, -135.3, 18010, 44960, 48.2, 65919.5, -93.8304, 1780,
+                                                 3790, 57.44, 19700, -157.4}};
+    std::vector<double> xout_robertson(1, 0.0);
+    for (int i=-5; i<=5; ++i)
+        xout_robertson.push_back(std::pow(10.0, i));
+    const std::vector<problem> problems = {
+        {"decay", []{ return new Decay(1.0); }, {1.0}, 10.0, linspace(0, 10, 16),
+         {"dopri5", "bulirsch_stoer", "fehlberg78", "cash_karp54", "verner65"}},
+        {"vdp", []{ return new VanDerPol(1.0); }, {1.0, 0.0}, 10.0, linspace(0, 10, 16),
+         {"dopri5", "bulirsch_stoer", "fehlberg78", "cash_karp54", "verner65", "rosenbrock4", "ros34pw2"}},
+        {"cetsa", []{ return new OdeSys(&p_cetsa[0]); },
+         {8.99937e-07, 0.000693731, 0.000264211, 0.000340312, 4.11575e-05}, 60.0, linspace(0, 60, 16),
+         {"rosenbrock4", "ros34pw2"}},
+        {"robertson", []{ return new Robertson(); }, {1.0, 0.0, 0.0}, 1e5, xout_robertson,
+         {"rosenbrock4", "rosenbrock4_banded", "rosenbrock4_sparse", "ros34pw2"}},
+    };
+    std::vector<record> records;
+    std::printf("%-18s %-9s %-20s %5s %4s %8s %9s %7s %12s %12s\n", "api", "problem", "stepper", "nsys", "thr",
+                "n_steps", "nfev", "njev", "wall [us]", "cpu [us]");
+    for (const auto &p : problems){
+        for (auto name : p.steppers){
+            std::unique_ptr<system_t> odesys(p.make());
+            records.push_back(measure("simple_adaptive", p.name, name, 1, 1, min_time, [&]{
+                odesys->nfev = odesys->njev = 0;
+                odeint_anyode::simple_adaptive(odesys.get(), abstol, reltol, odeint_anyode::styp_from_name(name),
+                                               &p.y0[0], 0.0, p.xend, mxsteps);
+                counts c;
+                c.add(odesys.get());
+                return c;
+            }));
+            std::vector<double> yout(p.xout.size()*p.y0.size());
+            records.push_back(measure("simple_predefined", p.name, name, 1, 1, min_time, [&]{
+                odesys->nfev = odesys->njev = 0;
+                odeint_anyode::simple_predefined(odesys.get(), abstol, reltol, odeint_anyode::styp_from_name(name),
+                                                 &p.y0[0], p.xout.size(), &p.xout[0], &yout[0], mxsteps);
+                counts c;
+                c.add(odesys.get());
+                return c;
+            }));
+            records.push_back(bench_multi_adaptive(p, name, nsys, 1, min_time));
+            records.push_back(bench_multi_predefined(p, name, nsys, 1, min_time));
+        }
+    }
+    // thread scaling (1, 2, 4, ..., max_threads)
+    for (int nthreads=1; ; nthreads = std::min(2*nthreads, max_threads)){
+        records.push_back(bench_multi_adaptive(problems[1], "dopri5", 256, nthreads, min_time));
+        records.push_back(bench_multi_adaptive(problems[2], "rosenbrock4", 64, nthreads, min_time));
+        if (nthreads == max_threads)
+            break;
+    }
+    write_json(path, records, min_time);
+    std::printf("Results written to %s\n", path);
+    return 0;
+}
@@ -2,9 +2,33 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 #include "odeint_anyode.hpp"
+#include "odeint_anyode_native.hpp"
 #include "testing_utils.hpp"
 
 
+TEST_CASE( "buffer_vector" ) {
+    std::vector<double> mem {{1.0, 2.0, 3.0}};
+    odeint_anyode::buffer_type wrapped(&mem[0], mem.size());
+    REQUIRE( !wrapped.owns_data() );
+    REQUIRE( wrapped.data() == &mem[0] );
+    odeint_anyode::buffer_type copy(wrapped);
+    REQUIRE( copy.owns_data() );
+    REQUIRE( copy[2] == 3.0 );
+    copy[2] = 5.0;
+    wrapped = copy;  // writes into caller memory
+    REQUIRE( mem[2] == 5.0 );
+    REQUIRE( wrapped.data() == &mem[0] );
+    odeint_anyode::buffer_type tmp;
+    boost::numeric::odeint::resize(tmp, wrapped);
+    REQUIRE( tmp.size() == 3 );
+    REQUIRE( tmp.owns_data() );
+    odeint_anyode::buffer_algebra::for_each3(tmp, wrapped, copy, [](double &a, double b, double c){ a = b + c; });
+    REQUIRE( tmp[0] == 2.0 );
+    REQUIRE( tmp[2] == 10.0 );
+    REQUIRE( odeint_anyode::buffer_algebra::norm_inf(tmp) == 10.0 );
+}
+
+
 TEST_CASE( "methods" ) {
     Decay odesys(1.0);
     double dx0 = 1e-12, atol=1e-8, rtol=1e-8, dx_max=INFINITY;
@@ -37,6 +61,186 @@ TEST_CASE( "decay_adaptive" ) {
 }
 
 
+TEST_CASE( "adaptive_sink" ) {
+    double y0[2] = {2.0, 0.0};
+    VanDerPol odesys_ref(2.0);
+    auto ref = odeint_anyode::simple_adaptive(&odesys_ref, 1e-8, 1e-8, odeint_anyode::StepType::rosenbrock4, y0,
+                                              0.0, 10.0, 5000, 1e-9);
+    const long int nrows = ref.first.size();
+    // callback: chunks of at most 7 rows, identical steps
+    std::vector<double> xs, ys;
+    long int nchunks = 0;
+    odeint_anyode::callback_sink cb_sink([&](long int n, const double * x, const double * y){
+        REQUIRE( n <= 7 );
+        xs.insert(xs.end(), x, x + n);
+        ys.insert(ys.end(), y, y + 2*n);
+        nchunks++;
+    });
+    VanDerPol odesys(2.0);
+    auto res = odeint_anyode::simple_adaptive(&odesys, 1e-8, 1e-8, odeint_anyode::StepType::rosenbrock4, y0,
+                                              0.0, 10.0, 5000, 1e-9, 0.0, 0, false, 10, &cb_sink, 7);
+    REQUIRE( res.first.size() == 0 );
+    REQUIRE( cb_sink.nrows == nrows );
+    REQUIRE( cb_sink.x_last == 10.0 );
+    REQUIRE( nchunks == (nrows + 6)/7 );
+    REQUIRE( xs == ref.first );
+    REQUIRE( ys == ref.second );
+    // .npy file
+    const std::string path = "adaptive_sink.npy";
+    {
+        odeint_anyode::npy_sink npy(path, 2);
+        odeint_anyode::simple_adaptive(&odesys, 1e-8, 1e-8, odeint_anyode::StepType::rosenbrock4, y0,
+                                       0.0, 10.0, 5000, 1e-9, 0.0, 0, false, 10, &npy, 5);
+        REQUIRE( npy.nrows == nrows );
+    }
+    std::FILE * f = std::fopen(path.c_str(), "rb");
+    REQUIRE( f != nullptr );
+    char header[128];
+    REQUIRE( std::fread(header, 1, 128, f) == 128 );
+    const std::string dict(header + 10, header + 128);
+    REQUIRE( dict.find("'shape': (" + std::to_string(nrows) + ", 3)") != std::string::npos );
+    REQUIRE( dict.back() == '\n' );
+    std::vector<double> data(3*nrows + 1);
+    REQUIRE( std::fread(&data[0], sizeof(double), data.size(), f) == data.size() - 1 );
+    std::fclose(f);
+    std::remove(path.c_str());
+    for (long int i = 0; i < nrows; ++i){
+        REQUIRE( data[3*i] == ref.first[i] );
+        REQUIRE( data[3*i + 1] == ref.second[2*i] );
+        REQUIRE( data[3*i + 2] == ref.second[2*i + 1] );
+    }
+    // a failing write fails the integration, the sink is not called again (also not when closed)
+    for (bool return_on_error : {false, true}){
+        nchunks = 0;
+        odeint_anyode::callback_sink bad_sink([&](long int, const double *, const double *){
+            if (++nchunks == 2)
+                throw std::runtime_error("sink full");
+        });
+        VanDerPol odesys_bad(2.0);
+        auto integrate = [&]{
+            return odeint_anyode::simple_adaptive(&odesys_bad, 1e-8, 1e-8, odeint_anyode::StepType::rosenbrock4,
+                                                  y0, 0.0, 10.0, 5000, 1e-9, 0.0, 0, return_on_error, 10,
+                                                  &bad_sink, 7);
+        };
+        if (return_on_error)
+            integrate();
+        else
+            REQUIRE_THROWS_WITH( integrate(), "sink full" );
+        REQUIRE( bad_sink.failed );
+        REQUIRE( nchunks == 2 );
+        REQUIRE( bad_sink.nrows == 7 );
+    }
+}
+
+
+TEST_CASE( "adaptive_output_policy" ) {
+    double y0[2] = {2.0, 0.0};
+    VanDerPol odesys_ref(2.0);
+    const auto styp = odeint_anyode::StepType::rosenbrock4;
+    auto ref = odeint_anyode::simple_adaptive(&odesys_ref, 1e-8, 1e-8, styp, y0, 0.0, 10.0, 5000, 1e-9);
+    const std::size_t nrows = ref.first.size();
+    auto run = [&](odeint_anyode::output_policy pol){
+        VanDerPol odesys(2.0);
+        auto res = odeint_anyode::simple_adaptive(&odesys, 1e-8, 1e-8, styp, y0, 0.0, 10.0, 5000, 1e-9, 0.0, 0,
+                                                  false, 10, nullptr, 0, pol);
+        // same steps
+        REQUIRE( odesys.current_info.nfo_int["n_steps"] == odesys_ref.current_info.nfo_int["n_steps"] );
+        REQUIRE( odesys.current_info.nfo_int["nfev"] == odesys_ref.current_info.nfo_int["nfev"] );
+        REQUIRE( res.second.size() == 2*res.first.size() );
+        REQUIRE( res.first.back() == 10.0 );
+        REQUIRE( res.second[res.second.size() - 1] == ref.second.back() );
+        return res;
+    };
+    odeint_anyode::output_policy pol;
+    pol.stride = 3;
+    auto res = run(pol);
+    REQUIRE( res.first.size() == (nrows - 1)/3 + 1 + ((nrows - 1) % 3 != 0) );
+    for (std::size_t i = 0; i + 1 < res.first.size(); ++i){
+        REQUIRE( res.first[i] == ref.first[3*i] );
+        REQUIRE( res.second[2*i + 1] == ref.second[6*i + 1] );
+    }
+    pol = odeint_anyode::output_policy();
+    pol.dx = 0.5;
+    res = run(pol);
+    REQUIRE( res.first.size() < 22 );
+    for (std::size_t i = 1; i + 1 < res.first.size(); ++i)
+        REQUIRE( res.first[i] - res.first[i - 1] >= 0.5 );
+    pol = odeint_anyode::output_policy();
+    pol.dy_rel = 0.1;
+    res = run(pol);
+    REQUIRE( res.first.size() < nrows );
+    for (std::size_t i = 1; i + 1 < res.first.size(); ++i)
+        REQUIRE( (std::abs(res.second[2*i] - res.second[2*i - 2]) > 0.1*std::abs(res.second[2*i - 2]) ||
+                  std::abs(res.second[2*i + 1] - res.second[2*i - 1]) > 0.1*std::abs(res.second[2*i - 1])) );
+    pol = odeint_anyode::output_policy();
+    pol.final_only = true;
+    res = run(pol);
+    REQUIRE( res.first.size() == 1 );
+    REQUIRE( res.second[0] == ref.second[2*nrows - 2] );
+}
+
+
+// dy/dt = lambda*(y - cos(t)) - sin(t), y(0) = 1: y = cos(t) (non-autonomous, dfdt != 0)
+struct Forced : public AnyODE::OdeSysBase<double> {
+    double m_lambda;
+
+    Forced(double lambda) : m_lambda(lambda) {}
+    int get_ny() const override { return 1; }
+    AnyODE::Status rhs(double t, const double * const __restrict__ y, double * const __restrict__ f) override {
+        f[0] = m_lambda*(y[0] - std::cos(t)) - std::sin(t);
+        this->nfev++;
+        return AnyODE::Status::success;
+    }
+    AnyODE::Status dense_jac_rmaj(double t, const double * const __restrict__ y, const double * const __restrict__ fy,
+                                  double * const __restrict__ jac, long int ldim,
+                                  double * const __restrict__ dfdt=nullptr) override {
+        AnyODE::ignore(y); AnyODE::ignore(fy); AnyODE::ignore(ldim);
+        jac[0] = m_lambda;
+        if (dfdt)
+            dfdt[0] = m_lambda*std::sin(t) - std::cos(t);
+        this->njev++;
+        return AnyODE::Status::success;
+    }
+};
+
+struct ForcedFixed : public Forced {
+    static constexpr int fixed_ny = 1;
+    using Forced::Forced;
+};
+
+TEST_CASE( "rosenbrock4_order_nonautonomous" ) {
+    typedef odeint_anyode::integr_types<0>::rosenbrock4_stepper_type stepper_type;
+    typedef odeint_anyode::vector_type vector_type;
+    Forced odesys(-2.0);
+    auto sys = std::make_pair(
+        [&](const vector_type &y, vector_type &f, double t){ odesys.rhs(t, &y[0], &f[0]); },
+        [&](const vector_type &y, odeint_anyode::matrix_type &J, double t, vector_type &dfdt){
+            odesys.dense_jac_rmaj(t, &y[0], nullptr, &J(0, 0), 1, &dfdt[0]); });
+    std::vector<double> err;
+    for (int n : {10, 20, 40}){  // fixed steps over [0, 1]
+        stepper_type stepper;
+        vector_type y(1, 1.0), ynew(1), yerr(1);
+        for (int i = 0; i < n; ++i){
+            stepper.do_step(sys, y, i*1.0/n, ynew, 1.0/n, yerr);
+            y = ynew;
+        }
+        err.push_back(std::abs(y[0] - std::cos(1.0)));
+    }
+    for (unsigned i = 1; i < err.size(); ++i)
+        REQUIRE( std::log2(err[i - 1]/err[i]) > 3.8 );  // 4th order (d4 with the wrong sign: 1st order)
+
+    const double y0 = 1.0;
+    ForcedFixed odesys_fix(-2.0);  // (rosenbrock4_dense_output_t)
+    for (auto res : {odeint_anyode::simple_adaptive(&odesys, 1e-10, 1e-10, odeint_anyode::StepType::rosenbrock4,
+                                                    &y0, 0.0, 5.0, 5000, 1e-9),
+                     odeint_anyode::simple_adaptive(&odesys_fix, 1e-10, 1e-10, odeint_anyode::StepType::rosenbrock4,
+                                                    &y0, 0.0, 5.0, 5000, 1e-9)}){
+        for (unsigned i = 0; i < res.first.size(); ++i)
+            REQUIRE( std::abs(res.second[i] - std::cos(res.first[i])) < 1e-8 );
+    }
+}
+
+
 TEST_CASE( "decay_adaptive_dx_max" ) {
     Decay odesys(1.0);
     double y0 = 1.0;
@@ -53,3 +257,628 @@ TEST_CASE( "decay_adaptive_dx_max" ) {
     }
     REQUIRE( odesys.current_info.nfo_int["nfev"] > 50 );
 }
+
+
+TEST_CASE( "decay_predefined_single_pass" ) {
+    std::vector<double> tout(101);
+    for (unsigned i = 0; i < tout.size(); ++i)
+        tout[i] = 0.03*i;
+    std::vector<double> y0(1, 1.0);
+    std::vector<double> yout(tout.size());
+    for (auto styp : {odeint_anyode::StepType::bulirsch_stoer, odeint_anyode::StepType::dopri5}){
+        Decay odesys(1.0);
+        int nreached = odeint_anyode::simple_predefined(&odesys, 1e-10, 1e-10, styp, &y0[0], tout.size(), &tout[0],
+                                                        &yout[0], 500, 1e-9, 0.0, 0, false, true);
+        REQUIRE( nreached == static_cast<int>(tout.size()) );
+        for (unsigned i = 0; i < tout.size(); ++i){
+            REQUIRE( std::abs(std::exp(-tout[i]) - yout[i]) < 1e-8 );
+        }
+        Decay odesys_ref(1.0);
+        std::vector<double> yout_ref(tout.size());
+        odeint_anyode::simple_predefined(&odesys_ref, 1e-10, 1e-10, styp, &y0[0], tout.size(), &tout[0],
+                                         &yout_ref[0], 500, 1e-9, 0.0);
+        REQUIRE( odesys.nfev < odesys_ref.nfev );
+    }
+}
+
+
+struct DecayJac : public Decay {
+    using Decay::Decay;
+    AnyODE::Status dense_jac_rmaj(double t, const double * const __restrict__ y, const double * const __restrict__ fy,
+                                  double * const __restrict__ jac, long int ldim,
+                                  double * const __restrict__ dfdt=nullptr) override {
+        AnyODE::ignore(t); AnyODE::ignore(y); AnyODE::ignore(fy); AnyODE::ignore(ldim);
+        jac[0] = -1.0;
+        if (dfdt)
+            dfdt[0] = 0.0;
+        this->njev++;
+        return AnyODE::Status::success;
+    }
+};
+
+struct DecayFixed : public DecayJac {
+    static constexpr int fixed_ny = 1;
+    using DecayJac::DecayJac;
+};
+
+struct DecayFixedWrongSize : public DecayJac {
+    static constexpr int fixed_ny = 2;
+    using DecayJac::DecayJac;
+};
+
+TEST_CASE( "decay_fixed_ny" ) {
+    static_assert(odeint_anyode::system_fixed_ny<DecayJac>::value == 0, "run-time size");
+    static_assert(odeint_anyode::system_fixed_ny<DecayFixed>::value == 1, "compile-time size");
+    double y0 = 1.0;
+    for (auto styp : {odeint_anyode::StepType::bulirsch_stoer, odeint_anyode::StepType::dopri5,
+                      odeint_anyode::StepType::rosenbrock4, odeint_anyode::StepType::fehlberg78}){
+        DecayJac odesys_dyn(1.0);
+        DecayFixed odesys_fix(1.0);
+        auto ref = odeint_anyode::simple_adaptive(&odesys_dyn, 1e-10, 1e-10, styp, &y0, 0.0, 1.0, 500, 1e-9);
+        auto res = odeint_anyode::simple_adaptive(&odesys_fix, 1e-10, 1e-10, styp, &y0, 0.0, 1.0, 500, 1e-9);
+        REQUIRE( res.first.size() == ref.first.size() );
+        for (unsigned i = 0; i < res.first.size(); ++i){
+            REQUIRE( std::abs(res.first[i] - ref.first[i]) < 1e-14 );
+            REQUIRE( std::abs(res.second[i] - ref.second[i]) < 1e-14 );
+        }
+        REQUIRE( odesys_fix.current_info.nfo_int["nfev"] == odesys_dyn.current_info.nfo_int["nfev"] );
+
+        std::vector<double> tout {{0.0, 0.5, 1.0}};
+        std::vector<double> yout(tout.size());
+        int nreached = odeint_anyode::simple_predefined(&odesys_fix, 1e-10, 1e-10, styp, &y0, tout.size(), &tout[0],
+                                                        &yout[0], 500, 1e-9);
+        REQUIRE( nreached == 3 );
+        for (unsigned i = 0; i < tout.size(); ++i)
+            REQUIRE( std::abs(std::exp(-tout[i]) - yout[i]) < 1e-8 );
+    }
+    DecayFixedWrongSize odesys_wrong(1.0);
+    REQUIRE_THROWS( odeint_anyode::simple_adaptive(&odesys_wrong, 1e-10, 1e-10, odeint_anyode::StepType::dopri5,
+                                                   &y0, 0.0, 1.0, 500, 1e-9) );
+}
+
+
+// dy_i/dt = D*(y_{i-1} - 2*y_i + y_{i+1}) - k*y_i (zero flux boundaries) + sin(t) source in y_0
+struct Diffusion : public AnyODE::OdeSysBase<double> {
+    int m_n;
+    double m_D, m_k;
+
+    Diffusion(int n, double D, double k) : m_n(n), m_D(D), m_k(k) {}
+    int get_ny() const override { return m_n; }
+    int get_mlower() const override { return 1; }
+    int get_mupper() const override { return 1; }
+    AnyODE::Status rhs(double t, const double * const __restrict__ y, double * const __restrict__ f) override {
+        for (int i = 0; i < m_n; ++i){
+            f[i] = -m_k*y[i];
+            if (i > 0)
+                f[i] += m_D*(y[i-1] - y[i]);
+            if (i < m_n - 1)
+                f[i] += m_D*(y[i+1] - y[i]);
+        }
+        f[0] += std::sin(t);
+        this->nfev++;
+        return AnyODE::Status::success;
+    }
+    double jac_elem(int ri, int ci) const {
+        if (ri == ci)
+            return -m_k - (ri > 0 ? m_D : 0) - (ri < m_n - 1 ? m_D : 0);
+        return (std::abs(ri - ci) == 1) ? m_D : 0.0;
+    }
+    AnyODE::Status dense_jac_rmaj(double t, const double * const __restrict__ y, const double * const __restrict__ fy,
+                                  double * const __restrict__ jac, long int ldim,
+                                  double * const __restrict__ dfdt=nullptr) override {
+        AnyODE::ignore(y); AnyODE::ignore(fy);
+        for (int ri = 0; ri < m_n; ++ri)
+            for (int ci = 0; ci < m_n; ++ci)
+                jac[ri*ldim + ci] = jac_elem(ri, ci);
+        if (dfdt){
+            std::fill(dfdt, dfdt + m_n, 0.0);
+            dfdt[0] = std::cos(t);
+        }
+        this->njev++;
+        return AnyODE::Status::success;
+    }
+    AnyODE::Status banded_jac_cmaj(double t, const double * const __restrict__ y, const double * const __restrict__ fy,
+                                   double * const __restrict__ jac, long int ldim) override {
+        AnyODE::ignore(t); AnyODE::ignore(y); AnyODE::ignore(fy);
+        for (int ci = 0; ci < m_n; ++ci)
+            for (int ri = std::max(0, ci - 1); ri <= std::min(m_n - 1, ci + 1); ++ri)
+                jac[1 + ri - ci + ci*ldim] = jac_elem(ri, ci);
+        this->njev++;
+        return AnyODE::Status::success;
+    }
+    int get_nnz() const override { return 3*m_n - 2; }
+    AnyODE::Status sparse_jac_csc(double t, const double * const __restrict__ y, const double * const __restrict__ fy,
+                                  double * const __restrict__ data, int * const __restrict__ colptrs,
+                                  int * const __restrict__ rowvals) override {
+        AnyODE::ignore(t); AnyODE::ignore(y); AnyODE::ignore(fy);
+        int nnz = 0;
+        for (int ci = 0; ci < m_n; ++ci){
+            colptrs[ci] = nnz;
+            for (int ri = std::max(0, ci - 1); ri <= std::min(m_n - 1, ci + 1); ++ri){
+                data[nnz] = jac_elem(ri, ci);
+                rowvals[nnz++] = ri;
+            }
+        }
+        colptrs[m_n] = nnz;
+        this->njev++;
+        return AnyODE::Status::success;
+    }
+};
+
+TEST_CASE( "banded_lu" ) {
+    // 5x5 with mlower=2, mupper=1, pivoting required (zero on the first diagonal element)
+    const int n = 5, ml = 2, mu = 1;
+    double A[n][n] = {{0, 2, 0, 0, 0}, {3, 1, 4, 0, 0}, {1, 5, 2, 1, 0}, {0, 2, 7, 1, 3}, {0, 0, 1, 8, 2}};
+    odeint_anyode::banded_lu<double, std::vector<double> > lu(ml, mu);
+    lu.resize(n);
+    for (int ci = 0; ci < n; ++ci)
+        for (int ri = std::max(0, ci - mu); ri <= std::min(n - 1, ci + ml); ++ri)
+            lu.jacobian()[mu + ri - ci + ci*lu.ldim()] = -A[ri][ci];  // factorize(0) gives A
+    lu.factorize(0.0);
+    std::vector<double> x {{1, -2, 3, 0.5, -1}}, b(n, 0.0);
+    for (int ri = 0; ri < n; ++ri)
+        for (int ci = 0; ci < n; ++ci)
+            b[ri] += A[ri][ci]*x[ci];
+    lu.solve(b);
+    for (int i = 0; i < n; ++i)
+        REQUIRE( std::abs(b[i] - x[i]) < 1e-13 );
+}
+
+TEST_CASE( "diffusion_rosenbrock4_banded" ) {
+    const int n = 40;
+    std::vector<double> y0(n);
+    for (int i = 0; i < n; ++i)
+        y0[i] = 1.0/(1 + i);
+    std::vector<double> tout {{0.0, 0.5, 1.0, 2.0, 5.0}};
+    std::vector<double> yout_dense(tout.size()*n), yout_banded(tout.size()*n);
+    Diffusion odesys_dense(n, 50.0, 0.1), odesys_banded(n, 50.0, 0.1);
+    int nreached_dense = odeint_anyode::simple_predefined(
+        &odesys_dense, 1e-8, 1e-8, odeint_anyode::StepType::rosenbrock4, &y0[0], tout.size(), &tout[0],
+        &yout_dense[0], 5000, 1e-9);
+    int nreached_banded = odeint_anyode::simple_predefined(
+        &odesys_banded, 1e-8, 1e-8, odeint_anyode::styp_from_name("rosenbrock4_banded"), &y0[0], tout.size(),
+        &tout[0], &yout_banded[0], 5000, 1e-9);
+    REQUIRE( nreached_dense == static_cast<int>(tout.size()) );
+    REQUIRE( nreached_banded == static_cast<int>(tout.size()) );
+    for (unsigned i = 0; i < yout_dense.size(); ++i)
+        REQUIRE( std::abs(yout_dense[i] - yout_banded[i]) < 1e-6 );
+    REQUIRE( odesys_banded.current_info.nfo_int["njev"] > 0 );
+
+    // non-autonomous (dfdt != 0): compare with dopri5 (regression test for the sign of d4)
+    Diffusion odesys_ref(n, 50.0, 0.1);
+    std::vector<double> yout_ref(tout.size()*n);
+    odeint_anyode::simple_predefined(&odesys_ref, 1e-12, 1e-12, odeint_anyode::StepType::dopri5, &y0[0], tout.size(),
+                                     &tout[0], &yout_ref[0], 50000, 1e-9);
+    for (unsigned i = 0; i < yout_dense.size(); ++i)
+        REQUIRE( std::abs(yout_dense[i] - yout_ref[i]) < 1e-8 );
+
+    auto res = odeint_anyode::simple_adaptive(&odesys_banded, 1e-8, 1e-8, odeint_anyode::StepType::rosenbrock4_banded,
+                                              &y0[0], 0.0, 5.0, 5000, 1e-9);
+    REQUIRE( std::abs(res.first.back() - 5.0) < 1e-12 );
+    for (int i = 0; i < n; ++i)
+        REQUIRE( std::abs(res.second[res.second.size() - n + i] - yout_dense[(tout.size() - 1)*n + i]) < 1e-6 );
+
+    Decay no_band(1.0);
+    double y0_decay = 1.0;
+    REQUIRE_THROWS( odeint_anyode::simple_adaptive(&no_band, 1e-8, 1e-8, odeint_anyode::StepType::rosenbrock4_banded,
+                                                   &y0_decay, 0.0, 1.0) );
+}
+
+
+TEST_CASE( "sparse_lu" ) {
+    // "arrow" matrix: dense first row & column, no fill-in when eliminating the first node last
+    const int n = 6;
+    std::vector<int> colptrs, rowvals;
+    std::vector<double> data, A(n*n, 0.0);  // A: row major
+    for (int ci = 0; ci < n; ++ci){
+        colptrs.push_back(rowvals.size());
+        for (int ri = 0; ri < n; ++ri){
+            if (ri == 0 || ci == 0 || ri == ci){
+                A[ri*n + ci] = (ri == ci) ? 10.0 + ri : 1.0 + 0.1*ri - 0.2*ci;
+                rowvals.push_back(ri);
+                data.push_back(-A[ri*n + ci]);  // factorize(0) gives A
+            }
+        }
+    }
+    colptrs.push_back(rowvals.size());
+    odeint_anyode::sparse_lu<double, std::vector<double> > lu(rowvals.size());
+    lu.resize(n);
+    lu.jacobian().data = data;
+    lu.jacobian().colptrs = colptrs;
+    lu.jacobian().rowvals = rowvals;
+    lu.factorize(0.0);
+    REQUIRE( lu.symbolic().analyzed );
+    REQUIRE( lu.symbolic().perm[0] != 0 );  // not the "hub"
+    REQUIRE( lu.symbolic().nnz_lu() == rowvals.size() );  // no fill-in
+    std::vector<double> x {{1, -2, 3, 0.5, -1, 2}}, b(n, 0.0);
+    for (int ri = 0; ri < n; ++ri)
+        for (int ci = 0; ci < n; ++ci)
+            b[ri] += A[ri*n + ci]*x[ci];
+    auto copy = lu;  // shares the symbolic analysis
+    copy.solve(b);
+    for (int i = 0; i < n; ++i)
+        REQUIRE( std::abs(b[i] - x[i]) < 1e-13 );
+
+    copy.jacobian().rowvals[1] = 2;  // the pattern must not change
+    REQUIRE_THROWS( copy.factorize(0.0) );
+    lu.factorize(1.0);
+    std::fill(lu.jacobian().data.begin(), lu.jacobian().data.end(), 0.0);  // singular: zero pivot
+    REQUIRE_THROWS( lu.factorize(0.0) );
+
+    // invalid patterns are rejected before they are used
+    auto check = [&](std::vector<int> cp, std::vector<int> rv){
+        odeint_anyode::sparse_lu<double, std::vector<double> > bad(rowvals.size());
+        bad.resize(n);
+        bad.jacobian().colptrs = cp;
+        bad.jacobian().rowvals = rv;
+        bad.jacobian().rowvals.resize(rowvals.size());
+        REQUIRE_THROWS( bad.factorize(0.0) );
+        REQUIRE( !bad.symbolic().analyzed );
+    };
+    auto cp = colptrs;
+    cp[n] = rowvals.size() + 1;  // beyond nnz
+    check(cp, rowvals);
+    cp = colptrs;
+    cp[0] = 1;
+    check(cp, rowvals);
+    cp = colptrs;
+    std::swap(cp[2], cp[3]);  // decreasing
+    check(cp, rowvals);
+    auto rv = rowvals;
+    rv.back() = n;  // row index out of range
+    check(colptrs, rv);
+    rv.back() = -1;
+    check(colptrs, rv);
+}
+
+TEST_CASE( "diffusion_rosenbrock4_sparse" ) {
+    const int n = 40;
+    std::vector<double> y0(n);
+    for (int i = 0; i < n; ++i)
+        y0[i] = 1.0/(1 + i);
+    std::vector<double> tout {{0.0, 0.5, 1.0, 2.0, 5.0}};
+    std::vector<double> yout_banded(tout.size()*n), yout_sparse(tout.size()*n);
+    Diffusion odesys_banded(n, 50.0, 0.1), odesys_sparse(n, 50.0, 0.1);
+    odeint_anyode::simple_predefined(
+        &odesys_banded, 1e-8, 1e-8, odeint_anyode::StepType::rosenbrock4_banded, &y0[0], tout.size(), &tout[0],
+        &yout_banded[0], 5000, 1e-9);
+    int nreached = odeint_anyode::simple_predefined(
+        &odesys_sparse, 1e-8, 1e-8, odeint_anyode::styp_from_name("rosenbrock4_sparse"), &y0[0], tout.size(),
+        &tout[0], &yout_sparse[0], 5000, 1e-9);
+    REQUIRE( nreached == static_cast<int>(tout.size()) );
+    for (unsigned i = 0; i < yout_sparse.size(); ++i)
+        REQUIRE( std::abs(yout_banded[i] - yout_sparse[i]) < 1e-10 );
+    REQUIRE( odesys_sparse.current_info.nfo_int["nnz"] == 3*n - 2 );
+    REQUIRE( odesys_sparse.current_info.nfo_int["nnz_lu"] == 3*n - 2 );  // tridiagonal: no fill-in
+    REQUIRE( odesys_sparse.current_info.nfo_vecint["jac_colptrs"].size() == n + 1 );
+    REQUIRE( odesys_sparse.current_info.nfo_vecint["jac_rowvals"].size() == 3*n - 2 );
+
+    Decay no_nnz(1.0);
+    double y0_decay = 1.0;
+    REQUIRE_THROWS( odeint_anyode::simple_adaptive(&no_nnz, 1e-8, 1e-8, odeint_anyode::StepType::rosenbrock4_sparse,
+                                                   &y0_decay, 0.0, 1.0) );
+}
+
+TEST_CASE( "session" ) {
+    const int n = 20;
+    std::vector<double> tout {{0.0, 0.5, 1.0, 2.0}};
+    for (auto name : {"dopri5", "rosenbrock4", "rosenbrock4_sparse", "ros34pw2"}){
+        const auto styp = odeint_anyode::styp_from_name(name);
+        Diffusion odesys(n, 5.0, 0.1), odesys_ref(n, 5.0, 0.1);
+        odeint_anyode::Session<Diffusion> session(&odesys, 1e-8, 1e-8, styp, 5000, 1e-9);
+        for (int call = 0; call < 3; ++call){
+            std::vector<double> y0(n), yout(tout.size()*n), yref(tout.size()*n);
+            for (int i = 0; i < n; ++i)
+                y0[i] = (1.0 + call)/(1 + i);
+            odesys_ref.nfev = odesys_ref.njev = 0;
+            int nref = odeint_anyode::simple_predefined(&odesys_ref, 1e-8, 1e-8, styp, &y0[0], tout.size(),
+                                                        &tout[0], &yref[0], 5000, 1e-9);
+            int nreached = session.predefined(&y0[0], tout.size(), &tout[0], &yout[0]);
+            REQUIRE( nreached == nref );
+            for (unsigned i = 0; i < yout.size(); ++i)
+                REQUIRE( yout[i] == yref[i] );
+            session.set_info();
+            for (auto key : {"n_steps", "nfev", "njev"})
+                REQUIRE( odesys.current_info.nfo_int[key] == odesys_ref.current_info.nfo_int[key] );
+        }
+    }
+}
+
+TEST_CASE( "stepping" ) {
+    const int n = 20;
+    std::vector<double> tout {{0.0, 0.5, 1.0, 2.0}};
+    for (auto name : {"bulirsch_stoer", "dopri5", "rosenbrock4", "rosenbrock4_banded", "rosenbrock4_sparse",
+                      "ros34pw2"}){
+        const auto styp = odeint_anyode::styp_from_name(name);
+        Diffusion odesys(n, 5.0, 0.1), odesys_ref(n, 5.0, 0.1);
+        std::vector<double> y0(n), yref(tout.size()*n);
+        for (int i = 0; i < n; ++i)
+            y0[i] = 1.0/(1 + i);
+        odeint_anyode::simple_predefined(&odesys_ref, 1e-8, 1e-8, styp, &y0[0], tout.size(), &tout[0], &yref[0],
+                                         5000, 1e-9, 0.0, 0, false, true);
+        odeint_anyode::Stepping<Diffusion> stepping(&odesys, 1e-8, 1e-8, styp, &y0[0], tout[0], 5000, 1e-9);
+        REQUIRE( stepping.advance_to(tout[0]) == 0 );
+        long int nsteps = 0;
+        for (unsigned ix = 1; ix < tout.size(); ++ix){
+            nsteps += stepping.advance_to(tout[ix]);
+            REQUIRE( stepping.x() == tout[ix] );
+            for (int i = 0; i < n; ++i){
+                if (ix + 1 < tout.size())  // identical steps (single_pass only shortens the last one)
+                    REQUIRE( stepping.y()[i] == yref[ix*n + i] );
+                else
+                    REQUIRE( std::abs(stepping.y()[i] - yref[ix*n + i]) < 1e-6 );
+            }
+        }
+        REQUIRE( nsteps == stepping.n_steps() );
+        REQUIRE( odesys.nfev <= 1.1*odesys_ref.current_info.nfo_int["nfev"] );  // no restarts
+        REQUIRE_THROWS( stepping.advance_to(1.5) );
+        // single steps continue from the last accepted step
+        const double dx = stepping.dx();
+        REQUIRE( dx > 0 );
+        REQUIRE( stepping.step() > tout.back() );
+        REQUIRE( stepping.n_steps() == nsteps + 1 );
+        stepping.set_info();
+        REQUIRE( odesys.current_info.nfo_int["n_steps"] == nsteps + 1 );
+        REQUIRE( odesys.current_info.nfo_int["nfev"] == odesys.nfev );
+    }
+    // compile-time size
+    double y0 = 1.0;
+    DecayFixed odesys(1.0);
+    odeint_anyode::Stepping<DecayFixed> stepping(&odesys, 1e-10, 1e-10, odeint_anyode::StepType::rosenbrock4, &y0, 0.0);
+    stepping.advance_to(1.0);
+    REQUIRE( std::abs(stepping.y()[0] - std::exp(-1.0)) < 1e-8 );
+    // a first x within the initial step: one step ending on x (as simple_adaptive takes), no interpolation
+    for (auto name : {"dopri5", "rosenbrock4"}){
+        const auto styp = odeint_anyode::styp_from_name(name);
+        DecayJac odesys_short(1.0), odesys_ref(1.0);
+        odeint_anyode::Stepping<DecayJac> stepping_short(&odesys_short, 1e-10, 1e-10, styp, &y0, 0.0, 0, 0.1);
+        auto ref = odeint_anyode::simple_adaptive(&odesys_ref, 1e-10, 1e-10, styp, &y0, 0.0, 0.01, 0, 0.1);
+        REQUIRE( stepping_short.advance_to(0.01) == 1 );
+        REQUIRE( ref.first.size() == 2 );
+        REQUIRE( stepping_short.y()[0] == ref.second.back() );
+        stepping_short.set_info();
+        REQUIRE( odesys_short.current_info.nfo_int["n_steps"] == 1 );
+        REQUIRE( odesys_short.current_info.nfo_int["nfev"] == odesys_ref.current_info.nfo_int["nfev"] );
+        REQUIRE( odesys_short.current_info.nfo_int["njev"] == odesys_ref.current_info.nfo_int["njev"] );
+    }
+}
+
+TEST_CASE( "estimate_dx0" ) {
+    Decay odesys(1.0);
+    double y0 = 1.0;
+    const double dx0 = odeint_anyode::estimate_dx0(&odesys, 0.0, 10.0, &y0, 1e-8, 1e-8, 5);
+    REQUIRE( odesys.nfev == 2 );
+    REQUIRE( dx0 > 1e-4 );
+    REQUIRE( dx0 < 0.1 );
+    REQUIRE( odeint_anyode::estimate_dx0(&odesys, 10.0, 0.0, &y0, 1e-8, 1e-8, 5) == -dx0 );  // towards xend
+    REQUIRE( odeint_anyode::estimate_dx0(&odesys, 0.0, 1e-6, &y0, 1e-8, 1e-8, 5) == 1e-6 );
+    REQUIRE( odeint_anyode::estimate_dx0(&odesys, 0.0, 10.0, &y0, 1e-8, 1e-8, 5, 1e-5) == 1e-5 );
+    // used by simple_adaptive (counted in nfev) unless dx0 is given, fewer steps than from 100*eps
+    for (auto name : {"bulirsch_stoer", "dopri5"}){
+        Decay odesys_est(1.0), odesys_eps(1.0);
+        odeint_anyode::simple_adaptive(&odesys_est, 1e-8, 1e-8, odeint_anyode::styp_from_name(name), &y0, 0.0, 10.0);
+        odeint_anyode::simple_adaptive(&odesys_eps, 1e-8, 1e-8, odeint_anyode::styp_from_name(name), &y0, 0.0, 10.0,
+                                       0, std::numeric_limits<double>::epsilon() * 100);
+        REQUIRE( odesys_est.current_info.nfo_int["n_steps"] < odesys_eps.current_info.nfo_int["n_steps"] );
+        REQUIRE( odesys_est.current_info.nfo_int["nfev"] == odesys_est.nfev );
+    }
+}
+
+// Records the largest x at which rhs is called.
+struct DiffusionXMax : public Diffusion {
+    double m_x_max = -INFINITY;
+
+    using Diffusion::Diffusion;
+    AnyODE::Status rhs(double t, const double * const __restrict__ y, double * const __restrict__ f) override {
+        m_x_max = std::max(m_x_max, t);
+        return Diffusion::rhs(t, y, f);
+    }
+};
+
+TEST_CASE( "dense_solution" ) {
+    const int n = 20;
+    std::vector<double> xs;
+    for (int i = 0; i <= 40; ++i)
+        xs.push_back(0.05*i);
+    for (auto name : {"bulirsch_stoer", "dopri5", "rosenbrock4", "rosenbrock4_banded", "rosenbrock4_sparse",
+                      "ros34pw2"}){
+        const auto styp = odeint_anyode::styp_from_name(name);
+        Diffusion odesys(n, 5.0, 0.1), odesys_ref(n, 5.0, 0.1);
+        std::vector<double> y0(n), yref(xs.size()*n), y(xs.size()*n);
+        for (int i = 0; i < n; ++i)
+            y0[i] = 1.0/(1 + i);
+        auto sol = odeint_anyode::simple_dense(&odesys, 1e-8, 1e-8, styp, &y0[0], 0.0, 2.0, 5000, 1e-9);
+        REQUIRE( sol.n_steps() == odesys.current_info.nfo_int["n_steps"] );
+        REQUIRE( sol.x_begin() == 0.0 );
+        REQUIRE( sol.x_end() == 2.0 );
+        const auto nfev = odesys.nfev;
+        sol(xs.size(), &xs[0], &y[0]);
+        REQUIRE( odesys.nfev == nfev );  // no further calls of rhs
+        odeint_anyode::simple_predefined(&odesys_ref, 1e-8, 1e-8, styp, &y0[0], xs.size(), &xs[0], &yref[0],
+                                         5000, 1e-9, 0.0, 0, false, true);
+        for (std::size_t j = 0; j < xs.size()*n; ++j)
+            REQUIRE( std::abs(y[j] - yref[j]) < 1e-6 );
+        // breakpoints are stored exactly, reverse order gives the same values
+        sol.eval(sol.breakpoints()[1], &y[0]);
+        for (int i = 0; i < n; ++i)
+            REQUIRE( y[i] == sol.y_breakpoint(1)[i] );
+        std::vector<double> xs_rev(xs.rbegin(), xs.rend()), y_rev(xs.size()*n);
+        sol(xs.size(), &xs_rev[0], &y_rev[0]);
+        sol(xs.size(), &xs[0], &y[0]);
+        for (std::size_t j = 0; j < xs.size(); ++j)
+            for (int i = 0; i < n; ++i)
+                REQUIRE( y_rev[(xs.size() - 1 - j)*n + i] == y[j*n + i] );
+        REQUIRE_THROWS_AS( sol.eval(2.0 + 1e-9, &y[0]), std::domain_error );
+        REQUIRE_THROWS_AS( sol.eval(-1e-9, &y[0]), std::domain_error );
+
+        // the last step ends on xend: no calls of rhs beyond it
+        DiffusionXMax odesys_xmax(n, 5.0, 0.1);
+        auto sol_xmax = odeint_anyode::simple_dense(&odesys_xmax, 1e-8, 1e-8, styp, &y0[0], 0.0, 2.0, 5000, 1e-9);
+        REQUIRE( odesys_xmax.m_x_max <= 2.0 );
+        REQUIRE( std::abs(sol_xmax.breakpoints().back() - 2.0) < 1e-14 );
+        // mxsteps: throws, or ends early at the last accepted step with return_on_error
+        REQUIRE_THROWS( odeint_anyode::simple_dense(&odesys_xmax, 1e-8, 1e-8, styp, &y0[0], 0.0, 2.0, 5, 1e-9) );
+        std::string diag;
+        auto sol_part = odeint_anyode::simple_dense(&odesys_xmax, 1e-8, 1e-8, styp, &y0[0], 0.0, 2.0, 5, 1e-9, 0.0,
+                                                    10, true, &diag);
+        REQUIRE( odesys_xmax.current_info.nfo_int["status"] ==
+                 static_cast<int>(odeint_anyode::IntegrStatus::mxsteps_reached) );
+        REQUIRE( odesys_xmax.current_info.nfo_int["n_steps"] == 5 );
+        REQUIRE( sol_part.n_steps() == 5 );
+        REQUIRE( sol_part.x_end() == sol_part.breakpoints().back() );
+        REQUIRE( sol_part.x_end() < 2.0 );
+        REQUIRE( diag.find("Maximum number of steps reached") != std::string::npos );
+    }
+    // dopri5: the dense output of the stepper is reproduced exactly (up to rounding)
+    Diffusion odesys(n, 5.0, 0.1);
+    std::vector<double> y0(n), y(n), y_step(n);
+    for (int i = 0; i < n; ++i)
+        y0[i] = 1.0/(1 + i);
+    auto sol = odeint_anyode::simple_dense(&odesys, 1e-6, 1e-6, odeint_anyode::StepType::dopri5, &y0[0], 0.0, 2.0,
+                                           5000, 1e-9);
+    odeint_anyode::Stepping<Diffusion> stepping(&odesys, 1e-6, 1e-6, odeint_anyode::StepType::dopri5, &y0[0], 0.0,
+                                                5000, 1e-9);
+    for (int k = 1; k <= 20; ++k){
+        while (stepping.x() < 0.1*k)
+            stepping.step(2.0);
+        stepping.calc_state(0.1*k, &y_step[0]);
+        sol.eval(0.1*k, &y[0]);
+        for (int i = 0; i < n; ++i)
+            REQUIRE( std::abs(y[i] - y_step[i]) < 1e-12 );
+    }
+    REQUIRE( stepping.n_steps() == sol.n_steps() );
+}
+
+TEST_CASE( "diffusion_ros34pw2" ) {
+    const int n = 40;
+    std::vector<double> y0(n);
+    for (int i = 0; i < n; ++i)
+        y0[i] = 1.0/(1 + i);
+    std::vector<double> tout {{0.0, 0.5, 1.0, 2.0, 5.0}};
+    std::vector<double> yout_ref(tout.size()*n), yout(tout.size()*n);
+    Diffusion odesys_ref(n, 50.0, 0.1), odesys(n, 50.0, 0.1);
+    odeint_anyode::simple_predefined(&odesys_ref, 1e-10, 1e-10, odeint_anyode::StepType::rosenbrock4_banded, &y0[0],
+                                     tout.size(), &tout[0], &yout_ref[0], 5000, 1e-9);
+    for (bool single_pass : {false, true}){
+        int nreached = odeint_anyode::simple_predefined(
+            &odesys, 1e-8, 1e-8, odeint_anyode::styp_from_name("ros34pw2"), &y0[0], tout.size(), &tout[0],
+            &yout[0], 5000, 1e-9, 0.0, 0, false, single_pass);
+        REQUIRE( nreached == static_cast<int>(tout.size()) );
+        for (unsigned i = 0; i < yout.size(); ++i)
+            REQUIRE( std::abs(yout_ref[i] - yout[i]) < 1e-6 );
+        auto &nfo = odesys.current_info.nfo_int;
+        REQUIRE( nfo["njev"] < nfo["n_factorizations"] );
+        if (single_pass)  // (n_steps only covers the last interval otherwise)
+            REQUIRE( nfo["n_factorizations"] < nfo["n_steps"] + nfo["n_rejected"] );
+    }
+    // max_jac_age=1: a Jacobian for every step
+    auto res = odeint_anyode::simple_adaptive(&odesys, 1e-8, 1e-8, odeint_anyode::StepType::ros34pw2, &y0[0],
+                                              0.0, 5.0, 5000, 1e-9, 0.0, 0, false, 1);
+    auto &nfo = odesys.current_info.nfo_int;
+    REQUIRE( nfo["njev"] >= nfo["n_steps"] );
+    for (int i = 0; i < n; ++i)
+        REQUIRE( std::abs(res.second[res.second.size() - n + i] - yout_ref[(tout.size() - 1)*n + i]) < 1e-6 );
+}
+
+TEST_CASE( "decay_fixed_ny_ros34pw2" ) {
+    double y0 = 1.0;
+    DecayFixed odesys(1.0);
+    auto res = odeint_anyode::simple_adaptive(&odesys, 1e-10, 1e-10, odeint_anyode::StepType::ros34pw2, &y0,
+                                              0.0, 1.0, 5000, 1e-9);
+    REQUIRE( std::abs(res.first.back() - 1.0) < 1e-14 );
+    for (unsigned i = 0; i < res.first.size(); ++i)
+        REQUIRE( std::abs(std::exp(-res.first[i]) - res.second[i]) < 1e-8 );
+}
+
+TEST_CASE( "step_trace" ) {
+    const int n = 40;
+    std::vector<double> y0(n);
+    for (int i = 0; i < n; ++i)
+        y0[i] = 1.0/(1 + i);
+    for (auto styp : {odeint_anyode::StepType::rosenbrock4, odeint_anyode::StepType::rosenbrock4_banded,
+                      odeint_anyode::StepType::ros34pw2}){
+        Diffusion odesys(n, 50.0, 0.1);
+        odeint_anyode::step_trace trace;
+        trace.history = true;
+        auto res = odeint_anyode::simple_adaptive(&odesys, 1e-8, 1e-8, styp, &y0[0], 0.0, 5.0, 5000, 1e-9, 0.0, 0,
+                                                  false, 10, nullptr, 0, odeint_anyode::output_policy(), &trace);
+        auto &nfo = odesys.current_info.nfo_int;
+        REQUIRE( nfo["n_accepted"] == static_cast<long int>(res.first.size()) - 1 );
+        REQUIRE( nfo["n_rejected"] == trace.n_rejected );
+        REQUIRE( trace.x.size() == static_cast<std::size_t>(trace.n_accepted + trace.n_rejected) );
+        REQUIRE( trace.n_factorizations > 0 );
+        REQUIRE( trace.n_solves >= trace.n_factorizations );
+        REQUIRE( trace.time_rhs > 0 );
+        REQUIRE( trace.time_jac > 0 );
+        REQUIRE( trace.time_linalg > 0 );
+        REQUIRE( trace.time_rhs + trace.time_jac + trace.time_linalg < odesys.current_info.nfo_dbl["time_wall"] );
+        std::size_t iacc = 0;  // the accepted steps are those of the output
+        for (std::size_t i = 0; i < trace.x.size(); ++i){
+            REQUIRE( trace.accepted[i] == (trace.err[i] <= 1) );
+            if (trace.accepted[i]){
+                REQUIRE( trace.x[i] == res.first[iacc] );
+                ++iacc;
+            }
+        }
+    }
+    Decay odesys(1.0);
+    double y0_decay = 1.0;
+    odeint_anyode::step_trace trace;
+    trace.history = true;
+    auto res = odeint_anyode::simple_adaptive(&odesys, 1e-10, 1e-10, odeint_anyode::StepType::dopri5, &y0_decay, 0.0,
+                                              1.0, 500, 0.0, 0.0, 0, false, 10, nullptr, 0,
+                                              odeint_anyode::output_policy(), &trace);
+    REQUIRE( trace.n_accepted == static_cast<long int>(res.first.size()) - 1 );
+    REQUIRE( odesys.current_info.nfo_int.count("n_rejected") == 0 );
+    REQUIRE( trace.n_factorizations == 0 );
+    REQUIRE( std::isnan(trace.err[0]) );
+    REQUIRE( odesys.current_info.nfo_vecdbl["steps_dt"].size() == static_cast<std::size_t>(trace.n_accepted) );
+
+    // disabled by default
+    odeint_anyode::simple_adaptive(&odesys, 1e-10, 1e-10, odeint_anyode::StepType::dopri5, &y0_decay, 0.0, 1.0);
+    REQUIRE( odesys.current_info.nfo_int.count("n_accepted") == 0 );
+}
+
+int decay_jac_cb(double t, const double * y, const double * fy, double * jmat, long int ldim, double * dfdt,
+                 void * user_data){
+    AnyODE::ignore(t); AnyODE::ignore(y); AnyODE::ignore(fy); AnyODE::ignore(ldim);
+    jmat[0] = -*static_cast<double *>(user_data);
+    if (dfdt)
+        dfdt[0] = 0;
+    return 0;
+}
+
+int rhs_fail_cb(double t, const double * const y, double * const f, void * user_data){
+    f[0] = -*static_cast<double *>(user_data)*y[0];
+    return (t > 0.5) ? 1 : 0;  // recoverable error
+}
+
+TEST_CASE( "decay_native" ) {
+    double k = 1.0, y0 = 1.0;
+    odeint_anyode_native::NativeOdeSys odesys(1, reinterpret_cast<void *>(&rhs_cb),
+                                              reinterpret_cast<void *>(&decay_jac_cb), nullptr, nullptr, &k);
+    for (auto styp : {odeint_anyode::StepType::dopri5, odeint_anyode::StepType::rosenbrock4}){
+        auto res = odeint_anyode::simple_adaptive(&odesys, 1e-10, 1e-10, styp, &y0, 0.0, 1.0, 5000, 1e-9);
+        REQUIRE( std::abs(res.first.back() - 1.0) < 1e-14 );
+        for (unsigned i = 0; i < res.first.size(); ++i)
+            REQUIRE( std::abs(std::exp(-res.first[i]) - res.second[i]) < 1e-8 );
+        REQUIRE( odesys.current_info.nfo_int["nfev"] > 1 );
+    }
+    REQUIRE( odesys.current_info.nfo_int["njev"] > 0 );
+    odeint_anyode_native::NativeOdeSys no_jac(1, reinterpret_cast<void *>(&rhs_cb));
+    REQUIRE_THROWS( odeint_anyode::simple_adaptive(&no_jac, 1e-10, 1e-10, odeint_anyode::StepType::rosenbrock4,
+                                                   &y0, 0.0, 1.0, 5000, 1e-9) );
+
+    // a non-zero status fails the step
+    odeint_anyode_native::NativeOdeSys failing(1, reinterpret_cast<void *>(&rhs_fail_cb), nullptr, nullptr, nullptr,
+                                               &k);
+    REQUIRE_THROWS( odeint_anyode::simple_adaptive(&failing, 1e-10, 1e-10, odeint_anyode::StepType::dopri5, &y0,
+                                                   0.0, 1.0, 5000, 1e-9) );
+    std::string diag;
+    auto res = odeint_anyode::simple_adaptive(&failing, 1e-10, 1e-10, odeint_anyode::StepType::dopri5, &y0, 0.0,
+                                              1.0, 5000, 1e-9, 0.0, 0, true, 10, nullptr, 0,
+                                              odeint_anyode::output_policy(), nullptr, &diag);
+    REQUIRE( failing.current_info.nfo_int["status"] == static_cast<int>(odeint_anyode::IntegrStatus::step_failed) );
+    REQUIRE( res.first.back() <= 0.5 );
+    REQUIRE( diag.find("rhs returned status 1") != std::string::npos );
+}
@@ -1,6 +1,7 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 #include <math.h>
+#include <algorithm>
 #include <vector>
 #include "anyode/anyode.hpp"
 #include "odeint_anyode.hpp"
@@ -30,4 +31,100 @@ TEST_CASE( "adaptive_autorestart" ) {
     REQUIRE( ref == yout.size() );
     REQUIRE( odesys.current_info.nfo_int["n_steps"] > 1 );
     REQUIRE( odesys.current_info.nfo_int["n_steps"] < 997 );
+    // the output continues in place (no repeated points) and restarts are reported
+    for (unsigned idx=1; idx<tout.size(); ++idx)
+        REQUIRE( tout[idx] > tout[idx - 1] );
+    auto &x_restarts = odesys.current_info.nfo_vecdbl["x_restarts"];
+    REQUIRE( odesys.current_info.nfo_int["n_restarts"] == static_cast<int>(x_restarts.size()) );
+    REQUIRE( x_restarts.size() > 0 );
+    REQUIRE( x_restarts.size() <= 2 );
+    for (auto x : x_restarts)
+        REQUIRE( std::find(tout.begin(), tout.end(), x) != tout.end() );
+}
+
+TEST_CASE( "predefined_autorestart" ) {
+    std::vector<double> p = {{298.15, 39390, -135.3, 18010, 44960, 48.2, 65919.5, -93.8304, 1780, 3790, 57.44, 19700, -157.4}};
+    std::vector<double> y0 = {{8.99937e-07, 0.000693731, 0.000264211, 0.000340312, 4.11575e-05}};
+    std::vector<double> tout = {{0.0, 1e-8, 1e-6, 1e-4, 1e-2, 1.0, 10.0, 60.0}};
+    for (bool single_pass : {false, true}){
+        std::vector<double> yout(tout.size()*5), yref(tout.size()*5);
+        OdeSys odesys(&p[0]), odesys_ref(&p[0]);
+        int nref = odeint_anyode::simple_predefined(&odesys_ref, 1e-6, 1e-6, odeint_anyode::StepType::rosenbrock4,
+                                                    &y0[0], tout.size(), &tout[0], &yref[0], 5000, 1e-13);
+        REQUIRE( nref == static_cast<int>(tout.size()) );
+        // too few steps for some intervals, resumed with the last step size
+        int nreached = odeint_anyode::simple_predefined(&odesys, 1e-6, 1e-6, odeint_anyode::StepType::rosenbrock4,
+                                                        &y0[0], tout.size(), &tout[0], &yout[0], single_pass ? 6 : 10, 1e-13, 0.0,
+                                                        10, false, single_pass);
+        REQUIRE( nreached == static_cast<int>(tout.size()) );
+        REQUIRE( odesys.current_info.nfo_int["n_restarts"] > 0 );
+        REQUIRE( odesys.current_info.nfo_int["n_restarts"] <= 10 );
+        for (unsigned i=0; i<yout.size(); ++i)
+            REQUIRE( std::abs(yout[i] - yref[i]) < 1e-2*std::abs(yref[i]) + 1e-10 );
+    }
+}
+
+
+TEST_CASE( "rosenbrock4_jacobian_cache" ) {
+    std::vector<double> p = {{298.15, 39390, -135.3, 18010, 44960, 48.2, 65919.5, -93.8304, 1780, 3790, 57.44, 19700, -157.4}};
+    std::vector<double> y0 = {{8.99937e-07, 0.000693731, 0.000264211, 0.000340312, 4.11575e-05}};
+    std::vector<double> yend[2];
+    const double dx0s[2] = {1e-13, 1.0};  // a too large first step gets rejected repeatedly
+    for (int i=0; i<2; ++i){
+        OdeSys odesys(&p[0]);
+        auto tout_yout = odeint_anyode::simple_adaptive(&odesys, 1e-10, 1e-10, odeint_anyode::StepType::rosenbrock4,
+                                                        &y0[0], 0.0, 60.0, 1000, dx0s[i]);
+        auto& yout = tout_yout.second;
+        yend[i].assign(yout.end() - odesys.get_ny(), yout.end());
+        REQUIRE( odesys.current_info.nfo_int["njev_cached"] > 0 );
+        REQUIRE( odesys.current_info.nfo_int["njev"] < odesys.current_info.nfo_int["n_steps"] );
+    }
+    for (int j=0; j<5; ++j)
+        REQUIRE( std::abs(yend[0][j] - yend[1][j]) < 1e-8*std::abs(yend[0][j]) + 1e-14 );
+}
+
+TEST_CASE( "return_on_error_status" ) {
+    std::vector<double> p = {{298.15, 39390, -135.3, 18010, 44960, 48.2, 65919.5, -93.8304, 1780, 3790, 57.44, 19700, -157.4}};
+    std::vector<double> y0 = {{8.99937e-07, 0.000693731, 0.000264211, 0.000340312, 4.11575e-05}};
+    std::vector<double> tout = {{0.0, 1e-8, 1e-6, 1e-4, 1e-2, 1.0, 10.0, 60.0}};
+    const int mxsteps = 10;
+    const std::string msg = "Maximum number of steps reached: 10\n";
+    OdeSys odesys(&p[0]);
+
+    // mxsteps: the integration stops early and reports it (in the diagnostics instead of std::cerr)
+    std::string diagnostics;
+    auto tout_yout = odeint_anyode::simple_adaptive(&odesys, 1e-6, 1e-6, odeint_anyode::StepType::rosenbrock4, &y0[0],
+                                                    0.0, 60.0, mxsteps, 1e-13, 0.0, 0, true, 10, nullptr, 0,
+                                                    odeint_anyode::output_policy(), nullptr, &diagnostics);
+    REQUIRE( tout_yout.first.size() == mxsteps + 1 );
+    REQUIRE( odesys.current_info.nfo_int["status"] == static_cast<int>(odeint_anyode::IntegrStatus::mxsteps_reached) );
+    REQUIRE( diagnostics == msg );
+    REQUIRE_THROWS_AS( odeint_anyode::simple_adaptive(&odesys, 1e-6, 1e-6, odeint_anyode::StepType::rosenbrock4,
+                                                      &y0[0], 0.0, 60.0, mxsteps, 1e-13), std::runtime_error );
+
+    for (bool single_pass : {false, true}){
+        const int mxsteps_interval = single_pass ? 6 : 10;
+        const std::string msg_interval = "Maximum number of steps reached: " + std::to_string(mxsteps_interval)
+            + "\n";
+        std::vector<double> yout(tout.size()*5);
+        diagnostics.clear();
+        int nreached = odeint_anyode::simple_predefined(&odesys, 1e-6, 1e-6, odeint_anyode::StepType::rosenbrock4,
+                                                        &y0[0], tout.size(), &tout[0], &yout[0], mxsteps_interval,
+                                                        1e-13, 0.0, 0, true, single_pass, 10, nullptr, &diagnostics);
+        REQUIRE( nreached >= 1 );
+        REQUIRE( nreached < static_cast<int>(tout.size()) );
+        REQUIRE( odesys.current_info.nfo_int["status"] ==
+                 static_cast<int>(odeint_anyode::IntegrStatus::mxsteps_reached) );
+        REQUIRE( diagnostics == msg_interval );
+
+        // autorestart: all of it ends up in the diagnostics as well
+        diagnostics.clear();
+        nreached = odeint_anyode::simple_predefined(&odesys, 1e-6, 1e-6, odeint_anyode::StepType::rosenbrock4,
+                                                    &y0[0], tout.size(), &tout[0], &yout[0], mxsteps_interval, 1e-13,
+                                                    0.0, 10, true, single_pass, 10, nullptr, &diagnostics);
+        REQUIRE( nreached == static_cast<int>(tout.size()) );
+        REQUIRE( odesys.current_info.nfo_int["status"] == static_cast<int>(odeint_anyode::IntegrStatus::success) );
+        REQUIRE( diagnostics.find(msg_interval) == 0 );
+        REQUIRE( diagnostics.find("Autorestart (10)") != std::string::npos );
+    }
 }
@@ -0,0 +1,90 @@
+// C++11 source code.
+// fehlberg78, cash_karp54 & verner65, built with optimization (see Makefile): -Wuninitialized &
+// -Wmaybe-uninitialized only look at the (std::array, fixed_ny) states of odeint's steppers when optimizing.
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+#include <cmath>
+#include <vector>
+#include "odeint_anyode.hpp"
+#include "testing_utils.hpp"
+
+// Kepler orbit (eccentricity 0.5, period 2 pi): back at the initial state after every period.
+struct Kepler : public AnyODE::OdeSysBase<double> {
+    int get_ny() const override { return 4; }
+    AnyODE::Status rhs(double t, const double * const __restrict__ y, double * const __restrict__ f) override {
+        AnyODE::ignore(t);
+        const double r = std::sqrt(y[0]*y[0] + y[1]*y[1]);
+        f[0] = y[2];
+        f[1] = y[3];
+        f[2] = -y[0]/(r*r*r);
+        f[3] = -y[1]/(r*r*r);
+        this->nfev++;
+        return AnyODE::Status::success;
+    }
+};
+
+struct KeplerFixed : public Kepler {
+    static constexpr int fixed_ny = 4;
+};
+
+const char * const explicit_pairs[] = {"fehlberg78", "cash_karp54", "verner65"};
+
+TEST_CASE( "explicit_pairs_decay" ) {
+    std::vector<double> tout(11);
+    for (unsigned i = 0; i < tout.size(); ++i)
+        tout[i] = 0.3*i;
+    const double y0 = 1.0, dx0 = 1e-3;
+    Decay odesys_dopri5(1.0);
+    odeint_anyode::simple_adaptive(&odesys_dopri5, 1e-13, 1e-13, odeint_anyode::StepType::dopri5, &y0, 0.0, 3.0,
+                                   5000, dx0);
+    for (auto name : explicit_pairs){
+        const auto styp = odeint_anyode::styp_from_name(name);
+        REQUIRE( !odeint_anyode::has_dense_output(styp) );
+        Decay odesys(1.0);
+        auto res = odeint_anyode::simple_adaptive(&odesys, 1e-13, 1e-13, styp, &y0, 0.0, 3.0, 5000, dx0);
+        REQUIRE( res.first.back() == 3.0 );
+        for (unsigned i = 0; i < res.first.size(); ++i)
+            REQUIRE( std::abs(std::exp(-res.first[i]) - res.second[i]) < 1e-11 );
+        if (styp == odeint_anyode::StepType::fehlberg78)
+            REQUIRE( 2*odesys.current_info.nfo_int["nfev"] < odesys_dopri5.current_info.nfo_int["nfev"] );
+
+        std::vector<double> yout(tout.size());
+        int nreached = odeint_anyode::simple_predefined(&odesys, 1e-13, 1e-13, styp, &y0, tout.size(), &tout[0],
+                                                        &yout[0], 5000, dx0);
+        REQUIRE( nreached == static_cast<int>(tout.size()) );
+        for (unsigned i = 0; i < tout.size(); ++i)
+            REQUIRE( std::abs(std::exp(-tout[i]) - yout[i]) < 1e-11 );
+        // no interpolant: no single_pass, Stepping or simple_dense
+        REQUIRE_THROWS( odeint_anyode::simple_predefined(&odesys, 1e-13, 1e-13, styp, &y0, tout.size(), &tout[0],
+                                                         &yout[0], 5000, dx0, 0.0, 0, false, true) );
+        REQUIRE_THROWS( odeint_anyode::Stepping<Decay>(&odesys, 1e-13, 1e-13, styp, &y0, 0.0, 5000, dx0) );
+        REQUIRE_THROWS( odeint_anyode::simple_dense(&odesys, 1e-13, 1e-13, styp, &y0, 0.0, 3.0, 5000, dx0) );
+    }
+}
+
+TEST_CASE( "explicit_pairs_kepler_fixed_ny" ) {
+    const std::vector<double> y0 {{0.5, 0.0, 0.0, std::sqrt(3.0)}};
+    const double xend = 4*M_PI;
+    for (auto name : explicit_pairs){
+        const auto styp = odeint_anyode::styp_from_name(name);
+        Kepler odesys_dyn;
+        KeplerFixed odesys_fix;
+        auto ref = odeint_anyode::simple_adaptive(&odesys_dyn, 1e-12, 1e-12, styp, &y0[0], 0.0, xend, 20000);
+        auto res = odeint_anyode::simple_adaptive(&odesys_fix, 1e-12, 1e-12, styp, &y0[0], 0.0, xend, 20000);
+        REQUIRE( res.first.size() == ref.first.size() );
+        for (unsigned i = 0; i < res.second.size(); ++i)
+            REQUIRE( std::abs(res.second[i] - ref.second[i]) < 1e-14 );
+        for (unsigned j = 0; j < y0.size(); ++j)
+            REQUIRE( std::abs(res.second[res.second.size() - 4 + j] - y0[j]) < 1e-7 );
+        REQUIRE( odesys_fix.current_info.nfo_int["nfev"] == odesys_dyn.current_info.nfo_int["nfev"] );
+
+        const std::vector<double> xout {{0.0, M_PI, 2*M_PI}};
+        std::vector<double> yout(xout.size()*y0.size());
+        int nreached = odeint_anyode::simple_predefined(&odesys_fix, 1e-12, 1e-12, styp, &y0[0], xout.size(),
+                                                        &xout[0], &yout[0], 20000);
+        REQUIRE( nreached == 3 );
+        REQUIRE( std::abs(yout[4] + 1.5) < 1e-7 );  // apocenter
+        for (unsigned j = 0; j < y0.size(); ++j)
+            REQUIRE( std::abs(yout[8 + j] - y0[j]) < 1e-7 );
+    }
+}
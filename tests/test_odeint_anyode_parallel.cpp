@@ -1,6 +1,10 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
-#include "odeint_anyode_parallel.hpp"
+#include <numeric>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "odeint_anyode_ensemble.hpp"
 #include "testing_utils.hpp"
 
 TEST_CASE( "decay_adaptive" ) {
@@ -28,3 +32,373 @@ TEST_CASE( "decay_adaptive" ) {
         REQUIRE( systems[idx]->current_info.nfo_dbl["time_wall"] > 1e-9 );
     }
 }
+
+
+TEST_CASE( "thread_pool" ) {
+    odeint_anyode_parallel::thread_pool pool(3);
+    REQUIRE( pool.size() == 3 );
+    std::vector<int> calls(100, 0);
+    std::vector<double> busy;
+    for (int rep=0; rep<3; ++rep)  // threads are reused
+        pool.run(calls.size(), [&](int idx){ calls[idx]++; }, nullptr, &busy);
+    for (auto c : calls)
+        REQUIRE( c == 3 );
+    REQUIRE( busy.size() == 3 );
+    std::vector<int> order {{ 2, 0, 1 }}, seen;
+    odeint_anyode_parallel::thread_pool serial(1);
+    serial.run(3, [&](int idx){ seen.push_back(idx); }, &order[0]);
+    REQUIRE( seen == order );
+}
+
+
+TEST_CASE( "thread_pool_nested_fork" ) {
+    // a nested run is executed by the calling thread (the workers are busy with the outer one)
+    std::vector<int> calls(8*8, 0), tids(8*8, -1);
+    odeint_anyode_parallel::parallel_for_tid(3, 8, [&](int i, int){
+        odeint_anyode_parallel::parallel_for_tid(3, 8, [&](int j, int tid){
+            calls[i*8 + j]++;
+            tids[i*8 + j] = tid;
+        });
+    });
+    for (std::size_t k=0; k<calls.size(); ++k){
+        REQUIRE( calls[k] == 1 );
+        REQUIRE( tids[k] == 0 );
+    }
+    // the child of fork starts a new pool (the threads of the inherited one do not exist)
+    auto pool = odeint_anyode_parallel::thread_pool::shared(3);
+    const pid_t pid = fork();
+    REQUIRE( pid >= 0 );
+    if (pid == 0){
+        alarm(10);  // a deadlock fails the test
+        std::atomic<int> n(0);
+        odeint_anyode_parallel::parallel_for_tid(3, 100, [&](int, int){ n++; });
+        const bool new_pool = odeint_anyode_parallel::thread_pool::shared(3) != pool;
+        _exit((n == 100 && new_pool) ? 0 : 1);
+    }
+    int status = 0;
+    REQUIRE( waitpid(pid, &status, 0) == pid );
+    REQUIRE( WIFEXITED(status) );
+    REQUIRE( WEXITSTATUS(status) == 0 );
+    REQUIRE( odeint_anyode_parallel::thread_pool::shared(3) == pool );  // unchanged in the parent
+}
+
+
+TEST_CASE( "multi_predefined_threads_cost" ) {
+    setenv("ANYODE_NUM_THREADS", "3", 1);
+    const int nsys = 7, nout = 5;
+    std::vector<VanDerPol> vdp;
+    for (int idx=0; idx<nsys; ++idx)
+        vdp.emplace_back(0.5 + 0.5*idx);
+    std::vector<VanDerPol *> systems;
+    for (auto& s : vdp)
+        systems.push_back(&s);
+    std::vector<double> y0, tout, dx0(nsys, 1e-8), dx_max(nsys, 0.0), yout(nsys*nout*2), yref(nsys*nout*2);
+    for (int idx=0; idx<nsys; ++idx){
+        y0.push_back(2.0);
+        y0.push_back(0.0);
+        for (int j=0; j<nout; ++j)
+            tout.push_back(j*1.0);
+    }
+    std::vector<double> cost, busy;
+    odeint_anyode_parallel::multi_predefined(
+        systems, 1e-8, 1e-8, odeint_anyode::StepType::dopri5, &y0[0], nout, &tout[0], &yref[0], 5000,
+        &dx0[0], &dx_max[0], 0, false, false, nullptr, &busy);
+    REQUIRE( busy.size() == 3 );
+    auto pool = odeint_anyode_parallel::thread_pool::shared(3);
+    for (auto s : systems)
+        cost.push_back(s->current_info.nfo_int["n_steps"]);
+    auto nreached = odeint_anyode_parallel::multi_predefined(
+        systems, 1e-8, 1e-8, odeint_anyode::StepType::dopri5, &y0[0], nout, &tout[0], &yout[0], 5000,
+        &dx0[0], &dx_max[0], 0, false, false, &cost[0], &busy);
+    REQUIRE( odeint_anyode_parallel::thread_pool::shared(3) == pool );  // no new threads
+    REQUIRE( busy.size() == 3 );
+    REQUIRE( std::accumulate(busy.begin(), busy.end(), 0.0) > 0 );
+    for (int idx=0; idx<nsys; ++idx)
+        REQUIRE( nreached[idx] == nout );
+    REQUIRE( yout == yref );
+    unsetenv("ANYODE_NUM_THREADS");
+}
+
+// A system whose rhs fails for some of its states (e.g. a bad parameter set in a sweep).
+struct DecayNonNegative : public Decay {
+    using Decay::Decay;
+    AnyODE::Status rhs(double t, const double * const __restrict__ y, double * const __restrict__ f) override {
+        if (y[0] < 0)
+            throw std::runtime_error("DecayNonNegative: y < 0");
+        return Decay::rhs(t, y, f);
+    }
+};
+
+TEST_CASE( "multi_predefined_return_on_error" ) {
+    // dx0 = 0: the initial step size is estimated, rhs of the second system fails already at x0
+    const int nsys = 3, nout = 3;
+    std::vector<DecayNonNegative> sys {{ DecayNonNegative(1.0), DecayNonNegative(1.0), DecayNonNegative(1.0) }};
+    std::vector<DecayNonNegative *> systems {{ &sys[0], &sys[1], &sys[2] }};
+    std::vector<double> y0 {{ 1.0, -1.0, 2.0 }}, tout, dx0(nsys, 0.0), dx_max(nsys, 0.0), yout(nsys*nout);
+    for (int idx=0; idx<nsys; ++idx)
+        for (int j=0; j<nout; ++j)
+            tout.push_back(0.5*j);
+    REQUIRE_THROWS( odeint_anyode_parallel::multi_predefined(
+        systems, 1e-8, 1e-8, odeint_anyode::StepType::dopri5, &y0[0], nout, &tout[0], &yout[0], 500,
+        &dx0[0], &dx_max[0]) );
+    std::vector<std::string> diag;
+    auto nreached = odeint_anyode_parallel::multi_predefined(
+        systems, 1e-8, 1e-8, odeint_anyode::StepType::dopri5, &y0[0], nout, &tout[0], &yout[0], 500,
+        &dx0[0], &dx_max[0], 0, true, false, nullptr, nullptr, 10, &diag);
+    REQUIRE( nreached[0] == nout );
+    REQUIRE( diag[0].empty() );
+    REQUIRE( nreached[1] == 0 );
+    REQUIRE( diag[1].find("DecayNonNegative: y < 0") != std::string::npos );
+    REQUIRE( sys[1].current_info.nfo_int["status"] == static_cast<int>(odeint_anyode::IntegrStatus::step_failed) );
+    REQUIRE( nreached[2] == nout );
+    REQUIRE( std::abs(yout[3*nout - 1] - 2*std::exp(-1.0)) < 1e-7 );
+
+    auto res = odeint_anyode::simple_adaptive(&sys[1], 1e-8, 1e-8, odeint_anyode::StepType::dopri5, &y0[1], 0.0,
+                                              1.0, 500, 0.0, 0.0, 0, true);
+    REQUIRE( res.first.empty() );
+    REQUIRE( sys[1].current_info.nfo_int["status"] == static_cast<int>(odeint_anyode::IntegrStatus::step_failed) );
+}
+
+TEST_CASE( "multi_adaptive_ragged" ) {
+    setenv("ANYODE_NUM_THREADS", "3", 1);
+    const int nsys = 11;
+    std::vector<VanDerPol> vdp;
+    for (int idx=0; idx<nsys; ++idx)
+        vdp.emplace_back(0.5 + 0.25*idx);
+    std::vector<VanDerPol *> systems;
+    for (auto& s : vdp)
+        systems.push_back(&s);
+    std::vector<double> y0, t0(nsys, 0.0), tend, dx0(nsys, 1e-8), dx_max(nsys, 0.0);
+    for (int idx=0; idx<nsys; ++idx){
+        y0.push_back(2.0);
+        y0.push_back(0.0);
+        tend.push_back(1.0 + idx);
+    }
+    auto ref = odeint_anyode_parallel::multi_adaptive(
+        systems, 1e-8, 1e-8, odeint_anyode::StepType::dopri5, &y0[0], &t0[0], &tend[0], 5000,
+        &dx0[0], &dx_max[0]);
+    auto result = odeint_anyode_parallel::multi_adaptive_ragged(
+        systems, 1e-8, 1e-8, odeint_anyode::StepType::dopri5, &y0[0], &t0[0], &tend[0], 5000,
+        &dx0[0], &dx_max[0], 0, false, nullptr, nullptr, 10, 7);  // chunks of 7 rows
+    REQUIRE( result.offsets.size() == nsys + 1 );
+    REQUIRE( result.offsets[0] == 0 );
+    REQUIRE( result.xout.size() == static_cast<std::size_t>(result.offsets[nsys]) );
+    REQUIRE( result.yout.size() == 2*result.xout.size() );
+    for (int idx=0; idx<nsys; ++idx){
+        REQUIRE( result.nrows(idx) == static_cast<long int>(ref[idx].first.size()) );
+        REQUIRE( std::equal(ref[idx].first.begin(), ref[idx].first.end(),
+                            result.xout.begin() + result.offsets[idx]) );
+        REQUIRE( std::equal(ref[idx].second.begin(), ref[idx].second.end(),
+                            result.yout.begin() + 2*result.offsets[idx]) );
+    }
+    unsetenv("ANYODE_NUM_THREADS");
+}
+
+TEST_CASE( "ensemble_adaptive" ) {
+    const int nsys = 23;  // not a multiple of the ensemble width
+    std::vector<VanDerPol> vdp;
+    for (int idx=0; idx<nsys; ++idx)
+        vdp.emplace_back(0.1 + 0.2*idx);
+    std::vector<VanDerPol *> systems;
+    for (auto& s : vdp)
+        systems.push_back(&s);
+    std::vector<double> y0, t0, tend, dx0(nsys, 0.0), dx_max(nsys, 0.0);
+    for (int idx=0; idx<nsys; ++idx){
+        y0.push_back(2.0);
+        y0.push_back(0.1*idx);
+        t0.push_back(0.1*idx);
+        tend.push_back(0.1*idx + 3.0 + (idx % 4));
+    }
+    dx_max[3] = 0.05;
+    auto ref = odeint_anyode_parallel::multi_adaptive(
+        systems, 1e-10, 1e-10, odeint_anyode::StepType::dopri5, &y0[0], &t0[0], &tend[0], 5000, &dx0[0], &dx_max[0]);
+    auto result = odeint_anyode_parallel::ensemble_adaptive(
+        systems, 1e-10, 1e-10, &y0[0], &t0[0], &tend[0], 5000, &dx0[0], &dx_max[0]);
+    for (int idx=0; idx<nsys; ++idx){
+        const auto& tout = result[idx].first;
+        const auto& yout = result[idx].second;
+        REQUIRE( tout.size()*2 == yout.size() );
+        REQUIRE( tout.front() == t0[idx] );
+        REQUIRE( tout.back() == tend[idx] );
+        // same step size control as odeint's dopri5: (almost) the same steps
+        REQUIRE( std::abs((long)tout.size() - (long)ref[idx].first.size()) <= 2 );
+        for (int i=0; i<2; ++i)
+            REQUIRE( std::abs(yout[yout.size() - 2 + i] - ref[idx].second[ref[idx].second.size() - 2 + i]) < 1e-7 );
+        REQUIRE( systems[idx]->current_info.nfo_int["n_steps"] == (int)tout.size() - 1 );
+    }
+    REQUIRE( result[3].first.size() > 60 );  // dx_max
+}
+
+
+TEST_CASE( "ensemble_predefined" ) {
+    const int nsys = 9, nout = 7;
+    std::vector<VanDerPol> vdp;
+    for (int idx=0; idx<nsys; ++idx)
+        vdp.emplace_back(0.5 + 0.3*idx);
+    std::vector<VanDerPol *> systems;
+    for (auto& s : vdp)
+        systems.push_back(&s);
+    std::vector<double> y0, tout, dx0(nsys, 1e-8), dx_max(nsys, 0.0);
+    for (int idx=0; idx<nsys; ++idx){
+        y0.push_back(1.0 + 0.1*idx);
+        y0.push_back(0.0);
+        for (int j=0; j<nout; ++j)
+            tout.push_back(0.5*idx + j*0.75);
+    }
+    std::vector<double> yref(nsys*nout*2), yout(nsys*nout*2);
+    for (auto styp : {odeint_anyode::StepType::dopri5, odeint_anyode::StepType::rosenbrock4}){
+        // the same steps and dense output as single_pass
+        for (auto& s : vdp)
+            s.nfev = s.njev = 0;
+        auto nref = odeint_anyode_parallel::multi_predefined(
+            systems, 1e-10, 1e-10, styp, &y0[0], nout, &tout[0], &yref[0], 5000, &dx0[0], &dx_max[0], 0, false,
+            true);
+        std::vector<long int> nsteps_ref, nfev_ref;
+        for (auto& s : vdp){
+            nsteps_ref.push_back(s.current_info.nfo_int["n_steps"]);
+            nfev_ref.push_back(s.current_info.nfo_int["nfev"]);
+            s.nfev = s.njev = 0;
+        }
+        auto nreached = odeint_anyode_parallel::ensemble_predefined(
+            systems, 1e-10, 1e-10, &y0[0], nout, &tout[0], &yout[0], 5000, &dx0[0], &dx_max[0], false, styp);
+        for (int idx=0; idx<nsys; ++idx){
+            REQUIRE( nreached[idx] == nout );
+            REQUIRE( nref[idx] == nout );
+            REQUIRE( vdp[idx].current_info.nfo_int["n_steps"] == nsteps_ref[idx] );
+            REQUIRE( vdp[idx].current_info.nfo_int["nfev"] <= nfev_ref[idx] );
+        }
+        for (std::size_t i=0; i<yout.size(); ++i)
+            REQUIRE( std::abs(yout[i] - yref[i]) < 1e-12 );
+    }
+}
+
+
+TEST_CASE( "ensemble_return_on_error" ) {
+    std::vector<VanDerPol> vdp {{ VanDerPol(1.0), VanDerPol(1.0) }};
+    std::vector<VanDerPol *> systems {{ &vdp[0], &vdp[1] }};
+    std::vector<double> y0 {{ 2.0, 0.0, 2.0, 0.0 }}, t0 {{ 0.0, 0.0 }}, tend {{ 1.0, 100.0 }};
+    std::vector<double> dx0 {{ 0.0, 0.0 }}, dx_max {{ 0.0, 0.0 }};
+    REQUIRE_THROWS( odeint_anyode_parallel::ensemble_adaptive(
+        systems, 1e-8, 1e-8, &y0[0], &t0[0], &tend[0], 50, &dx0[0], &dx_max[0]) );
+    auto result = odeint_anyode_parallel::ensemble_adaptive(
+        systems, 1e-8, 1e-8, &y0[0], &t0[0], &tend[0], 50, &dx0[0], &dx_max[0], true);
+    REQUIRE( result[0].first.back() == 1.0 );
+    REQUIRE( result[1].first.size() == 51 );
+    REQUIRE( result[1].first.back() < 100.0 );
+}
+
+
+TEST_CASE( "ensemble_rosenbrock4" ) {
+    const int nsys = 11;
+    std::vector<VanDerPol> vdp;
+    for (int idx=0; idx<nsys; ++idx)
+        vdp.emplace_back(1.0 + 2.0*idx);
+    std::vector<VanDerPol *> systems;
+    for (auto& s : vdp)
+        systems.push_back(&s);
+    std::vector<double> y0, t0(nsys, 0.0), tend(nsys, 5.0), dx0(nsys, 0.0), dx_max(nsys, 0.0);
+    for (int idx=0; idx<nsys; ++idx){
+        y0.push_back(2.0);
+        y0.push_back(0.0);
+    }
+    auto ref = odeint_anyode_parallel::multi_adaptive(
+        systems, 1e-8, 1e-8, odeint_anyode::StepType::rosenbrock4, &y0[0], &t0[0], &tend[0], 5000,
+        &dx0[0], &dx_max[0]);
+    auto result = odeint_anyode_parallel::ensemble_adaptive(
+        systems, 1e-8, 1e-8, &y0[0], &t0[0], &tend[0], 5000, &dx0[0], &dx_max[0], false,
+        odeint_anyode::StepType::rosenbrock4);
+    for (int idx=0; idx<nsys; ++idx){
+        const auto& tout = result[idx].first;
+        const auto& yout = result[idx].second;
+        REQUIRE( tout.back() == tend[idx] );
+        // same step size control as rosenbrock4_controller: (almost) the same steps
+        REQUIRE( std::abs((long)tout.size() - (long)ref[idx].first.size()) <= 2 );
+        for (int i=0; i<2; ++i)
+            REQUIRE( std::abs(yout[yout.size() - 2 + i] - ref[idx].second[ref[idx].second.size() - 2 + i]) < 1e-5 );
+    }
+    REQUIRE_THROWS( odeint_anyode_parallel::ensemble_adaptive(
+        systems, 1e-8, 1e-8, &y0[0], &t0[0], &tend[0], 5000, &dx0[0], &dx_max[0], false,
+        odeint_anyode::StepType::bulirsch_stoer) );
+}
+
+
+struct VanDerPolBatch : public odeint_anyode_parallel::ensemble_batch {
+    std::vector<double> m_mu;
+    int m_ncalls = 0;
+
+    void rhs(int n, const int * idx, const double *, const double * y, double * f) override {
+        ++m_ncalls;
+        for (int k=0; k<n; ++k){
+            const double * const yk = y + 2*k;
+            f[2*k] = yk[1];
+            f[2*k + 1] = m_mu[idx[k]]*(1 - yk[0]*yk[0])*yk[1] - yk[0];
+        }
+    }
+    void jac(int n, const int * idx, const double *, const double * y, double * jmat, double *) override {
+        for (int k=0; k<n; ++k){
+            const double * const yk = y + 2*k;
+            double * const jk = jmat + 4*k;
+            jk[1] = 1;
+            jk[2] = -2*m_mu[idx[k]]*yk[0]*yk[1] - 1;
+            jk[3] = m_mu[idx[k]]*(1 - yk[0]*yk[0]);
+        }
+    }
+};
+
+
+TEST_CASE( "ensemble_batch" ) {
+    const int nsys = 13, nout = 5;
+    VanDerPolBatch batch;
+    std::vector<VanDerPol> vdp;
+    std::vector<odeint_anyode_parallel::ensemble_member> members(nsys, odeint_anyode_parallel::ensemble_member(2));
+    for (int idx=0; idx<nsys; ++idx){
+        batch.m_mu.push_back(0.5 + 0.7*idx);
+        vdp.emplace_back(batch.m_mu.back());
+    }
+    std::vector<VanDerPol *> systems;
+    for (auto& s : vdp)
+        systems.push_back(&s);
+    std::vector<odeint_anyode_parallel::ensemble_member *> msystems;
+    for (auto& s : members)
+        msystems.push_back(&s);
+    std::vector<double> y0, tout, dx0(nsys, 1e-6), dx_max(nsys, 0.0);
+    for (int idx=0; idx<nsys; ++idx){
+        y0.push_back(2.0);
+        y0.push_back(0.1*idx);
+        for (int j=0; j<nout; ++j)
+            tout.push_back(j*(1.0 + 0.1*idx));
+    }
+    for (auto styp : {odeint_anyode::StepType::dopri5, odeint_anyode::StepType::rosenbrock4}){
+        for (int batch_size : {0, 4}){
+            std::vector<double> yref(nsys*nout*2), yout(nsys*nout*2);
+            odeint_anyode_parallel::ensemble_predefined(
+                systems, 1e-9, 1e-9, &y0[0], nout, &tout[0], &yref[0], 5000, &dx0[0], &dx_max[0], false, styp);
+            batch.m_ncalls = 0;
+            for (auto& s : members)
+                s.nfev = s.njev = 0;
+            auto nreached = odeint_anyode_parallel::ensemble_predefined(
+                msystems, 1e-9, 1e-9, &y0[0], nout, &tout[0], &yout[0], 5000, &dx0[0], &dx_max[0], false, styp,
+                &batch, batch_size);
+            long nfev = 0;
+            for (int idx=0; idx<nsys; ++idx){
+                REQUIRE( nreached[idx] == nout );
+                REQUIRE( members[idx].current_info.nfo_int["n_steps"] ==
+                         vdp[idx].current_info.nfo_int["n_steps"] );
+                nfev += members[idx].nfev;
+            }
+            for (std::size_t i=0; i<yout.size(); ++i)
+                REQUIRE( std::abs(yout[i] - yref[i]) < 1e-12 );
+            REQUIRE( batch.m_ncalls < nfev/3 );
+        }
+    }
+    std::vector<odeint_anyode_parallel::ensemble_member *> two {{ msystems[0], msystems[1] }};
+    struct RhsOnly : public odeint_anyode_parallel::ensemble_batch {
+        void rhs(int n, const int *, const double *, const double * y, double * f) override {
+            std::copy(y, y + 2*n, f);
+        }
+    } rhs_only;  // rosenbrock4 needs ensemble_batch::jac
+    std::vector<double> yout(2*nout*2);
+    REQUIRE_THROWS( odeint_anyode_parallel::ensemble_predefined(
+        two, 1e-9, 1e-9, &y0[0], nout, &tout[0], &yout[0], 5000, &dx0[0], &dx_max[0], false,
+        odeint_anyode::StepType::rosenbrock4, &rhs_only) );
+}
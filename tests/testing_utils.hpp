@@ -18,3 +18,96 @@ struct Decay : public AnyODE::OdeSysBase<double> {
         return AnyODE::Status::success;
     }
 };
+
+struct VanDerPol : public AnyODE::OdeSysBase<double> {
+    double m_mu;
+
+    VanDerPol(double mu) : m_mu(mu) {}
+    int get_ny() const override { return 2; }
+    AnyODE::Status rhs(double t, const double * const __restrict__ y, double * const __restrict__ f) override {
+        AnyODE::ignore(t);
+        f[0] = y[1];
+        f[1] = m_mu*(1 - y[0]*y[0])*y[1] - y[0];
+        this->nfev++;
+        return AnyODE::Status::success;
+    }
+    AnyODE::Status dense_jac_rmaj(double t, const double * const __restrict__ y, const double * const __restrict__ fy,
+                                  double * const __restrict__ jac, long int ldim,
+                                  double * const __restrict__ dfdt=nullptr) override {
+        AnyODE::ignore(t); AnyODE::ignore(fy);
+        jac[0] = 0;
+        jac[1] = 1;
+        jac[ldim] = -2*m_mu*y[0]*y[1] - 1;
+        jac[ldim + 1] = m_mu*(1 - y[0]*y[0]);
+        if (dfdt){
+            dfdt[0] = 0;
+            dfdt[1] = 0;
+        }
+        this->njev++;
+        return AnyODE::Status::success;
+    }
+};
+
+// Robertson's stiff chemical kinetics (3 species), with dense, banded (full band) & sparse Jacobians.
+struct Robertson : public AnyODE::OdeSysBase<double> {
+    double m_k1, m_k2, m_k3;
+
+    Robertson(double k1=0.04, double k2=3e7, double k3=1e4) : m_k1(k1), m_k2(k2), m_k3(k3) {}
+    int get_ny() const override { return 3; }
+    int get_mlower() const override { return 2; }
+    int get_mupper() const override { return 2; }
+    int get_nnz() const override { return 7; }
+    AnyODE::Status rhs(double t, const double * const __restrict__ y, double * const __restrict__ f) override {
+        AnyODE::ignore(t);
+        const double r1 = m_k1*y[0], r2 = m_k2*y[1]*y[1], r3 = m_k3*y[1]*y[2];
+        f[0] = r3 - r1;
+        f[1] = r1 - r2 - r3;
+        f[2] = r2;
+        this->nfev++;
+        return AnyODE::Status::success;
+    }
+    double jac_elem(const double * const y, int ri, int ci) const {
+        const double J[3][3] = {{-m_k1, m_k3*y[2], m_k3*y[1]},
+                                {m_k1, -2*m_k2*y[1] - m_k3*y[2], -m_k3*y[1]},
+                                {0, 2*m_k2*y[1], 0}};
+        return J[ri][ci];
+    }
+    AnyODE::Status dense_jac_rmaj(double t, const double * const __restrict__ y, const double * const __restrict__ fy,
+                                  double * const __restrict__ jac, long int ldim,
+                                  double * const __restrict__ dfdt=nullptr) override {
+        AnyODE::ignore(t); AnyODE::ignore(fy);
+        for (int ri = 0; ri < 3; ++ri)
+            for (int ci = 0; ci < 3; ++ci)
+                jac[ri*ldim + ci] = jac_elem(y, ri, ci);
+        if (dfdt)
+            dfdt[0] = dfdt[1] = dfdt[2] = 0;
+        this->njev++;
+        return AnyODE::Status::success;
+    }
+    AnyODE::Status banded_jac_cmaj(double t, const double * const __restrict__ y, const double * const __restrict__ fy,
+                                   double * const __restrict__ jac, long int ldim) override {
+        AnyODE::ignore(t); AnyODE::ignore(fy);
+        for (int ci = 0; ci < 3; ++ci)
+            for (int ri = 0; ri < 3; ++ri)
+                jac[2 + ri - ci + ci*ldim] = jac_elem(y, ri, ci);
+        this->njev++;
+        return AnyODE::Status::success;
+    }
+    AnyODE::Status sparse_jac_csc(double t, const double * const __restrict__ y, const double * const __restrict__ fy,
+                                  double * const __restrict__ data, int * const __restrict__ colptrs,
+                                  int * const __restrict__ rowvals) override {
+        AnyODE::ignore(t); AnyODE::ignore(fy);
+        const int nrows[3] = {2, 3, 2};  // J[2][0] & J[2][2] are structurally zero
+        int nnz = 0;
+        for (int ci = 0; ci < 3; ++ci){
+            colptrs[ci] = nnz;
+            for (int ri = 0; ri < nrows[ci]; ++ri){
+                data[nnz] = jac_elem(y, ri, ci);
+                rowvals[nnz++] = ri;
+            }
+        }
+        colptrs[3] = nnz;
+        this->njev++;
+        return AnyODE::Status::success;
+    }
+};